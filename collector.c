@@ -0,0 +1,267 @@
+/*
+ * Dave's Network Inquisition - data collection engine
+ * Website: https://prowse.tech
+ */
+
+#include "collector.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <net/if.h>
+
+int collector_init(Collector *c, int64_t interval_ns, const char *history_dir) {
+    struct if_nameindex *names;
+
+    memset(c, 0, sizeof(*c));
+    stats_table_init(&c->stats);
+    stats_table_set_history_dir(&c->stats, history_dir);
+    c->interval_ns = interval_ns;
+
+    // Rows for everything present now, so the sysfs fallback has a list
+    // and history files are mapped before the first sample
+    names = if_nameindex();
+    if (names != NULL) {
+        for (struct if_nameindex *n = names; n->if_index != 0; n++) {
+            stats_table_insert(&c->stats, n->if_index, n->if_name);
+        }
+        if_freenameindex(names);
+    }
+
+    if (sampler_start(&c->sampler, interval_ns) < 0) {
+        c->sampler_error = errno;
+    }
+    return 0;
+}
+
+void collector_free(Collector *c) {
+    sampler_stop(&c->sampler);
+    stats_table_free(&c->stats);
+    collector_sysfs_free(&c->sysfs);
+    free(c->batch);
+    c->batch = NULL;
+}
+
+void collector_set_interval(Collector *c, int64_t interval_ns) {
+    c->interval_ns = interval_ns;
+    sampler_set_interval(&c->sampler, interval_ns);
+}
+
+int collector_add_interface(Collector *c, int ifindex, const char *name) {
+    return stats_table_insert(&c->stats, ifindex, name);
+}
+
+int collector_track_interface(Collector *c, int ifindex) {
+    int row = stats_table_lookup(&c->stats, ifindex);
+
+    // Selected before its first sample arrived
+    if (row < 0) {
+        char name[IF_NAMESIZE];
+        if (if_indextoname(ifindex, name) == NULL) {
+            return -1;
+        }
+        row = stats_table_insert(&c->stats, ifindex, name);
+        if (row < 0) {
+            return -1;
+        }
+    }
+    return stats_table_track(&c->stats, row);
+}
+
+int collector_open_history(Collector *c) {
+    StatsRrdOpen *open;
+    int n = 0;
+
+    while ((open = stats_table_take_open(&c->stats)) != NULL) {
+        stats_rrd_open_run(open);
+        stats_table_attach_rrd(&c->stats, open);
+        n++;
+    }
+    return n;
+}
+
+static void collector_wall_offset(Collector *c) {
+    struct timespec real, mono;
+
+    // Keep the wall-clock mapping current for the history tiers
+    clock_gettime(CLOCK_REALTIME, &real);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    c->stats.wall_offset_ns = ((int64_t)real.tv_sec - mono.tv_sec) * 1000000000LL + (real.tv_nsec - mono.tv_nsec);
+}
+
+static void collector_read_sysfs(const char *name, const char *counter, uint64_t *value) {
+    char path[256];
+    unsigned long long v;
+    FILE *fp;
+
+    *value = 0;
+    snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/%s", name, counter);
+    fp = fopen(path, "r");
+    if (fp != NULL) {
+        if (fscanf(fp, "%llu", &v) == 1) {
+            *value = v;
+        }
+        fclose(fp);
+    }
+}
+
+int collector_sysfs_prepare(Collector *c, CollectorSysfs *s) {
+    const StatsTable *t = &c->stats;
+
+    if (t->count > s->capacity) {
+        int capacity = s->capacity > 0 ? s->capacity : 64;
+        while (capacity < t->count) {
+            capacity *= 2;
+        }
+        int *ifindex = realloc(s->ifindex, capacity * sizeof(int));
+        if (ifindex != NULL) {
+            s->ifindex = ifindex;
+        }
+        char (*name)[IF_NAMESIZE] = realloc(s->name, capacity * sizeof(*name));
+        if (name != NULL) {
+            s->name = name;
+        }
+        Sample *samples = realloc(s->samples, capacity * sizeof(Sample));
+        if (samples != NULL) {
+            s->samples = samples;
+        }
+        if (ifindex == NULL || name == NULL || samples == NULL) {
+            s->count = 0;
+            errno = ENOMEM;
+            return -1;
+        }
+        s->capacity = capacity;
+    }
+
+    s->count = t->count;
+    memcpy(s->ifindex, t->ifindex, t->count * sizeof(int));
+    memcpy(s->name, t->name, t->count * sizeof(*s->name));
+    return 0;
+}
+
+void collector_sysfs_read(CollectorSysfs *s) {
+    s->t_ns = sampler_now_ns();
+    for (int i = 0; i < s->count; i++) {
+        Sample *sample = &s->samples[i];
+
+        sample->t_ns = s->t_ns;
+        sample->ifindex = s->ifindex[i];
+        sample->flags = 0;
+        sample->removed = 0;
+        sample->reset = 0;
+        // Printed from the 64-bit counters on every kernel since 2.6.36
+        sample->stats32 = 0;
+        collector_read_sysfs(s->name[i], "rx_bytes", &sample->rx_bytes);
+        collector_read_sysfs(s->name[i], "tx_bytes", &sample->tx_bytes);
+        for (int j = 0; j < LINK_COUNTERS; j++) {
+            collector_read_sysfs(s->name[i], link_counter_names[j], &sample->counters[j]);
+        }
+    }
+}
+
+// Same rules as the sampler thread, but only for rows that were in the
+// table when the pass was prepared
+int collector_sysfs_apply(Collector *c, CollectorSysfs *s, CollectorSampleFunc func, void *user_data) {
+    StatsTable *t = &c->stats;
+    int64_t now_ns = s->t_ns;
+    int n = 0;
+
+    collector_wall_offset(c);
+
+    for (int i = 0; i < s->count; i++) {
+        Sample *sample = &s->samples[i];
+        int row = stats_table_lookup(t, sample->ifindex);
+        if (row < 0) {
+            continue;
+        }
+        int64_t last_ns = t->last_ns[row];
+
+        // The first sample only primes the counters
+        if (last_ns == 0 || now_ns <= last_ns) {
+            t->rx_bytes[row] = sample->rx_bytes;
+            t->tx_bytes[row] = sample->tx_bytes;
+            memcpy(t->counters[row], sample->counters, sizeof(sample->counters));
+            t->last_ns[row] = now_ns;
+            continue;
+        }
+
+        sampler_rates(sample, t->rx_bytes[row], t->tx_bytes[row], t->counters[row], (now_ns - last_ns) / 1e9);
+        stats_table_push(t, row, sample->t_ns, sample->rx_bytes, sample->tx_bytes, sample->rx_rate, sample->tx_rate,
+                         sample->counters, sample->rates, sample->reset);
+        if (func != NULL) {
+            func(c, row, sample, user_data);
+        }
+        n++;
+    }
+    s->count = 0;
+    return n;
+}
+
+void collector_sysfs_free(CollectorSysfs *s) {
+    free(s->ifindex);
+    free(s->name);
+    free(s->samples);
+    memset(s, 0, sizeof(*s));
+}
+
+static int collector_poll_sysfs(Collector *c, CollectorSampleFunc func, void *user_data) {
+    if (collector_sysfs_prepare(c, &c->sysfs) < 0) {
+        return 0;
+    }
+    collector_sysfs_read(&c->sysfs);
+    return collector_sysfs_apply(c, &c->sysfs, func, user_data);
+}
+
+// Fold everything collected since the last call into the stats table and
+// hand each sample to func (may be NULL).  Returns the number of samples.
+int collector_poll(Collector *c, CollectorSampleFunc func, void *user_data) {
+    size_t count;
+    int n = 0;
+
+    collector_wall_offset(c);
+
+    if (!collector_threaded(c)) {
+        return collector_poll_sysfs(c, func, user_data);
+    }
+
+    // Per collector, so the GUI and headless each have their own
+    if (c->batch == NULL && (c->batch = malloc(COLLECTOR_BATCH * sizeof(Sample))) == NULL) {
+        return 0;
+    }
+
+    while ((count = sampler_read(&c->sampler, c->batch, COLLECTOR_BATCH)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            const Sample *sample = &c->batch[i];
+            int row = stats_table_lookup(&c->stats, sample->ifindex);
+
+            // A deleted veth takes its history with it; with container
+            // churn the rows would otherwise only accumulate
+            if (sample->removed) {
+                if (row >= 0) {
+                    stats_table_remove(&c->stats, row);
+                }
+                continue;
+            }
+            if (row < 0) {
+                char name[IF_NAMESIZE];
+                if (if_indextoname(sample->ifindex, name) == NULL) {
+                    continue;
+                }
+                row = stats_table_insert(&c->stats, sample->ifindex, name);
+                if (row < 0) {
+                    continue;
+                }
+            }
+
+            stats_table_push(&c->stats, row, sample->t_ns, sample->rx_bytes, sample->tx_bytes,
+                             sample->rx_rate, sample->tx_rate, sample->counters, sample->rates, sample->reset);
+            if (func != NULL) {
+                func(c, row, sample, user_data);
+            }
+            n++;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,77 @@
+/*
+ * Dave's Network Inquisition - data collection engine
+ * Website: https://prowse.tech
+ */
+
+#ifndef COLLECTOR_H
+#define COLLECTOR_H
+
+#include <stdint.h>
+#include <net/if.h>
+
+#include "sampler.h"
+#include "stats-table.h"
+
+// Samples taken off the sampler ring per read
+#define COLLECTOR_BATCH 1024
+
+// One sysfs pass: the interfaces to read, copied out of the stats table,
+// and what was read.  Only collector_sysfs_read touches it in between, so
+// that part can run on another thread while the table stays in use.
+typedef struct {
+    int count;
+    int capacity;
+    int *ifindex;
+    char (*name)[IF_NAMESIZE];
+    Sample *samples;
+    int64_t t_ns;
+} CollectorSysfs;
+
+// Everything that gathers data, with no knowledge of who shows it.  The
+// GTK window and the headless writer (headless.c) are both consumers: they
+// call collector_poll from their own loop and get every new sample after
+// it has been folded into the stats table and history.
+typedef struct {
+    Sampler sampler;
+    StatsTable stats;
+    int64_t interval_ns;
+
+    // errno from sampler_start when it fell back to sysfs
+    int sampler_error;
+    CollectorSysfs sysfs;       // collector_poll's own pass
+    Sample *batch;              // COLLECTOR_BATCH, allocated on first use
+} Collector;
+
+typedef void (*CollectorSampleFunc)(const Collector *c, int row, const Sample *sample, void *user_data);
+
+// history_dir NULL: no persistent history
+int collector_init(Collector *c, int64_t interval_ns, const char *history_dir);
+void collector_free(Collector *c);
+void collector_set_interval(Collector *c, int64_t interval_ns);
+int collector_poll(Collector *c, CollectorSampleFunc func, void *user_data);
+int collector_add_interface(Collector *c, int ifindex, const char *name);
+// Long-term history for an interface that has none (not a NIC); kept
+// until the interface goes away
+int collector_track_interface(Collector *c, int ifindex);
+// Opens the history files of newly tracked rows right here.  Callers that
+// keep file work off their thread use stats_table_take_open and friends
+// instead.  Returns how many were opened.
+int collector_open_history(Collector *c);
+
+// collector_poll's sysfs fallback in three steps, for callers that keep
+// the file reads off their own thread: prepare and apply on the thread
+// that owns the collector, read anywhere.  prepare returns -1 (ENOMEM)
+// on failure; apply folds in the samples of rows still present and
+// returns how many there were.
+int collector_sysfs_prepare(Collector *c, CollectorSysfs *s);
+void collector_sysfs_read(CollectorSysfs *s);
+int collector_sysfs_apply(Collector *c, CollectorSysfs *s, CollectorSampleFunc func, void *user_data);
+void collector_sysfs_free(CollectorSysfs *s);
+
+// Netlink sampler thread running; otherwise counters come from sysfs,
+// once per collector_poll
+static inline int collector_threaded(const Collector *c) {
+    return c->sampler.running;
+}
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ * Dave's Network Inquisition - decimation for plotting
+ * Website: https://prowse.tech
+ */
+
+#include "decimate.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Four floats, which every target GCC builds for has registers for (SSE,
+// NEON); elsewhere the compiler splits them up
+typedef float DecimVec __attribute__((vector_size(16)));
+typedef int32_t DecimMask __attribute__((vector_size(16)));
+
+static inline DecimVec decim_vmin(DecimVec a, DecimVec b) {
+    DecimMask lt = a < b;
+    return (DecimVec)(((DecimMask)a & lt) | ((DecimMask)b & ~lt));
+}
+
+static inline DecimVec decim_vmax(DecimVec a, DecimVec b) {
+    DecimMask gt = a > b;
+    return (DecimVec)(((DecimMask)a & gt) | ((DecimMask)b & ~gt));
+}
+
+void decimate_minmax(const float *v, size_t n, float *min, float *max) {
+    float lo = *min;
+    float hi = *max;
+    size_t i = 0;
+
+    // Two vectors per step, so the compares of one overlap the other's
+    if (n >= 8) {
+        DecimVec lo0, lo1, hi0, hi1;
+        memcpy(&lo0, v, sizeof(lo0));
+        memcpy(&lo1, v + 4, sizeof(lo1));
+        hi0 = lo0;
+        hi1 = lo1;
+        for (i = 8; i + 8 <= n; i += 8) {
+            DecimVec a, b;
+            memcpy(&a, v + i, sizeof(a));
+            memcpy(&b, v + i + 4, sizeof(b));
+            lo0 = decim_vmin(lo0, a);
+            lo1 = decim_vmin(lo1, b);
+            hi0 = decim_vmax(hi0, a);
+            hi1 = decim_vmax(hi1, b);
+        }
+        lo0 = decim_vmin(lo0, lo1);
+        hi0 = decim_vmax(hi0, hi1);
+        for (int lane = 0; lane < 4; lane++) {
+            if (lo0[lane] < lo) lo = lo0[lane];
+            if (hi0[lane] > hi) hi = hi0[lane];
+        }
+    }
+    for (; i < n; i++) {
+        if (v[i] < lo) lo = v[i];
+        if (v[i] > hi) hi = v[i];
+    }
+
+    *min = lo;
+    *max = hi;
+}
+
+int decimate_points(const RrdPoint *in, int n, int64_t start_ns, int64_t window_ns, int columns, RrdPoint *out) {
+    int m = 0;
+    int last = -1;
+    int count = 0;
+
+    if (columns <= 0 || window_ns <= 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < n; i++) {
+        RrdPoint p = in[i];     // out may be in: read before anything is written
+        int column = (int)((double)(p.t_ns - start_ns) / window_ns * columns);
+        if (column < 0) column = 0;
+        if (column >= columns) column = columns - 1;
+
+        if (column != last) {
+            // Close the previous column: the averages hold sums until now
+            if (m > 0) {
+                out[m - 1].rx_avg /= count;
+                out[m - 1].tx_avg /= count;
+            }
+            out[m] = p;
+            out[m].t_ns = start_ns + (int64_t)((double)window_ns * column / columns);
+            count = 1;
+            last = column;
+            m++;
+        } else {
+            RrdPoint *q = &out[m - 1];
+            if (p.rx_min < q->rx_min) q->rx_min = p.rx_min;
+            if (p.rx_max > q->rx_max) q->rx_max = p.rx_max;
+            if (p.tx_min < q->tx_min) q->tx_min = p.tx_min;
+            if (p.tx_max > q->tx_max) q->tx_max = p.tx_max;
+            q->rx_avg += p.rx_avg;
+            q->tx_avg += p.tx_avg;
+            count++;
+        }
+    }
+
+    if (m > 0) {
+        out[m - 1].rx_avg /= count;
+        out[m - 1].tx_avg /= count;
+    }
+    return m;
+}
+
+void decim_pyramid_init(DecimPyramid *p, int64_t t0_ms, int64_t step_ms, int64_t max_buckets) {
+    memset(p, 0, sizeof(*p));
+    p->t0_ms = t0_ms;
+    p->step_ms = step_ms > 0 ? step_ms : 1;
+    p->max_buckets = max_buckets > 0 ? max_buckets : 1;
+
+    // Up to the level with a single bucket
+    p->levels = 1;
+    while (p->levels < DECIMATE_LEVELS && (p->max_buckets >> p->levels) > 0) {
+        p->levels++;
+    }
+}
+
+void decim_pyramid_free(DecimPyramid *p) {
+    for (int l = 0; l < DECIMATE_LEVELS; l++) {
+        free(p->level[l]);
+    }
+    memset(p, 0, sizeof(*p));
+}
+
+int decim_pyramid_add(DecimPyramid *p, int64_t t_ms, float rx, float tx) {
+    const float v[2] = {rx, tx};
+
+    if (t_ms < p->t0_ms) {
+        return 0;
+    }
+    int64_t k = (t_ms - p->t0_ms) / p->step_ms;
+    if (k >= p->max_buckets) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    for (int l = 0; l < p->levels; l++, k >>= 1) {
+        if (k >= p->len[l]) {
+            if (k >= p->capacity[l]) {
+                int64_t capacity = p->capacity[l] > 0 ? p->capacity[l] * 2 : 1024;
+                while (capacity <= k) {
+                    capacity *= 2;
+                }
+                DecimBucket *level = realloc(p->level[l], capacity * sizeof(DecimBucket));
+                if (level == NULL) {
+                    errno = ENOMEM;
+                    return -1;
+                }
+                p->level[l] = level;
+                p->capacity[l] = capacity;
+            }
+            memset(&p->level[l][p->len[l]], 0, (k + 1 - p->len[l]) * sizeof(DecimBucket));
+            p->len[l] = k + 1;
+        }
+
+        DecimBucket *b = &p->level[l][k];
+        b->count++;
+        for (int side = 0; side < 2; side++) {
+            if (b->count == 1) {
+                b->min[side] = b->max[side] = b->avg[side] = v[side];
+            } else {
+                if (v[side] < b->min[side]) b->min[side] = v[side];
+                if (v[side] > b->max[side]) b->max[side] = v[side];
+                b->avg[side] += (v[side] - b->avg[side]) / b->count;
+            }
+        }
+    }
+    return 0;
+}
+
+int decim_pyramid_query(const DecimPyramid *p, int64_t start_ms, int64_t end_ms, int columns, RrdPoint *out) {
+    double span = (double)(end_ms - start_ms);
+    double column_ms = span / (columns > 0 ? columns : 1);
+    int level = 0;
+    int n = 0;
+
+    if (columns <= 0 || span <= 0 || p->levels == 0) {
+        return 0;
+    }
+
+    // Coarsest level that still has two buckets per column
+    while (level + 1 < p->levels && (double)(p->step_ms << (level + 1)) * 2 <= column_ms) {
+        level++;
+    }
+    int64_t width = p->step_ms << level;
+    const DecimBucket *buckets = p->level[level];
+    int64_t len = p->len[level];
+
+    for (int column = 0; column < columns; column++) {
+        int64_t from = start_ms + (int64_t)(span * column / columns);
+        int64_t to = start_ms + (int64_t)(span * (column + 1) / columns);
+        int64_t first = (from - p->t0_ms) / width;
+        int64_t last = (to - 1 - p->t0_ms) / width;
+        uint32_t count = 0;
+        RrdPoint *q = &out[n];
+
+        if (to - 1 < p->t0_ms) {
+            continue;
+        }
+        if (first < 0) first = 0;
+        if (last >= len) last = len - 1;
+
+        double rx_sum = 0.0;
+        double tx_sum = 0.0;
+        for (int64_t k = first; k <= last; k++) {
+            const DecimBucket *b = &buckets[k];
+            if (b->count == 0) {
+                continue;
+            }
+            if (count == 0 || b->min[0] < q->rx_min) q->rx_min = b->min[0];
+            if (count == 0 || b->max[0] > q->rx_max) q->rx_max = b->max[0];
+            if (count == 0 || b->min[1] < q->tx_min) q->tx_min = b->min[1];
+            if (count == 0 || b->max[1] > q->tx_max) q->tx_max = b->max[1];
+            rx_sum += (double)b->avg[0] * b->count;
+            tx_sum += (double)b->avg[1] * b->count;
+            count += b->count;
+        }
+        if (count == 0) {
+            continue;
+        }
+        q->t_ns = from * 1000000;
+        q->rx_avg = rx_sum / count;
+        q->tx_avg = tx_sum / count;
+        n++;
+    }
+    return n;
+}
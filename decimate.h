@@ -0,0 +1,57 @@
+/*
+ * Dave's Network Inquisition - decimation for plotting
+ * Website: https://prowse.tech
+ */
+
+#ifndef DECIMATE_H
+#define DECIMATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rrd.h"
+
+#define DECIMATE_LEVELS 24
+
+// Widens [*min, *max] to cover v[0 .. n - 1], four lanes at a time
+void decimate_minmax(const float *v, size_t n, float *min, float *max);
+
+// Min/max envelope: points (oldest first) reduced to one per pixel column
+// of [start_ns, start_ns + window_ns), the min of their mins, the max of
+// their maxes and the mean of their averages.  Spikes keep their height
+// however many points share a column.  Returns the count; out may be in.
+int decimate_points(const RrdPoint *in, int n, int64_t start_ns, int64_t window_ns, int columns, RrdPoint *out);
+
+// One bucket of a pyramid level, rx then tx
+typedef struct {
+    float min[2];
+    float max[2];
+    float avg[2];
+    uint32_t count;
+} DecimBucket;
+
+// Min/max/average pyramid over an rx/tx rate pair.  Level 0 has one bucket
+// per step_ms from t0_ms on and each level above halves the count, so a
+// sample updates one bucket per level.  A query takes the coarsest level
+// with two buckets or more per pixel column, and touches a couple of
+// buckets per column: a frame costs the same over days as over minutes.
+typedef struct {
+    int64_t t0_ms;
+    int64_t step_ms;
+    int64_t max_buckets;        // of level 0
+    int levels;
+    DecimBucket *level[DECIMATE_LEVELS];
+    int64_t len[DECIMATE_LEVELS];
+    int64_t capacity[DECIMATE_LEVELS];
+} DecimPyramid;
+
+void decim_pyramid_init(DecimPyramid *p, int64_t t0_ms, int64_t step_ms, int64_t max_buckets);
+void decim_pyramid_free(DecimPyramid *p);
+// Samples before t0_ms are ignored.  Returns -1 once t_ms is past
+// max_buckets (the caller starts a new pyramid) or with ENOMEM.
+int decim_pyramid_add(DecimPyramid *p, int64_t t_ms, float rx, float tx);
+// One point per column of [start_ms, end_ms) that has data, with t_ns the
+// column's start in nanoseconds.  Returns the count.
+int decim_pyramid_query(const DecimPyramid *p, int64_t start_ms, int64_t end_ms, int columns, RrdPoint *out);
+
+#endif
@@ -0,0 +1,446 @@
+/*
+ * Dave's Network Inquisition - DNS load generator
+ * Website: https://prowse.tech
+ *
+ * Drives a resolver with queries from a file at a fixed rate and keeps
+ * rcode counts and a latency histogram of the answers (see dns-bench.h).
+ */
+
+#define _GNU_SOURCE             // recvmmsg()
+
+#include "dns-bench.h"
+#include "dns.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+
+#define DNS_BENCH_PUBLISH_NS 100000000LL
+#define DNS_BENCH_BATCH 64
+
+static int64_t dns_bench_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void dns_bench_options_default(DnsBenchOptions *opts) {
+    memset(opts, 0, sizeof(opts[0]));
+    opts->qps = 1000;
+    opts->concurrency = 1000;
+    opts->sockets = 8;
+    opts->duration_ns = 0;
+    opts->timeout_ns = 2000000000LL;
+    opts->edns = 1;
+    opts->recurse = 1;
+}
+
+static int dns_bench_load(DnsBench *b, const char *path, char *error, size_t error_size) {
+    FILE *fp = fopen(path, "r");
+    char line[1200];
+    int capacity = 0;
+    size_t bytes = 0;
+    size_t bytes_capacity = 0;
+    int lineno = 0;
+
+    if (fp == NULL) {
+        snprintf(error, error_size, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char name[DNS_NAME_MAX];
+        char type_name[64];
+        unsigned char packet[DNS_QUERY_MAX];
+        int type = DNS_TYPE_A;
+
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash != NULL) {
+            *hash = '\0';
+        }
+        int fields = sscanf(line, "%1024s %63s", name, type_name);
+        if (fields <= 0) {
+            continue;
+        }
+        if (fields == 2) {
+            type = dns_type_from_string(type_name);
+            if (type < 0) {
+                snprintf(error, error_size, "%s:%d: unknown type '%s'", path, lineno, type_name);
+                fclose(fp);
+                return -1;
+            }
+        }
+
+        int len = dns_encode_query(packet, sizeof(packet), 0, name, type, b->opts.recurse, b->opts.edns);
+        if (len < 0) {
+            snprintf(error, error_size, "%s:%d: bad name '%s'", path, lineno, name);
+            fclose(fp);
+            return -1;
+        }
+
+        if (b->nqueries + 2 > capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            int *offsets = realloc(b->offsets, capacity * sizeof(int));
+            if (offsets == NULL) {
+                goto nomem;
+            }
+            b->offsets = offsets;
+        }
+        if (bytes + len > bytes_capacity) {
+            bytes_capacity = bytes_capacity ? bytes_capacity * 2 : 65536;
+            unsigned char *packets = realloc(b->packets, bytes_capacity);
+            if (packets == NULL) {
+                goto nomem;
+            }
+            b->packets = packets;
+        }
+        b->offsets[b->nqueries++] = bytes;
+        memcpy(b->packets + bytes, packet, len);
+        bytes += len;
+    }
+    fclose(fp);
+
+    if (b->nqueries == 0) {
+        snprintf(error, error_size, "%s: no queries", path);
+        return -1;
+    }
+    b->offsets[b->nqueries] = bytes;
+    return 0;
+
+nomem:
+    fclose(fp);
+    snprintf(error, error_size, "%s", strerror(ENOMEM));
+    return -1;
+}
+
+static void dns_bench_free(DnsBench *b) {
+    for (int i = 0; i < DNS_BENCH_MAX_SOCKETS; i++) {
+        if (b->fds[i] >= 0) {
+            close(b->fds[i]);
+            b->fds[i] = -1;
+        }
+    }
+    if (b->epoll_fd >= 0) {
+        close(b->epoll_fd);
+        b->epoll_fd = -1;
+    }
+    free(b->packets);
+    free(b->offsets);
+    free(b->slots);
+    free(b->free_ring);
+    b->packets = NULL;
+    b->offsets = NULL;
+    b->slots = NULL;
+    b->free_ring = NULL;
+}
+
+static void dns_bench_release(DnsBench *b, int index) {
+    DnsBenchSlot *s = &b->slots[index];
+
+    if (s->prev >= 0) {
+        b->slots[s->prev].next = s->next;
+    } else {
+        b->busy_head = s->next;
+    }
+    if (s->next >= 0) {
+        b->slots[s->next].prev = s->prev;
+    } else {
+        b->busy_tail = s->prev;
+    }
+    s->query = -1;
+
+    int concurrency = b->opts.concurrency;
+    b->free_ring[(b->free_head + b->free_count) % concurrency] = index;
+    b->free_count++;
+}
+
+// Returns 0 when sent, -1 with errno set otherwise; the slot is only
+// taken on success
+static int dns_bench_send(DnsBench *b, int query, int64_t now) {
+    int index = b->free_ring[b->free_head];
+    int sockets = b->opts.sockets;
+    unsigned char *packet = b->packets + b->offsets[query];
+    int len = b->offsets[query + 1] - b->offsets[query];
+    unsigned char id[2] = {(index / sockets) >> 8, (index / sockets) & 0xff};
+    struct iovec iov[2] = {{id, 2}, {packet + 2, len - 2}};
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    if (sendmsg(b->fds[index % sockets], &msg, 0) < 0) {
+        return -1;
+    }
+
+    b->free_head = (b->free_head + 1) % b->opts.concurrency;
+    b->free_count--;
+
+    DnsBenchSlot *s = &b->slots[index];
+    s->query = query;
+    s->sent_ns = now;
+    s->next = -1;
+    s->prev = b->busy_tail;
+    if (b->busy_tail >= 0) {
+        b->slots[b->busy_tail].next = index;
+    } else {
+        b->busy_head = index;
+    }
+    b->busy_tail = index;
+    return 0;
+}
+
+// Receive buffers for one recvmmsg() batch, owned by the run's thread
+typedef struct {
+    unsigned char buffers[DNS_BENCH_BATCH][DNS_UDP_MAX + 512];
+    struct mmsghdr msgs[DNS_BENCH_BATCH];
+    struct iovec iovs[DNS_BENCH_BATCH];
+    DnsBenchStats stats;
+} DnsBenchRun;
+
+static void dns_bench_read(DnsBench *b, int socket_index, DnsBenchRun *run) {
+    DnsBenchStats *stats = &run->stats;
+    int sockets = b->opts.sockets;
+
+    for (;;) {
+        memset(run->msgs, 0, sizeof(run->msgs));
+        for (int i = 0; i < DNS_BENCH_BATCH; i++) {
+            run->iovs[i].iov_base = run->buffers[i];
+            run->iovs[i].iov_len = sizeof(run->buffers[i]);
+            run->msgs[i].msg_hdr.msg_iov = &run->iovs[i];
+            run->msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(b->fds[socket_index], run->msgs, DNS_BENCH_BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) {
+            return;
+        }
+        int64_t now = dns_bench_clock_ns();
+
+        for (int i = 0; i < n; i++) {
+            const unsigned char *reply = run->buffers[i];
+            int len = run->msgs[i].msg_len;
+            if (len < 12 || !(reply[2] & 0x80)) {
+                continue;
+            }
+            int index = ((reply[0] << 8) | reply[1]) * sockets + socket_index;
+            if (index >= b->opts.concurrency || b->slots[index].query < 0) {
+                continue;
+            }
+
+            // The question must be ours: ids are reused, late replies happen
+            DnsBenchSlot *s = &b->slots[index];
+            const unsigned char *packet = b->packets + b->offsets[s->query];
+            int question = b->offsets[s->query + 1] - b->offsets[s->query] - 12 - (b->opts.edns ? 11 : 0);
+            if (len < 12 + question || memcmp(reply + 12, packet + 12, question) != 0) {
+                continue;
+            }
+
+            stats->completed++;
+            stats->rcodes[reply[3] & 0x0f]++;
+            rtt_hist_record(&stats->latency, now - s->sent_ns);
+            dns_bench_release(b, index);
+        }
+        if (n < DNS_BENCH_BATCH) {
+            return;
+        }
+    }
+}
+
+static void dns_bench_publish(DnsBench *b, DnsBenchStats *stats, int64_t start) {
+    stats->elapsed_ns = dns_bench_clock_ns() - start;
+    stats->inflight = b->opts.concurrency - b->free_count;
+    pthread_mutex_lock(&b->lock);
+    b->shared = *stats;
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void *dns_bench_thread(void *arg) {
+    DnsBench *b = arg;
+    DnsBenchRun *run = calloc(1, sizeof(DnsBenchRun));
+    DnsBenchStats *stats = &run->stats;
+    int64_t start = dns_bench_clock_ns();
+    int64_t end = b->opts.duration_ns > 0 ? start + b->opts.duration_ns : 0;
+    int64_t last_publish = start;
+    int64_t tokens_ns = start;
+    double burst = b->opts.qps / 100.0 > 1.0 ? b->opts.qps / 100.0 : 1.0;
+    double tokens = 1.0;
+    int sending = 1;
+    int next = 0;
+
+    if (run == NULL) {
+        pthread_mutex_lock(&b->lock);
+        b->shared.done = 1;
+        pthread_mutex_unlock(&b->lock);
+        return NULL;
+    }
+
+    while (!atomic_load_explicit(&b->stop, memory_order_relaxed)) {
+        int64_t now = dns_bench_clock_ns();
+        int wait_ms = 100;
+        int blocked = 0;
+
+        if (sending && ((end != 0 && now >= end) || (end == 0 && next >= b->nqueries))) {
+            sending = 0;
+        }
+        if (!sending && b->busy_head < 0) {
+            break;
+        }
+
+        if (sending && b->opts.qps > 0) {
+            tokens += (now - tokens_ns) * (double)b->opts.qps / 1e9;
+            tokens_ns = now;
+            if (tokens > burst) {
+                tokens = burst;
+            }
+        }
+        while (sending && b->free_count > 0 && (b->opts.qps == 0 || tokens >= 1.0)) {
+            if (dns_bench_send(b, next % b->nqueries, now) < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                    blocked = 1;
+                    break;
+                }
+                stats->send_errors++;
+            } else {
+                stats->sent++;
+            }
+            next++;
+            tokens -= 1.0;
+            if (end == 0 && next >= b->nqueries) {
+                break;
+            }
+        }
+        // A full socket buffer gets a millisecond to drain; sub-millisecond
+        // token waits round up, the burst allowance absorbs the difference
+        if (blocked) {
+            wait_ms = 1;
+        } else if (sending && b->opts.qps > 0 && tokens < 1.0) {
+            int ms = (int)((1.0 - tokens) * 1000.0 / b->opts.qps) + 1;
+            wait_ms = ms < wait_ms ? ms : wait_ms;
+        } else if (sending && b->free_count > 0) {
+            wait_ms = 0;
+        }
+
+        // One timeout for every query: expired ones are at the head
+        while (b->busy_head >= 0 && b->slots[b->busy_head].sent_ns + b->opts.timeout_ns <= now) {
+            stats->timeouts++;
+            dns_bench_release(b, b->busy_head);
+        }
+        if (b->busy_head >= 0) {
+            int ms = (int)((b->slots[b->busy_head].sent_ns + b->opts.timeout_ns - now) / 1000000) + 1;
+            wait_ms = ms < wait_ms ? ms : wait_ms;
+        }
+
+        if (now - last_publish >= DNS_BENCH_PUBLISH_NS) {
+            dns_bench_publish(b, stats, start);
+            last_publish = now;
+        }
+
+        struct epoll_event events[DNS_BENCH_MAX_SOCKETS];
+        int n = epoll_wait(b->epoll_fd, events, DNS_BENCH_MAX_SOCKETS, wait_ms);
+        for (int i = 0; i < n; i++) {
+            dns_bench_read(b, events[i].data.u32, run);
+        }
+    }
+
+    stats->done = 1;
+    dns_bench_publish(b, stats, start);
+    free(run);
+    return NULL;
+}
+
+int dns_bench_start(DnsBench *b, const char *query_file, const struct sockaddr *server, socklen_t server_len,
+                    const DnsBenchOptions *opts, char *error, size_t error_size) {
+    memset(b, 0, sizeof(*b));
+    for (int i = 0; i < DNS_BENCH_MAX_SOCKETS; i++) {
+        b->fds[i] = -1;
+    }
+    b->epoll_fd = -1;
+    b->opts = *opts;
+    if (b->opts.sockets < 1) b->opts.sockets = 1;
+    if (b->opts.sockets > DNS_BENCH_MAX_SOCKETS) b->opts.sockets = DNS_BENCH_MAX_SOCKETS;
+    if (b->opts.concurrency < 1) b->opts.concurrency = 1;
+    if (b->opts.concurrency > 65536 * b->opts.sockets) b->opts.concurrency = 65536 * b->opts.sockets;
+    if (b->opts.qps < 0) b->opts.qps = 0;
+    atomic_init(&b->stop, 0);
+
+    if (dns_bench_load(b, query_file, error, error_size) < 0) {
+        dns_bench_free(b);
+        return -1;
+    }
+
+    int concurrency = b->opts.concurrency;
+    b->slots = malloc(concurrency * sizeof(DnsBenchSlot));
+    b->free_ring = malloc(concurrency * sizeof(int));
+    if (b->slots == NULL || b->free_ring == NULL) {
+        snprintf(error, error_size, "%s", strerror(ENOMEM));
+        dns_bench_free(b);
+        return -1;
+    }
+    for (int i = 0; i < concurrency; i++) {
+        b->slots[i].query = -1;
+        b->free_ring[i] = i;
+    }
+    b->free_count = concurrency;
+    b->busy_head = -1;
+    b->busy_tail = -1;
+
+    b->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (b->epoll_fd < 0) {
+        snprintf(error, error_size, "epoll: %s", strerror(errno));
+        dns_bench_free(b);
+        return -1;
+    }
+    for (int i = 0; i < b->opts.sockets; i++) {
+        int rcvbuf = 4 << 20;
+        struct epoll_event ev;
+
+        b->fds[i] = socket(server->sa_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (b->fds[i] < 0 || connect(b->fds[i], server, server_len) < 0) {
+            snprintf(error, error_size, "socket: %s", strerror(errno));
+            dns_bench_free(b);
+            return -1;
+        }
+        setsockopt(b->fds[i], SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, b->fds[i], &ev);
+    }
+
+    pthread_mutex_init(&b->lock, NULL);
+    int err = pthread_create(&b->thread, NULL, dns_bench_thread, b);
+    if (err != 0) {
+        snprintf(error, error_size, "thread: %s", strerror(err));
+        pthread_mutex_destroy(&b->lock);
+        dns_bench_free(b);
+        return -1;
+    }
+    b->running = 1;
+    return 0;
+}
+
+void dns_bench_snapshot(DnsBench *b, DnsBenchStats *out) {
+    if (!b->running) {
+        *out = b->shared;
+        return;
+    }
+    pthread_mutex_lock(&b->lock);
+    *out = b->shared;
+    pthread_mutex_unlock(&b->lock);
+}
+
+void dns_bench_stop(DnsBench *b) {
+    if (!b->running) {
+        return;
+    }
+    atomic_store(&b->stop, 1);
+    pthread_join(b->thread, NULL);
+    pthread_mutex_destroy(&b->lock);
+    b->running = 0;
+    dns_bench_free(b);
+}
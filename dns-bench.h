@@ -0,0 +1,90 @@
+/*
+ * Dave's Network Inquisition - DNS load generator
+ * Website: https://prowse.tech
+ */
+
+#ifndef DNS_BENCH_H
+#define DNS_BENCH_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "rtt-hist.h"
+
+#define DNS_BENCH_MAX_SOCKETS 64
+#define DNS_BENCH_RCODES 16
+
+typedef struct {
+    int qps;                    // target queries per second, 0 = no limit
+    int concurrency;            // queries in flight at most
+    int sockets;                // UDP sockets the queries are spread over
+    int64_t duration_ns;        // loop over the file this long; 0 = one pass
+    int64_t timeout_ns;
+    int edns;
+    int recurse;
+} DnsBenchOptions;
+
+typedef struct {
+    int64_t elapsed_ns;
+    uint64_t sent;
+    uint64_t completed;
+    uint64_t timeouts;
+    uint64_t send_errors;
+    uint64_t rcodes[DNS_BENCH_RCODES];
+    int inflight;
+    int done;
+    RttHist latency;
+} DnsBenchStats;
+
+// A query in flight.  Its transaction id and socket are fixed by its
+// index (id = index / sockets, socket = index % sockets), so a reply finds
+// its slot without a lookup.  Busy slots are chained in send order; with
+// one timeout for all, the head is always the next to expire.
+typedef struct {
+    int query;                  // -1 = free
+    int next;
+    int prev;
+    int64_t sent_ns;
+} DnsBenchSlot;
+
+// All queries are encoded once, up front; a send only patches the
+// transaction id in through its own iovec.  The run happens on a thread
+// of its own and publishes its counters a few times a second.
+typedef struct {
+    pthread_t thread;
+    int running;
+    atomic_int stop;
+    DnsBenchOptions opts;
+
+    int fds[DNS_BENCH_MAX_SOCKETS];
+    int epoll_fd;
+
+    unsigned char *packets;
+    int *offsets;               // nqueries + 1 entries
+    int nqueries;
+
+    DnsBenchSlot *slots;
+    int *free_ring;             // FIFO, so a late reply rarely meets a reused id
+    int free_head;
+    int free_count;
+    int busy_head;
+    int busy_tail;
+
+    pthread_mutex_t lock;
+    DnsBenchStats shared;       // under lock
+} DnsBench;
+
+void dns_bench_options_default(DnsBenchOptions *opts);
+
+// query_file: one "name [type]" per line, # comments.  On failure error
+// says why and nothing is left running.
+int dns_bench_start(DnsBench *b, const char *query_file, const struct sockaddr *server, socklen_t server_len,
+                    const DnsBenchOptions *opts, char *error, size_t error_size);
+void dns_bench_snapshot(DnsBench *b, DnsBenchStats *out);
+// Stops the run if it is still going and frees everything; the last
+// snapshot stays readable
+void dns_bench_stop(DnsBench *b);
+
+#endif
@@ -0,0 +1,284 @@
+/*
+ * Dave's Network Inquisition - DNS answer cache
+ * Website: https://prowse.tech
+ *
+ * TTL-aware store of the last answer per (name, type, server), and the
+ * record-level diff between an answer and the one before it.
+ */
+
+#include "dns-cache.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <netinet/in.h>
+
+void dns_cache_init(DnsCache *c) {
+    memset(c, 0, sizeof(*c));
+}
+
+static void dns_cache_free_lines(char **lines, int n) {
+    for (int i = 0; i < n; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+}
+
+void dns_cache_free(DnsCache *c) {
+    for (int i = 0; i < c->count; i++) {
+        dns_cache_free_lines(c->entries[i].lines, c->entries[i].nlines);
+    }
+    free(c->entries);
+    free(c->hash);
+    memset(c, 0, sizeof(*c));
+}
+
+void dns_server_key(DnsServerKey *key, const struct sockaddr *server, socklen_t server_len) {
+    memset(key, 0, sizeof(*key));
+    key->family = server->sa_family;
+    if (server->sa_family == AF_INET && server_len >= sizeof(struct sockaddr_in)) {
+        const struct sockaddr_in *sin = (const struct sockaddr_in *)server;
+        key->port = sin->sin_port;
+        memcpy(key->address, &sin->sin_addr, 4);
+    } else if (server->sa_family == AF_INET6 && server_len >= sizeof(struct sockaddr_in6)) {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)server;
+        key->port = sin6->sin6_port;
+        memcpy(key->address, &sin6->sin6_addr, 16);
+    }
+}
+
+// Length of name without its trailing dot: replies carry "example.com."
+// where a watch or a dig asks for "example.com", and both are one name
+static size_t dns_cache_name_len(const char *name) {
+    size_t len = strlen(name);
+
+    return len > 0 && name[len - 1] == '.' ? len - 1 : len;
+}
+
+// FNV-1a over the lower-cased name, the type and the server
+static unsigned int dns_cache_hash(const char *name, int type, const DnsServerKey *server) {
+    const unsigned char *p = (const unsigned char *)server;
+    size_t len = dns_cache_name_len(name);
+    unsigned int h = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)tolower((unsigned char)name[i])) * 16777619u;
+    }
+    h = (h ^ (type & 0xff)) * 16777619u;
+    h = (h ^ (type >> 8)) * 16777619u;
+    for (size_t i = 0; i < sizeof(*server); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static int dns_cache_find(const DnsCache *c, const char *name, int type, const DnsServerKey *server) {
+    size_t len = dns_cache_name_len(name);
+
+    if (c->hash_size == 0) {
+        return -1;
+    }
+
+    for (unsigned int slot = dns_cache_hash(name, type, server) & (c->hash_size - 1);;
+         slot = (slot + 1) & (c->hash_size - 1)) {
+        int i = c->hash[slot] - 1;
+        if (i < 0) {
+            return -1;
+        }
+        const DnsCacheEntry *e = &c->entries[i];
+        // Stored names never end in a dot
+        if (e->type == type && memcmp(&e->server, server, sizeof(*server)) == 0 &&
+            strncasecmp(e->name, name, len) == 0 && e->name[len] == '\0') {
+            return i;
+        }
+    }
+}
+
+int dns_cache_lookup(const DnsCache *c, const char *name, int type, const struct sockaddr *server,
+                     socklen_t server_len) {
+    DnsServerKey key;
+
+    dns_server_key(&key, server, server_len);
+    return dns_cache_find(c, name, type, &key);
+}
+
+static int dns_cache_grow(DnsCache *c) {
+    int capacity = c->capacity ? c->capacity * 2 : 64;
+    DnsCacheEntry *entries = realloc(c->entries, capacity * sizeof(DnsCacheEntry));
+    if (entries == NULL) {
+        return -1;
+    }
+    c->entries = entries;
+
+    // Keep the hash at most half full
+    int *hash = calloc(capacity * 2, sizeof(int));
+    if (hash == NULL) {
+        return -1;
+    }
+    free(c->hash);
+    c->hash = hash;
+    c->hash_size = capacity * 2;
+    c->capacity = capacity;
+
+    for (int i = 0; i < c->count; i++) {
+        const DnsCacheEntry *e = &c->entries[i];
+        unsigned int slot = dns_cache_hash(e->name, e->type, &e->server) & (c->hash_size - 1);
+        while (c->hash[slot] != 0) {
+            slot = (slot + 1) & (c->hash_size - 1);
+        }
+        c->hash[slot] = i + 1;
+    }
+    return 0;
+}
+
+static int dns_cache_compare_lines(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// RFC 2308: a negative answer lives for the lower of the SOA's own TTL
+// and its MINIMUM field
+static uint32_t dns_cache_negative_ttl(const DnsMessage *m) {
+    for (int i = 0; i < m->nrecords; i++) {
+        const DnsRecord *r = &m->records[i];
+        if (r->section == DNS_SECTION_AUTHORITY && r->type == DNS_TYPE_SOA && r->rdlength >= 22) {
+            const unsigned char *p = m->data + r->rdata + r->rdlength - 4;
+            uint32_t minimum = ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+            return minimum < r->ttl ? minimum : r->ttl;
+        }
+    }
+    return DNS_CACHE_NEGATIVE_TTL;
+}
+
+int dns_cache_store(DnsCache *c, const DnsMessage *m, const struct sockaddr *server, socklen_t server_len,
+                    int64_t now_ns, DnsCacheDiff *diff) {
+    DnsServerKey key;
+    char **lines;
+    int nlines = 0;
+    int have_ttl = 0;
+    uint32_t ttl = 0;
+
+    // A reply with no question (FORMERR, say) answers nothing to file it under
+    if (m->qdcount == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    lines = malloc((m->nrecords + 1) * sizeof(char *));
+    if (lines == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < m->nrecords; i++) {
+        const DnsRecord *r = &m->records[i];
+        char rdata[4096];
+        char type[16];
+        char line[DNS_NAME_MAX + sizeof(rdata) + 32];
+
+        if (r->section != DNS_SECTION_ANSWER) {
+            continue;
+        }
+        snprintf(line, sizeof(line), "%s %s %s", r->name, dns_type_string(r->type, type, sizeof(type)),
+                 dns_record_format(m, r, rdata, sizeof(rdata)));
+        for (char *p = line; *p != '\0' && *p != ' '; p++) {
+            *p = tolower((unsigned char)*p);
+        }
+        lines[nlines] = strdup(line);
+        if (lines[nlines] == NULL) {
+            dns_cache_free_lines(lines, nlines);
+            return -1;
+        }
+        nlines++;
+        if (!have_ttl || r->ttl < ttl) {
+            ttl = r->ttl;
+            have_ttl = 1;
+        }
+    }
+    qsort(lines, nlines, sizeof(char *), dns_cache_compare_lines);
+    if (!have_ttl) {
+        ttl = dns_cache_negative_ttl(m);
+    }
+
+    dns_server_key(&key, server, server_len);
+    int index = dns_cache_find(c, m->qname, m->qtype, &key);
+    if (index < 0) {
+        if (c->count == c->capacity && dns_cache_grow(c) < 0) {
+            dns_cache_free_lines(lines, nlines);
+            return -1;
+        }
+        index = c->count++;
+        DnsCacheEntry *e = &c->entries[index];
+        memset(e, 0, sizeof(*e));
+        size_t len = dns_cache_name_len(m->qname);
+        for (size_t i = 0; i < len && i < DNS_NAME_MAX - 1; i++) {
+            e->name[i] = tolower((unsigned char)m->qname[i]);
+        }
+        e->type = m->qtype;
+        e->server = key;
+        e->rcode = -1;
+
+        unsigned int slot = dns_cache_hash(e->name, e->type, &e->server) & (c->hash_size - 1);
+        while (c->hash[slot] != 0) {
+            slot = (slot + 1) & (c->hash_size - 1);
+        }
+        c->hash[slot] = index + 1;
+    }
+
+    DnsCacheEntry *e = &c->entries[index];
+    if (diff != NULL) {
+        memset(diff, 0, sizeof(*diff));
+        diff->first = e->rcode < 0;
+        diff->old_rcode = e->rcode;
+        diff->old_fetched_ns = e->fetched_ns;
+        diff->added = malloc((nlines + 1) * sizeof(char *));
+        diff->removed = malloc((e->nlines + 1) * sizeof(char *));
+        if (diff->added == NULL || diff->removed == NULL) {
+            free(diff->added);
+            free(diff->removed);
+            dns_cache_free_lines(lines, nlines);
+            return -1;
+        }
+
+        // Both sides are sorted: one merge pass
+        int i = 0;
+        int j = 0;
+        while (i < e->nlines || j < nlines) {
+            int cmp = i == e->nlines ? 1 : j == nlines ? -1 : strcmp(e->lines[i], lines[j]);
+            if (cmp < 0) {
+                diff->removed[diff->nremoved++] = e->lines[i++];
+            } else if (cmp > 0) {
+                diff->added[diff->nadded++] = lines[j++];
+            } else {
+                i++;
+                j++;
+            }
+        }
+        diff->old_lines = e->lines;
+        diff->nold = e->nlines;
+    } else {
+        dns_cache_free_lines(e->lines, e->nlines);
+    }
+
+    e->rcode = m->rcode;
+    e->lines = lines;
+    e->nlines = nlines;
+    e->ttl = ttl;
+    e->fetched_ns = now_ns;
+    e->expires_ns = now_ns + (int64_t)ttl * 1000000000LL;
+    return index;
+}
+
+void dns_cache_diff_free(DnsCacheDiff *diff) {
+    dns_cache_free_lines(diff->old_lines, diff->nold);
+    free(diff->added);
+    free(diff->removed);
+    memset(diff, 0, sizeof(*diff));
+}
+
+uint32_t dns_cache_ttl_left(const DnsCacheEntry *e, int64_t now_ns) {
+    if (now_ns >= e->expires_ns) {
+        return 0;
+    }
+    return (uint32_t)((e->expires_ns - now_ns) / 1000000000LL);
+}
@@ -0,0 +1,87 @@
+/*
+ * Dave's Network Inquisition - DNS answer cache
+ * Website: https://prowse.tech
+ */
+
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "dns.h"
+
+// Negative answers without an SOA to take the TTL from
+#define DNS_CACHE_NEGATIVE_TTL 60
+
+// Answers are kept per (name, type, server): the same name can differ
+// between servers, which is the point when chasing propagation.
+typedef struct {
+    uint16_t family;
+    uint16_t port;
+    unsigned char address[16];
+} DnsServerKey;
+
+// The answer section as sorted text lines, "owner TYPE rdata" without the
+// TTL, so a countdown is not a change and two answers compare line by line
+typedef struct {
+    char name[DNS_NAME_MAX];    // lower case
+    uint16_t type;
+    DnsServerKey server;
+
+    int rcode;
+    char **lines;
+    int nlines;
+    uint32_t ttl;               // lowest in the answer, or the negative TTL
+    int64_t fetched_ns;
+    int64_t expires_ns;
+} DnsCacheEntry;
+
+// What a new answer changed.  added points into the entry's new lines,
+// removed into the old ones, which the diff owns until dns_cache_diff_free().
+typedef struct {
+    int first;                  // nothing was cached before
+    int old_rcode;
+    int64_t old_fetched_ns;
+    const char **added;
+    int nadded;
+    const char **removed;
+    int nremoved;
+    char **old_lines;
+    int nold;
+} DnsCacheDiff;
+
+// Entries are never dropped; there is one per name ever looked up, which
+// stays small for a tool driven by hand and watch lists
+typedef struct {
+    DnsCacheEntry *entries;
+    int count;
+    int capacity;
+    int *hash;                  // open-addressed, entry + 1 (0 = empty)
+    int hash_size;
+} DnsCache;
+
+void dns_cache_init(DnsCache *c);
+void dns_cache_free(DnsCache *c);
+
+void dns_server_key(DnsServerKey *key, const struct sockaddr *server, socklen_t server_len);
+
+// Entry index or -1; stale entries are returned too, check expires_ns.
+// A trailing dot on name makes no difference.
+int dns_cache_lookup(const DnsCache *c, const char *name, int type, const struct sockaddr *server,
+                     socklen_t server_len);
+// Stores m, the answer to (m->qname, m->qtype) from server, and fills
+// diff when it is not NULL.  Returns the entry index, -1 when out of memory
+// or when m has no question to file it under (errno EINVAL).
+int dns_cache_store(DnsCache *c, const DnsMessage *m, const struct sockaddr *server, socklen_t server_len,
+                    int64_t now_ns, DnsCacheDiff *diff);
+void dns_cache_diff_free(DnsCacheDiff *diff);
+
+static inline int dns_cache_diff_changed(const DnsCacheDiff *diff, int rcode) {
+    return diff->first || diff->nadded > 0 || diff->nremoved > 0 || diff->old_rcode != rcode;
+}
+
+// Whole seconds of TTL left, 0 once expired
+uint32_t dns_cache_ttl_left(const DnsCacheEntry *e, int64_t now_ns);
+
+#endif
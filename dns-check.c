@@ -0,0 +1,433 @@
+/*
+ * Dave's Network Inquisition - DNS client check
+ * Website: https://prowse.tech
+ *
+ * Runs dns.c against a stand-in server on 127.0.0.1 (UDP and TCP on one
+ * port, in a thread) whose behaviour is picked by the first label of the
+ * question: truncation and the TCP fallback, EDNS and the no-EDNS retry,
+ * short and malformed answers, a forged reply, retransmission, NXDOMAIN
+ * and a refused port.  "make check" runs it and fails on the first
+ * unexpected result.
+ */
+
+#include "dns.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#define CHECK_BIG_RECORDS 280   // 4.5 KB of A records, well past DNS_UDP_MAX
+
+typedef struct {
+    int udp_fd;
+    int tcp_fd;
+    atomic_int slow_seen;       // "slow" queries so far
+    atomic_int old_edns;        // "old" queries that came with EDNS
+    // Sender of the UDP query being answered
+    const struct sockaddr_storage *from;
+    socklen_t from_len;
+} CheckServer;
+
+// What a test needs from a result; the message is gone after the callback
+typedef struct {
+    int done;
+    DnsStatus status;
+    int error;
+    int tcp;
+    int attempt;
+    int progress;
+    int rcode;
+    int nrecords;
+    int edns;
+    int edns_udp_size;
+    int section;
+    int type;
+    char text[256];
+} CheckResult;
+
+static uint16_t get16(const unsigned char *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static void put16(unsigned char *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+// Answer record for the question's name (a pointer to offset 12)
+static int put_record(unsigned char *buf, int pos, int type, uint32_t ttl, const void *rdata, int rdlength) {
+    buf[pos++] = 0xc0;
+    buf[pos++] = 12;
+    put16(buf + pos, type);
+    put16(buf + pos + 2, DNS_CLASS_IN);
+    put16(buf + pos + 4, ttl >> 16);
+    put16(buf + pos + 6, ttl & 0xffff);
+    put16(buf + pos + 8, rdlength);
+    memcpy(buf + pos + 10, rdata, rdlength);
+    return pos + 10 + rdlength;
+}
+
+static int put_opt(unsigned char *buf, int pos) {
+    buf[pos++] = 0;
+    put16(buf + pos, DNS_TYPE_OPT);
+    put16(buf + pos + 2, DNS_UDP_MAX);
+    memset(buf + pos + 4, 0, 6);
+    return pos + 10;
+}
+
+// Builds the reply to query in buf and returns its length; 0 sends
+// nothing
+static int check_reply(CheckServer *srv, const unsigned char *query, int len, int tcp, unsigned char *buf) {
+    DnsMessage q;
+    static const unsigned char address[4] = {192, 0, 2, 1};
+
+    if (dns_message_parse(&q, query, len) < 0 || q.qdcount != 1) {
+        dns_message_free(&q);
+        return 0;
+    }
+
+    // Header and question as they came, QR set
+    int qend = 12;
+    while (query[qend] != 0) {
+        qend += query[qend] + 1;
+    }
+    qend += 5;
+    memcpy(buf, query, qend);
+    put16(buf + 2, DNS_FLAG_QR | DNS_FLAG_RA | (q.flags & DNS_FLAG_RD));
+    put16(buf + 6, 0);
+    put16(buf + 8, 0);
+    put16(buf + 10, 0);
+
+    int pos = qend;
+    int edns = q.edns;
+    const char *name = q.qname;
+
+    if (strncasecmp(name, "big.", 4) == 0) {
+        if (!tcp) {
+            put16(buf + 2, get16(buf + 2) | DNS_FLAG_TC);
+        } else {
+            for (int i = 0; i < CHECK_BIG_RECORDS; i++) {
+                unsigned char a[4] = {198, 51, i >> 8, i & 0xff};
+                pos = put_record(buf, pos, DNS_TYPE_A, 60, a, 4);
+            }
+            put16(buf + 6, CHECK_BIG_RECORDS);
+        }
+    } else if (strncasecmp(name, "old.", 4) == 0) {
+        // Predates EDNS: FORMERR for an OPT record, and never sends one
+        if (edns) {
+            srv->old_edns++;
+            put16(buf + 2, get16(buf + 2) | 1);
+        } else {
+            pos = put_record(buf, pos, DNS_TYPE_A, 60, address, 4);
+            put16(buf + 6, 1);
+        }
+        edns = 0;
+    } else if (strncasecmp(name, "short.", 6) == 0) {
+        // One answer promised, half of one sent
+        pos = put_record(buf, pos, DNS_TYPE_A, 60, address, 4) - 7;
+        put16(buf + 6, 1);
+        edns = 0;
+    } else if (strncasecmp(name, "tiny.", 5) == 0) {
+        pos = 6;
+        edns = 0;
+    } else if (strncasecmp(name, "forged.", 7) == 0) {
+        // A reply with the wrong id first; the real one follows
+        unsigned char forged[DNS_PACKET_MAX];
+        memcpy(forged, buf, qend);
+        put16(forged, q.id ^ 0x5a5a);
+        int flen = put_record(forged, qend, DNS_TYPE_A, 60, "\x0a\x00\x00\x01", 4);
+        put16(forged + 6, 1);
+        if (!tcp) {
+            sendto(srv->udp_fd, forged, flen, 0, (struct sockaddr *)srv->from, srv->from_len);
+        }
+        pos = put_record(buf, pos, DNS_TYPE_A, 60, address, 4);
+        put16(buf + 6, 1);
+    } else if (strncasecmp(name, "slow.", 5) == 0) {
+        // The first try goes unanswered
+        if (srv->slow_seen++ == 0) {
+            dns_message_free(&q);
+            return 0;
+        }
+        pos = put_record(buf, pos, DNS_TYPE_A, 60, address, 4);
+        put16(buf + 6, 1);
+    } else if (strncasecmp(name, "nx.", 3) == 0) {
+        static const unsigned char soa[] = {
+            0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0x0e, 0x10, 0, 0, 0x02, 0x58, 0, 0x09, 0x3a, 0x80, 0, 0, 0x01, 0x2c
+        };
+        put16(buf + 2, get16(buf + 2) | 3);
+        pos = put_record(buf, pos, DNS_TYPE_SOA, 300, soa, sizeof(soa));
+        put16(buf + 8, 1);
+    } else {
+        pos = put_record(buf, pos, DNS_TYPE_A, 60, address, 4);
+        put16(buf + 6, 1);
+    }
+
+    if (edns) {
+        pos = put_opt(buf, pos);
+        put16(buf + 10, 1);
+    }
+    dns_message_free(&q);
+    return pos;
+}
+
+static void check_serve_udp(CheckServer *srv) {
+    unsigned char query[DNS_PACKET_MAX];
+    unsigned char reply[DNS_PACKET_MAX];
+    struct sockaddr_storage from;
+    socklen_t from_len = sizeof(from);
+
+    ssize_t len = recvfrom(srv->udp_fd, query, sizeof(query), 0, (struct sockaddr *)&from, &from_len);
+    if (len <= 0) {
+        return;
+    }
+    srv->from = &from;
+    srv->from_len = from_len;
+    int n = check_reply(srv, query, len, 0, reply);
+    if (n > 0) {
+        sendto(srv->udp_fd, reply, n, 0, (struct sockaddr *)&from, from_len);
+    }
+}
+
+static int check_read_all(int fd, unsigned char *buf, int len) {
+    for (int got = 0; got < len;) {
+        ssize_t n = recv(fd, buf + got, len - got, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        got += n;
+    }
+    return 0;
+}
+
+// One length-prefixed query per connection
+static void check_serve_tcp(CheckServer *srv) {
+    static unsigned char query[DNS_PACKET_MAX];
+    static unsigned char reply[DNS_PACKET_MAX + 2];
+    int fd = accept(srv->tcp_fd, NULL, NULL);
+
+    if (fd < 0) {
+        return;
+    }
+    unsigned char prefix[2];
+    if (check_read_all(fd, prefix, 2) == 0 && check_read_all(fd, query, get16(prefix)) == 0) {
+        int n = check_reply(srv, query, get16(prefix), 1, reply + 2);
+        put16(reply, n);
+        send(fd, reply, n + 2, MSG_NOSIGNAL);
+    }
+    close(fd);
+}
+
+static void *check_server_thread(void *data) {
+    CheckServer *srv = data;
+    struct pollfd fds[2] = {{srv->udp_fd, POLLIN, 0}, {srv->tcp_fd, POLLIN, 0}};
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            continue;
+        }
+        if (fds[0].revents & POLLIN) {
+            check_serve_udp(srv);
+        }
+        if (fds[1].revents & POLLIN) {
+            check_serve_tcp(srv);
+        }
+    }
+    return NULL;
+}
+
+static void check_on_result(const DnsResult *r, void *user_data) {
+    CheckResult *c = user_data;
+
+    if (r->status == DNS_RETRYING) {
+        c->progress++;
+        c->tcp = r->tcp;
+        return;
+    }
+    c->done = 1;
+    c->status = r->status;
+    c->error = r->error;
+    c->tcp = r->tcp;
+    c->attempt = r->attempt;
+    if (r->message != NULL) {
+        const DnsMessage *m = r->message;
+        c->rcode = m->rcode;
+        c->nrecords = m->nrecords;
+        c->edns = m->edns;
+        c->edns_udp_size = m->edns_udp_size;
+        if (m->nrecords > 0) {
+            c->section = m->records[0].section;
+            c->type = m->records[0].type;
+            dns_record_format(m, &m->records[0], c->text, sizeof(c->text));
+        }
+    }
+}
+
+static int check_run(DnsEngine *e, const char *name, int port, const DnsOptions *opts, CheckResult *c) {
+    struct sockaddr_in server;
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    memset(c, 0, sizeof(*c));
+    if (dns_query_start(e, name, DNS_TYPE_A, (struct sockaddr *)&server, sizeof(server), opts, check_on_result,
+                        c) < 0) {
+        printf("%s: dns_query_start: %s\n", name, strerror(errno));
+        return -1;
+    }
+    while (!c->done) {
+        struct pollfd pfd = {dns_engine_fd(e), POLLIN, 0};
+        if (poll(&pfd, 1, 5000) == 0) {
+            printf("%s: no result after 5 s\n", name);
+            return -1;
+        }
+        dns_engine_dispatch(e);
+    }
+    return 0;
+}
+
+#define EXPECT(cond) do { \
+        if (!(cond)) { \
+            printf("%s: expected %s\n", name, #cond); \
+            failed = 1; \
+        } \
+    } while (0)
+
+int main(void) {
+    CheckServer srv;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    pthread_t thread;
+    DnsEngine engine;
+    DnsOptions opts;
+    CheckResult c;
+    const char *name;
+    int failed = 0;
+
+    memset(&srv, 0, sizeof(srv));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // TCP on whatever port the kernel picks, UDP on the same one
+    srv.tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    srv.udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (srv.tcp_fd < 0 || srv.udp_fd < 0 || bind(srv.tcp_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(srv.tcp_fd, 8) < 0 || getsockname(srv.tcp_fd, (struct sockaddr *)&addr, &addr_len) < 0 ||
+        bind(srv.udp_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "stand-in server: %s\n", strerror(errno));
+        return 1;
+    }
+    int port = ntohs(addr.sin_port);
+
+    // A port nothing listens on, for the refused case
+    int closed = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    addr.sin_port = 0;
+    addr_len = sizeof(addr);
+    if (closed < 0 || bind(closed, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(closed, (struct sockaddr *)&addr, &addr_len) < 0) {
+        fprintf(stderr, "closed port: %s\n", strerror(errno));
+        return 1;
+    }
+    int closed_port = ntohs(addr.sin_port);
+    close(closed);
+
+    if (pthread_create(&thread, NULL, check_server_thread, &srv) != 0 || dns_engine_open(&engine) < 0) {
+        fprintf(stderr, "setup failed\n");
+        return 1;
+    }
+    pthread_detach(thread);
+
+    dns_options_default(&opts);
+    opts.timeout_ns = 300000000LL;
+
+    name = "plain.test";
+    if (check_run(&engine, name, port, &opts, &c) == 0) {
+        EXPECT(c.status == DNS_ANSWER && !c.tcp && c.attempt == 1);
+        EXPECT(c.nrecords == 1 && c.type == DNS_TYPE_A && strcmp(c.text, "192.0.2.1") == 0);
+        EXPECT(c.edns && c.edns_udp_size == DNS_UDP_MAX);
+    } else {
+        failed = 1;
+    }
+
+    name = "big.test";
+    if (check_run(&engine, name, port, &opts, &c) == 0) {
+        EXPECT(c.status == DNS_ANSWER && c.tcp && c.progress == 1);
+        EXPECT(c.nrecords == CHECK_BIG_RECORDS);
+    } else {
+        failed = 1;
+    }
+
+    name = "old.test";
+    if (check_run(&engine, name, port, &opts, &c) == 0) {
+        EXPECT(c.status == DNS_ANSWER && c.rcode == 0 && c.nrecords == 1 && !c.edns);
+        EXPECT(srv.old_edns == 1 && c.attempt == 2);
+    } else {
+        failed = 1;
+    }
+
+    // Over UDP a reply that does not parse is ignored like a stray one
+    name = "short.test";
+    if (check_run(&engine, name, port, &opts, &c) == 0) {
+        EXPECT(c.status == DNS_TIMEOUT && c.attempt == opts.tries);
+    } else {
+        failed = 1;
+    }
+
+    opts.tcp = 1;
+    name = "short.test";
+    if (check_run(&engine, name, port, &opts, &c) == 0) {
+        EXPECT(c.status == DNS_BAD_REPLY);
+    } else {
+        failed = 1;
+    }
+
+    name = "tiny.test";
+    if (check_run(&engine, name, port, &opts, &c) == 0) {
+        EXPECT(c.status == DNS_BAD_REPLY);
+    } else {
+        failed = 1;
+    }
+    opts.tcp = 0;
+
+    name = "forged.test";
+    if (check_run(&engine, name, port, &opts, &c) == 0) {
+        EXPECT(c.status == DNS_ANSWER && c.attempt == 1 && strcmp(c.text, "192.0.2.1") == 0);
+    } else {
+        failed = 1;
+    }
+
+    name = "slow.test";
+    if (check_run(&engine, name, port, &opts, &c) == 0) {
+        EXPECT(c.status == DNS_ANSWER && c.attempt == 2 && c.progress == 1);
+    } else {
+        failed = 1;
+    }
+
+    name = "nx.test";
+    if (check_run(&engine, name, port, &opts, &c) == 0) {
+        EXPECT(c.status == DNS_ANSWER && c.rcode == 3);
+        EXPECT(c.nrecords == 1 && c.section == DNS_SECTION_AUTHORITY && c.type == DNS_TYPE_SOA);
+    } else {
+        failed = 1;
+    }
+
+    name = "refused.test";
+    if (check_run(&engine, name, closed_port, &opts, &c) == 0) {
+        EXPECT(c.status == DNS_FAILED && c.error == ECONNREFUSED);
+    } else {
+        failed = 1;
+    }
+
+    dns_engine_close(&engine);
+    printf(failed ? "DNS check FAILED\n" : "DNS check passed: every stand-in server case answered as expected\n");
+    return failed;
+}
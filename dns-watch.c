@@ -0,0 +1,237 @@
+/*
+ * Dave's Network Inquisition - DNS watch list
+ * Website: https://prowse.tech
+ *
+ * Re-resolves a list of names as their answers expire and reports what
+ * changed between lookups (see dns-watch.h).
+ */
+
+#include "dns-watch.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+static int64_t dns_watch_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void dns_watch_init(DnsWatch *w, DnsEngine *engine, DnsCache *cache, DnsWatchFunc func, void *user_data) {
+    memset(w, 0, sizeof(*w));
+    w->engine = engine;
+    w->cache = cache;
+    w->func = func;
+    w->user_data = user_data;
+}
+
+void dns_watch_free(DnsWatch *w) {
+    for (int i = 0; i < w->ninflight; i++) {
+        dns_query_cancel(w->engine, w->items[w->inflight[i]].query);
+    }
+    free(w->items);
+    free(w->heap);
+    memset(w, 0, sizeof(*w));
+}
+
+static void dns_watch_heap_swap(DnsWatch *w, int a, int b) {
+    int item = w->heap[a];
+    w->heap[a] = w->heap[b];
+    w->heap[b] = item;
+    w->items[w->heap[a]].heap_index = a;
+    w->items[w->heap[b]].heap_index = b;
+}
+
+static void dns_watch_heap_push(DnsWatch *w, int item) {
+    int i = w->heap_len++;
+
+    w->heap[i] = item;
+    w->items[item].heap_index = i;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (w->items[w->heap[parent]].due_ns <= w->items[w->heap[i]].due_ns) {
+            break;
+        }
+        dns_watch_heap_swap(w, i, parent);
+        i = parent;
+    }
+}
+
+static int dns_watch_heap_pop(DnsWatch *w) {
+    int top = w->heap[0];
+    int i = 0;
+
+    w->items[top].heap_index = -1;
+    if (--w->heap_len == 0) {
+        return top;
+    }
+    w->heap[0] = w->heap[w->heap_len];
+    w->items[w->heap[0]].heap_index = 0;
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < w->heap_len && w->items[w->heap[left]].due_ns < w->items[w->heap[smallest]].due_ns) {
+            smallest = left;
+        }
+        if (right < w->heap_len && w->items[w->heap[right]].due_ns < w->items[w->heap[smallest]].due_ns) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        dns_watch_heap_swap(w, i, smallest);
+        i = smallest;
+    }
+    return top;
+}
+
+int dns_watch_add(DnsWatch *w, const char *name, int type, const struct sockaddr *server, socklen_t server_len) {
+    DnsServerKey key;
+    DnsServerKey other;
+
+    dns_server_key(&key, server, server_len);
+    for (int i = 0; i < w->count; i++) {
+        DnsWatchItem *item = &w->items[i];
+        dns_server_key(&other, (struct sockaddr *)&item->server, item->server_len);
+        if (item->type == type && strcasecmp(item->name, name) == 0 && memcmp(&key, &other, sizeof(key)) == 0) {
+            return i;
+        }
+    }
+
+    if (w->count == w->capacity) {
+        int capacity = w->capacity ? w->capacity * 2 : 64;
+        DnsWatchItem *items = realloc(w->items, capacity * sizeof(DnsWatchItem));
+        if (items == NULL) {
+            return -1;
+        }
+        w->items = items;
+        int *heap = realloc(w->heap, capacity * sizeof(int));
+        if (heap == NULL) {
+            return -1;
+        }
+        w->heap = heap;
+        w->capacity = capacity;
+    }
+
+    int index = w->count++;
+    DnsWatchItem *item = &w->items[index];
+    memset(item, 0, sizeof(*item));
+    snprintf(item->name, sizeof(item->name), "%s", name);
+    item->type = type;
+    memcpy(&item->server, server, server_len);
+    item->server_len = server_len;
+    item->entry = dns_cache_lookup(w->cache, name, type, server, server_len);
+    item->due_ns = dns_watch_clock_ns();
+    dns_watch_heap_push(w, index);
+    return index;
+}
+
+// Next lookup once the answer has expired, so a recursive resolver hands
+// out a fresh copy rather than its cached one
+static int64_t dns_watch_interval(const DnsCacheEntry *e) {
+    int64_t interval = (int64_t)e->ttl * 1000000000LL + 1000000000LL;
+
+    if (interval < DNS_WATCH_MIN_INTERVAL_NS) {
+        return DNS_WATCH_MIN_INTERVAL_NS;
+    }
+    if (interval > DNS_WATCH_MAX_INTERVAL_NS) {
+        return DNS_WATCH_MAX_INTERVAL_NS;
+    }
+    return interval;
+}
+
+static void dns_watch_start(DnsWatch *w, int index, int64_t now_ns);
+
+static void dns_watch_pump(DnsWatch *w, int64_t now_ns) {
+    while (w->heap_len > 0 && w->ninflight < DNS_WATCH_MAX_INFLIGHT &&
+           w->items[w->heap[0]].due_ns <= now_ns + DNS_WATCH_BATCH_NS) {
+        dns_watch_start(w, dns_watch_heap_pop(w), now_ns);
+    }
+}
+
+static void on_dns_watch_result(const DnsResult *result, void *user_data) {
+    DnsWatch *w = (DnsWatch *)user_data;
+    DnsCacheDiff diff;
+    int have_diff = 0;
+    int index = -1;
+
+    if (result->status == DNS_RETRYING) {
+        return;
+    }
+    for (int i = 0; i < w->ninflight; i++) {
+        if (w->items[w->inflight[i]].query == result->query) {
+            index = w->inflight[i];
+            w->inflight[i] = w->inflight[--w->ninflight];
+            break;
+        }
+    }
+    if (index < 0) {
+        return;
+    }
+
+    DnsWatchItem *item = &w->items[index];
+    int64_t now_ns = dns_watch_clock_ns();
+    item->query = 0;
+    item->lookups++;
+
+    int entry = -1;
+    if (result->status == DNS_ANSWER) {
+        entry = dns_cache_store(w->cache, result->message, (struct sockaddr *)&item->server, item->server_len,
+                                now_ns, &diff);
+    }
+    if (entry >= 0) {
+        have_diff = 1;
+        item->entry = entry;
+        if (!diff.first && dns_cache_diff_changed(&diff, result->message->rcode)) {
+            item->changes++;
+        }
+        item->failures = 0;
+        item->due_ns = now_ns + dns_watch_interval(&w->cache->entries[entry]);
+    } else {
+        item->failures++;
+        item->due_ns = now_ns + DNS_WATCH_RETRY_NS;
+    }
+    dns_watch_heap_push(w, index);
+    dns_watch_pump(w, now_ns);
+
+    w->func(w, index, result, have_diff ? &diff : NULL, w->user_data);
+    if (have_diff) {
+        dns_cache_diff_free(&diff);
+    }
+}
+
+static void dns_watch_start(DnsWatch *w, int index, int64_t now_ns) {
+    DnsWatchItem *item = &w->items[index];
+    DnsOptions opts;
+
+    dns_options_default(&opts);
+    item->query = dns_query_start(w->engine, item->name, item->type, (struct sockaddr *)&item->server,
+                                  item->server_len, &opts, on_dns_watch_result, w);
+    if (item->query > 0) {
+        w->inflight[w->ninflight++] = index;
+        return;
+    }
+
+    // Could not even send: report it and try again later
+    DnsResult result;
+    memset(&result, 0, sizeof(result));
+    result.query = 0;
+    result.status = DNS_FAILED;
+    result.error = errno;
+    item->query = 0;
+    item->lookups++;
+    item->failures++;
+    item->due_ns = now_ns + DNS_WATCH_RETRY_NS;
+    dns_watch_heap_push(w, index);
+    w->func(w, index, &result, NULL, w->user_data);
+}
+
+int64_t dns_watch_run(DnsWatch *w, int64_t now_ns) {
+    dns_watch_pump(w, now_ns);
+    return w->heap_len > 0 ? w->items[w->heap[0]].due_ns : 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * Dave's Network Inquisition - DNS watch list
+ * Website: https://prowse.tech
+ */
+
+#ifndef DNS_WATCH_H
+#define DNS_WATCH_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "dns.h"
+#include "dns-cache.h"
+
+// Bounds on the time between two lookups of a name, whatever its TTL
+#define DNS_WATCH_MIN_INTERVAL_NS 5000000000LL
+#define DNS_WATCH_MAX_INTERVAL_NS 300000000000LL
+// After a timeout or error
+#define DNS_WATCH_RETRY_NS 30000000000LL
+// Items due within this of each other go out together
+#define DNS_WATCH_BATCH_NS 1000000000LL
+#define DNS_WATCH_MAX_INFLIGHT 64
+
+typedef struct {
+    char name[DNS_NAME_MAX];
+    int type;
+    struct sockaddr_storage server;
+    socklen_t server_len;
+
+    int64_t due_ns;
+    int heap_index;             // -1 while its query is in flight
+    int query;                  // engine query id, 0 = none
+    int entry;                  // cache entry, -1 before the first answer
+    int lookups;
+    int changes;
+    int failures;               // in a row
+} DnsWatchItem;
+
+struct DnsWatch;
+
+// result is the engine's final status for one lookup.  diff is set for
+// answers only (status DNS_ANSWER) and says what changed in the cache.
+typedef void (*DnsWatchFunc)(struct DnsWatch *w, int item, const DnsResult *result, const DnsCacheDiff *diff,
+                             void *user_data);
+
+// Items wait in a min-heap on their due time.  dns_watch_run() only looks
+// at the top, so between expiries a long list costs one comparison; what
+// is due goes out in one batch, at most DNS_WATCH_MAX_INFLIGHT at a time,
+// and each answer schedules its name again from the TTL it came back with.
+typedef struct DnsWatch {
+    DnsEngine *engine;          // not owned
+    DnsCache *cache;            // not owned
+    DnsWatchFunc func;
+    void *user_data;
+
+    DnsWatchItem *items;
+    int count;
+    int capacity;
+
+    int *heap;                  // item indices, earliest due first
+    int heap_len;
+
+    int inflight[DNS_WATCH_MAX_INFLIGHT];
+    int ninflight;
+} DnsWatch;
+
+void dns_watch_init(DnsWatch *w, DnsEngine *engine, DnsCache *cache, DnsWatchFunc func, void *user_data);
+// Cancels whatever is still in flight
+void dns_watch_free(DnsWatch *w);
+
+// Due at once.  Returns the item index (the existing one when the same
+// name, type and server is already watched), or -1 when out of memory.
+int dns_watch_add(DnsWatch *w, const char *name, int type, const struct sockaddr *server, socklen_t server_len);
+// Starts what is due by now_ns plus the batch window.  Returns when to
+// call again, 0 when nothing is waiting.
+int64_t dns_watch_run(DnsWatch *w, int64_t now_ns);
+
+#endif
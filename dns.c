@@ -0,0 +1,947 @@
+/*
+ * Dave's Network Inquisition - DNS client engine
+ * Website: https://prowse.tech
+ *
+ * A small stub resolver client for the DIG panel: one question per query,
+ * UDP with EDNS, TCP when the answer is truncated, retransmits on
+ * timeout.  Everything is non-blocking and driven from the caller's main
+ * loop, like the ping engine.
+ */
+
+#include "dns.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/random.h>
+#include <sys/timerfd.h>
+
+#define DNS_TIMER_KEY 0
+
+static int64_t dns_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint16_t dns_get16(const unsigned char *p) {
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t dns_get32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void dns_put16(unsigned char *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+// Unpredictable transaction ids, together with the fresh source port,
+// make forged answers hard to slip in
+static uint16_t dns_random_id(void) {
+    uint16_t id;
+    if (getrandom(&id, sizeof(id), GRND_NONBLOCK) != sizeof(id)) {
+        id = (uint16_t)(dns_clock_ns() ^ getpid());
+    }
+    return id;
+}
+
+static int dns_encode_name(unsigned char *buf, size_t size, const char *name) {
+    size_t pos = 0;
+    const char *p = name;
+
+    if (strcmp(name, ".") == 0) {
+        p = "";
+    }
+    while (*p != '\0') {
+        const char *dot = strchr(p, '.');
+        size_t len = dot != NULL ? (size_t)(dot - p) : strlen(p);
+
+        if (len == 0 || len > 63 || pos + 1 + len + 1 > size || pos + 1 + len + 1 > 255) {
+            return -1;
+        }
+        buf[pos++] = len;
+        memcpy(buf + pos, p, len);
+        pos += len;
+        p += len;
+        if (*p == '.') {
+            p++;
+        }
+    }
+    if (pos + 1 > size) {
+        return -1;
+    }
+    buf[pos++] = 0;
+    return pos;
+}
+
+// Decode a possibly compressed name at offset into presentation form.
+// Returns the offset just past the name where it started, or -1.
+static int dns_read_name(const unsigned char *msg, int size, int offset, char *out, size_t out_size) {
+    int pos = offset;
+    int end = -1;
+    int jumps = 0;
+    size_t o = 0;
+
+    for (;;) {
+        if (pos >= size) {
+            return -1;
+        }
+        int len = msg[pos];
+        if ((len & 0xc0) == 0xc0) {
+            if (pos + 1 >= size || ++jumps > 64) {
+                return -1;
+            }
+            if (end < 0) {
+                end = pos + 2;
+            }
+            pos = ((len & 0x3f) << 8) | msg[pos + 1];
+            continue;
+        }
+        if (len & 0xc0) {
+            return -1;
+        }
+        if (len == 0) {
+            if (end < 0) {
+                end = pos + 1;
+            }
+            break;
+        }
+        if (pos + 1 + len > size) {
+            return -1;
+        }
+        for (int i = 0; i < len; i++) {
+            unsigned char ch = msg[pos + 1 + i];
+            if (o + 6 >= out_size) {
+                return -1;
+            }
+            if (ch == '.' || ch == '\\') {
+                out[o++] = '\\';
+                out[o++] = ch;
+            } else if (ch <= ' ' || ch >= 127) {
+                o += snprintf(out + o, out_size - o, "\\%03d", ch);
+            } else {
+                out[o++] = ch;
+            }
+        }
+        out[o++] = '.';
+        pos += 1 + len;
+    }
+
+    if (o == 0) {
+        out[o++] = '.';
+    }
+    out[o] = '\0';
+    return end;
+}
+
+int dns_encode_query(unsigned char *buf, size_t size, uint16_t id, const char *name, int type, int recurse,
+                     int edns) {
+    int pos;
+
+    if (size < 12) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    memset(buf, 0, 12);
+    dns_put16(buf, id);
+    dns_put16(buf + 2, recurse ? DNS_FLAG_RD : 0);
+    dns_put16(buf + 4, 1);
+    dns_put16(buf + 10, edns ? 1 : 0);
+    pos = 12;
+
+    int len = dns_encode_name(buf + pos, size - pos, name);
+    if (len < 0 || pos + len + 4 > (int)size) {
+        errno = EINVAL;
+        return -1;
+    }
+    pos += len;
+    dns_put16(buf + pos, type);
+    dns_put16(buf + pos + 2, DNS_CLASS_IN);
+    pos += 4;
+
+    if (edns) {
+        // OPT: root name, payload size in the class field, no options
+        if (pos + 11 > (int)size) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        buf[pos] = 0;
+        dns_put16(buf + pos + 1, DNS_TYPE_OPT);
+        dns_put16(buf + pos + 3, DNS_UDP_MAX);
+        memset(buf + pos + 5, 0, 6);
+        pos += 11;
+    }
+    return pos;
+}
+
+int dns_message_parse(DnsMessage *m, const unsigned char *data, int size) {
+    memset(m, 0, sizeof(*m));
+    if (size < 12) {
+        return -1;
+    }
+
+    m->data = malloc(size);
+    if (m->data == NULL) {
+        return -1;
+    }
+    memcpy(m->data, data, size);
+    m->size = size;
+    m->id = dns_get16(data);
+    m->flags = dns_get16(data + 2);
+    m->rcode = m->flags & 0x0f;
+    m->qdcount = dns_get16(data + 4);
+    m->ancount = dns_get16(data + 6);
+    m->nscount = dns_get16(data + 8);
+    m->arcount = dns_get16(data + 10);
+
+    int pos = 12;
+    char name[DNS_NAME_MAX];
+    for (int i = 0; i < m->qdcount; i++) {
+        pos = dns_read_name(data, size, pos, name, sizeof(name));
+        if (pos < 0 || pos + 4 > size) {
+            goto fail;
+        }
+        if (i == 0) {
+            strcpy(m->qname, name);
+            m->qtype = dns_get16(data + pos);
+            m->qclass = dns_get16(data + pos + 2);
+        }
+        pos += 4;
+    }
+
+    int total = m->ancount + m->nscount + m->arcount;
+    if (total > 0) {
+        // Every record takes at least 11 bytes
+        if (total > (size - pos) / 11) {
+            goto fail;
+        }
+        m->records = calloc(total, sizeof(DnsRecord));
+        if (m->records == NULL) {
+            goto fail;
+        }
+    }
+
+    for (int i = 0; i < total; i++) {
+        DnsRecord *r = &m->records[m->nrecords];
+
+        pos = dns_read_name(data, size, pos, r->name, sizeof(r->name));
+        if (pos < 0 || pos + 10 > size) {
+            goto fail;
+        }
+        r->section = i < m->ancount ? DNS_SECTION_ANSWER
+                   : i < m->ancount + m->nscount ? DNS_SECTION_AUTHORITY : DNS_SECTION_ADDITIONAL;
+        r->type = dns_get16(data + pos);
+        r->rclass = dns_get16(data + pos + 2);
+        r->ttl = dns_get32(data + pos + 4);
+        r->rdlength = dns_get16(data + pos + 8);
+        r->rdata = pos + 10;
+        pos += 10 + r->rdlength;
+        if (pos > size) {
+            goto fail;
+        }
+
+        if (r->type == DNS_TYPE_OPT && r->section == DNS_SECTION_ADDITIONAL) {
+            m->edns = 1;
+            m->edns_udp_size = r->rclass;
+            m->rcode |= (r->ttl >> 24) << 4;
+            m->edns_version = (r->ttl >> 16) & 0xff;
+            m->edns_do = (r->ttl & 0x8000) != 0;
+            continue;
+        }
+        m->nrecords++;
+    }
+    return 0;
+
+fail:
+    dns_message_free(m);
+    return -1;
+}
+
+void dns_message_free(DnsMessage *m) {
+    free(m->data);
+    free(m->records);
+    memset(m, 0, sizeof(*m));
+}
+
+static const char *dns_record_generic(const unsigned char *rdata, int len, char *buf, size_t size) {
+    // RFC 3597 unknown-type syntax
+    size_t o = snprintf(buf, size, "\\# %d", len);
+    if (len > 0 && o < size) {
+        o += snprintf(buf + o, size - o, " ");
+    }
+    for (int i = 0; i < len && o + 3 < size; i++) {
+        o += snprintf(buf + o, size - o, "%02x", rdata[i]);
+    }
+    return buf;
+}
+
+const char *dns_record_format(const DnsMessage *m, const DnsRecord *r, char *buf, size_t size) {
+    const unsigned char *rdata = m->data + r->rdata;
+    int len = r->rdlength;
+    int end = r->rdata + len;
+    char name[DNS_NAME_MAX];
+    char name2[DNS_NAME_MAX];
+    int pos;
+
+    switch (r->type) {
+    case DNS_TYPE_A:
+        if (len == 4 && inet_ntop(AF_INET, rdata, buf, size) != NULL) {
+            return buf;
+        }
+        break;
+    case DNS_TYPE_AAAA:
+        if (len == 16 && inet_ntop(AF_INET6, rdata, buf, size) != NULL) {
+            return buf;
+        }
+        break;
+    case DNS_TYPE_NS:
+    case DNS_TYPE_CNAME:
+    case DNS_TYPE_PTR:
+        if (dns_read_name(m->data, end, r->rdata, name, sizeof(name)) == end) {
+            snprintf(buf, size, "%s", name);
+            return buf;
+        }
+        break;
+    case DNS_TYPE_MX:
+        if (len > 2 && dns_read_name(m->data, end, r->rdata + 2, name, sizeof(name)) == end) {
+            snprintf(buf, size, "%u %s", dns_get16(rdata), name);
+            return buf;
+        }
+        break;
+    case DNS_TYPE_SRV:
+        if (len > 6 && dns_read_name(m->data, end, r->rdata + 6, name, sizeof(name)) == end) {
+            snprintf(buf, size, "%u %u %u %s", dns_get16(rdata), dns_get16(rdata + 2), dns_get16(rdata + 4), name);
+            return buf;
+        }
+        break;
+    case DNS_TYPE_SOA:
+        pos = dns_read_name(m->data, end, r->rdata, name, sizeof(name));
+        if (pos > 0) {
+            pos = dns_read_name(m->data, end, pos, name2, sizeof(name2));
+        }
+        if (pos > 0 && pos + 20 == end) {
+            const unsigned char *p = m->data + pos;
+            snprintf(buf, size, "%s %s %u %u %u %u %u", name, name2, dns_get32(p), dns_get32(p + 4),
+                     dns_get32(p + 8), dns_get32(p + 12), dns_get32(p + 16));
+            return buf;
+        }
+        break;
+    case DNS_TYPE_TXT: {
+        // One quoted string per character-string
+        size_t o = 0;
+        int i = 0;
+        buf[0] = '\0';
+        while (i < len) {
+            int n = rdata[i++];
+            if (i + n > len) {
+                break;
+            }
+            if (o + 3 < size) {
+                o += snprintf(buf + o, size - o, "%s\"", o > 0 ? " " : "");
+            }
+            for (int j = 0; j < n && o + 6 < size; j++) {
+                unsigned char ch = rdata[i + j];
+                if (ch == '"' || ch == '\\') {
+                    o += snprintf(buf + o, size - o, "\\%c", ch);
+                } else if (ch < ' ' || ch >= 127) {
+                    o += snprintf(buf + o, size - o, "\\%03d", ch);
+                } else {
+                    buf[o++] = ch;
+                    buf[o] = '\0';
+                }
+            }
+            if (o + 2 < size) {
+                o += snprintf(buf + o, size - o, "\"");
+            }
+            i += n;
+        }
+        if (i == len) {
+            return buf;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return dns_record_generic(rdata, len, buf, size);
+}
+
+static const struct {
+    int type;
+    const char *name;
+} dns_types[] = {
+    {DNS_TYPE_A, "A"}, {DNS_TYPE_NS, "NS"}, {DNS_TYPE_CNAME, "CNAME"}, {DNS_TYPE_SOA, "SOA"},
+    {DNS_TYPE_PTR, "PTR"}, {DNS_TYPE_MX, "MX"}, {DNS_TYPE_TXT, "TXT"}, {DNS_TYPE_AAAA, "AAAA"},
+    {DNS_TYPE_SRV, "SRV"}, {DNS_TYPE_OPT, "OPT"}, {DNS_TYPE_ANY, "ANY"}
+};
+
+int dns_type_from_string(const char *text) {
+    char *end;
+
+    for (size_t i = 0; i < sizeof(dns_types) / sizeof(dns_types[0]); i++) {
+        if (strcasecmp(text, dns_types[i].name) == 0) {
+            return dns_types[i].type;
+        }
+    }
+    if (strncasecmp(text, "TYPE", 4) == 0 && text[4] != '\0') {
+        long type = strtol(text + 4, &end, 10);
+        if (*end == '\0' && type > 0 && type < 65536) {
+            return type;
+        }
+    }
+    return -1;
+}
+
+const char *dns_type_string(int type, char *buf, size_t size) {
+    for (size_t i = 0; i < sizeof(dns_types) / sizeof(dns_types[0]); i++) {
+        if (dns_types[i].type == type) {
+            return dns_types[i].name;
+        }
+    }
+    snprintf(buf, size, "TYPE%d", type);
+    return buf;
+}
+
+const char *dns_rcode_string(int rcode) {
+    static const char *names[] = {
+        "NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED",
+        "YXDOMAIN", "YXRRSET", "NXRRSET", "NOTAUTH", "NOTZONE"
+    };
+
+    if (rcode >= 0 && rcode < (int)(sizeof(names) / sizeof(names[0]))) {
+        return names[rcode];
+    }
+    return rcode == 16 ? "BADVERS" : "RESERVED";
+}
+
+int dns_parse_server(const char *text, struct sockaddr_storage *server, socklen_t *len) {
+    char host[256];
+    const char *port = "53";
+    const char *hash = strchr(text, '#');
+    struct addrinfo hints;
+    struct addrinfo *res;
+
+    if (hash != NULL) {
+        if ((size_t)(hash - text) >= sizeof(host)) {
+            errno = EINVAL;
+            return -1;
+        }
+        memcpy(host, text, hash - text);
+        host[hash - text] = '\0';
+        port = hash + 1;
+    } else {
+        snprintf(host, sizeof(host), "%s", text);
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, port, &hints, &res) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(server, res->ai_addr, res->ai_addrlen);
+    *len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return 0;
+}
+
+int dns_default_server(struct sockaddr_storage *server, socklen_t *len) {
+    FILE *fp = fopen("/etc/resolv.conf", "r");
+    char line[512];
+
+    if (fp != NULL) {
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            char address[256];
+            if (sscanf(line, " nameserver %255s", address) == 1 && dns_parse_server(address, server, len) == 0) {
+                fclose(fp);
+                return 0;
+            }
+        }
+        fclose(fp);
+    }
+    // Same default as the C library
+    return dns_parse_server("127.0.0.1", server, len);
+}
+
+int dns_reverse_name(const char *address, char *buf, size_t size) {
+    unsigned char bytes[16];
+    size_t o = 0;
+
+    if (inet_pton(AF_INET, address, bytes) == 1) {
+        snprintf(buf, size, "%u.%u.%u.%u.in-addr.arpa.", bytes[3], bytes[2], bytes[1], bytes[0]);
+        return 0;
+    }
+    if (inet_pton(AF_INET6, address, bytes) == 1) {
+        if (size < 16 * 4 + sizeof("ip6.arpa.")) {
+            errno = ENOSPC;
+            return -1;
+        }
+        for (int i = 15; i >= 0; i--) {
+            o += snprintf(buf + o, size - o, "%x.%x.", bytes[i] & 0x0f, bytes[i] >> 4);
+        }
+        snprintf(buf + o, size - o, "ip6.arpa.");
+        return 0;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+void dns_options_default(DnsOptions *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->edns = 1;
+    opts->recurse = 1;
+    opts->tries = 3;
+    opts->timeout_ns = 2000000000LL;
+}
+
+int dns_engine_open(DnsEngine *e) {
+    memset(e, 0, sizeof(*e));
+    e->timer_fd = -1;
+    e->next_id = 1;
+
+    e->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (e->epoll_fd < 0) {
+        return -1;
+    }
+    e->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (e->timer_fd < 0) {
+        dns_engine_close(e);
+        return -1;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = DNS_TIMER_KEY;
+    if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, e->timer_fd, &ev) < 0) {
+        dns_engine_close(e);
+        return -1;
+    }
+    return 0;
+}
+
+static void dns_query_release(DnsQuery *q) {
+    if (q->fd >= 0) {
+        close(q->fd);
+    }
+    free(q->reply);
+    memset(q, 0, sizeof(*q));
+    q->fd = -1;
+}
+
+void dns_engine_close(DnsEngine *e) {
+    for (int i = 0; i < e->capacity; i++) {
+        if (e->queries[i].id != 0) {
+            dns_query_release(&e->queries[i]);
+        }
+    }
+    free(e->queries);
+    if (e->timer_fd >= 0) {
+        close(e->timer_fd);
+    }
+    if (e->epoll_fd >= 0) {
+        close(e->epoll_fd);
+    }
+    memset(e, 0, sizeof(*e));
+    e->epoll_fd = -1;
+    e->timer_fd = -1;
+}
+
+int dns_engine_fd(const DnsEngine *e) {
+    return e->epoll_fd;
+}
+
+static DnsQuery *dns_query_find(DnsEngine *e, int id) {
+    for (int i = 0; i < e->capacity; i++) {
+        if (e->queries[i].id == id) {
+            return &e->queries[i];
+        }
+    }
+    return NULL;
+}
+
+void dns_query_cancel(DnsEngine *e, int query) {
+    DnsQuery *q = query != 0 ? dns_query_find(e, query) : NULL;
+    if (q != NULL) {
+        dns_query_release(q);
+    }
+}
+
+static void dns_arm_timer(DnsEngine *e) {
+    int64_t next = INT64_MAX;
+    struct itimerspec its;
+
+    for (int i = 0; i < e->capacity; i++) {
+        if (e->queries[i].id != 0 && e->queries[i].deadline_ns < next) {
+            next = e->queries[i].deadline_ns;
+        }
+    }
+
+    memset(&its, 0, sizeof(its));
+    if (next != INT64_MAX) {
+        if (next <= 0) {
+            next = 1;
+        }
+        its.it_value.tv_sec = next / 1000000000LL;
+        its.it_value.tv_nsec = next % 1000000000LL;
+    }
+    timerfd_settime(e->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static int dns_query_encode(DnsQuery *q, const char *name) {
+    q->txid = dns_random_id();
+    q->query_len = dns_encode_query(q->query + 2, DNS_QUERY_MAX, q->txid, name, q->qtype, q->opts.recurse,
+                                    q->opts.edns);
+    if (q->query_len < 0) {
+        return -1;
+    }
+    dns_put16(q->query, q->query_len);
+    return 0;
+}
+
+// Send the next attempt: over the query's UDP socket, or a new TCP
+// connection
+static int dns_query_send(DnsEngine *e, DnsQuery *q, int slot) {
+    struct epoll_event ev;
+
+    if (q->fd < 0) {
+        q->fd = socket(q->server.ss_family, (q->tcp ? SOCK_STREAM : SOCK_DGRAM) | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (q->fd < 0) {
+            return -1;
+        }
+        if (connect(q->fd, (struct sockaddr *)&q->server, q->server_len) < 0 && errno != EINPROGRESS) {
+            return -1;
+        }
+        memset(&ev, 0, sizeof(ev));
+        ev.events = q->tcp ? EPOLLOUT | EPOLLIN : EPOLLIN;
+        ev.data.u64 = ((uint64_t)q->id << 32) | (uint32_t)slot;
+        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, q->fd, &ev) < 0) {
+            return -1;
+        }
+        q->connected = 0;
+        q->written = 0;
+        q->reply_len = 0;
+        q->reply_want = 2;
+    }
+
+    q->attempt++;
+    q->sent_ns = dns_clock_ns();
+    q->deadline_ns = q->sent_ns + q->opts.timeout_ns;
+
+    if (!q->tcp && send(q->fd, q->query + 2, q->query_len, 0) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int dns_query_start(DnsEngine *e, const char *name, int type, const struct sockaddr *server, socklen_t server_len,
+                    const DnsOptions *opts, DnsResultFunc func, void *user_data) {
+    int slot = -1;
+
+    if (server_len > sizeof(struct sockaddr_storage)) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (int i = 0; i < e->capacity; i++) {
+        if (e->queries[i].id == 0) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        int capacity = e->capacity ? e->capacity * 2 : 8;
+        DnsQuery *queries = realloc(e->queries, capacity * sizeof(DnsQuery));
+        if (queries == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        memset(&queries[e->capacity], 0, (capacity - e->capacity) * sizeof(DnsQuery));
+        for (int i = e->capacity; i < capacity; i++) {
+            queries[i].fd = -1;
+        }
+        slot = e->capacity;
+        e->queries = queries;
+        e->capacity = capacity;
+    }
+
+    DnsQuery *q = &e->queries[slot];
+    memset(q, 0, sizeof(*q));
+    q->fd = -1;
+    q->opts = *opts;
+    if (q->opts.tries < 1) {
+        q->opts.tries = 1;
+    }
+    q->func = func;
+    q->user_data = user_data;
+    memcpy(&q->server, server, server_len);
+    q->server_len = server_len;
+    q->qtype = type;
+    q->tcp = opts->tcp;
+
+    if (dns_query_encode(q, name) < 0) {
+        int err = errno;
+        dns_query_release(q);
+        errno = err;
+        return -1;
+    }
+    // Our own question in presentation form, to check the answer against
+    dns_read_name(q->query + 2, q->query_len, 12, q->qname, sizeof(q->qname));
+
+    q->id = e->next_id++;
+    if (e->next_id <= 0) {
+        e->next_id = 1;
+    }
+    if (dns_query_send(e, q, slot) < 0) {
+        int err = errno;
+        dns_query_release(q);
+        errno = err;
+        return -1;
+    }
+    dns_arm_timer(e);
+    return q->id;
+}
+
+// Final outcome: the query is gone before the callback runs, so the
+// callback is free to start or cancel others
+static void dns_query_finish(DnsQuery *q, DnsStatus status, int error, const DnsMessage *m) {
+    DnsResult r;
+
+    memset(&r, 0, sizeof(r));
+    r.query = q->id;
+    r.status = status;
+    r.error = error;
+    r.tcp = q->tcp;
+    r.attempt = q->attempt;
+    r.rtt_ns = dns_clock_ns() - q->sent_ns;
+    r.message = m;
+
+    DnsResultFunc func = q->func;
+    void *user_data = q->user_data;
+    dns_query_release(q);
+    func(&r, user_data);
+}
+
+// Progress notice; the query has already been resent
+static void dns_query_progress(DnsQuery *q) {
+    DnsResult r;
+
+    memset(&r, 0, sizeof(r));
+    r.query = q->id;
+    r.status = DNS_RETRYING;
+    r.tcp = q->tcp;
+    r.attempt = q->attempt;
+    q->func(&r, q->user_data);
+}
+
+static void dns_query_resend(DnsEngine *e, DnsQuery *q, int slot) {
+    if (dns_query_send(e, q, slot) < 0) {
+        dns_query_finish(q, DNS_FAILED, errno, NULL);
+        return;
+    }
+    dns_query_progress(q);
+}
+
+// An answer to this query, or something to ignore (late, forged or
+// stray); FORMERR and friends may come without the question
+static int dns_reply_matches(const DnsQuery *q, const DnsMessage *m) {
+    if (m->id != q->txid || !(m->flags & DNS_FLAG_QR)) {
+        return 0;
+    }
+    if (m->qdcount == 0) {
+        return m->rcode != 0;
+    }
+    return m->qtype == q->qtype && strcasecmp(m->qname, q->qname) == 0;
+}
+
+static void dns_handle_reply(DnsEngine *e, DnsQuery *q, int slot, const unsigned char *data, int size) {
+    DnsMessage m;
+
+    if (dns_message_parse(&m, data, size) < 0) {
+        if (q->tcp) {
+            dns_query_finish(q, DNS_BAD_REPLY, 0, NULL);
+        }
+        return;
+    }
+    if (!dns_reply_matches(q, &m)) {
+        if (q->tcp) {
+            dns_query_finish(q, DNS_BAD_REPLY, 0, NULL);
+        }
+        dns_message_free(&m);
+        return;
+    }
+
+    if ((m.flags & DNS_FLAG_TC) && !q->tcp) {
+        // Truncated: ask again over TCP
+        dns_message_free(&m);
+        close(q->fd);
+        q->fd = -1;
+        q->tcp = 1;
+        dns_query_resend(e, q, slot);
+        return;
+    }
+    if (m.rcode == 1 && q->opts.edns && !m.edns) {
+        // FORMERR without OPT: a server that predates EDNS
+        char qname[DNS_NAME_MAX];
+        dns_message_free(&m);
+        q->opts.edns = 0;
+        strcpy(qname, q->qname);
+        if (dns_query_encode(q, qname) < 0) {
+            dns_query_finish(q, DNS_FAILED, errno, NULL);
+            return;
+        }
+        dns_query_resend(e, q, slot);
+        return;
+    }
+
+    dns_query_finish(q, DNS_ANSWER, 0, &m);
+    dns_message_free(&m);
+}
+
+static void dns_read_udp(DnsEngine *e, int slot, int id) {
+    unsigned char buf[DNS_PACKET_MAX];
+
+    // Callbacks may finish this query or grow the array under us
+    while (slot < e->capacity && e->queries[slot].id == id) {
+        DnsQuery *q = &e->queries[slot];
+        ssize_t len = recv(q->fd, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                // ICMP port unreachable and the like
+                dns_query_finish(q, DNS_FAILED, errno, NULL);
+            }
+            return;
+        }
+        dns_handle_reply(e, q, slot, buf, len);
+    }
+}
+
+static void dns_tcp_io(DnsEngine *e, DnsQuery *q, int slot, uint32_t events) {
+    if (!q->connected && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(q->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (error != 0) {
+            dns_query_finish(q, DNS_FAILED, error, NULL);
+            return;
+        }
+        q->connected = 1;
+    }
+
+    if (q->connected && q->written < q->query_len + 2) {
+        ssize_t n = send(q->fd, q->query + q->written, q->query_len + 2 - q->written, MSG_NOSIGNAL);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            dns_query_finish(q, DNS_FAILED, errno, NULL);
+            return;
+        }
+        if (n > 0) {
+            q->written += n;
+        }
+        if (q->written == q->query_len + 2) {
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN;
+            ev.data.u64 = ((uint64_t)q->id << 32) | (uint32_t)slot;
+            epoll_ctl(e->epoll_fd, EPOLL_CTL_MOD, q->fd, &ev);
+        }
+    }
+
+    if (!(events & EPOLLIN) || !q->connected) {
+        return;
+    }
+    if (q->reply == NULL) {
+        q->reply = malloc(DNS_PACKET_MAX + 2);
+        if (q->reply == NULL) {
+            dns_query_finish(q, DNS_FAILED, ENOMEM, NULL);
+            return;
+        }
+    }
+
+    // Two-byte length, then the message
+    for (;;) {
+        ssize_t n = recv(q->fd, q->reply + q->reply_len, q->reply_want - q->reply_len, 0);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                dns_query_finish(q, DNS_FAILED, errno, NULL);
+            }
+            return;
+        }
+        if (n == 0) {
+            dns_query_finish(q, DNS_FAILED, ECONNRESET, NULL);
+            return;
+        }
+        q->reply_len += n;
+        if (q->reply_len < q->reply_want) {
+            continue;
+        }
+        if (q->reply_want == 2) {
+            q->reply_want = 2 + dns_get16(q->reply);
+            if (q->reply_want == 2) {
+                dns_query_finish(q, DNS_BAD_REPLY, 0, NULL);
+                return;
+            }
+            continue;
+        }
+        dns_handle_reply(e, q, slot, q->reply + 2, q->reply_len - 2);
+        return;
+    }
+}
+
+static void dns_timeouts(DnsEngine *e) {
+    int64_t now = dns_clock_ns();
+
+    for (int i = 0; i < e->capacity; i++) {
+        DnsQuery *q = &e->queries[i];
+        if (q->id == 0 || q->deadline_ns > now) {
+            continue;
+        }
+        if (!q->tcp && q->attempt < q->opts.tries) {
+            dns_query_resend(e, q, i);
+        } else {
+            dns_query_finish(q, DNS_TIMEOUT, 0, NULL);
+        }
+    }
+}
+
+int dns_engine_dispatch(DnsEngine *e) {
+    struct epoll_event events[16];
+    int n = epoll_wait(e->epoll_fd, events, 16, 0);
+
+    for (int i = 0; i < n; i++) {
+        uint64_t key = events[i].data.u64;
+        if (key == DNS_TIMER_KEY) {
+            uint64_t expirations;
+            if (read(e->timer_fd, &expirations, sizeof(expirations)) < 0) {
+                // Already drained
+            }
+            continue;
+        }
+
+        // Earlier callbacks may have finished or replaced the query
+        int slot = (int)(uint32_t)key;
+        int id = (int)(key >> 32);
+        if (slot >= e->capacity || e->queries[slot].id != id) {
+            continue;
+        }
+        DnsQuery *q = &e->queries[slot];
+        if (q->tcp) {
+            dns_tcp_io(e, q, slot, events[i].events);
+        } else {
+            dns_read_udp(e, slot, id);
+        }
+    }
+
+    dns_timeouts(e);
+    dns_arm_timer(e);
+    return n;
+}
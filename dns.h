@@ -0,0 +1,182 @@
+/*
+ * Dave's Network Inquisition - DNS client engine
+ * Website: https://prowse.tech
+ */
+
+#ifndef DNS_H
+#define DNS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define DNS_NAME_MAX 1025       // presentation form, escapes included
+#define DNS_UDP_MAX 1232        // EDNS payload size we advertise
+#define DNS_PACKET_MAX 65535
+#define DNS_QUERY_MAX 512
+
+enum {
+    DNS_TYPE_A = 1,
+    DNS_TYPE_NS = 2,
+    DNS_TYPE_CNAME = 5,
+    DNS_TYPE_SOA = 6,
+    DNS_TYPE_PTR = 12,
+    DNS_TYPE_MX = 15,
+    DNS_TYPE_TXT = 16,
+    DNS_TYPE_AAAA = 28,
+    DNS_TYPE_SRV = 33,
+    DNS_TYPE_OPT = 41,
+    DNS_TYPE_ANY = 255
+};
+
+#define DNS_CLASS_IN 1
+
+enum {
+    DNS_SECTION_ANSWER,
+    DNS_SECTION_AUTHORITY,
+    DNS_SECTION_ADDITIONAL
+};
+
+// Header flag bits as they sit in the second 16-bit word
+#define DNS_FLAG_QR 0x8000
+#define DNS_FLAG_AA 0x0400
+#define DNS_FLAG_TC 0x0200
+#define DNS_FLAG_RD 0x0100
+#define DNS_FLAG_RA 0x0080
+#define DNS_FLAG_AD 0x0020
+#define DNS_FLAG_CD 0x0010
+
+typedef struct {
+    char name[DNS_NAME_MAX];
+    int section;
+    uint16_t type;
+    uint16_t rclass;
+    uint32_t ttl;
+    uint16_t rdlength;
+    int rdata;                  // offset into the message
+} DnsRecord;
+
+// A parsed reply.  Records point back into data for their RDATA, which
+// dns_record_format() decodes.
+typedef struct {
+    unsigned char *data;
+    int size;
+    uint16_t id;
+    uint16_t flags;
+    int rcode;                  // extended with the OPT record's bits
+    int qdcount;
+    int ancount;
+    int nscount;
+    int arcount;
+    char qname[DNS_NAME_MAX];
+    uint16_t qtype;
+    uint16_t qclass;
+
+    int edns;                   // OPT record present
+    int edns_version;
+    int edns_udp_size;
+    int edns_do;
+
+    DnsRecord *records;         // answer, authority, additional; no OPT
+    int nrecords;
+} DnsMessage;
+
+typedef enum {
+    DNS_ANSWER,         // message set, whatever the rcode
+    DNS_RETRYING,       // progress only: UDP resend or TCP fallback (tcp set)
+    DNS_TIMEOUT,        // every attempt went unanswered
+    DNS_FAILED,         // socket error (error set)
+    DNS_BAD_REPLY       // reply did not parse or match the question
+} DnsStatus;
+
+typedef struct {
+    int query;
+    DnsStatus status;
+    int error;
+    int tcp;                    // this attempt or answer went over TCP
+    int attempt;                // 1-based
+    int64_t rtt_ns;             // last attempt, from send to reply
+    const DnsMessage *message;
+} DnsResult;
+
+typedef void (*DnsResultFunc)(const DnsResult *result, void *user_data);
+
+typedef struct {
+    int tcp;                    // TCP from the start
+    int edns;                   // add an OPT record
+    int recurse;                // RD bit
+    int tries;                  // UDP sends before giving up
+    int64_t timeout_ns;         // per attempt
+} DnsOptions;
+
+// One query in flight.  UDP goes out on a connected socket of its own
+// (fresh source port, kernel-filtered replies); a truncated answer moves
+// it to TCP.
+typedef struct {
+    int id;                     // 0 = free
+    DnsOptions opts;
+    DnsResultFunc func;
+    void *user_data;
+    struct sockaddr_storage server;
+    socklen_t server_len;
+
+    unsigned char query[DNS_QUERY_MAX + 2];    // TCP length prefix first
+    int query_len;
+    uint16_t txid;
+    char qname[DNS_NAME_MAX];
+    uint16_t qtype;
+
+    int fd;
+    int tcp;
+    int attempt;
+    int64_t sent_ns;
+    int64_t deadline_ns;
+
+    // TCP stream state
+    int connected;
+    int written;
+    unsigned char *reply;
+    int reply_len;
+    int reply_want;
+} DnsQuery;
+
+// Same model as the ping engine: everything runs on the caller's thread;
+// watch dns_engine_fd() and call dns_engine_dispatch() when it is readable.
+typedef struct {
+    int epoll_fd;
+    int timer_fd;
+    DnsQuery *queries;          // id 0 = free; a query keeps its index
+    int capacity;
+    int next_id;
+} DnsEngine;
+
+int dns_engine_open(DnsEngine *e);
+void dns_engine_close(DnsEngine *e);
+int dns_engine_fd(const DnsEngine *e);
+int dns_engine_dispatch(DnsEngine *e);
+
+void dns_options_default(DnsOptions *opts);
+// Returns a query id, or -1 with errno set
+int dns_query_start(DnsEngine *e, const char *name, int type, const struct sockaddr *server, socklen_t server_len,
+                    const DnsOptions *opts, DnsResultFunc func, void *user_data);
+void dns_query_cancel(DnsEngine *e, int query);
+
+// Wire format helpers, also used on their own
+int dns_encode_query(unsigned char *buf, size_t size, uint16_t id, const char *name, int type, int recurse,
+                     int edns);
+int dns_message_parse(DnsMessage *m, const unsigned char *data, int size);
+void dns_message_free(DnsMessage *m);
+const char *dns_record_format(const DnsMessage *m, const DnsRecord *r, char *buf, size_t size);
+
+// Server from /etc/resolv.conf, 127.0.0.1 if there is none
+int dns_default_server(struct sockaddr_storage *server, socklen_t *len);
+// "1.2.3.4", "2001:db8::1", "::1#5353" (dig's port syntax)
+int dns_parse_server(const char *text, struct sockaddr_storage *server, socklen_t *len);
+int dns_reverse_name(const char *address, char *buf, size_t size);
+
+int dns_type_from_string(const char *text);
+const char *dns_type_string(int type, char *buf, size_t size);
+const char *dns_rcode_string(int rcode);
+
+#endif
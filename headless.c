@@ -0,0 +1,812 @@
+/*
+ * Dave's Network Inquisition - headless collector
+ * Website: https://prowse.tech
+ *
+ * Runs the collector without GTK and streams every sample to stdout or a
+ * file, either as line-delimited JSON or as the binary records described
+ * in headless.h.  The route and address tables, ping hosts and watched
+ * DNS names are streamed alongside, from the same engines as the GUI's,
+ * all run from one poll loop.
+ */
+
+#include "headless.h"
+#include "collector.h"
+#include "dns.h"
+#include "dns-cache.h"
+#include "dns-watch.h"
+#include "nl-addr.h"
+#include "nl-route.h"
+#include "ping.h"
+#include "rrd-file.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+
+// How often the sampler ring is drained and the output flushed
+#define HEADLESS_MIN_POLL_NS 50000000LL
+
+typedef struct {
+    int ifindex;
+    char name[IF_NAMESIZE];
+} HeadlessAnnounced;
+
+typedef struct {
+    FILE *out;
+    HeadlessFormat format;
+    int error;
+
+    // Interface last announced for each stats row, to spot new rows,
+    // renames and rows taken over by another interface
+    HeadlessAnnounced *announced;
+    int announced_size;
+} HeadlessWriter;
+
+// One --ping host
+typedef struct {
+    struct HeadlessEngines *engines;
+    int index;
+    const char *host;
+    PingAddress address;
+    int session;
+} HeadlessPingTarget;
+
+// Everything besides the collector; an engine that could not be opened
+// is left out and said so on stderr
+typedef struct HeadlessEngines {
+    HeadlessWriter *w;
+    NlRoute routes;
+    int have_routes;
+    NlAddr addrs;
+    int have_addrs;
+    PingEngine ping;
+    int have_ping;
+    HeadlessPingTarget targets[HEADLESS_MAX_TARGETS];
+    int ntargets;
+    DnsEngine dns;
+    int have_dns;
+    DnsCache cache;
+    DnsWatch watch;
+    int64_t watch_next_ns;      // 0: nothing waiting
+} HeadlessEngines;
+
+static volatile sig_atomic_t headless_stop;
+
+static void headless_on_signal(int sig) {
+    (void)sig;
+    headless_stop = 1;
+}
+
+static void headless_usage(FILE *fp) {
+    fprintf(fp,
+            "Usage: network-inq --headless [options]\n"
+            "\n"
+            "  -i, --interval MS     sampling interval in milliseconds (default 1000, min 10)\n"
+            "  -f, --format FORMAT   json (default) or binary\n"
+            "  -o, --output FILE     write to FILE instead of stdout\n"
+            "  -n, --count N         stop after N polls\n"
+            "      --no-history      do not update the history files\n"
+            "      --no-routes       do not stream the routing tables\n"
+            "      --no-addresses    do not stream the interface addresses\n"
+            "  -p, --ping HOST       ping HOST and stream every probe (repeatable)\n"
+            "      --ping-interval MS  time between pings of a host (default 1000)\n"
+            "  -w, --watch NAME[/TYPE]  look NAME up each time its TTL runs out (repeatable)\n"
+            "      --dns-server ADDR  server for --watch (default: from /etc/resolv.conf)\n"
+            "  -h, --help            show this help\n");
+}
+
+int headless_parse_args(int argc, char **argv, HeadlessOptions *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->interval_ns = 1000000000LL;
+    opts->format = HEADLESS_JSON;
+    opts->history = 1;
+    opts->routes = 1;
+    opts->addresses = 1;
+    opts->ping_interval_ns = 1000000000LL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        char *end;
+
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            headless_usage(stdout);
+            exit(0);
+        } else if (strcmp(arg, "--no-history") == 0) {
+            opts->history = 0;
+            continue;
+        } else if (strcmp(arg, "--no-routes") == 0) {
+            opts->routes = 0;
+            continue;
+        } else if (strcmp(arg, "--no-addresses") == 0) {
+            opts->addresses = 0;
+            continue;
+        }
+
+        if (strcmp(arg, "-i") != 0 && strcmp(arg, "--interval") != 0 &&
+            strcmp(arg, "-f") != 0 && strcmp(arg, "--format") != 0 &&
+            strcmp(arg, "-o") != 0 && strcmp(arg, "--output") != 0 &&
+            strcmp(arg, "-n") != 0 && strcmp(arg, "--count") != 0 &&
+            strcmp(arg, "-p") != 0 && strcmp(arg, "--ping") != 0 &&
+            strcmp(arg, "--ping-interval") != 0 &&
+            strcmp(arg, "-w") != 0 && strcmp(arg, "--watch") != 0 &&
+            strcmp(arg, "--dns-server") != 0) {
+            fprintf(stderr, "network-inq: unknown option '%s'\n", arg);
+            headless_usage(stderr);
+            return -1;
+        }
+        if (value == NULL) {
+            fprintf(stderr, "network-inq: %s needs a value\n", arg);
+            return -1;
+        }
+        i++;
+
+        if (strcmp(arg, "-i") == 0 || strcmp(arg, "--interval") == 0) {
+            long ms = strtol(value, &end, 10);
+            if (*end != '\0' || ms < 10) {
+                fprintf(stderr, "network-inq: bad interval '%s'\n", value);
+                return -1;
+            }
+            opts->interval_ns = ms * 1000000LL;
+        } else if (strcmp(arg, "-f") == 0 || strcmp(arg, "--format") == 0) {
+            if (strcmp(value, "json") == 0) {
+                opts->format = HEADLESS_JSON;
+            } else if (strcmp(value, "binary") == 0) {
+                opts->format = HEADLESS_BINARY;
+            } else {
+                fprintf(stderr, "network-inq: unknown format '%s'\n", value);
+                return -1;
+            }
+        } else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+            opts->output = value;
+        } else if (strcmp(arg, "-p") == 0 || strcmp(arg, "--ping") == 0) {
+            if (opts->nping == HEADLESS_MAX_TARGETS) {
+                fprintf(stderr, "network-inq: at most %d --ping hosts\n", HEADLESS_MAX_TARGETS);
+                return -1;
+            }
+            opts->ping[opts->nping++] = value;
+        } else if (strcmp(arg, "--ping-interval") == 0) {
+            long ms = strtol(value, &end, 10);
+            if (*end != '\0' || ms < 10) {
+                fprintf(stderr, "network-inq: bad ping interval '%s'\n", value);
+                return -1;
+            }
+            opts->ping_interval_ns = ms * 1000000LL;
+        } else if (strcmp(arg, "-w") == 0 || strcmp(arg, "--watch") == 0) {
+            if (opts->nwatch == HEADLESS_MAX_TARGETS) {
+                fprintf(stderr, "network-inq: at most %d --watch names\n", HEADLESS_MAX_TARGETS);
+                return -1;
+            }
+            opts->watch[opts->nwatch++] = value;
+        } else if (strcmp(arg, "--dns-server") == 0) {
+            opts->dns_server = value;
+        } else {
+            opts->count = strtol(value, &end, 10);
+            if (*end != '\0' || opts->count < 0) {
+                fprintf(stderr, "network-inq: bad count '%s'\n", value);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void headless_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s != '\0'; s++) {
+        unsigned char ch = *s;
+        if (ch == '"' || ch == '\\') {
+            fputc('\\', out);
+            fputc(ch, out);
+        } else if (ch < 0x20) {
+            fprintf(out, "\\u%04x", ch);
+        } else {
+            fputc(ch, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void headless_write(HeadlessWriter *w, const void *record, size_t size) {
+    if (fwrite(record, size, 1, w->out) != 1) {
+        w->error = errno;
+    }
+}
+
+// Binary streams carry names out of band; returns without writing
+// anything if the row's name is already known to the reader
+static void headless_announce(HeadlessWriter *w, const Collector *c, int row) {
+    const char *name = c->stats.name[row];
+
+    if (row >= w->announced_size) {
+        int size = w->announced_size ? w->announced_size : 64;
+        while (size <= row) {
+            size *= 2;
+        }
+        void *announced = realloc(w->announced, size * sizeof(*w->announced));
+        if (announced == NULL) {
+            w->error = ENOMEM;
+            return;
+        }
+        w->announced = announced;
+        memset(&w->announced[w->announced_size], 0, (size - w->announced_size) * sizeof(*w->announced));
+        w->announced_size = size;
+    }
+
+    HeadlessAnnounced *announced = &w->announced[row];
+    if (announced->ifindex == c->stats.ifindex[row] && strncmp(announced->name, name, IF_NAMESIZE) == 0) {
+        return;
+    }
+    announced->ifindex = c->stats.ifindex[row];
+    memcpy(announced->name, name, IF_NAMESIZE);
+
+    HeadlessNameRecord record;
+    memset(&record, 0, sizeof(record));
+    record.header.type = HEADLESS_RECORD_NAME;
+    record.header.size = sizeof(record);
+    record.header.ifindex = c->stats.ifindex[row];
+    strncpy(record.name, name, IF_NAMESIZE - 1);
+    headless_write(w, &record, sizeof(record));
+}
+
+static void headless_on_sample(const Collector *c, int row, const Sample *sample, void *user_data) {
+    HeadlessWriter *w = user_data;
+    int64_t t_ns = sample->t_ns + c->stats.wall_offset_ns;
+
+    if (w->error != 0) {
+        return;
+    }
+
+    if (w->format == HEADLESS_JSON) {
+        fprintf(w->out, "{\"type\":\"sample\",\"t_ns\":%lld,\"ifindex\":%d,\"name\":", (long long)t_ns,
+                sample->ifindex);
+        headless_json_string(w->out, c->stats.name[row]);
+        fprintf(w->out, ",\"flags\":%u,\"reset\":%d,\"rx_bytes\":%llu,\"tx_bytes\":%llu,\"rx_rate\":%.1f,\"tx_rate\":%.1f",
+                sample->flags, sample->reset, (unsigned long long)sample->rx_bytes,
+                (unsigned long long)sample->tx_bytes, sample->rx_rate, sample->tx_rate);
+        for (int i = 0; i < LINK_COUNTERS; i++) {
+            fprintf(w->out, ",\"%s\":%llu,\"%s_rate\":%.1f", link_counter_names[i],
+                    (unsigned long long)sample->counters[i], link_counter_names[i], sample->rates[i]);
+        }
+        fputs("}\n", w->out);
+        if (ferror(w->out)) {
+            w->error = errno;
+        }
+        return;
+    }
+
+    headless_announce(w, c, row);
+
+    HeadlessSampleRecord record;
+    memset(&record, 0, sizeof(record));
+    record.header.type = HEADLESS_RECORD_SAMPLE;
+    record.header.size = sizeof(record);
+    record.header.ifindex = sample->ifindex;
+    record.t_ns = t_ns;
+    record.flags = sample->flags;
+    record.reset = sample->reset;
+    record.rx_bytes = sample->rx_bytes;
+    record.tx_bytes = sample->tx_bytes;
+    record.rx_rate = sample->rx_rate;
+    record.tx_rate = sample->tx_rate;
+    memcpy(record.counters, sample->counters, sizeof(record.counters));
+    memcpy(record.rates, sample->rates, sizeof(record.rates));
+    headless_write(w, &record, sizeof(record));
+}
+
+static int64_t headless_wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static const char *headless_address(int family, const void *address, char *buf, size_t size) {
+    if (inet_ntop(family, address, buf, size) == NULL) {
+        snprintf(buf, size, "?");
+    }
+    return buf;
+}
+
+// The address table follows every link already; the kernel is asked
+// only without it
+static const char *headless_ifname(const HeadlessEngines *h, int ifindex, char *buf) {
+    const AddrLink *link = h->have_addrs ? nl_addr_link(&h->addrs, ifindex) : NULL;
+
+    if (link != NULL) {
+        return link->name;
+    }
+    return if_indextoname(ifindex, buf);
+}
+
+static void headless_json_end(HeadlessWriter *w) {
+    fputs("}\n", w->out);
+    if (ferror(w->out)) {
+        w->error = errno;
+    }
+}
+
+static void on_headless_route(const NlRoute *nl, int row, int added, void *user_data) {
+    HeadlessEngines *h = user_data;
+    HeadlessWriter *w = h->w;
+    const RouteEntry *r = &nl->routes[row];
+    const RouteHop *hop = nl_route_hop(nl, r);
+    char ifname[IF_NAMESIZE];
+    char text[512];
+    char dst[INET6_ADDRSTRLEN];
+
+    if (w->error != 0) {
+        return;
+    }
+
+    if (w->format == HEADLESS_JSON) {
+        fprintf(w->out, "{\"type\":\"route\",\"t_ns\":%lld,\"event\":\"%s\",\"ifindex\":%d,\"table\":%u,\"dst\":",
+                (long long)headless_wall_ns(), added ? "add" : "del", hop->oif, r->table);
+        headless_json_string(w->out, headless_address(r->family, r->dst, dst, sizeof(dst)));
+        fprintf(w->out, ",\"dst_len\":%d,\"metric\":%u,\"text\":", r->dst_len, r->priority);
+        headless_json_string(w->out, nl_route_format(nl, r, headless_ifname(h, hop->oif, ifname), text, sizeof(text)));
+        headless_json_end(w);
+        return;
+    }
+
+    HeadlessRouteRecord record;
+    memset(&record, 0, sizeof(record));
+    record.header.type = HEADLESS_RECORD_ROUTE;
+    record.header.size = sizeof(record);
+    record.header.ifindex = hop->oif;
+    record.t_ns = headless_wall_ns();
+    record.added = added;
+    record.family = r->family;
+    record.dst_len = r->dst_len;
+    record.tos = r->tos;
+    record.protocol = r->protocol;
+    record.scope = r->scope;
+    record.type = r->type;
+    record.nexthops = r->nexthops;
+    record.table = r->table;
+    record.priority = r->priority;
+    memcpy(record.dst, r->dst, sizeof(record.dst));
+    if (hop->has_gateway) {
+        memcpy(record.gateway, hop->gateway, sizeof(record.gateway));
+    }
+    if (hop->has_prefsrc) {
+        memcpy(record.prefsrc, hop->prefsrc, sizeof(record.prefsrc));
+    }
+    headless_write(w, &record, sizeof(record));
+}
+
+static void on_headless_addr(const NlAddr *nl, int row, int added, void *user_data) {
+    HeadlessEngines *h = user_data;
+    HeadlessWriter *w = h->w;
+    const AddrEntry *a = &nl->addrs[row];
+    char text[512];
+    char address[INET6_ADDRSTRLEN];
+
+    if (w->error != 0) {
+        return;
+    }
+
+    if (w->format == HEADLESS_JSON) {
+        fprintf(w->out, "{\"type\":\"addr\",\"t_ns\":%lld,\"event\":\"%s\",\"ifindex\":%d,\"address\":",
+                (long long)headless_wall_ns(), added ? "add" : "del", a->ifindex);
+        headless_json_string(w->out, headless_address(a->family, a->address, address, sizeof(address)));
+        fprintf(w->out, ",\"prefixlen\":%d,\"text\":", a->prefixlen);
+        headless_json_string(w->out, nl_addr_format(nl, a, text, sizeof(text)));
+        headless_json_end(w);
+        return;
+    }
+
+    HeadlessAddrRecord record;
+    memset(&record, 0, sizeof(record));
+    record.header.type = HEADLESS_RECORD_ADDR;
+    record.header.size = sizeof(record);
+    record.header.ifindex = a->ifindex;
+    record.t_ns = headless_wall_ns();
+    record.added = added;
+    record.family = a->family;
+    record.prefixlen = a->prefixlen;
+    record.scope = a->scope;
+    record.flags = a->flags;
+    memcpy(record.address, a->address, sizeof(record.address));
+    if (a->has_peer) {
+        memcpy(record.peer, a->peer, sizeof(record.peer));
+    }
+    memcpy(record.label, a->label, sizeof(record.label));
+    headless_write(w, &record, sizeof(record));
+}
+
+static void on_headless_ping(const PingResult *result, void *user_data) {
+    HeadlessPingTarget *target = user_data;
+    HeadlessWriter *w = target->engines->w;
+    const PingAddress *to = &target->address;
+    const void *address = to->sa.sa_family == AF_INET6 ? (const void *)&to->v6.sin6_addr
+                                                         : (const void *)&to->v4.sin_addr;
+    static const char *status_names[] = {"reply", "timeout", "unreachable", "error"};
+    char text[INET6_ADDRSTRLEN];
+
+    if (w->error != 0 || result->status == PING_DONE) {
+        return;
+    }
+
+    if (w->format == HEADLESS_JSON) {
+        fprintf(w->out, "{\"type\":\"ping\",\"t_ns\":%lld,\"host\":", (long long)headless_wall_ns());
+        headless_json_string(w->out, target->host);
+        fputs(",\"address\":", w->out);
+        headless_json_string(w->out, headless_address(to->sa.sa_family, address, text, sizeof(text)));
+        fprintf(w->out, ",\"seq\":%d,\"status\":\"%s\"", result->seq, status_names[result->status]);
+        if (result->status == PING_REPLY) {
+            fprintf(w->out, ",\"rtt_ms\":%.3f,\"ttl\":%d", result->rtt_ns / 1e6, result->ttl);
+        } else if (result->status != PING_TIMEOUT) {
+            fputs(",\"error\":", w->out);
+            headless_json_string(w->out, ping_error_string(result));
+        }
+        headless_json_end(w);
+        return;
+    }
+
+    HeadlessPingRecord record;
+    memset(&record, 0, sizeof(record));
+    record.header.type = HEADLESS_RECORD_PING;
+    record.header.size = sizeof(record);
+    record.t_ns = headless_wall_ns();
+    record.target = target->index;
+    record.status = result->status;
+    record.seq = result->seq;
+    record.ttl = result->ttl;
+    record.rtt_ns = result->status == PING_REPLY ? result->rtt_ns : 0;
+    record.icmp_type = result->type;
+    record.icmp_code = result->code;
+    record.error = result->error;
+    record.family = to->sa.sa_family;
+    memcpy(record.address, address, to->sa.sa_family == AF_INET6 ? 16 : 4);
+    headless_write(w, &record, sizeof(record));
+}
+
+static void headless_json_lines(FILE *out, const char *key, const char **lines, int n) {
+    fprintf(out, ",\"%s\":[", key);
+    for (int i = 0; i < n; i++) {
+        if (i > 0) {
+            fputc(',', out);
+        }
+        headless_json_string(out, lines[i]);
+    }
+    fputc(']', out);
+}
+
+static void on_headless_watch(DnsWatch *watch, int item, const DnsResult *result, const DnsCacheDiff *diff,
+                              void *user_data) {
+    HeadlessEngines *h = user_data;
+    HeadlessWriter *w = h->w;
+    const DnsWatchItem *it = &watch->items[item];
+    const DnsCacheEntry *entry = it->entry >= 0 ? &h->cache.entries[it->entry] : NULL;
+    static const char *status_names[] = {"answer", "retrying", "timeout", "failed", "bad_reply"};
+    char type[16];
+
+    if (w->error != 0) {
+        return;
+    }
+
+    if (w->format == HEADLESS_JSON) {
+        fprintf(w->out, "{\"type\":\"dns\",\"t_ns\":%lld,\"name\":", (long long)headless_wall_ns());
+        headless_json_string(w->out, it->name);
+        fprintf(w->out, ",\"qtype\":\"%s\",\"status\":\"%s\",\"rtt_ms\":%.3f", dns_type_string(it->type, type, sizeof(type)),
+                status_names[result->status], result->rtt_ns / 1e6);
+        if (diff != NULL && entry != NULL) {
+            fputs(",\"rcode\":", w->out);
+            headless_json_string(w->out, dns_rcode_string(entry->rcode));
+            fprintf(w->out, ",\"ttl\":%u,\"changed\":%s", entry->ttl,
+                    dns_cache_diff_changed(diff, entry->rcode) ? "true" : "false");
+            headless_json_lines(w->out, "answer", (const char **)entry->lines, entry->nlines);
+            headless_json_lines(w->out, "added", diff->added, diff->nadded);
+            headless_json_lines(w->out, "removed", diff->removed, diff->nremoved);
+        } else if (result->status == DNS_FAILED) {
+            fputs(",\"error\":", w->out);
+            headless_json_string(w->out, strerror(result->error));
+        }
+        headless_json_end(w);
+        return;
+    }
+
+    // Padded so the next record stays 8-byte aligned
+    size_t size = (offsetof(HeadlessDnsRecord, name) + strlen(it->name) + 1 + 7) & ~(size_t)7;
+    HeadlessDnsRecord *record = calloc(1, size);
+    if (record == NULL) {
+        w->error = ENOMEM;
+        return;
+    }
+    record->header.type = HEADLESS_RECORD_DNS;
+    record->header.size = size;
+    record->t_ns = headless_wall_ns();
+    record->target = item;
+    record->status = result->status;
+    record->qtype = it->type;
+    record->rtt_ns = result->rtt_ns;
+    if (diff != NULL && entry != NULL) {
+        record->rcode = entry->rcode;
+        record->ttl = entry->ttl;
+        record->added = diff->nadded;
+        record->removed = diff->nremoved;
+    }
+    strcpy(record->name, it->name);
+    headless_write(w, record, size);
+    free(record);
+}
+
+// First address getaddrinfo has for host, at startup only
+static int headless_resolve(const char *host, PingAddress *address) {
+    struct addrinfo hints;
+    struct addrinfo *res;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_RAW;
+    int status = getaddrinfo(host, NULL, &hints, &res);
+    if (status != 0) {
+        fprintf(stderr, "network-inq: %s: %s\n", host, gai_strerror(status));
+        return -1;
+    }
+    memset(address, 0, sizeof(*address));
+    memcpy(address, res->ai_addr, res->ai_addrlen < sizeof(*address) ? res->ai_addrlen : sizeof(*address));
+    freeaddrinfo(res);
+    return 0;
+}
+
+static void headless_engines_open(HeadlessEngines *h, HeadlessWriter *w, const HeadlessOptions *opts) {
+    memset(h, 0, sizeof(*h));
+    h->w = w;
+    dns_cache_init(&h->cache);
+
+    // Addresses first, so routes can name their interfaces from its links
+    if (opts->addresses) {
+        if (nl_addr_open(&h->addrs, on_headless_addr, NULL, h) == 0) {
+            h->have_addrs = 1;
+        } else {
+            fprintf(stderr, "network-inq: addresses unavailable: %s\n", strerror(errno));
+        }
+    }
+    if (opts->routes) {
+        if (nl_route_open(&h->routes, on_headless_route, h) == 0) {
+            h->have_routes = 1;
+        } else {
+            fprintf(stderr, "network-inq: routes unavailable: %s\n", strerror(errno));
+        }
+    }
+
+    if (opts->nping > 0) {
+        if (ping_engine_open(&h->ping) == 0) {
+            h->have_ping = 1;
+        } else {
+            fprintf(stderr, "network-inq: ping unavailable: %s\n", strerror(errno));
+        }
+    }
+    for (int i = 0; h->have_ping && i < opts->nping; i++) {
+        HeadlessPingTarget *target = &h->targets[h->ntargets];
+        target->engines = h;
+        target->index = i;
+        target->host = opts->ping[i];
+        if (headless_resolve(target->host, &target->address) < 0) {
+            continue;
+        }
+        socklen_t len = target->address.sa.sa_family == AF_INET6 ? sizeof(struct sockaddr_in6)
+                                                                   : sizeof(struct sockaddr_in);
+        // Until stopped, timing out like the GUI's ping
+        target->session = ping_start(&h->ping, &target->address.sa, len, 0, opts->ping_interval_ns,
+                                     2000000000LL, on_headless_ping, target);
+        if (target->session < 0) {
+            fprintf(stderr, "network-inq: ping %s: %s\n", target->host, strerror(errno));
+            continue;
+        }
+        h->ntargets++;
+    }
+
+    if (opts->nwatch > 0) {
+        struct sockaddr_storage server;
+        socklen_t server_len;
+        int status = opts->dns_server != NULL ? dns_parse_server(opts->dns_server, &server, &server_len)
+                                              : dns_default_server(&server, &server_len);
+        if (status < 0) {
+            fprintf(stderr, "network-inq: bad DNS server '%s'\n", opts->dns_server);
+        } else if (dns_engine_open(&h->dns) < 0) {
+            fprintf(stderr, "network-inq: DNS unavailable: %s\n", strerror(errno));
+        } else {
+            h->have_dns = 1;
+            dns_watch_init(&h->watch, &h->dns, &h->cache, on_headless_watch, h);
+        }
+
+        for (int i = 0; h->have_dns && i < opts->nwatch; i++) {
+            char name[DNS_NAME_MAX];
+            int type = DNS_TYPE_A;
+            snprintf(name, sizeof(name), "%s", opts->watch[i]);
+            char *slash = strrchr(name, '/');
+            if (slash != NULL) {
+                *slash = '\0';
+                type = dns_type_from_string(slash + 1);
+            }
+            if (type <= 0 || name[0] == '\0') {
+                fprintf(stderr, "network-inq: bad watch '%s'\n", opts->watch[i]);
+                continue;
+            }
+            if (dns_watch_add(&h->watch, name, type, (struct sockaddr *)&server, server_len) < 0) {
+                fprintf(stderr, "network-inq: watch %s: %s\n", name, strerror(errno));
+            }
+        }
+    }
+}
+
+static void headless_engines_close(HeadlessEngines *h) {
+    if (h->have_dns) {
+        dns_watch_free(&h->watch);
+        dns_engine_close(&h->dns);
+    }
+    if (h->have_ping) {
+        ping_engine_close(&h->ping);
+    }
+    if (h->have_routes) {
+        nl_route_close(&h->routes);
+    }
+    if (h->have_addrs) {
+        nl_addr_close(&h->addrs);
+    }
+    dns_cache_free(&h->cache);
+}
+
+// Dispatches engine events until deadline_ns (CLOCK_MONOTONIC) or the
+// next DNS lookup is due.  A signal ends the wait early so shutdown is
+// prompt.
+static void headless_wait(HeadlessEngines *h, int64_t deadline_ns) {
+    struct pollfd fds[4];
+    int nfds = 0;
+
+    if (h->have_routes) {
+        fds[nfds++] = (struct pollfd){.fd = nl_route_fd(&h->routes), .events = POLLIN};
+    }
+    if (h->have_addrs) {
+        fds[nfds++] = (struct pollfd){.fd = nl_addr_fd(&h->addrs), .events = POLLIN};
+    }
+    if (h->have_ping) {
+        fds[nfds++] = (struct pollfd){.fd = ping_engine_fd(&h->ping), .events = POLLIN};
+    }
+    if (h->have_dns) {
+        fds[nfds++] = (struct pollfd){.fd = dns_engine_fd(&h->dns), .events = POLLIN};
+    }
+
+    if (h->watch_next_ns != 0 && h->watch_next_ns < deadline_ns) {
+        deadline_ns = h->watch_next_ns;
+    }
+    int64_t wait_ns = deadline_ns - sampler_now_ns();
+    int timeout_ms = wait_ns > 0 ? (int)((wait_ns + 999999) / 1000000) : 0;
+    if (poll(fds, nfds, timeout_ms) <= 0) {
+        return;
+    }
+
+    for (int i = 0; i < nfds; i++) {
+        if (fds[i].revents == 0) {
+            continue;
+        }
+        int fd = fds[i].fd;
+        int status = 0;
+        if (h->have_routes && fd == nl_route_fd(&h->routes)) {
+            status = nl_route_dispatch(&h->routes);
+        } else if (h->have_addrs && fd == nl_addr_fd(&h->addrs)) {
+            status = nl_addr_dispatch(&h->addrs);
+        } else if (h->have_ping && fd == ping_engine_fd(&h->ping)) {
+            status = ping_engine_dispatch(&h->ping);
+        } else if (h->have_dns) {
+            status = dns_engine_dispatch(&h->dns);
+        }
+        if (status < 0 && errno != EAGAIN && errno != EINTR) {
+            fprintf(stderr, "network-inq: event dispatch failed: %s\n", strerror(errno));
+        }
+    }
+}
+
+int headless_run(const HeadlessOptions *opts) {
+    HeadlessWriter writer;
+    Collector collector;
+    char history_dir[4096];
+    const char *history = NULL;
+    HeadlessEngines engines;
+    struct sigaction sa;
+
+    memset(&writer, 0, sizeof(writer));
+    writer.format = opts->format;
+    writer.out = stdout;
+    if (opts->output != NULL) {
+        writer.out = fopen(opts->output, opts->format == HEADLESS_BINARY ? "wb" : "w");
+        if (writer.out == NULL) {
+            fprintf(stderr, "network-inq: %s: %s\n", opts->output, strerror(errno));
+            return 1;
+        }
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = headless_on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    // A closed pipe shows up as a write error instead
+    signal(SIGPIPE, SIG_IGN);
+
+    if (opts->history) {
+        if (rrd_file_default_dir(history_dir, sizeof(history_dir)) == 0) {
+            history = history_dir;
+        } else {
+            fprintf(stderr, "network-inq: history will not be kept: %s\n", strerror(errno));
+        }
+    }
+
+    collector_init(&collector, opts->interval_ns, history);
+    // Nothing here waits on this thread, so history files open inline
+    collector_open_history(&collector);
+    if (!collector_threaded(&collector)) {
+        fprintf(stderr, "network-inq: netlink sampler unavailable, using /sys/class/net: %s\n",
+                strerror(collector.sampler_error));
+    }
+
+    if (opts->format == HEADLESS_BINARY) {
+        HeadlessStreamHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, HEADLESS_MAGIC, sizeof(HEADLESS_MAGIC));
+        header.version = HEADLESS_VERSION;
+        headless_write(&writer, &header, sizeof(header));
+    }
+
+    // With the sampler thread the ring only needs draining now and then;
+    // the sysfs fallback samples once per poll
+    int64_t period_ns = opts->interval_ns;
+    if (collector_threaded(&collector) && period_ns < HEADLESS_MIN_POLL_NS) {
+        period_ns = HEADLESS_MIN_POLL_NS;
+    }
+
+    // After the header: the tables' initial dumps are streamed as they load
+    headless_engines_open(&engines, &writer, opts);
+
+    int64_t next_ns = sampler_now_ns() + period_ns;
+    for (long polls = 0; !headless_stop && writer.error == 0 && (opts->count == 0 || polls < opts->count); ) {
+        headless_wait(&engines, next_ns);
+
+        int64_t now_ns = sampler_now_ns();
+        if (engines.have_dns) {
+            engines.watch_next_ns = dns_watch_run(&engines.watch, now_ns);
+        }
+        if (now_ns >= next_ns) {
+            collector_poll(&collector, headless_on_sample, &writer);
+            collector_open_history(&collector);
+            next_ns += period_ns;
+            if (next_ns < now_ns) {
+                next_ns = now_ns + period_ns;
+            }
+            polls++;
+        }
+        if (fflush(writer.out) != 0 && writer.error == 0) {
+            writer.error = errno;
+        }
+    }
+
+    int status = 0;
+    if (writer.error != 0 && writer.error != EPIPE) {
+        fprintf(stderr, "network-inq: write failed: %s\n", strerror(writer.error));
+        status = 1;
+    }
+
+    headless_engines_close(&engines);
+    collector_free(&collector);
+    free(writer.announced);
+    if (writer.out != stdout) {
+        fclose(writer.out);
+    }
+    return status;
+}
+
+int headless_main(int argc, char **argv) {
+    HeadlessOptions opts;
+
+    if (headless_parse_args(argc, argv, &opts) < 0) {
+        return 2;
+    }
+    return headless_run(&opts);
+}
@@ -0,0 +1,162 @@
+/*
+ * Dave's Network Inquisition - headless collector
+ * Website: https://prowse.tech
+ */
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <stdint.h>
+#include <net/if.h>
+
+#include "nl-link.h"
+
+typedef enum {
+    HEADLESS_JSON,      // one JSON object per line
+    HEADLESS_BINARY     // HeadlessStreamHeader, then records
+} HeadlessFormat;
+
+// --ping hosts and --watch names, each
+#define HEADLESS_MAX_TARGETS 64
+
+typedef struct {
+    int64_t interval_ns;
+    HeadlessFormat format;
+    const char *output;     // NULL: stdout
+    int history;            // keep the mapped history files up to date
+    long count;             // stop after this many polls, 0 = run until signalled
+    int routes;             // stream the routing tables and their changes
+    int addresses;          // stream the interface addresses and their changes
+
+    // Probes: hosts pinged every ping_interval_ns, and "name[/type]"s
+    // looked up again each time their TTL runs out
+    const char *ping[HEADLESS_MAX_TARGETS];
+    int nping;
+    int64_t ping_interval_ns;
+    const char *watch[HEADLESS_MAX_TARGETS];
+    int nwatch;
+    const char *dns_server; // NULL: from /etc/resolv.conf
+} HeadlessOptions;
+
+// Binary stream layout, host byte order.  The stream starts with a header,
+// then carries self-sized records; a reader skips types it does not know.
+// An interface's name is sent before its first sample and after a rename.
+// Routes and addresses are sent as found at startup, then as they change.
+#define HEADLESS_MAGIC "NIQSTRM"
+#define HEADLESS_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} HeadlessStreamHeader;
+
+enum {
+    HEADLESS_RECORD_NAME = 1,
+    HEADLESS_RECORD_SAMPLE = 2,
+    HEADLESS_RECORD_ROUTE = 3,
+    HEADLESS_RECORD_ADDR = 4,
+    HEADLESS_RECORD_PING = 5,
+    HEADLESS_RECORD_DNS = 6
+};
+
+typedef struct {
+    uint16_t type;
+    uint16_t size;      // whole record, header included
+    int32_t ifindex;
+} HeadlessRecordHeader;
+
+typedef struct {
+    HeadlessRecordHeader header;
+    char name[IF_NAMESIZE];
+} HeadlessNameRecord;
+
+// Fields are only ever added at the end; header.size says how many a
+// record carries
+typedef struct {
+    HeadlessRecordHeader header;
+    int64_t t_ns;           // wall clock, ns since the epoch
+    uint32_t flags;         // IFF_*
+    uint32_t reset;         // a counter was reset since the last sample
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    double rx_rate;         // bytes per second
+    double tx_rate;
+    uint64_t counters[LINK_COUNTERS];   // in LINK_* order (nl-link.h)
+    double rates[LINK_COUNTERS];        // per second
+} HeadlessSampleRecord;
+
+// A route added, replaced or removed.  header.ifindex is the output
+// interface of its (first) next hop.  Addresses are in network byte
+// order, the first 4 bytes for IPv4.
+typedef struct {
+    HeadlessRecordHeader header;
+    int64_t t_ns;           // wall clock, ns since the epoch
+    uint8_t added;          // 0: removed
+    uint8_t family;         // AF_INET or AF_INET6
+    uint8_t dst_len;
+    uint8_t tos;
+    uint8_t protocol;       // RTPROT_*
+    uint8_t scope;          // RT_SCOPE_*
+    uint8_t type;           // RTN_*
+    uint8_t nexthops;
+    uint32_t table;
+    uint32_t priority;      // metric
+    uint8_t dst[16];
+    uint8_t gateway[16];    // all zero without one
+    uint8_t prefsrc[16];    // all zero without one
+} HeadlessRouteRecord;
+
+// An address added, changed or removed; header.ifindex is its interface
+typedef struct {
+    HeadlessRecordHeader header;
+    int64_t t_ns;
+    uint8_t added;
+    uint8_t family;
+    uint8_t prefixlen;
+    uint8_t scope;
+    uint32_t flags;         // IFA_F_*
+    uint8_t address[16];
+    uint8_t peer[16];       // all zero unless point-to-point
+    char label[IF_NAMESIZE];
+} HeadlessAddrRecord;
+
+// One probe of a --ping host; header.ifindex is 0
+typedef struct {
+    HeadlessRecordHeader header;
+    int64_t t_ns;
+    uint32_t target;        // index among the --ping hosts
+    uint32_t status;        // PingStatus (ping.h)
+    int32_t seq;
+    int32_t ttl;            // -1 if unknown
+    int64_t rtt_ns;         // replies only
+    int32_t icmp_type;      // unreachable only
+    int32_t icmp_code;
+    int32_t error;          // errno, send errors only
+    uint8_t family;
+    uint8_t pad[3];
+    uint8_t address[16];    // the host's
+} HeadlessPingRecord;
+
+// One lookup of a --watch name; header.ifindex is 0.  name runs to the
+// end of the record, NUL-terminated and padded to 8 bytes.
+typedef struct {
+    HeadlessRecordHeader header;
+    int64_t t_ns;
+    uint32_t target;        // index among the --watch names
+    uint32_t status;        // DnsStatus (dns.h)
+    int32_t rcode;          // answers only
+    uint16_t qtype;
+    uint16_t pad;
+    int64_t rtt_ns;
+    uint32_t ttl;           // lowest in the answer
+    uint16_t added;         // answer lines new since the last lookup
+    uint16_t removed;       // and gone
+    char name[];
+} HeadlessDnsRecord;
+
+int headless_parse_args(int argc, char **argv, HeadlessOptions *opts);
+int headless_run(const HeadlessOptions *opts);
+int headless_main(int argc, char **argv);
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * Dave's Network Inquisition - worker thread pool
+ * Website: https://prowse.tech
+ */
+
+#include "job-pool.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Under lock.  The eventfd is only written when the list stops being
+// empty; dispatch drains it before taking the list, so a job finished in
+// between leaves it readable rather than unseen.
+static void job_pool_finish(JobPool *pool, Job *job) {
+    job->next = NULL;
+    if (pool->done_tail != NULL) {
+        pool->done_tail->next = job;
+    } else {
+        pool->done = job;
+        uint64_t one = 1;
+        if (write(pool->event_fd, &one, sizeof(one)) < 0) {
+            // Already at its maximum: readable anyway
+        }
+    }
+    pool->done_tail = job;
+}
+
+static void *job_pool_thread(void *arg) {
+    JobPool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->queue == NULL) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+
+        Job *job = pool->queue;
+        pool->queue = job->next;
+        if (pool->queue == NULL) {
+            pool->queue_tail = NULL;
+        }
+        job->next = pool->running;
+        pool->running = job;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (!job_cancelled(job)) {
+            job->work(job, job->data);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        for (Job **p = &pool->running; *p != NULL; p = &(*p)->next) {
+            if (*p == job) {
+                *p = job->next;
+                break;
+            }
+        }
+        job_pool_finish(pool, job);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int job_pool_init(JobPool *pool, int nthreads) {
+    memset(pool, 0, sizeof(*pool));
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > JOB_POOL_MAX_THREADS) nthreads = JOB_POOL_MAX_THREADS;
+
+    pool->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pool->event_fd < 0) {
+        return -1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pool->next_id = 1;
+
+    for (int i = 0; i < nthreads; i++) {
+        int err = pthread_create(&pool->threads[i], NULL, job_pool_thread, pool);
+        if (err != 0) {
+            job_pool_free(pool);
+            errno = err;
+            return -1;
+        }
+        pool->nthreads++;
+    }
+    return 0;
+}
+
+// Under lock: queued jobs go straight to the completion list, running
+// ones are told to stop early
+static void job_pool_cancel_where(JobPool *pool, uint64_t id, uint64_t key) {
+    Job **p = &pool->queue;
+    pool->queue_tail = NULL;
+    while (*p != NULL) {
+        Job *job = *p;
+        if ((id != 0 && job->id == id) || (key != 0 && job->key == key)) {
+            *p = job->next;
+            atomic_store_explicit(&job->cancelled, 1, memory_order_relaxed);
+            job_pool_finish(pool, job);
+        } else {
+            pool->queue_tail = job;
+            p = &job->next;
+        }
+    }
+
+    for (Job *job = pool->running; job != NULL; job = job->next) {
+        if ((id != 0 && job->id == id) || (key != 0 && job->key == key)) {
+            atomic_store_explicit(&job->cancelled, 1, memory_order_relaxed);
+        }
+    }
+}
+
+void job_pool_free(JobPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    for (Job *job = pool->queue; job != NULL; job = job->next) {
+        atomic_store_explicit(&job->cancelled, 1, memory_order_relaxed);
+    }
+    for (Job *job = pool->running; job != NULL; job = job->next) {
+        atomic_store_explicit(&job->cancelled, 1, memory_order_relaxed);
+    }
+    while (pool->queue != NULL) {
+        Job *job = pool->queue;
+        pool->queue = job->next;
+        job_pool_finish(pool, job);
+    }
+    pool->queue_tail = NULL;
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    job_pool_dispatch(pool);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    close(pool->event_fd);
+    memset(pool, 0, sizeof(*pool));
+    pool->event_fd = -1;
+}
+
+int job_pool_fd(const JobPool *pool) {
+    return pool->event_fd;
+}
+
+uint64_t job_submit(JobPool *pool, uint64_t key, JobWorkFunc work, JobDoneFunc done, void *data) {
+    Job *job = calloc(1, sizeof(Job));
+    if (job == NULL) {
+        errno = ENOMEM;
+        return 0;
+    }
+    job->key = key;
+    job->work = work;
+    job->done = done;
+    job->data = data;
+    atomic_init(&job->cancelled, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    if (key != 0) {
+        job_pool_cancel_where(pool, 0, key);
+    }
+    job->id = pool->next_id++;
+    if (pool->queue_tail != NULL) {
+        pool->queue_tail->next = job;
+    } else {
+        pool->queue = job;
+    }
+    pool->queue_tail = job;
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    return job->id;
+}
+
+void job_cancel(JobPool *pool, uint64_t id) {
+    if (id == 0) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    job_pool_cancel_where(pool, id, 0);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void job_cancel_key(JobPool *pool, uint64_t key) {
+    if (key == 0) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    job_pool_cancel_where(pool, 0, key);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int job_pool_dispatch(JobPool *pool) {
+    uint64_t count;
+    int n = 0;
+
+    if (read(pool->event_fd, &count, sizeof(count)) < 0) {
+        // Not readable: nothing new, but the list is checked anyway
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    Job *job = pool->done;
+    pool->done = NULL;
+    pool->done_tail = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    // Callbacks run unlocked, so they may submit or cancel
+    while (job != NULL) {
+        Job *next = job->next;
+        job->done(job->data, job_cancelled(job));
+        free(job);
+        job = next;
+        n++;
+    }
+    return n;
+}
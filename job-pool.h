@@ -0,0 +1,80 @@
+/*
+ * Dave's Network Inquisition - worker thread pool
+ * Website: https://prowse.tech
+ */
+
+#ifndef JOB_POOL_H
+#define JOB_POOL_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define JOB_POOL_MAX_THREADS 8
+
+typedef struct Job Job;
+
+// work runs on a worker thread and must not touch anything the owner's
+// thread uses meanwhile.  done runs afterwards on the thread that calls
+// job_pool_dispatch, exactly once per job, so it is where results are
+// applied and data is freed.  cancelled: the job was cancelled or
+// superseded, and work may not have run at all.
+typedef void (*JobWorkFunc)(Job *job, void *data);
+typedef void (*JobDoneFunc)(void *data, int cancelled);
+
+struct Job {
+    uint64_t id;
+    uint64_t key;               // 0 = none
+    JobWorkFunc work;
+    JobDoneFunc done;
+    void *data;
+    atomic_int cancelled;
+    Job *next;
+};
+
+// Jobs wait in a FIFO for one of a fixed set of threads; finished ones
+// collect on a completion list, and an eventfd is readable while it is
+// not empty, so the owner's event loop needs one fd watch to hear about
+// every job.
+typedef struct {
+    pthread_t threads[JOB_POOL_MAX_THREADS];
+    int nthreads;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int stop;
+
+    // Each job is on exactly one list, all under lock
+    Job *queue;
+    Job *queue_tail;
+    Job *running;
+    Job *done;
+    Job *done_tail;
+
+    int event_fd;
+    uint64_t next_id;
+} JobPool;
+
+int job_pool_init(JobPool *pool, int nthreads);
+// Cancels everything, waits for running work to return and runs every
+// done callback still owed
+void job_pool_free(JobPool *pool);
+int job_pool_fd(const JobPool *pool);
+
+// With a key, jobs still queued or running under the same key are
+// cancelled first: only the newest result for a key is ever applied.
+// Returns the job's id, or 0 with errno set (done will not be called).
+uint64_t job_submit(JobPool *pool, uint64_t key, JobWorkFunc work, JobDoneFunc done, void *data);
+// Unknown or finished ids are ignored
+void job_cancel(JobPool *pool, uint64_t id);
+void job_cancel_key(JobPool *pool, uint64_t key);
+
+// For long work to poll, and stop early
+static inline int job_cancelled(const Job *job) {
+    return atomic_load_explicit(&job->cancelled, memory_order_relaxed);
+}
+
+// Runs the done callbacks of every job finished so far, in order of
+// completion.  Returns how many ran.
+int job_pool_dispatch(JobPool *pool);
+
+#endif
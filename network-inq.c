@@ -5,38 +5,172 @@
  */
 
 #include <gtk/gtk.h>
+#include <glib-unix.h>
 #include <vte/vte.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <net/if.h>
-#include <ifaddrs.h>
 #include <netdb.h>
 #include <time.h>
 #include <pthread.h>
+#include <errno.h>
+#include <linux/rtnetlink.h>
+
+#include "collector.h"
+#include "decimate.h"
+#include "dns.h"
+#include "dns-bench.h"
+#include "dns-cache.h"
+#include "dns-watch.h"
+#include "headless.h"
+#include "job-pool.h"
+#include "ping.h"
+#include "nl-addr.h"
+#include "nl-route.h"
+#include "output-log.h"
+#include "ping-targets.h"
+#include "route-lpm.h"
+#include "route-view.h"
+#include "rrd-file.h"
+#include "rtt-hist.h"
+#include "softnet.h"
+
+typedef struct PingSweep PingSweep;
+typedef struct PingMonitor PingMonitor;
+typedef struct DigWatch DigWatch;
+typedef struct SoftnetView SoftnetView;
+typedef struct _RouteModel RouteModel;
+typedef struct _AddrModel AddrModel;
+typedef struct _LogModel LogModel;
+
+#define GRAPH_CHUNK_SAMPLES 32
+// Enough for a whole ring, so even at 10 ms only the newest samples are
+// stroked each frame
+#define GRAPH_MAX_CHUNKS (STATS_HISTORY_LEN / GRAPH_CHUNK_SAMPLES + 2)
+
+// A run of live samples stroked once into a render node
+typedef struct {
+    GskRenderNode *node;
+    int64_t last_t;             // newest sample in it
+} GraphChunk;
+
+// The render node path's layers.  Finished runs of samples are kept as
+// nodes in whole pixels from origin_px and moved into place with a
+// transform, so only the newest run is stroked on each frame; the GPU
+// renderer can reuse whatever it uploaded for the rest.
+typedef struct {
+    GskRenderNode *background;
+    int width;
+    int height;
+    
+    gboolean valid;
+    int ifindex;
+    int series;
+    int64_t window_ns;
+    double scale;
+    double series_scale;
+    int64_t origin_px;
+    int64_t last_t;             // last sample in a chunk
+    double dash_offset[2];      // where the overlay's dashes left off there
+    GraphChunk chunks[GRAPH_MAX_CHUNKS];
+    int chunk_count;
+    
+    GskRenderNode *legend[2];
+} GraphNodes;
+
+// Offscreen layers behind the bandwidth graph when it is drawn with Cairo
+// (on the Cairo renderer).  The background and grid only change with the
+// size.  In live mode the plot only changes at its
+// right edge: it is scrolled by whole pixels as samples arrive and only
+// the new segments are stroked, for as long as the interface, window and
+// scale stay the same.
+typedef struct {
+    cairo_surface_t *background;
+    cairo_surface_t *plot[2];   // shown, and the spare it is scrolled into
+    int width;
+    int height;
+    double device_scale;
+    
+    // What plot[0] shows; valid is cleared whenever it is not a live plot
+    gboolean valid;
+    int ifindex;
+    int series;
+    int64_t window_ns;
+    double scale;
+    double series_scale;
+    int64_t end_px;             // last sample's time in whole pixels
+    int64_t last_t;             // last sample drawn
+    double dash_offset[2];      // where the overlay's dashes left off
+    int reduced[STATS_HISTORY_LEN];     // graph_line_reduce's samples
+    
+    // Legend lines, shaped again only when their text changes
+    PangoLayout *legend[2];
+    char legend_text[2][512];
+    
+    GraphNodes nodes;           // the same when it is drawn as render nodes
+    
+    // Frame times since the last report, shown as the graph's tooltip
+    int frames;
+    int scrolled;
+    int64_t frame_us;
+    int64_t report_us;
+} GraphCache;
+
+// The selected interface's 1 s archive as rates in a min/max pyramid, so
+// a long window costs a couple of buckets per pixel column instead of a
+// decode of every sample.  It is caught up a slice at a time from where
+// the last frame left off.
+typedef struct {
+    DecimPyramid pyramid;
+    int ifindex;                // 0: nothing decoded yet
+    int64_t prev_t;             // last sample decoded, ms
+    uint64_t prev[2];
+} GraphArchive;
+
+// Lines a PING or DIG panel keeps, per entry of its Keep menu
+#define OUTPUT_KEEP_DEFAULT 1
+static const uint64_t output_keep_lines[] = {10000, 100000, 1000000};
+
+// A PING or DIG panel's output: a bounded log shown through a list view,
+// which only has widgets for the rows on screen
+typedef struct {
+    OutputLog log;
+    LogModel *model;
+    GtkWidget *list;
+    GtkSingleSelection *selection;
+    GtkWidget *search;
+    int64_t found;              // line of the last match, -1 for none
+} OutputPane;
 
 // Structure to hold application state
 typedef struct {
     GtkWidget *window;
-    GtkWidget *ip_info_text;
     GtkWidget *ip_info_frame;
-    GtkWidget *route_info_text;
+    GtkWidget *route_search;
+    GtkWidget *route_status;
+    GtkWidget *route_lookup_entry;
+    GtkWidget *route_lookup_result;
     GtkWidget *route_info_frame;
     GtkWidget *ping_entry;
-    GtkWidget *ping_output;
+    OutputPane ping_output;
     GtkWidget *ping_button;
     GtkWidget *ping_frame;
     GtkWidget *dig_entry;
-    GtkWidget *dig_output;
+    OutputPane dig_output;
     GtkWidget *dig_button;
     GtkWidget *dig_frame;
     GtkWidget *network_graph;
     GtkWidget *graph_frame;
     GtkWidget *interface_dropdown;
+    GtkWidget *rate_dropdown;
+    GtkWidget *window_dropdown;
+    GtkWidget *series_dropdown;
     GtkWidget *terminal_left;
     GtkWidget *terminal_right;
     GtkWidget *terminal_frame;
@@ -46,17 +180,69 @@ typedef struct {
     GtkWidget *row1_box;
     GtkWidget *row2_box;
     
-    // Network statistics
-    unsigned long long prev_rx_bytes;
-    unsigned long long prev_tx_bytes;
-    unsigned long long total_rx_bytes;
-    unsigned long long total_tx_bytes;
-    char selected_interface[64];
-    
-    // Graph data (60 data points for 60 seconds)
-    double rx_data[60];
-    double tx_data[60];
-    int graph_position;
+    // Blocking work (file reads, mostly) runs on these threads; what they
+    // finish is applied on this one, from a single fd watch
+    JobPool jobs;
+    
+    // Data layer (every interface is sampled, the graph shows one)
+    Collector collector;
+    CollectorSysfs graph_sysfs; // sysfs fallback pass being read
+    gboolean graph_sysfs_busy;
+    int selected_ifindex;
+    GArray *iface_order;        // ifindex of each interface_dropdown entry, ascending
+    
+    // Graph time range: 0 = live history ring, otherwise a span of the
+    // long-term tiers ending now
+    int64_t graph_window_ns;
+    int64_t graph_last_second;
+    int graph_series;           // STATS_SERIES_* drawn over the throughput, -1 for none
+    GraphCache graph_cache;
+    GraphArchive graph_archive;
+    SoftnetView *softnet;       // CPU heatmap window, NULL when closed
+    RrdPoint *rrd_points;
+    
+    // Interface addresses, kept current from netlink notifications; NULL
+    // if netlink could not be opened.  addr_order holds the rows in the
+    // pane's order, which addr_model presents to the list.
+    NlAddr *addrs;
+    GArray *addr_order;         // int rows, sorted with nl_addr_compare
+    AddrModel *addr_model;
+    int addr_batch_changes;     // in the dispatch under way
+    int addr_batch_shown;       // rows the list last heard of, once deferred
+    
+    // Routing tables, kept current from netlink notifications; NULL if
+    // netlink could not be opened.  The route pane lists route_view
+    // through route_model, which only formats the rows on screen.
+    NlRoute *routes;
+    RouteView route_view;
+    RouteModel *route_model;
+    GHashTable *route_ifnames;  // ifindex -> name
+    guint route_filter_idle;
+    guint route_watch;          // route socket, 0 while batches run
+    int route_batches;          // @file lookups on workers; the table holds still
+    RouteLpm route_lpm;         // lookups; nl is NULL when unavailable
+    
+    // ICMP engine behind the PING panel, opened on first use
+    PingEngine *ping;
+    int ping_session;
+    char ping_host[256];
+    GCancellable *ping_lookup;
+    PingSweep *sweep;           // sweep window, NULL when closed
+    PingMonitor *monitor;       // monitor window, NULL when closed
+    GtkWidget *ping_monitor_check;
+    
+    // DNS client behind the DIG panel, opened on first use
+    DnsEngine *dns;
+    int dig_query;
+    struct sockaddr_storage dig_server;
+    socklen_t dig_server_len;
+    DnsBench *dig_bench;        // +bench run, NULL when idle
+    uint64_t dig_bench_job;     // its query file still loading, 0 once running
+    guint dig_bench_timer;
+    uint64_t dig_bench_last_sent;
+    DnsCache dns_cache;         // last answer per name, type and server
+    DigWatch *watch;            // watch window, NULL when closed
+    GtkWidget *dig_watch_check;
     
     // Terminal font sizes
     double terminal_font_scale_left;
@@ -69,25 +255,178 @@ typedef struct {
     gboolean ping_maximized;
     gboolean dig_maximized;
     
-    guint refresh_timer;
     guint graph_timer;
     guint terminal_visibility_check;
 } AppData;
 
+// One sweep target as shown in the sweep window's table
+typedef enum {
+    SWEEP_UP,
+    SWEEP_DOWN,
+    SWEEP_PENDING
+} SweepState;
+
+#define SWEEP_TYPE_ROW (sweep_row_get_type())
+G_DECLARE_FINAL_TYPE(SweepRow, sweep_row, SWEEP, ROW, GObject)
+
+struct _SweepRow {
+    GObject parent_instance;
+    const PingAddress *address;
+    SweepState state;
+    int64_t rtt_ns;
+    const char *reason;         // static ICMP error text, or NULL
+    gboolean dirty;
+};
+
+// The bandwidth graph.  On a GPU renderer it is built from render nodes
+// that are kept across frames; on the Cairo renderer, which rasterizes in
+// software either way, it is painted as a drawing area would be, from
+// layers it scrolls itself.
+#define GRAPH_TYPE_VIEW (graph_view_get_type())
+G_DECLARE_FINAL_TYPE(GraphView, graph_view, GRAPH, VIEW, GtkWidget)
+
+struct _GraphView {
+    GtkWidget parent_instance;
+    AppData *app;
+};
+
+// The address pane's list: addr_order seen as a GListModel of strings
+#define ADDR_TYPE_MODEL (addr_model_get_type())
+G_DECLARE_FINAL_TYPE(AddrModel, addr_model, ADDR, MODEL, GObject)
+
+struct _AddrModel {
+    GObject parent_instance;
+    AppData *app;
+};
+
+// Address changes in one dispatch passed on one at a time; past this the
+// list is told it was replaced once the dispatch is done
+#define ADDR_EAGER_LIMIT 64
+
+// The route pane's list: route_view seen as a GListModel of strings
+#define ROUTE_TYPE_MODEL (route_model_get_type())
+G_DECLARE_FINAL_TYPE(RouteModel, route_model, ROUTE, MODEL, GObject)
+
+struct _RouteModel {
+    GObject parent_instance;
+    AppData *app;
+};
+
+// A panel's output log seen as a GListModel of strings
+#define LOG_TYPE_MODEL (log_model_get_type())
+G_DECLARE_FINAL_TYPE(LogModel, log_model, LOG, MODEL, GObject)
+
+struct _LogModel {
+    GObject parent_instance;
+    OutputPane *pane;
+};
+
+// Sweep window state; results are folded into the rows as they arrive and
+// the table is refreshed from the dirty list a few times a second
+struct PingSweep {
+    AppData *app;
+    GtkWidget *window;
+    GtkWidget *summary;
+    GtkSorter *sorters[3];      // address, status, RTT
+    PingTargets targets;
+    SweepRow **rows;
+    GPtrArray *dirty;
+    char spec[256];
+    int session;
+    int rounds;
+    int up;
+    int down;
+    int64_t started_us;
+    int64_t finished_us;
+    guint refresh_timer;
+};
+
+// One host in the monitor window; RTTs go into fixed-size histograms
+typedef struct {
+    PingMonitor *monitor;
+    char host[256];
+    char address[INET6_ADDRSTRLEN];
+    int session;
+    GCancellable *lookup;
+    RttMonitor rtt;
+} MonitorTarget;
+
+// Continuous pings to any number of hosts with a live percentile table
+struct PingMonitor {
+    AppData *app;
+    GtkWidget *window;
+    GtkWidget *table;
+    GtkWidget *window_dropdown;
+    GPtrArray *targets;         // MonitorTarget, owned
+    guint refresh_timer;
+};
+
+// DNS names re-resolved as their answers expire.  The table is redrawn
+// only when an answer came in; the log gets changes, not full answers.
+struct DigWatch {
+    AppData *app;
+    GtkWidget *window;
+    GtkWidget *table;
+    GtkWidget *log;
+    DnsWatch watch;
+    guint timer;                // one-shot, for the next item due
+    int64_t timer_due_ns;
+    gboolean dirty;
+    guint refresh_timer;
+};
+
+// Per-CPU softnet and NIC interrupt rates as heatmaps (CPU by time),
+// sampled at 10 Hz while the window is open
+struct SoftnetView {
+    AppData *app;
+    GtkWidget *window;
+    GtkWidget *area;
+    GtkWidget *metric_dropdown;
+    Softnet softnet;
+    cairo_surface_t *image;     // one pixel per CPU and column
+    guint timer;
+    uint64_t job;               // read in flight, 0 when none
+    gboolean follow;            // the interface changed during it
+    gboolean closed;            // window gone; the read's done frees the view
+};
+
+// Keys of jobs where only the newest request counts
+enum {
+    JOB_KEY_ROUTE_LOOKUP = 1,   // single or @file: the label shows the newest
+    JOB_KEY_SWEEP,
+};
+
 // Function prototypes
 static void activate(GtkApplication *app, gpointer user_data);
-static void update_ip_info(AppData *data);
-static void update_route_info(AppData *data);
+static gboolean on_jobs_ready(gint fd, GIOCondition condition, gpointer user_data);
+static void on_addr_change(const NlAddr *nl, int row, int added, void *user_data);
+static void interface_list_update(AppData *data, int ifindex, const char *name);
+static void on_addr_link_change(const NlAddr *nl, int ifindex, void *user_data);
+static gboolean on_addr_ready(gint fd, GIOCondition condition, gpointer user_data);
+static guint addr_rows_shown(AppData *data);
+static void addr_end_batch(AppData *data);
+static void update_route_status(AppData *data);
 static void on_ping_clicked(GtkButton *button, gpointer user_data);
 static void on_ping_activate(GtkEntry *entry, gpointer user_data);
 static void on_dig_clicked(GtkButton *button, gpointer user_data);
 static void on_dig_activate(GtkEntry *entry, gpointer user_data);
-static gboolean refresh_network_info(gpointer user_data);
+static gboolean on_route_ready(gint fd, GIOCondition condition, gpointer user_data);
+static void on_route_change(const NlRoute *nl, int row, int added, void *user_data);
+static void on_route_view_changed(int position, int removed, int added, void *user_data);
+static const char *route_ifname(int ifindex, void *user_data);
+static void on_route_search_changed(GtkSearchEntry *entry, gpointer user_data);
+static void on_route_lookup_activate(GtkEntry *entry, gpointer user_data);
+static void route_setup_row(GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data);
+static void route_bind_row(GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data);
+static void output_pane_init(OutputPane *pane, GtkWidget *box, const char *search_text);
 static gboolean update_network_graph(gpointer user_data);
-static void network_graph_draw(GtkDrawingArea *area, cairo_t *cr, int width, int height, gpointer user_data);
-static void get_interface_stats(const char *interface, unsigned long long *rx_bytes, unsigned long long *tx_bytes);
+static GtkWidget *graph_view_new(AppData *data);
 static void populate_interface_dropdown(AppData *data);
 static void on_interface_changed(GtkDropDown *dropdown, GParamSpec *pspec, gpointer user_data);
+static void on_rate_changed(GtkDropDown *dropdown, GParamSpec *pspec, gpointer user_data);
+static void on_window_changed(GtkDropDown *dropdown, GParamSpec *pspec, gpointer user_data);
+static void on_series_changed(GtkDropDown *dropdown, GParamSpec *pspec, gpointer user_data);
+static void on_softnet_clicked(GtkButton *button, gpointer user_data);
 static void flash_button_green(GtkWidget *button);
 static gboolean reset_button_style(gpointer button);
 static void on_graph_double_click(GtkGestureClick *gesture, int n_press, double x, double y, gpointer user_data);
@@ -106,6 +445,11 @@ int main(int argc, char **argv) {
     GtkApplication *app;
     int status;
     
+    // No display needed: the collector runs without any widgets
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0) {
+        return headless_main(argc - 1, argv + 1);
+    }
+    
     app = gtk_application_new("org.prowse.network-inquisition", G_APPLICATION_DEFAULT_FLAGS);
     g_signal_connect(app, "activate", G_CALLBACK(activate), NULL);
     status = g_application_run(G_APPLICATION(app), argc, argv);
@@ -116,6 +460,12 @@ int main(int argc, char **argv) {
 
 static void activate(GtkApplication *app, gpointer user_data) {
     AppData *data = g_new0(AppData, 1);
+    dns_cache_init(&data->dns_cache);
+    
+    if (job_pool_init(&data->jobs, 4) < 0) {
+        g_error("cannot start worker threads: %s", g_strerror(errno));
+    }
+    g_unix_fd_add(job_pool_fd(&data->jobs), G_IO_IN, on_jobs_ready, data);
     
     // Load CSS for button styling
     GtkCssProvider *css_provider = gtk_css_provider_new();
@@ -172,10 +522,16 @@ static void activate(GtkApplication *app, gpointer user_data) {
                                    GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
     gtk_frame_set_child(GTK_FRAME(ip_frame), ip_scroll);
     
-    data->ip_info_text = gtk_text_view_new();
-    gtk_text_view_set_editable(GTK_TEXT_VIEW(data->ip_info_text), FALSE);
-    gtk_text_view_set_monospace(GTK_TEXT_VIEW(data->ip_info_text), TRUE);
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(ip_scroll), data->ip_info_text);
+    // One row per address; an event only touches the rows it changed
+    data->addr_model = g_object_new(ADDR_TYPE_MODEL, NULL);
+    data->addr_model->app = data;
+    data->addr_order = g_array_new(FALSE, FALSE, sizeof(int));
+    GtkListItemFactory *addr_factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(addr_factory, "setup", G_CALLBACK(route_setup_row), NULL);
+    g_signal_connect(addr_factory, "bind", G_CALLBACK(route_bind_row), NULL);
+    GtkNoSelection *addr_selection = gtk_no_selection_new(g_object_ref(G_LIST_MODEL(data->addr_model)));
+    GtkWidget *addr_list = gtk_list_view_new(GTK_SELECTION_MODEL(addr_selection), addr_factory);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(ip_scroll), addr_list);
     
     // IP Route Info
     GtkWidget *route_frame = gtk_frame_new("🗺️ IP ROUTE INFO");
@@ -189,15 +545,46 @@ static void activate(GtkApplication *app, gpointer user_data) {
     g_signal_connect(route_click_gesture, "pressed", G_CALLBACK(on_route_info_double_click), data);
     gtk_widget_add_controller(route_frame, GTK_EVENT_CONTROLLER(route_click_gesture));
     
+    GtkWidget *route_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_frame_set_child(GTK_FRAME(route_frame), route_box);
+    
+    data->route_search = gtk_search_entry_new();
+    gtk_search_entry_set_placeholder_text(GTK_SEARCH_ENTRY(data->route_search), "Filter routes");
+    g_signal_connect(data->route_search, "search-changed", G_CALLBACK(on_route_search_changed), data);
+    gtk_box_append(GTK_BOX(route_box), data->route_search);
+    
     GtkWidget *route_scroll = gtk_scrolled_window_new();
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(route_scroll),
                                    GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
-    gtk_frame_set_child(GTK_FRAME(route_frame), route_scroll);
-    
-    data->route_info_text = gtk_text_view_new();
-    gtk_text_view_set_editable(GTK_TEXT_VIEW(data->route_info_text), FALSE);
-    gtk_text_view_set_monospace(GTK_TEXT_VIEW(data->route_info_text), TRUE);
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(route_scroll), data->route_info_text);
+    gtk_widget_set_vexpand(route_scroll, TRUE);
+    gtk_box_append(GTK_BOX(route_box), route_scroll);
+    
+    // Only the rows on screen have widgets and formatted text, so a full
+    // Internet table scrolls like a short one
+    data->route_model = g_object_new(ROUTE_TYPE_MODEL, NULL);
+    data->route_model->app = data;
+    GtkListItemFactory *route_factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(route_factory, "setup", G_CALLBACK(route_setup_row), NULL);
+    g_signal_connect(route_factory, "bind", G_CALLBACK(route_bind_row), NULL);
+    GtkNoSelection *route_selection = gtk_no_selection_new(g_object_ref(G_LIST_MODEL(data->route_model)));
+    GtkWidget *route_list = gtk_list_view_new(GTK_SELECTION_MODEL(route_selection), route_factory);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(route_scroll), route_list);
+    
+    data->route_status = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(data->route_status), 0.0);
+    gtk_box_append(GTK_BOX(route_box), data->route_status);
+    
+    data->route_lookup_entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(data->route_lookup_entry), "Route lookup: address or @file");
+    g_signal_connect(data->route_lookup_entry, "activate", G_CALLBACK(on_route_lookup_activate), data);
+    gtk_box_append(GTK_BOX(route_box), data->route_lookup_entry);
+    
+    data->route_lookup_result = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(data->route_lookup_result), 0.0);
+    gtk_label_set_wrap(GTK_LABEL(data->route_lookup_result), TRUE);
+    gtk_label_set_selectable(GTK_LABEL(data->route_lookup_result), TRUE);
+    gtk_widget_add_css_class(data->route_lookup_result, "monospace");
+    gtk_box_append(GTK_BOX(route_box), data->route_lookup_result);
     
     // ROW 2 & 3: PING/DIG and Graph in a paned widget (resizable)
     GtkWidget *paned = gtk_paned_new(GTK_ORIENTATION_VERTICAL);
@@ -242,21 +629,15 @@ static void activate(GtkApplication *app, gpointer user_data) {
     g_signal_connect(data->ping_entry, "activate", G_CALLBACK(on_ping_activate), data);
     gtk_box_append(GTK_BOX(ping_input_box), data->ping_entry);
     
+    // Monitor mode keeps pinging and shows latency percentiles instead
+    data->ping_monitor_check = gtk_check_button_new_with_label("Monitor");
+    gtk_box_append(GTK_BOX(ping_input_box), data->ping_monitor_check);
+    
     data->ping_button = gtk_button_new_with_label("GO");
     g_signal_connect(data->ping_button, "clicked", G_CALLBACK(on_ping_clicked), data);
     gtk_box_append(GTK_BOX(ping_input_box), data->ping_button);
     
-    GtkWidget *ping_scroll = gtk_scrolled_window_new();
-    gtk_widget_set_vexpand(ping_scroll, TRUE);
-    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(ping_scroll),
-                                   GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
-    gtk_box_append(GTK_BOX(ping_vbox), ping_scroll);
-    
-    data->ping_output = gtk_text_view_new();
-    gtk_text_view_set_editable(GTK_TEXT_VIEW(data->ping_output), FALSE);
-    gtk_text_view_set_monospace(GTK_TEXT_VIEW(data->ping_output), TRUE);
-    gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(data->ping_output), GTK_WRAP_WORD);
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(ping_scroll), data->ping_output);
+    output_pane_init(&data->ping_output, ping_vbox, "Find in ping output");
     
     // DIG Tool (on right)
     GtkWidget *dig_frame = gtk_frame_new("🔍 DIG");
@@ -286,21 +667,15 @@ static void activate(GtkApplication *app, gpointer user_data) {
     g_signal_connect(data->dig_entry, "activate", G_CALLBACK(on_dig_activate), data);
     gtk_box_append(GTK_BOX(dig_input_box), data->dig_entry);
     
+    // Watch mode re-resolves the names as they expire and logs changes
+    data->dig_watch_check = gtk_check_button_new_with_label("Watch");
+    gtk_box_append(GTK_BOX(dig_input_box), data->dig_watch_check);
+    
     data->dig_button = gtk_button_new_with_label("GO");
     g_signal_connect(data->dig_button, "clicked", G_CALLBACK(on_dig_clicked), data);
     gtk_box_append(GTK_BOX(dig_input_box), data->dig_button);
     
-    GtkWidget *dig_scroll = gtk_scrolled_window_new();
-    gtk_widget_set_vexpand(dig_scroll, TRUE);
-    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(dig_scroll),
-                                   GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
-    gtk_box_append(GTK_BOX(dig_vbox), dig_scroll);
-    
-    data->dig_output = gtk_text_view_new();
-    gtk_text_view_set_editable(GTK_TEXT_VIEW(data->dig_output), FALSE);
-    gtk_text_view_set_monospace(GTK_TEXT_VIEW(data->dig_output), TRUE);
-    gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(data->dig_output), GTK_WRAP_WORD);
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(dig_scroll), data->dig_output);
+    output_pane_init(&data->dig_output, dig_vbox, "Find in dig output");
     
     // Bottom pane of paned: Network Send/Receive Graph
     GtkWidget *graph_frame = gtk_frame_new("📊 Network SEND/RECEIVE");
@@ -334,20 +709,79 @@ static void activate(GtkApplication *app, gpointer user_data) {
     GtkWidget *interface_label = gtk_label_new("Interface:");
     gtk_box_append(GTK_BOX(interface_box), interface_label);
     
-    // Create string list for interfaces
+    // Kept in step with link events, one entry at a time (see
+    // interface_list_update); typing in the popup narrows a long list
     GtkStringList *string_list = gtk_string_list_new(NULL);
+    data->iface_order = g_array_new(FALSE, FALSE, sizeof(int));
     data->interface_dropdown = gtk_drop_down_new(G_LIST_MODEL(string_list), NULL);
+    gtk_drop_down_set_expression(GTK_DROP_DOWN(data->interface_dropdown),
+                                 gtk_property_expression_new(GTK_TYPE_STRING_OBJECT, NULL, "string"));
+    gtk_drop_down_set_enable_search(GTK_DROP_DOWN(data->interface_dropdown), TRUE);
+#if GTK_CHECK_VERSION(4, 12, 0)
+    gtk_drop_down_set_search_match_mode(GTK_DROP_DOWN(data->interface_dropdown),
+                                        GTK_STRING_FILTER_MATCH_MODE_SUBSTRING);
+#endif
     gtk_widget_set_hexpand(data->interface_dropdown, FALSE);
     g_signal_connect(data->interface_dropdown, "notify::selected", G_CALLBACK(on_interface_changed), data);
     gtk_box_append(GTK_BOX(interface_box), data->interface_dropdown);
     
-    populate_interface_dropdown(data);
+    // Sampling rate selector (10 ms is the fastest the sampler allows)
+    GtkWidget *rate_label = gtk_label_new("Rate:");
+    gtk_widget_set_margin_start(rate_label, 10);
+    gtk_box_append(GTK_BOX(interface_box), rate_label);
+    
+    const char *rates[] = {"1 s", "100 ms", "50 ms", "20 ms", "10 ms", NULL};
+    data->rate_dropdown = gtk_drop_down_new_from_strings(rates);
+    g_signal_connect(data->rate_dropdown, "notify::selected", G_CALLBACK(on_rate_changed), data);
+    gtk_box_append(GTK_BOX(interface_box), data->rate_dropdown);
+    
+    // Time range selector: the live ring or the consolidated history tiers
+    GtkWidget *window_label = gtk_label_new("Window:");
+    gtk_widget_set_margin_start(window_label, 10);
+    gtk_box_append(GTK_BOX(interface_box), window_label);
+    
+    const char *windows[] = {"Live", "10 min", "1 hour", "6 hours", "24 hours", "7 days", "30 days", NULL};
+    data->window_dropdown = gtk_drop_down_new_from_strings(windows);
+    g_signal_connect(data->window_dropdown, "notify::selected", G_CALLBACK(on_window_changed), data);
+    gtk_box_append(GTK_BOX(interface_box), data->window_dropdown);
+    data->rrd_points = g_new(RrdPoint, RRD_MAX_SLOTS + 1);
+    
+    // Packet, drop or error rates over the throughput (live window)
+    GtkWidget *series_label = gtk_label_new("Show:");
+    gtk_widget_set_margin_start(series_label, 10);
+    gtk_box_append(GTK_BOX(interface_box), series_label);
+    
+    const char *series[] = {"Throughput", "+ Packets/s", "+ Drops/s", "+ Errors/s", NULL};
+    data->graph_series = -1;
+    data->series_dropdown = gtk_drop_down_new_from_strings(series);
+    g_signal_connect(data->series_dropdown, "notify::selected", G_CALLBACK(on_series_changed), data);
+    gtk_box_append(GTK_BOX(interface_box), data->series_dropdown);
+    
+    // Where the packets are handled: softirq load and queue interrupts per CPU
+    GtkWidget *softnet_button = gtk_button_new_with_label("CPUs");
+    gtk_widget_set_margin_start(softnet_button, 10);
+    g_signal_connect(softnet_button, "clicked", G_CALLBACK(on_softnet_clicked), data);
+    gtk_box_append(GTK_BOX(interface_box), softnet_button);
+    
+    // Long-term history lives in mapped files, so it is back on screen as
+    // soon as they are mapped (graph_open_history)
+    char history_dir[4096];
+    const char *history = history_dir;
+    if (rrd_file_default_dir(history_dir, sizeof(history_dir)) < 0) {
+        g_warning("history will not be kept: %s", g_strerror(errno));
+        history = NULL;
+    }
+    
+    // Sampler thread for the graph (falls back to sysfs if netlink is unavailable)
+    collector_init(&data->collector, 1000000000LL, history);
+    if (!collector_threaded(&data->collector)) {
+        g_warning("netlink sampler unavailable, using /sys/class/net: %s", g_strerror(data->collector.sampler_error));
+        gtk_widget_set_sensitive(data->rate_dropdown, FALSE);
+    }
     
     // Drawing area for graph
-    data->network_graph = gtk_drawing_area_new();
+    data->network_graph = graph_view_new(data);
     gtk_widget_set_vexpand(data->network_graph, TRUE);
-    gtk_drawing_area_set_draw_func(GTK_DRAWING_AREA(data->network_graph),
-                                   network_graph_draw, data, NULL);
     gtk_box_append(GTK_BOX(graph_vbox), data->network_graph);
     
     // Add color key for graph
@@ -363,15 +797,6 @@ static void activate(GtkApplication *app, gpointer user_data) {
     GtkWidget *tx_label = gtk_label_new("🟥 TX (Upload)");
     gtk_box_append(GTK_BOX(key_box), tx_label);
     
-    // Initialize graph data
-    for (int i = 0; i < 60; i++) {
-        data->rx_data[i] = 0.0;
-        data->tx_data[i] = 0.0;
-    }
-    data->graph_position = 0;
-    data->total_rx_bytes = 0;
-    data->total_tx_bytes = 0;
-    
     // Initialize maximization states
     data->graph_maximized = FALSE;
     data->ip_info_maximized = FALSE;
@@ -487,414 +912,4048 @@ static void activate(GtkApplication *app, gpointer user_data) {
     gtk_widget_set_visible(data->terminal_button_bar, FALSE);
     
     // Initial updates
-    update_ip_info(data);
-    update_route_info(data);
+    data->addrs = g_new0(NlAddr, 1);
+    if (nl_addr_open(data->addrs, on_addr_change, on_addr_link_change, data) < 0) {
+        g_warning("interface addresses unavailable: %s", g_strerror(errno));
+        // Drop whatever a dump that failed half way reported
+        guint shown = addr_rows_shown(data);
+        g_array_set_size(data->addr_order, 0);
+        data->addr_batch_changes = 0;
+        g_list_model_items_changed(G_LIST_MODEL(data->addr_model), 0, shown, 0);
+        g_clear_pointer(&data->addrs, g_free);
+    } else {
+        addr_end_batch(data);
+        g_unix_fd_add(nl_addr_fd(data->addrs), G_IO_IN, on_addr_ready, data);
+    }
+    populate_interface_dropdown(data);
+    data->routes = g_new0(NlRoute, 1);
+    data->route_ifnames = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    if (nl_route_open(data->routes, on_route_change, data) < 0) {
+        g_warning("route table unavailable: %s", g_strerror(errno));
+        g_clear_pointer(&data->routes, g_free);
+    } else if (route_view_init(&data->route_view, data->routes, route_ifname, on_route_view_changed, data) < 0) {
+        g_warning("route table unavailable: %s", g_strerror(ENOMEM));
+        nl_route_close(data->routes);
+        g_clear_pointer(&data->routes, g_free);
+    } else {
+        g_list_model_items_changed(G_LIST_MODEL(data->route_model), 0, 0, route_view_len(&data->route_view));
+        data->route_watch = g_unix_fd_add(nl_route_fd(data->routes), G_IO_IN, on_route_ready, data);
+        if (route_lpm_init(&data->route_lpm, data->routes) < 0) {
+            g_warning("route lookups unavailable: %s", g_strerror(errno));
+        }
+    }
+    gtk_widget_set_sensitive(data->route_search, data->routes != NULL);
+    gtk_widget_set_sensitive(data->route_lookup_entry, data->route_lpm.nl != NULL);
+    update_route_status(data);
     
     // Set up timers
-    data->refresh_timer = g_timeout_add_seconds(30, refresh_network_info, data);
-    data->graph_timer = g_timeout_add_seconds(1, update_network_graph, data);
+    if (collector_threaded(&data->collector)) {
+        // Drain the sampler ring at roughly frame rate
+        data->graph_timer = g_timeout_add(50, update_network_graph, data);
+    } else {
+        data->graph_timer = g_timeout_add_seconds(1, update_network_graph, data);
+    }
     data->terminal_visibility_check = g_timeout_add(500, check_terminal_visibility, data);
     
     gtk_window_present(GTK_WINDOW(data->window));
 }
 
-static void update_ip_info(AppData *data) {
-    struct ifaddrs *ifaddr, *ifa;
-    char host[256];
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(data->ip_info_text));
-    GString *output = g_string_new("");
+// Done callbacks of every job finished since the last wakeup, in one go
+static gboolean on_jobs_ready(gint fd, GIOCondition condition, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
     
-    if (getifaddrs(&ifaddr) == -1) {
-        g_string_append(output, "Error getting interface information\n");
-    } else {
-        for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
-            if (ifa->ifa_addr == NULL)
-                continue;
-            
-            int family = ifa->ifa_addr->sa_family;
-            
-            if (family == AF_INET) {
-                if (getnameinfo(ifa->ifa_addr, sizeof(struct sockaddr_in),
-                               host, sizeof(host), NULL, 0, NI_NUMERICHOST) == 0) {
-                    g_string_append_printf(output, "Interface: %s\n", ifa->ifa_name);
-                    g_string_append_printf(output, "  IPv4: %s\n\n", host);
-                }
-            }
+    job_pool_dispatch(&data->jobs);
+    return G_SOURCE_CONTINUE;
+}
+
+// First position in addr_order whose address sorts at or after a
+static guint addr_order_search(AppData *data, const AddrEntry *a) {
+    const int *rows = (const int *)data->addr_order->data;
+    guint lo = 0;
+    guint hi = data->addr_order->len;
+    
+    while (lo < hi) {
+        guint mid = (lo + hi) / 2;
+        if (nl_addr_compare(&data->addrs->addrs[rows[mid]], a) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
-        freeifaddrs(ifaddr);
     }
-    
-    gtk_text_buffer_set_text(buffer, output->str, -1);
-    g_string_free(output, TRUE);
+    return lo;
 }
 
-static void update_route_info(AppData *data) {
-    FILE *fp;
-    char line[512];
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(data->route_info_text));
-    GString *output = g_string_new("");
+static void addr_items_changed(AppData *data, guint position, guint removed, guint added) {
+    if (data->addr_batch_changes++ < ADDR_EAGER_LIMIT) {
+        g_list_model_items_changed(G_LIST_MODEL(data->addr_model), position, removed, added);
+    }
+}
+
+// Called by the engine (the initial dump included) with the row already
+// updated; a removed row keeps its key until the dispatch returns
+static void on_addr_change(const NlAddr *nl, int row, int added, void *user_data) {
+    AppData *data = (AppData *)user_data;
+    const AddrEntry *a = &nl->addrs[row];
+    guint position = addr_order_search(data, a);
+    gboolean present = position < data->addr_order->len &&
+                       g_array_index(data->addr_order, int, position) == row;
     
-    fp = popen("ip route show", "r");
-    if (fp == NULL) {
-        g_string_append(output, "Error getting route information\n");
-    } else {
-        while (fgets(line, sizeof(line), fp) != NULL) {
-            g_string_append(output, line);
+    if (data->addr_batch_changes == ADDR_EAGER_LIMIT) {
+        data->addr_batch_shown = data->addr_order->len;
+    }
+    if (!added) {
+        if (present) {
+            g_array_remove_index(data->addr_order, position);
+            addr_items_changed(data, position, 1, 0);
         }
-        pclose(fp);
+    } else if (present) {
+        addr_items_changed(data, position, 1, 1);
+    } else {
+        g_array_insert_val(data->addr_order, position, row);
+        addr_items_changed(data, position, 0, 1);
     }
-    
-    gtk_text_buffer_set_text(buffer, output->str, -1);
-    g_string_free(output, TRUE);
 }
 
-static void on_dig_activate(GtkEntry *entry, gpointer user_data) {
+// An interface's addresses are contiguous in the order, so a link change
+// redraws just them.  The interface list is updated from here too.
+static void on_addr_link_change(const NlAddr *nl, int ifindex, void *user_data) {
     AppData *data = (AppData *)user_data;
-    flash_button_green(data->dig_button);
-    on_dig_clicked(NULL, user_data);
+    const AddrLink *link = nl_addr_link(nl, ifindex);
+    AddrEntry key;
+    
+    interface_list_update(data, ifindex, link != NULL && !(link->flags & IFF_LOOPBACK) ? link->name : NULL);
+    
+    memset(&key, 0, sizeof(key));
+    key.ifindex = ifindex;
+    guint position = addr_order_search(data, &key);
+    guint end = position;
+    while (end < data->addr_order->len &&
+           nl->addrs[g_array_index(data->addr_order, int, end)].ifindex == ifindex) {
+        end++;
+    }
+    if (end > position) {
+        if (data->addr_batch_changes == ADDR_EAGER_LIMIT) {
+            data->addr_batch_shown = data->addr_order->len;
+        }
+        addr_items_changed(data, position, end - position, end - position);
+    }
 }
 
-static void on_dig_clicked(GtkButton *button, gpointer user_data) {
-    AppData *data = (AppData *)user_data;
-    if (button != NULL) {
-        flash_button_green(GTK_WIDGET(button));
+// Rows the list view currently knows about
+static guint addr_rows_shown(AppData *data) {
+    return data->addr_batch_changes > ADDR_EAGER_LIMIT ? (guint)data->addr_batch_shown : data->addr_order->len;
+}
+
+static void addr_end_batch(AppData *data) {
+    if (data->addr_batch_changes > ADDR_EAGER_LIMIT) {
+        g_list_model_items_changed(G_LIST_MODEL(data->addr_model), 0, data->addr_batch_shown,
+                                   data->addr_order->len);
     }
+    data->addr_batch_changes = 0;
+}
+
+// Like routes, one read's worth of address events is a batch
+static gboolean on_addr_ready(gint fd, GIOCondition condition, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
     
-    GtkEntryBuffer *buffer = gtk_entry_get_buffer(GTK_ENTRY(data->dig_entry));
-    const char *domain = gtk_entry_buffer_get_text(buffer);
-    
-    if (strlen(domain) == 0) {
-        GtkTextBuffer *output_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(data->dig_output));
-        GtkTextIter end;
-        gtk_text_buffer_get_end_iter(output_buffer, &end);
-        gtk_text_buffer_insert(output_buffer, &end, "Please enter a domain name\n", -1);
-        return;
+    int changes = nl_addr_dispatch(data->addrs);
+    if (changes < 0) {
+        g_warning("address updates failed: %s", g_strerror(errno));
     }
+    addr_end_batch(data);
+    return G_SOURCE_CONTINUE;
+}
+
+static GType addr_model_get_item_type(GListModel *list) {
+    return GTK_TYPE_STRING_OBJECT;
+}
+
+static guint addr_model_get_n_items(GListModel *list) {
+    return ADDR_MODEL(list)->app->addr_order->len;
+}
+
+static gpointer addr_model_get_item(GListModel *list, guint position) {
+    AppData *data = ADDR_MODEL(list)->app;
+    char line[512];
     
-    char command[512];
-    snprintf(command, sizeof(command), "dig %s", domain);
-    
-    FILE *fp = popen(command, "r");
-    if (fp == NULL) {
-        GtkTextBuffer *output_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(data->dig_output));
-        GtkTextIter end;
-        gtk_text_buffer_get_end_iter(output_buffer, &end);
-        gtk_text_buffer_insert(output_buffer, &end, "Error executing dig command\n", -1);
-        return;
+    if (position >= data->addr_order->len) {
+        return NULL;
     }
-    
-    GtkTextBuffer *output_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(data->dig_output));
-    GtkTextIter end;
-    
-    // Add separator and command to history
-    gtk_text_buffer_get_end_iter(output_buffer, &end);
-    char header[600];
-    snprintf(header, sizeof(header), "\n=== dig %s ===\n", domain);
-    gtk_text_buffer_insert(output_buffer, &end, header, -1);
-    
-    // Read output
-    GString *result = g_string_new("");
+    int row = g_array_index(data->addr_order, int, position);
+    return gtk_string_object_new(nl_addr_format(data->addrs, &data->addrs->addrs[row], line, sizeof(line)));
+}
+
+static void addr_model_list_init(GListModelInterface *iface) {
+    iface->get_item_type = addr_model_get_item_type;
+    iface->get_n_items = addr_model_get_n_items;
+    iface->get_item = addr_model_get_item;
+}
+
+G_DEFINE_TYPE_WITH_CODE(AddrModel, addr_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_LIST_MODEL, addr_model_list_init))
+
+static void addr_model_class_init(AddrModelClass *klass) {
+}
+
+static void addr_model_init(AddrModel *model) {
+}
+
+static GType route_model_get_item_type(GListModel *list) {
+    return GTK_TYPE_STRING_OBJECT;
+}
+
+static guint route_model_get_n_items(GListModel *list) {
+    AppData *data = ROUTE_MODEL(list)->app;
+    return data->routes != NULL ? route_view_len(&data->route_view) : 0;
+}
+
+// Rows are formatted when the list view asks for them, i.e. when they
+// scroll into sight
+static gpointer route_model_get_item(GListModel *list, guint position) {
+    AppData *data = ROUTE_MODEL(list)->app;
     char line[512];
-    while (fgets(line, sizeof(line), fp) != NULL) {
-        g_string_append(result, line);
-    }
-    pclose(fp);
-    
-    // Insert result
-    gtk_text_buffer_get_end_iter(output_buffer, &end);
-    gtk_text_buffer_insert(output_buffer, &end, result->str, -1);
-    g_string_free(result, TRUE);
-    
-    // Add separator at end
-    gtk_text_buffer_get_end_iter(output_buffer, &end);
-    gtk_text_buffer_insert(output_buffer, &end, "══════════════════════════════════════\n\n", -1);
     
-    // Scroll to end
-    GtkTextMark *mark = gtk_text_buffer_create_mark(output_buffer, NULL, &end, FALSE);
-    gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(data->dig_output), mark, 0.0, FALSE, 0.0, 0.0);
+    if (position >= route_model_get_n_items(list)) {
+        return NULL;
+    }
+    return gtk_string_object_new(route_view_format(&data->route_view, position, line, sizeof(line)));
 }
 
-static void on_ping_activate(GtkEntry *entry, gpointer user_data) {
-    AppData *data = (AppData *)user_data;
-    flash_button_green(data->ping_button);
-    on_ping_clicked(NULL, user_data);
+static void route_model_list_init(GListModelInterface *iface) {
+    iface->get_item_type = route_model_get_item_type;
+    iface->get_n_items = route_model_get_n_items;
+    iface->get_item = route_model_get_item;
 }
 
-static void on_ping_clicked(GtkButton *button, gpointer user_data) {
+G_DEFINE_TYPE_WITH_CODE(RouteModel, route_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_LIST_MODEL, route_model_list_init))
+
+static void route_model_class_init(RouteModelClass *klass) {
+}
+
+static void route_model_init(RouteModel *model) {
+}
+
+static void route_setup_row(GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data) {
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_widget_add_css_class(label, "monospace");
+    gtk_list_item_set_child(item, label);
+}
+
+static void route_bind_row(GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data) {
+    GtkWidget *label = gtk_list_item_get_child(item);
+    GtkStringObject *line = gtk_list_item_get_item(item);
+    gtk_label_set_text(GTK_LABEL(label), gtk_string_object_get_string(line));
+}
+
+// Interface names are looked up once, not once per route drawn
+static const char *route_ifname(int ifindex, void *user_data) {
     AppData *data = (AppData *)user_data;
-    if (button != NULL) {
-        flash_button_green(GTK_WIDGET(button));
-    }
-    
-    GtkEntryBuffer *buffer = gtk_entry_get_buffer(GTK_ENTRY(data->ping_entry));
-    const char *host = gtk_entry_buffer_get_text(buffer);
+    const char *name = g_hash_table_lookup(data->route_ifnames, GINT_TO_POINTER(ifindex));
     
-    if (strlen(host) == 0) {
-        GtkTextBuffer *output_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(data->ping_output));
-        GtkTextIter end;
-        gtk_text_buffer_get_end_iter(output_buffer, &end);
-        gtk_text_buffer_insert(output_buffer, &end, "Please enter a hostname or IP address\n", -1);
-        return;
+    // The address table already follows every link
+    if (name == NULL && data->addrs != NULL) {
+        const AddrLink *link = nl_addr_link(data->addrs, ifindex);
+        if (link != NULL) {
+            return link->name;
+        }
     }
+    if (name == NULL) {
+        char ifname[IF_NAMESIZE];
+        if (if_indextoname(ifindex, ifname) == NULL) {
+            return NULL;
+        }
+        name = g_strdup(ifname);
+        g_hash_table_insert(data->route_ifnames, GINT_TO_POINTER(ifindex), (gpointer)name);
+    }
+    return name;
+}
+
+// Counts under the list, or how far a new filter has got
+static void update_route_status(AppData *data) {
+    char text[256];
     
-    char command[512];
-    snprintf(command, sizeof(command), "ping -c 4 %s 2>&1", host);
-    
-    FILE *fp = popen(command, "r");
-    if (fp == NULL) {
-        GtkTextBuffer *output_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(data->ping_output));
-        GtkTextIter end;
-        gtk_text_buffer_get_end_iter(output_buffer, &end);
-        gtk_text_buffer_insert(output_buffer, &end, "Error executing ping command\n", -1);
+    if (data->routes == NULL) {
+        gtk_label_set_text(GTK_LABEL(data->route_status), "Error getting route information");
         return;
     }
     
-    GtkTextBuffer *output_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(data->ping_output));
-    GtkTextIter end;
-    
-    // Add separator and command to history
-    gtk_text_buffer_get_end_iter(output_buffer, &end);
-    char header[600];
-    snprintf(header, sizeof(header), "\n=== ping %s ===\n", host);
-    gtk_text_buffer_insert(output_buffer, &end, header, -1);
-    
-    // Read and display output line by line
-    char line[512];
-    while (fgets(line, sizeof(line), fp) != NULL) {
-        gtk_text_buffer_get_end_iter(output_buffer, &end);
-        gtk_text_buffer_insert(output_buffer, &end, line, -1);
-        
-        // Scroll to end and process GTK events to show live output
-        GtkTextMark *mark = gtk_text_buffer_get_insert(output_buffer);
-        gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(data->ping_output), mark, 0.0, FALSE, 0.0, 0.0);
-        
-        while (g_main_context_pending(NULL)) {
-            g_main_context_iteration(NULL, FALSE);
-        }
+    const RouteView *view = &data->route_view;
+    if (view->scanning) {
+        snprintf(text, sizeof(text), "Filtering… %d%%", route_view_progress(view));
+    } else if (view->filter.ntokens > 0) {
+        snprintf(text, sizeof(text), "%d of %d routes in the main table match, %d in all tables",
+                 route_view_len(view), route_view_total(view), data->routes->count);
+    } else {
+        snprintf(text, sizeof(text), "%d routes in the main table, %d in all tables",
+                 route_view_total(view), data->routes->count);
     }
-    
-    pclose(fp);
-    
-    // Add separator at end
-    gtk_text_buffer_get_end_iter(output_buffer, &end);
-    gtk_text_buffer_insert(output_buffer, &end, "══════════════════════════════════════\n\n", -1);
-    
-    // Scroll to end
-    GtkTextMark *mark = gtk_text_buffer_create_mark(output_buffer, NULL, &end, FALSE);
-    gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(data->ping_output), mark, 0.0, FALSE, 0.0, 0.0);
+    gtk_label_set_text(GTK_LABEL(data->route_status), text);
 }
 
-static gboolean refresh_network_info(gpointer user_data) {
+static void on_route_view_changed(int position, int removed, int added, void *user_data) {
     AppData *data = (AppData *)user_data;
-    update_ip_info(data);
-    update_route_info(data);
-    return G_SOURCE_CONTINUE;
+    g_list_model_items_changed(G_LIST_MODEL(data->route_model), position, removed, added);
 }
 
-static void get_interface_stats(const char *interface, unsigned long long *rx_bytes, unsigned long long *tx_bytes) {
-    char path[256];
-    FILE *fp;
-    
-    *rx_bytes = 0;
-    *tx_bytes = 0;
+// The view only exists once the initial dump is in
+static void on_route_change(const NlRoute *nl, int row, int added, void *user_data) {
+    AppData *data = (AppData *)user_data;
     
-    // Read RX bytes
-    snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/rx_bytes", interface);
-    fp = fopen(path, "r");
-    if (fp != NULL) {
-        if (fscanf(fp, "%llu", rx_bytes) != 1) {
-            *rx_bytes = 0;
-        }
-        fclose(fp);
+    if (data->route_view.nl != NULL) {
+        route_view_change(&data->route_view, row, added);
     }
-    
-    // Read TX bytes
-    snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/tx_bytes", interface);
-    fp = fopen(path, "r");
-    if (fp != NULL) {
-        if (fscanf(fp, "%llu", tx_bytes) != 1) {
-            *tx_bytes = 0;
-        }
-        fclose(fp);
+    if (data->route_lpm.nl != NULL) {
+        route_lpm_change(&data->route_lpm, row, added);
     }
 }
 
-static gboolean update_network_graph(gpointer user_data) {
+// A few milliseconds of filtering per main loop iteration, so typing
+// keeps up however many routes there are to go through
+static gboolean on_route_filter_step(gpointer user_data) {
     AppData *data = (AppData *)user_data;
     
-    if (strlen(data->selected_interface) == 0) {
+    if (route_view_step(&data->route_view, 8000000)) {
+        update_route_status(data);
         return G_SOURCE_CONTINUE;
     }
+    data->route_filter_idle = 0;
+    update_route_status(data);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_route_search_changed(GtkSearchEntry *entry, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
     
-    unsigned long long rx_bytes, tx_bytes;
-    get_interface_stats(data->selected_interface, &rx_bytes, &tx_bytes);
-    
-    // Initialize totals on first run
-    if (data->total_rx_bytes == 0 && data->total_tx_bytes == 0) {
-        data->total_rx_bytes = rx_bytes;
-        data->total_tx_bytes = tx_bytes;
+    if (data->routes == NULL) {
+        return;
     }
-    
-    // Calculate speeds (bytes per second)
-    double rx_speed = 0.0;
-    double tx_speed = 0.0;
-    
-    if (data->prev_rx_bytes > 0) {
-        rx_speed = (double)(rx_bytes - data->prev_rx_bytes);
-        tx_speed = (double)(tx_bytes - data->prev_tx_bytes);
+    route_view_set_filter(&data->route_view, gtk_editable_get_text(GTK_EDITABLE(entry)));
+    if (data->route_view.scanning && data->route_filter_idle == 0) {
+        data->route_filter_idle = g_idle_add(on_route_filter_step, data);
     }
-    
-    data->prev_rx_bytes = rx_bytes;
-    data->prev_tx_bytes = tx_bytes;
-    
-    // Update graph data
-    data->rx_data[data->graph_position] = rx_speed / 1024.0; // Convert to KB/s
-    data->tx_data[data->graph_position] = tx_speed / 1024.0;
-    data->graph_position = (data->graph_position + 1) % 60;
-    
-    // Trigger redraw
-    gtk_widget_queue_draw(data->network_graph);
-    
-    return G_SOURCE_CONTINUE;
+    update_route_status(data);
 }
 
-static void network_graph_draw(GtkDrawingArea *area, cairo_t *cr, int width, int height, gpointer user_data) {
+// Route changes are applied as they arrive.  One read's worth is a batch:
+// a burst (a BGP session coming up) reaches the list as one change.
+static gboolean on_route_ready(gint fd, GIOCondition condition, gpointer user_data) {
     AppData *data = (AppData *)user_data;
     
-    // Background
-    cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
-    cairo_rectangle(cr, 0, 0, width, height);
-    cairo_fill(cr);
-    
-    // Grid lines
-    cairo_set_source_rgba(cr, 0.3, 0.3, 0.3, 0.5);
-    cairo_set_line_width(cr, 1.0);
-    
-    for (int i = 0; i <= 5; i++) {
-        double y = (height / 5.0) * i;
-        cairo_move_to(cr, 0, y);
-        cairo_line_to(cr, width, y);
-        cairo_stroke(cr);
+    // Interfaces may have been renamed or replaced since the last look
+    g_hash_table_remove_all(data->route_ifnames);
+    route_view_begin_batch(&data->route_view);
+    int changes = nl_route_dispatch(data->routes);
+    int err = errno;
+    route_view_end_batch(&data->route_view);
+    if (data->route_lpm.nl != NULL && route_lpm_commit(&data->route_lpm) < 0) {
+        g_warning("route lookups failed: %s", g_strerror(errno));
     }
-    
-    // Find max value for scaling
-    double max_value = 1.0;
-    for (int i = 0; i < 60; i++) {
-        if (data->rx_data[i] > max_value) max_value = data->rx_data[i];
-        if (data->tx_data[i] > max_value) max_value = data->tx_data[i];
+    if (changes < 0) {
+        g_warning("route updates failed: %s", g_strerror(err));
+    } else if (changes > 0) {
+        update_route_status(data);
     }
-    max_value *= 1.2; // Add 20% headroom
-    
-    // Draw RX line (receive - green)
-    cairo_set_source_rgb(cr, 0.2, 0.8, 0.2);
-    cairo_set_line_width(cr, 2.0);
-    cairo_move_to(cr, 0, height);
-    
-    for (int i = 0; i < 60; i++) {
-        int index = (data->graph_position + i) % 60;
-        double x = (width / 60.0) * i;
-        double y = height - (data->rx_data[index] / max_value * height);
-        cairo_line_to(cr, x, y);
+    return G_SOURCE_CONTINUE;
+}
+
+// An IPv4 or IPv6 address; returns its family, 0 if it is neither
+static int route_parse_address(const char *text, unsigned char *addr) {
+    if (inet_pton(AF_INET, text, addr) == 1) {
+        return AF_INET;
     }
-    cairo_stroke(cr);
-    
-    // Draw TX line (transmit - red)
-    cairo_set_source_rgb(cr, 0.8, 0.2, 0.2);
-    cairo_set_line_width(cr, 2.0);
-    cairo_move_to(cr, 0, height);
-    
-    for (int i = 0; i < 60; i++) {
-        int index = (data->graph_position + i) % 60;
-        double x = (width / 60.0) * i;
-        double y = height - (data->tx_data[index] / max_value * height);
-        cairo_line_to(cr, x, y);
+    if (inet_pton(AF_INET6, text, addr) == 1) {
+        return AF_INET6;
+    }
+    return 0;
+}
+
+// Whether the kernel's answer (rc and errno from nl_route_query) is the route
+// the trie found.  Routes are compared by key and next hop: the kernel
+// gives the type of the destination rather than of the route, and IPv4
+// local routes come back as main.
+static gboolean route_lookup_agrees(const NlRoute *nl, int row, int rc, int err, const RouteEntry *kernel) {
+    if (rc < 0) {
+        int type = row >= 0 ? nl->routes[row].type : -1;
+        return (err == ENETUNREACH && row < 0) || (err == EINVAL && type == RTN_BLACKHOLE) ||
+               (err == EHOSTUNREACH && type == RTN_UNREACHABLE) || (err == EACCES && type == RTN_PROHIBIT);
+    }
+    if (row < 0) {
+        return FALSE;
     }
-    cairo_stroke(cr);
-    
-    // Draw legend and current values with total bytes
-    cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-    cairo_set_font_size(cr, 14);  // Increased from 12
-    
-    char legend[512];
-    int current_index = (data->graph_position - 1 + 60) % 60;
-    double total_rx_gb = data->total_rx_bytes / (1024.0 * 1024.0 * 1024.0);
-    double total_tx_gb = data->total_tx_bytes / (1024.0 * 1024.0 * 1024.0);
     
-    snprintf(legend, sizeof(legend), 
-             "↓ RX: %.2f KB/s  ↑ TX: %.2f KB/s  Max: %.2f KB/s  |  Total RX: %.2f GB  Total TX: %.2f GB",
-             data->rx_data[current_index], data->tx_data[current_index], max_value,
-             total_rx_gb, total_tx_gb);
+    const RouteEntry *r = &nl->routes[row];
+    const RouteHop *a = nl_route_hop(nl, r);
+    const RouteHop *b = nl_route_hop(nl, kernel);
+    return r->dst_len == kernel->dst_len && memcmp(r->dst, kernel->dst, sizeof(r->dst)) == 0 &&
+           r->priority == kernel->priority && a->oif == b->oif && a->has_gateway == b->has_gateway &&
+           memcmp(a->gateway, b->gateway, sizeof(a->gateway)) == 0;
+}
+
+// The trie's answer for addr, as one line
+static void route_lookup_answer(AppData *data, int family, const unsigned char *addr, int *row, char *answer,
+                                size_t size) {
+    *row = route_lpm_lookup(&data->route_lpm, family, addr);
+    if (*row >= 0) {
+        const RouteEntry *r = &data->routes->routes[*row];
+        int oif = nl_route_hop(data->routes, r)->oif;
+        nl_route_format(data->routes, r, oif != 0 ? route_ifname(oif, data) : NULL, answer, size);
+    } else {
+        snprintf(answer, size, "no route");
+    }
+}
+
+// Every lookup is checked against the kernel.  The trie's answer is
+// shown at once and the kernel is asked on a worker, so a slow netlink
+// round trip never holds up the window.
+typedef struct {
+    AppData *app;
+    char text[INET6_ADDRSTRLEN];
+    int family;
+    unsigned char addr[16];
+    int rc;                     // from nl_route_query, errno in err
+    int err;
+    RouteEntry kernel;
+    RouteHop hop;
+} RouteCheck;
+
+static void route_check_work(Job *job, void *user_data) {
+    RouteCheck *check = (RouteCheck *)user_data;
     
-    cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
-    cairo_move_to(cr, 10, 20);
-    cairo_show_text(cr, legend);
+    check->rc = nl_route_query(check->family, check->addr, &check->kernel, &check->hop);
+    check->err = errno;
 }
 
-static void populate_interface_dropdown(AppData *data) {
-    struct ifaddrs *ifaddr, *ifa;
-    GtkStringList *string_list = GTK_STRING_LIST(gtk_drop_down_get_model(GTK_DROP_DOWN(data->interface_dropdown)));
+// The trie is looked in again: routes may have changed while the kernel
+// was asked
+static void on_route_check_done(void *user_data, int cancelled) {
+    RouteCheck *check = (RouteCheck *)user_data;
+    AppData *data = check->app;
+    char answer[512];
+    char kernel_answer[512];
+    char result[1200];
+    int row;
+    
+    if (cancelled) {
+        g_free(check);
+        return;
+    }
     
-    if (getifaddrs(&ifaddr) == -1) {
+    route_lookup_answer(data, check->family, check->addr, &row, answer, sizeof(answer));
+    if (check->rc == 0 && nl_route_intern(data->routes, &check->kernel, &check->hop) < 0) {
+        check->rc = -1;
+        check->err = errno;
+    }
+    if (route_lookup_agrees(data->routes, row, check->rc, check->err, &check->kernel)) {
+        snprintf(result, sizeof(result), "%s → %s\n(the kernel agrees)", check->text, answer);
+    } else {
+        if (check->rc == 0) {
+            int oif = nl_route_hop(data->routes, &check->kernel)->oif;
+            nl_route_format(data->routes, &check->kernel, oif != 0 ? route_ifname(oif, data) : NULL,
+                            kernel_answer, sizeof(kernel_answer));
+        } else {
+            snprintf(kernel_answer, sizeof(kernel_answer), "%s", g_strerror(check->err));
+        }
+        snprintf(result, sizeof(result), "%s → %s\n(the kernel says: %s; policy rules may differ)",
+                 check->text, answer, kernel_answer);
+    }
+    gtk_label_set_text(GTK_LABEL(data->route_lookup_result), result);
+    g_free(check);
+}
+
+static void route_lookup_one(AppData *data, const char *text) {
+    unsigned char addr[16];
+    char answer[512];
+    char result[1200];
+    int family = route_parse_address(text, addr);
+    int row;
+    
+    if (family == 0) {
+        job_cancel_key(&data->jobs, JOB_KEY_ROUTE_LOOKUP);
+        snprintf(result, sizeof(result), "%s: not an IPv4 or IPv6 address", text);
+        gtk_label_set_text(GTK_LABEL(data->route_lookup_result), result);
         return;
     }
     
-    for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
-        if (ifa->ifa_addr == NULL)
-            continue;
+    route_lookup_answer(data, family, addr, &row, answer, sizeof(answer));
+    
+    RouteCheck *check = g_new0(RouteCheck, 1);
+    check->app = data;
+    g_strlcpy(check->text, text, sizeof(check->text));
+    check->family = family;
+    memcpy(check->addr, addr, sizeof(addr));
+    if (job_submit(&data->jobs, JOB_KEY_ROUTE_LOOKUP, route_check_work, on_route_check_done, check) == 0) {
+        snprintf(result, sizeof(result), "%s → %s\n(the kernel was not asked: %s)", text, answer,
+                 g_strerror(errno));
+        g_free(check);
+    } else {
+        snprintf(result, sizeof(result), "%s → %s\n(asking the kernel…)", text, answer);
+    }
+    gtk_label_set_text(GTK_LABEL(data->route_lookup_result), result);
+}
+
+static int route_hits_compare(const void *a, const void *b, void *user_data) {
+    const int *hits = user_data;
+    int x = hits[*(const int *)a];
+    int y = hits[*(const int *)b];
+    return x > y ? -1 : x < y;
+}
+
+// Batch mode: the first address on each line of a file (a flow log, say)
+// is looked up.  Reading, parsing and the lookups run on a worker; the
+// route socket is left unread meanwhile, so the tables it looks in hold
+// still, and whatever changed is caught up with afterwards.
+typedef struct {
+    AppData *app;
+    char path[1024];
+    int error;                  // errno from fopen, 0 if it opened
+    GArray *v4;
+    GArray *v6;
+    int skipped;
+    int *rows;                  // v4 then v6
+    int64_t lookups;
+    int64_t elapsed_us;
+} RouteBatch;
+
+// Parsing is kept out of the timing
+static void route_batch_work(Job *job, void *user_data) {
+    RouteBatch *batch = (RouteBatch *)user_data;
+    FILE *fp = fopen(batch->path, "r");
+    char file_line[1024];
+    
+    if (fp == NULL) {
+        batch->error = errno;
+        return;
+    }
+    
+    batch->v4 = g_array_new(FALSE, FALSE, 4);
+    batch->v6 = g_array_new(FALSE, FALSE, 16);
+    while (fgets(file_line, sizeof(file_line), fp) != NULL) {
+        unsigned char addr[16];
+        int family = 0;
+        char *save = NULL;
+        for (char *field = strtok_r(file_line, " \t,;\r\n", &save); field != NULL && family == 0;
+             field = strtok_r(NULL, " \t,;\r\n", &save)) {
+            family = route_parse_address(field, addr);
+        }
+        if (family == AF_INET) {
+            g_array_append_vals(batch->v4, addr, 1);
+        } else if (family == AF_INET6) {
+            g_array_append_vals(batch->v6, addr, 1);
+        } else {
+            batch->skipped++;
+        }
+    }
+    fclose(fp);
+    
+    const RouteLpm *lpm = &batch->app->route_lpm;
+    GArray *v4 = batch->v4;
+    GArray *v6 = batch->v6;
+    int total = v4->len + v6->len;
+    int64_t start_us = g_get_monotonic_time();
+    
+    // Passes until the clock has something to measure
+    batch->rows = g_new(int, total + 1);
+    do {
+        const unsigned char *a4 = (const unsigned char *)v4->data;
+        const unsigned char *a6 = (const unsigned char *)v6->data;
+        for (guint i = 0; i < v4->len; i++) {
+            batch->rows[i] = route_lpm_lookup(lpm, AF_INET, a4 + 4 * i);
+        }
+        for (guint i = 0; i < v6->len; i++) {
+            batch->rows[v4->len + i] = route_lpm_lookup(lpm, AF_INET6, a6 + 16 * i);
+        }
+        batch->lookups += total;
+        batch->elapsed_us = g_get_monotonic_time() - start_us;
+    } while (total > 0 && batch->elapsed_us < 100000 && !job_cancelled(job));
+}
+
+static void route_batch_show(AppData *data, RouteBatch *batch) {
+    char result[2048];
+    
+    if (batch->error != 0) {
+        snprintf(result, sizeof(result), "%s: %s", batch->path, g_strerror(batch->error));
+        gtk_label_set_text(GTK_LABEL(data->route_lookup_result), result);
+        return;
+    }
+    
+    int total = batch->v4->len + batch->v6->len;
+    int *hits = g_new0(int, data->routes->size + 1);
+    int *used = g_new(int, data->routes->size + 1);
+    int nused = 0;
+    int unrouted = 0;
+    for (int i = 0; i < total; i++) {
+        int row = batch->rows[i];
+        if (row < 0) {
+            unrouted++;
+        } else if (hits[row]++ == 0) {
+            used[nused++] = row;
+        }
+    }
+    g_qsort_with_data(used, nused, sizeof(int), route_hits_compare, hits);
+    
+    size_t o = snprintf(result, sizeof(result),
+                        "%s: %d addresses (%d lines without one), %.2f M lookups/s\n"
+                        "%d routed over %d routes, %d without a route",
+                        batch->path, total, batch->skipped,
+                        batch->elapsed_us > 0 ? batch->lookups / (double)batch->elapsed_us : 0.0,
+                        total - unrouted, nused, unrouted);
+    for (int i = 0; i < nused && i < 5 && o < sizeof(result); i++) {
+        char line[512];
+        const RouteEntry *r = &data->routes->routes[used[i]];
+        int oif = nl_route_hop(data->routes, r)->oif;
+        nl_route_format(data->routes, r, oif != 0 ? route_ifname(oif, data) : NULL, line, sizeof(line));
+        o += snprintf(result + o, sizeof(result) - o, "\n%8d  %s", hits[used[i]], line);
+    }
+    gtk_label_set_text(GTK_LABEL(data->route_lookup_result), result);
+    
+    g_free(hits);
+    g_free(used);
+}
+
+// The last batch out lets route changes in again
+static void route_batch_end(AppData *data) {
+    if (--data->route_batches == 0) {
+        data->route_watch = g_unix_fd_add(nl_route_fd(data->routes), G_IO_IN, on_route_ready, data);
+    }
+}
+
+// Rows are only shown before the table has moved on, and a newer batch
+// or single lookup cancels an older one
+static void on_route_batch_done(void *user_data, int cancelled) {
+    RouteBatch *batch = (RouteBatch *)user_data;
+    AppData *data = batch->app;
+    
+    if (!cancelled) {
+        route_batch_show(data, batch);
+    }
+    route_batch_end(data);
+    
+    g_free(batch->rows);
+    if (batch->v4 != NULL) {
+        g_array_free(batch->v4, TRUE);
+        g_array_free(batch->v6, TRUE);
+    }
+    g_free(batch);
+}
+
+static void route_lookup_file(AppData *data, const char *path) {
+    RouteBatch *batch = g_new0(RouteBatch, 1);
+    char result[1200];
+    
+    batch->app = data;
+    g_strlcpy(batch->path, path, sizeof(batch->path));
+    
+    if (data->route_batches++ == 0) {
+        g_source_remove(data->route_watch);
+        data->route_watch = 0;
+    }
+    if (job_submit(&data->jobs, JOB_KEY_ROUTE_LOOKUP, route_batch_work, on_route_batch_done, batch) == 0) {
+        snprintf(result, sizeof(result), "%s: %s", path, g_strerror(errno));
+        gtk_label_set_text(GTK_LABEL(data->route_lookup_result), result);
+        route_batch_end(data);
+        g_free(batch);
+        return;
+    }
+    snprintf(result, sizeof(result), "%s: reading…", path);
+    gtk_label_set_text(GTK_LABEL(data->route_lookup_result), result);
+}
+
+static void on_route_lookup_activate(GtkEntry *entry, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
+    char *text = g_strstrip(g_strdup(gtk_editable_get_text(GTK_EDITABLE(entry))));
+    
+    if (data->route_lpm.nl != NULL && *text != '\0') {
+        if (text[0] == '@') {
+            route_lookup_file(data, text + 1);
+        } else {
+            route_lookup_one(data, text);
+        }
+    }
+    g_free(text);
+}
+
+static GType log_model_get_item_type(GListModel *list) {
+    return GTK_TYPE_STRING_OBJECT;
+}
+
+static guint log_model_get_n_items(GListModel *list) {
+    return output_log_rows(&LOG_MODEL(list)->pane->log);
+}
+
+// As with routes, only the rows on screen are ever formatted
+static gpointer log_model_get_item(GListModel *list, guint position) {
+    OutputPane *pane = LOG_MODEL(list)->pane;
+    char line[OUTPUT_LOG_LINE_MAX + 64];
+    
+    if (position >= log_model_get_n_items(list)) {
+        return NULL;
+    }
+    return gtk_string_object_new(output_log_format(&pane->log, position, line, sizeof(line)));
+}
+
+static void log_model_list_init(GListModelInterface *iface) {
+    iface->get_item_type = log_model_get_item_type;
+    iface->get_n_items = log_model_get_n_items;
+    iface->get_item = log_model_get_item;
+}
+
+G_DEFINE_TYPE_WITH_CODE(LogModel, log_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_LIST_MODEL, log_model_list_init))
+
+static void log_model_class_init(LogModelClass *klass) {
+}
+
+static void log_model_init(LogModel *model) {
+}
+
+static void on_output_log_changed(int position, int removed, int added, void *user_data) {
+    OutputPane *pane = (OutputPane *)user_data;
+    g_list_model_items_changed(G_LIST_MODEL(pane->model), position, removed, added);
+}
+
+static void output_pane_scroll_to(OutputPane *pane, guint row) {
+#if GTK_CHECK_VERSION(4, 12, 0)
+    gtk_list_view_scroll_to(GTK_LIST_VIEW(pane->list), row, GTK_LIST_SCROLL_NONE, NULL);
+#else
+    gtk_widget_activate_action(pane->list, "list.scroll-to-item", "u", row);
+#endif
+}
+
+// Clicking a run's header folds or unfolds it.  The click is claimed, so
+// a double click folds and unfolds again rather than maximizing the panel.
+static void on_log_row_pressed(GtkGestureClick *gesture, int n_press, double x, double y, gpointer user_data) {
+    OutputPane *pane = (OutputPane *)user_data;
+    GtkListItem *item = g_object_get_data(G_OBJECT(gesture), "list-item");
+    guint position = gtk_list_item_get_position(item);
+    
+    if (position != GTK_INVALID_LIST_POSITION && output_log_toggle(&pane->log, position)) {
+        gtk_gesture_set_state(GTK_GESTURE(gesture), GTK_EVENT_SEQUENCE_CLAIMED);
+    }
+}
+
+static void log_setup_row(GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data) {
+    route_setup_row(factory, item, NULL);
+    
+    GtkGesture *click = gtk_gesture_click_new();
+    gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(click), GDK_BUTTON_PRIMARY);
+    g_object_set_data(G_OBJECT(click), "list-item", item);
+    g_signal_connect(click, "pressed", G_CALLBACK(on_log_row_pressed), user_data);
+    gtk_widget_add_controller(gtk_list_item_get_child(item), GTK_EVENT_CONTROLLER(click));
+}
+
+// Enter on a header does what a click does
+static void on_log_activate(GtkListView *list, guint position, gpointer user_data) {
+    OutputPane *pane = (OutputPane *)user_data;
+    output_log_toggle(&pane->log, position);
+}
+
+// Selects the first line with the search text from `from` on (backward:
+// the last one up to it), starting over from the other end if there is
+// none, and unfolds its run to show it
+static void output_pane_find(OutputPane *pane, int64_t from, gboolean backward) {
+    const char *needle = gtk_editable_get_text(GTK_EDITABLE(pane->search));
+    OutputLog *log = &pane->log;
+    int64_t line = -1;
+    
+    if (needle[0] != '\0' && from >= 0) {
+        line = output_log_find(log, needle, from, backward);
+    }
+    if (needle[0] != '\0' && line < 0) {
+        line = output_log_find(log, needle, backward ? log->first + log->count : log->first, backward);
+    }
+    pane->found = line;
+    
+    if (line < 0) {
+        gtk_selection_model_unselect_all(GTK_SELECTION_MODEL(pane->selection));
+        if (needle[0] != '\0') {
+            gtk_widget_add_css_class(pane->search, "error");
+        } else {
+            gtk_widget_remove_css_class(pane->search, "error");
+        }
+        return;
+    }
+    gtk_widget_remove_css_class(pane->search, "error");
+    
+    int row = output_log_reveal(log, line);
+    gtk_selection_model_select_item(GTK_SELECTION_MODEL(pane->selection), row, TRUE);
+    output_pane_scroll_to(pane, row);
+}
+
+// Typing keeps the current match while it still matches
+static void on_output_search_changed(GtkSearchEntry *entry, gpointer user_data) {
+    OutputPane *pane = (OutputPane *)user_data;
+    output_pane_find(pane, pane->found, FALSE);
+}
+
+static void on_output_next_match(GtkSearchEntry *entry, gpointer user_data) {
+    OutputPane *pane = (OutputPane *)user_data;
+    output_pane_find(pane, pane->found + 1, FALSE);
+}
+
+static void on_output_previous_match(GtkSearchEntry *entry, gpointer user_data) {
+    OutputPane *pane = (OutputPane *)user_data;
+    output_pane_find(pane, pane->found - 1, TRUE);
+}
+
+static void on_output_keep_changed(GtkDropDown *dropdown, GParamSpec *pspec, gpointer user_data) {
+    OutputPane *pane = (OutputPane *)user_data;
+    guint keep = gtk_drop_down_get_selected(dropdown);
+    
+    if (keep >= G_N_ELEMENTS(output_keep_lines)) {
+        return;
+    }
+    // Line numbers start over
+    pane->found = -1;
+    if (output_log_set_limit(&pane->log, output_keep_lines[keep]) < 0) {
+        g_warning("cannot resize the output log: %s", g_strerror(errno));
+    }
+}
+
+// The search row and the list under it
+static void output_pane_init(OutputPane *pane, GtkWidget *box, const char *search_text) {
+    GtkWidget *search_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_append(GTK_BOX(box), search_box);
+    
+    pane->found = -1;
+    pane->search = gtk_search_entry_new();
+    gtk_search_entry_set_placeholder_text(GTK_SEARCH_ENTRY(pane->search), search_text);
+    gtk_widget_set_hexpand(pane->search, TRUE);
+    g_signal_connect(pane->search, "search-changed", G_CALLBACK(on_output_search_changed), pane);
+    g_signal_connect(pane->search, "activate", G_CALLBACK(on_output_next_match), pane);
+    g_signal_connect(pane->search, "next-match", G_CALLBACK(on_output_next_match), pane);
+    g_signal_connect(pane->search, "previous-match", G_CALLBACK(on_output_previous_match), pane);
+    gtk_box_append(GTK_BOX(search_box), pane->search);
+    
+    // Retention: past it the oldest lines go, so memory and search time
+    // stop growing however long the panel runs
+    gtk_box_append(GTK_BOX(search_box), gtk_label_new("Keep:"));
+    const char *keep[] = {"10k lines", "100k lines", "1M lines", NULL};
+    GtkWidget *keep_dropdown = gtk_drop_down_new_from_strings(keep);
+    gtk_drop_down_set_selected(GTK_DROP_DOWN(keep_dropdown), OUTPUT_KEEP_DEFAULT);
+    g_signal_connect(keep_dropdown, "notify::selected", G_CALLBACK(on_output_keep_changed), pane);
+    gtk_box_append(GTK_BOX(search_box), keep_dropdown);
+    
+    GtkWidget *scroll = gtk_scrolled_window_new();
+    gtk_widget_set_vexpand(scroll, TRUE);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll),
+                                   GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_box_append(GTK_BOX(box), scroll);
+    
+    if (output_log_init(&pane->log, output_keep_lines[OUTPUT_KEEP_DEFAULT], on_output_log_changed, pane) < 0) {
+        g_error("cannot allocate the output log: %s", g_strerror(errno));
+    }
+    pane->model = g_object_new(LOG_TYPE_MODEL, NULL);
+    pane->model->pane = pane;
+    GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(factory, "setup", G_CALLBACK(log_setup_row), pane);
+    g_signal_connect(factory, "bind", G_CALLBACK(route_bind_row), NULL);
+    pane->selection = gtk_single_selection_new(g_object_ref(G_LIST_MODEL(pane->model)));
+    gtk_single_selection_set_autoselect(pane->selection, FALSE);
+    gtk_single_selection_set_can_unselect(pane->selection, TRUE);
+    pane->list = gtk_list_view_new(GTK_SELECTION_MODEL(pane->selection), factory);
+    g_signal_connect(pane->list, "activate", G_CALLBACK(on_log_activate), pane);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroll), pane->list);
+}
+
+// New output is followed only while the end of the list is in sight, so
+// reading back through a long run is not undone by the next reply
+static void output_pane_append(OutputPane *pane, const char *text) {
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(pane->list));
+    gboolean at_end = gtk_adjustment_get_value(adjustment) + gtk_adjustment_get_page_size(adjustment) >=
+                      gtk_adjustment_get_upper(adjustment) - 1.0;
+    
+    output_log_append(&pane->log, text);
+    int rows = output_log_rows(&pane->log);
+    if (at_end && rows > 0) {
+        output_pane_scroll_to(pane, rows - 1);
+    }
+}
+
+static void on_dig_activate(GtkEntry *entry, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
+    flash_button_green(data->dig_button);
+    on_dig_clicked(NULL, user_data);
+}
+
+static void dig_output_append(AppData *data, const char *text) {
+    output_pane_append(&data->dig_output, text);
+}
+
+static gboolean on_dns_ready(gint fd, GIOCondition condition, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
+    dns_engine_dispatch(data->dns);
+    return G_SOURCE_CONTINUE;
+}
+
+static void dig_format_section(GString *out, const DnsMessage *m, int section, const char *title) {
+    char rdata[4096];
+    char type[16];
+    gboolean first = TRUE;
+    
+    for (int i = 0; i < m->nrecords; i++) {
+        const DnsRecord *r = &m->records[i];
+        if (r->section != section) {
+            continue;
+        }
+        if (first) {
+            g_string_append_printf(out, "\n;; %s SECTION:\n", title);
+            first = FALSE;
+        }
+        g_string_append_printf(out, "%s\t\t%u\t", r->name, r->ttl);
+        if (r->rclass == DNS_CLASS_IN) {
+            g_string_append(out, "IN");
+        } else {
+            g_string_append_printf(out, "CLASS%u", r->rclass);
+        }
+        g_string_append_printf(out, "\t%s\t%s\n", dns_type_string(r->type, type, sizeof(type)),
+                               dns_record_format(m, r, rdata, sizeof(rdata)));
+    }
+}
+
+// Same layout as dig's default output
+static void dig_format_answer(GString *out, AppData *data, const DnsResult *result) {
+    static const struct { uint16_t flag; const char *name; } flags[] = {
+        {DNS_FLAG_QR, "qr"}, {DNS_FLAG_AA, "aa"}, {DNS_FLAG_TC, "tc"}, {DNS_FLAG_RD, "rd"},
+        {DNS_FLAG_RA, "ra"}, {DNS_FLAG_AD, "ad"}, {DNS_FLAG_CD, "cd"}
+    };
+    const DnsMessage *m = result->message;
+    char type[16];
+    char host[NI_MAXHOST];
+    char port[NI_MAXSERV];
+    time_t now = time(NULL);
+    char when[64];
+    
+    g_string_append(out, ";; Got answer:\n");
+    g_string_append_printf(out, ";; ->>HEADER<<- opcode: QUERY, status: %s, id: %u\n;; flags:",
+                           dns_rcode_string(m->rcode), m->id);
+    for (size_t i = 0; i < G_N_ELEMENTS(flags); i++) {
+        if (m->flags & flags[i].flag) {
+            g_string_append_printf(out, " %s", flags[i].name);
+        }
+    }
+    g_string_append_printf(out, "; QUERY: %d, ANSWER: %d, AUTHORITY: %d, ADDITIONAL: %d\n",
+                           m->qdcount, m->ancount, m->nscount, m->arcount);
+    
+    if (m->edns) {
+        g_string_append_printf(out, "\n;; OPT PSEUDOSECTION:\n; EDNS: version: %d, flags:%s; udp: %d\n",
+                               m->edns_version, m->edns_do ? " do" : "", m->edns_udp_size);
+    }
+    if (m->qdcount > 0) {
+        g_string_append_printf(out, "\n;; QUESTION SECTION:\n;%s\t\t\tIN\t%s\n",
+                               m->qname, dns_type_string(m->qtype, type, sizeof(type)));
+    }
+    dig_format_section(out, m, DNS_SECTION_ANSWER, "ANSWER");
+    dig_format_section(out, m, DNS_SECTION_AUTHORITY, "AUTHORITY");
+    dig_format_section(out, m, DNS_SECTION_ADDITIONAL, "ADDITIONAL");
+    
+    if (getnameinfo((struct sockaddr *)&data->dig_server, data->dig_server_len, host, sizeof(host),
+                    port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        g_strlcpy(host, "?", sizeof(host));
+        g_strlcpy(port, "?", sizeof(port));
+    }
+    strftime(when, sizeof(when), "%a %b %d %H:%M:%S %Z %Y", localtime(&now));
+    g_string_append_printf(out, "\n;; Query time: %lld msec\n;; SERVER: %s#%s(%s) (%s)\n;; WHEN: %s\n"
+                           ";; MSG SIZE  rcvd: %d\n",
+                           (long long)(result->rtt_ns / 1000000), host, port, host,
+                           result->tcp ? "TCP" : "UDP", when, m->size);
+}
+
+// What this answer changed against the last one from the same server,
+// which may have come from an earlier dig or the watch list
+static void dig_format_changes(GString *out, AppData *data, const DnsMessage *m) {
+    DnsCacheDiff diff;
+    int64_t now_ns = g_get_monotonic_time() * 1000;
+    
+    if (dns_cache_store(&data->dns_cache, m, (struct sockaddr *)&data->dig_server, data->dig_server_len,
+                        now_ns, &diff) < 0) {
+        return;
+    }
+    if (!diff.first) {
+        long long ago = (now_ns - diff.old_fetched_ns) / 1000000000LL;
+        if (!dns_cache_diff_changed(&diff, m->rcode)) {
+            g_string_append_printf(out, ";; Unchanged since the lookup %lld s ago\n", ago);
+        } else {
+            g_string_append_printf(out, ";; CHANGED since the lookup %lld s ago:\n", ago);
+            if (diff.old_rcode != m->rcode) {
+                g_string_append_printf(out, ";;   status %s -> %s\n", dns_rcode_string(diff.old_rcode),
+                                       dns_rcode_string(m->rcode));
+            }
+            for (int i = 0; i < diff.nremoved; i++) {
+                g_string_append_printf(out, ";;   - %s\n", diff.removed[i]);
+            }
+            for (int i = 0; i < diff.nadded; i++) {
+                g_string_append_printf(out, ";;   + %s\n", diff.added[i]);
+            }
+        }
+    }
+    dns_cache_diff_free(&diff);
+}
+
+static void on_dig_result(const DnsResult *result, void *user_data) {
+    AppData *data = (AppData *)user_data;
+    GString *out = g_string_new("");
+    
+    switch (result->status) {
+    case DNS_RETRYING:
+        if (result->tcp) {
+            g_string_append(out, ";; Truncated, retrying in TCP mode.\n");
+        } else {
+            g_string_append_printf(out, ";; no reply yet, sending attempt %d\n", result->attempt);
+        }
+        dig_output_append(data, out->str);
+        g_string_free(out, TRUE);
+        return;
+    case DNS_ANSWER:
+        dig_format_answer(out, data, result);
+        dig_format_changes(out, data, result->message);
+        break;
+    case DNS_TIMEOUT:
+        g_string_append(out, ";; connection timed out; no servers could be reached\n");
+        break;
+    case DNS_BAD_REPLY:
+        g_string_append(out, ";; malformed or mismatched reply\n");
+        break;
+    case DNS_FAILED:
+    default:
+        g_string_append_printf(out, ";; communications error: %s\n", g_strerror(result->error));
+        break;
+    }
+    
+    g_string_append(out, "══════════════════════════════════════\n\n");
+    dig_output_append(data, out->str);
+    g_string_free(out, TRUE);
+    data->dig_query = 0;
+}
+
+// dig-style arguments: [@server[#port]] name [type] [-x address] [+tcp]
+// [+norecurse] [+noedns]
+static int dig_parse_args(const char *text, char *name, size_t name_size, int *type,
+                          struct sockaddr_storage *server, socklen_t *server_len, DnsOptions *opts,
+                          char *error, size_t error_size) {
+    char **args = g_strsplit_set(text, " \t", -1);
+    gboolean have_server = FALSE;
+    int status = 0;
+    
+    name[0] = '\0';
+    *type = -1;
+    dns_options_default(opts);
+    
+    for (int i = 0; args[i] != NULL && status == 0; i++) {
+        const char *arg = args[i];
+        
+        if (*arg == '\0') {
+            continue;
+        } else if (arg[0] == '@') {
+            if (dns_parse_server(arg + 1, server, server_len) < 0) {
+                snprintf(error, error_size, "bad server address '%s' (IP address, optionally #port)", arg + 1);
+                status = -1;
+            }
+            have_server = TRUE;
+        } else if (strcmp(arg, "-x") == 0) {
+            if (args[i + 1] == NULL || dns_reverse_name(args[i + 1], name, name_size) < 0) {
+                snprintf(error, error_size, "-x needs an IPv4 or IPv6 address");
+                status = -1;
+            } else {
+                *type = DNS_TYPE_PTR;
+                i++;
+            }
+        } else if (strcmp(arg, "+tcp") == 0) {
+            opts->tcp = 1;
+        } else if (strcmp(arg, "+norecurse") == 0 || strcmp(arg, "+norec") == 0) {
+            opts->recurse = 0;
+        } else if (strcmp(arg, "+noedns") == 0) {
+            opts->edns = 0;
+        } else if (arg[0] == '+') {
+            snprintf(error, error_size, "unknown option '%s'", arg);
+            status = -1;
+        } else if (name[0] != '\0' && *type < 0 && dns_type_from_string(arg) > 0) {
+            *type = dns_type_from_string(arg);
+        } else if (name[0] == '\0') {
+            g_strlcpy(name, arg, name_size);
+        } else {
+            snprintf(error, error_size, "unexpected '%s'", arg);
+            status = -1;
+        }
+    }
+    g_strfreev(args);
+    
+    if (status == 0 && name[0] == '\0') {
+        snprintf(error, error_size, "no name to look up");
+        status = -1;
+    }
+    if (status == 0 && !have_server && dns_default_server(server, server_len) < 0) {
+        snprintf(error, error_size, "no DNS server found");
+        status = -1;
+    }
+    if (*type < 0) {
+        *type = DNS_TYPE_A;
+    }
+    return status;
+}
+
+// Value of a "+option=number" argument; FALSE when it is not a number
+static gboolean dig_bench_number(const char *arg, double *value) {
+    const char *text = strchr(arg, '=') + 1;
+    char *end;
+    
+    *value = g_ascii_strtod(text, &end);
+    return end != text && *end == '\0' && *value >= 0;
+}
+
+// Benchmark arguments: +bench=FILE [@server[#port]] [+qps=N] [+time=S]
+// [+concurrency=N] [+timeout=S] [+norecurse] [+noedns]
+static int dig_bench_parse_args(const char *text, char *file, size_t file_size,
+                                struct sockaddr_storage *server, socklen_t *server_len, DnsBenchOptions *opts,
+                                char *error, size_t error_size) {
+    char **args = g_strsplit_set(text, " \t", -1);
+    gboolean have_server = FALSE;
+    int status = 0;
+    double value;
+    
+    file[0] = '\0';
+    dns_bench_options_default(opts);
+    
+    for (int i = 0; args[i] != NULL && status == 0; i++) {
+        const char *arg = args[i];
+        
+        if (*arg == '\0') {
+            continue;
+        } else if (arg[0] == '@') {
+            if (dns_parse_server(arg + 1, server, server_len) < 0) {
+                snprintf(error, error_size, "bad server address '%s' (IP address, optionally #port)", arg + 1);
+                status = -1;
+            }
+            have_server = TRUE;
+        } else if (g_str_has_prefix(arg, "+bench=")) {
+            g_strlcpy(file, arg + 7, file_size);
+        } else if (strcmp(arg, "+norecurse") == 0 || strcmp(arg, "+norec") == 0) {
+            opts->recurse = 0;
+        } else if (strcmp(arg, "+noedns") == 0) {
+            opts->edns = 0;
+        } else if (!g_str_has_prefix(arg, "+") || strchr(arg, '=') == NULL) {
+            snprintf(error, error_size, "'%s' does not go with +bench", arg);
+            status = -1;
+        } else if (!dig_bench_number(arg, &value)) {
+            snprintf(error, error_size, "bad value in '%s'", arg);
+            status = -1;
+        } else if (g_str_has_prefix(arg, "+qps=")) {
+            opts->qps = (int)value;
+        } else if (g_str_has_prefix(arg, "+concurrency=") && value >= 1) {
+            opts->concurrency = (int)value;
+        } else if (g_str_has_prefix(arg, "+time=")) {
+            opts->duration_ns = (int64_t)(value * 1e9);
+        } else if (g_str_has_prefix(arg, "+timeout=") && value > 0) {
+            opts->timeout_ns = (int64_t)(value * 1e9);
+        } else {
+            snprintf(error, error_size, "unknown or out of range '%s'", arg);
+            status = -1;
+        }
+    }
+    g_strfreev(args);
+    
+    if (status == 0 && file[0] == '\0') {
+        snprintf(error, error_size, "+bench needs a query file");
+        status = -1;
+    }
+    if (status == 0 && !have_server && dns_default_server(server, server_len) < 0) {
+        snprintf(error, error_size, "no DNS server found");
+        status = -1;
+    }
+    return status;
+}
+
+// Final report: totals, rcodes, latency percentiles and a histogram with
+// one row per power of two milliseconds
+static void dig_bench_report(GString *out, const DnsBenchStats *st) {
+    const RttHist *h = &st->latency;
+    double seconds = st->elapsed_ns / 1e9;
+    
+    g_string_append_printf(out, "\n;; Run time: %.2f s, %.0f queries/s completed\n",
+                           seconds, seconds > 0 ? st->completed / seconds : 0.0);
+    g_string_append_printf(out, ";; Sent: %llu  Completed: %llu (%.2f%%)  Timed out: %llu  Send errors: %llu\n",
+                           (unsigned long long)st->sent, (unsigned long long)st->completed,
+                           st->sent > 0 ? 100.0 * st->completed / st->sent : 0.0,
+                           (unsigned long long)st->timeouts, (unsigned long long)st->send_errors);
+    
+    g_string_append(out, "\n;; Response codes:\n");
+    for (int i = 0; i < DNS_BENCH_RCODES; i++) {
+        if (st->rcodes[i] > 0) {
+            g_string_append_printf(out, ";;   %-10s %llu (%.2f%%)\n", dns_rcode_string(i),
+                                   (unsigned long long)st->rcodes[i], 100.0 * st->rcodes[i] / st->completed);
+        }
+    }
+    if (h->total == 0) {
+        return;
+    }
+    
+    g_string_append_printf(out, "\n;; Latency (ms): min %.3f  p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n",
+                           h->min_ns / 1e6, rtt_hist_quantile(h, 0.50) / 1e6, rtt_hist_quantile(h, 0.90) / 1e6,
+                           rtt_hist_quantile(h, 0.99) / 1e6, rtt_hist_quantile(h, 0.999) / 1e6, h->max_ns / 1e6);
+    
+    uint64_t below = 0;
+    int64_t low = 0;
+    for (int64_t high = 1000000; low <= h->max_ns; low = high, high *= 2) {
+        uint64_t upto = rtt_hist_count_below(h, high);
+        uint64_t count = upto - below;
+        int bar = (int)(40 * count / h->total);
+        
+        below = upto;
+        if (count == 0 && high <= h->min_ns) {
+            continue;
+        }
+        g_string_append_printf(out, ";; %6lld - %-6lld ms %8llu ", (long long)(low / 1000000),
+                               (long long)(high / 1000000), (unsigned long long)count);
+        for (int i = 0; i < bar; i++) {
+            g_string_append(out, "█");
+        }
+        g_string_append(out, count > 0 && bar == 0 ? "▏\n" : "\n");
+    }
+}
+
+static gboolean on_dig_bench_tick(gpointer user_data) {
+    AppData *data = (AppData *)user_data;
+    DnsBenchStats *st = g_new(DnsBenchStats, 1);
+    
+    dns_bench_snapshot(data->dig_bench, st);
+    if (!st->done) {
+        char line[256];
+        snprintf(line, sizeof(line), ";; %5.1f s  sent %llu (%llu/s)  completed %llu  timed out %llu  in flight %d\n",
+                 st->elapsed_ns / 1e9, (unsigned long long)st->sent,
+                 (unsigned long long)(st->sent - data->dig_bench_last_sent), (unsigned long long)st->completed,
+                 (unsigned long long)st->timeouts, st->inflight);
+        data->dig_bench_last_sent = st->sent;
+        dig_output_append(data, line);
+        g_free(st);
+        return G_SOURCE_CONTINUE;
+    }
+    
+    GString *out = g_string_new("");
+    dig_bench_report(out, st);
+    g_string_append(out, "══════════════════════════════════════\n\n");
+    dig_output_append(data, out->str);
+    g_string_free(out, TRUE);
+    g_free(st);
+    
+    dns_bench_stop(data->dig_bench);
+    g_clear_pointer(&data->dig_bench, g_free);
+    data->dig_bench_timer = 0;
+    return G_SOURCE_REMOVE;
+}
+
+// Stops a run still going and prints what it got so far
+static void dig_bench_cancel(AppData *data) {
+    // Still loading its queries: the job's done callback frees it
+    if (data->dig_bench_job != 0) {
+        job_cancel(&data->jobs, data->dig_bench_job);
+        data->dig_bench_job = 0;
+        data->dig_bench = NULL;
+        dig_output_append(data, "(stopped)\n══════════════════════════════════════\n\n");
+        return;
+    }
+    
+    DnsBenchStats *st = g_new(DnsBenchStats, 1);
+    GString *out = g_string_new("(stopped)\n");
+    
+    g_source_remove(data->dig_bench_timer);
+    data->dig_bench_timer = 0;
+    dns_bench_stop(data->dig_bench);
+    dns_bench_snapshot(data->dig_bench, st);
+    g_clear_pointer(&data->dig_bench, g_free);
+    
+    dig_bench_report(out, st);
+    g_string_append(out, "══════════════════════════════════════\n\n");
+    dig_output_append(data, out->str);
+    g_string_free(out, TRUE);
+    g_free(st);
+}
+
+// dns_bench_start reads and encodes the whole query file, so it runs on
+// a worker; the run itself has its own thread after that
+typedef struct {
+    AppData *app;
+    DnsBench *bench;
+    char file[1024];
+    struct sockaddr_storage server;
+    socklen_t server_len;
+    DnsBenchOptions opts;
+    int status;
+    char error[1200];
+} DigBenchStart;
+
+static void dig_bench_start_work(Job *job, void *user_data) {
+    DigBenchStart *start = (DigBenchStart *)user_data;
+    
+    start->status = dns_bench_start(start->bench, start->file, (struct sockaddr *)&start->server,
+                                    start->server_len, &start->opts, start->error, sizeof(start->error));
+}
+
+static void on_dig_bench_started(void *user_data, int cancelled) {
+    DigBenchStart *start = (DigBenchStart *)user_data;
+    AppData *data = start->app;
+    char line[1400];
+    char host[NI_MAXHOST];
+    char port[NI_MAXSERV];
+    char rate[32];
+    char length[32];
+    
+    // Stopped while loading; (stopped) was printed then
+    if (cancelled) {
+        if (start->status == 0) {
+            dns_bench_stop(start->bench);
+        }
+        g_free(start->bench);
+        g_free(start);
+        return;
+    }
+    data->dig_bench_job = 0;
+    
+    if (start->status < 0) {
+        snprintf(line, sizeof(line), "dig: %s\n══════════════════════════════════════\n\n", start->error);
+        dig_output_append(data, line);
+        g_clear_pointer(&data->dig_bench, g_free);
+        g_free(start);
+        return;
+    }
+    
+    if (getnameinfo((struct sockaddr *)&start->server, start->server_len, host, sizeof(host),
+                    port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        g_strlcpy(host, "?", sizeof(host));
+        g_strlcpy(port, "?", sizeof(port));
+    }
+    if (start->opts.qps > 0) {
+        snprintf(rate, sizeof(rate), "%d/s", start->opts.qps);
+    } else {
+        g_strlcpy(rate, "no rate limit", sizeof(rate));
+    }
+    if (start->opts.duration_ns > 0) {
+        snprintf(length, sizeof(length), "looping for %g s", start->opts.duration_ns / 1e9);
+    } else {
+        g_strlcpy(length, "one pass", sizeof(length));
+    }
+    snprintf(line, sizeof(line), ";; %d queries from %s against %s#%s, %s, %d in flight at most, %s\n",
+             data->dig_bench->nqueries, start->file, host, port, rate, data->dig_bench->opts.concurrency, length);
+    dig_output_append(data, line);
+    g_free(start);
+    
+    data->dig_bench_last_sent = 0;
+    data->dig_bench_timer = g_timeout_add(1000, on_dig_bench_tick, data);
+}
+
+static void dig_bench_start(AppData *data, const char *text) {
+    DigBenchStart *start = g_new0(DigBenchStart, 1);
+    char line[1400];
+    
+    if (dig_bench_parse_args(text, start->file, sizeof(start->file), &data->dig_server, &data->dig_server_len,
+                             &start->opts, start->error, sizeof(start->error)) < 0) {
+        snprintf(line, sizeof(line), "dig: %s\n══════════════════════════════════════\n\n", start->error);
+        dig_output_append(data, line);
+        g_free(start);
+        return;
+    }
+    
+    start->app = data;
+    start->bench = g_new0(DnsBench, 1);
+    start->server = data->dig_server;
+    start->server_len = data->dig_server_len;
+    data->dig_bench_job = job_submit(&data->jobs, 0, dig_bench_start_work, on_dig_bench_started, start);
+    if (data->dig_bench_job == 0) {
+        snprintf(line, sizeof(line), "dig: %s\n══════════════════════════════════════\n\n", g_strerror(errno));
+        dig_output_append(data, line);
+        g_free(start->bench);
+        g_free(start);
+        return;
+    }
+    data->dig_bench = start->bench;
+}
+
+static void dig_watch_log(DigWatch *watch, const char *text) {
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(watch->log));
+    GtkTextMark *mark = gtk_text_buffer_get_mark(buffer, "watch-end");
+    GtkTextIter end;
+    
+    gtk_text_buffer_get_end_iter(buffer, &end);
+    gtk_text_buffer_insert(buffer, &end, text, -1);
+    
+    gtk_text_buffer_get_end_iter(buffer, &end);
+    if (mark == NULL) {
+        mark = gtk_text_buffer_create_mark(buffer, "watch-end", &end, FALSE);
+    } else {
+        gtk_text_buffer_move_mark(buffer, mark, &end);
+    }
+    gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(watch->log), mark, 0.0, FALSE, 0.0, 0.0);
+}
+
+static void dig_watch_server_text(const DnsWatchItem *item, char *buf, size_t size) {
+    char host[NI_MAXHOST];
+    char port[NI_MAXSERV];
+    
+    if (getnameinfo((struct sockaddr *)&item->server, item->server_len, host, sizeof(host), port, sizeof(port),
+                    NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        g_strlcpy(buf, "?", size);
+    } else if (strcmp(port, "53") == 0) {
+        g_strlcpy(buf, host, size);
+    } else {
+        snprintf(buf, size, "%s#%s", host, port);
+    }
+}
+
+// CLOCK_MONOTONIC time as local wall-clock HH:MM:SS
+static void dig_watch_clock(int64_t mono_ns, int64_t now_ns, char *buf, size_t size) {
+    time_t when = (time_t)((g_get_real_time() * 1000 + (mono_ns - now_ns)) / 1000000000LL);
+    strftime(buf, size, "%H:%M:%S", localtime(&when));
+}
+
+static void dig_watch_schedule(DigWatch *watch);
+
+static gboolean on_dig_watch_timer(gpointer user_data) {
+    DigWatch *watch = (DigWatch *)user_data;
+    watch->timer = 0;
+    dig_watch_schedule(watch);
+    return G_SOURCE_REMOVE;
+}
+
+// Sends what is due and sets the one timer for whatever is due next.  With
+// every slot in flight the next answer calls back in here instead.
+static void dig_watch_schedule(DigWatch *watch) {
+    int64_t now_ns = g_get_monotonic_time() * 1000;
+    int64_t next_ns = dns_watch_run(&watch->watch, now_ns);
+    
+    if (next_ns == 0 || watch->watch.ninflight == DNS_WATCH_MAX_INFLIGHT) {
+        return;
+    }
+    if (watch->timer != 0 && watch->timer_due_ns == next_ns) {
+        return;
+    }
+    if (watch->timer != 0) {
+        g_source_remove(watch->timer);
+    }
+    int64_t ms = next_ns > now_ns ? (next_ns - now_ns + 999999) / 1000000 : 0;
+    watch->timer_due_ns = next_ns;
+    watch->timer = g_timeout_add((guint)ms, on_dig_watch_timer, watch);
+}
+
+static void on_dig_watch_result(DnsWatch *w, int index, const DnsResult *result, const DnsCacheDiff *diff,
+                                void *user_data) {
+    DigWatch *watch = (DigWatch *)user_data;
+    const DnsWatchItem *item = &w->items[index];
+    int64_t now_ns = g_get_monotonic_time() * 1000;
+    char server[NI_MAXHOST + NI_MAXSERV];
+    char type[16];
+    char when[16];
+    GString *out = g_string_new("");
+    
+    watch->dirty = TRUE;
+    dig_watch_server_text(item, server, sizeof(server));
+    dig_watch_clock(now_ns, now_ns, when, sizeof(when));
+    
+    if (diff == NULL) {
+        // Report the first failure of a run only
+        if (item->failures == 1) {
+            g_string_append_printf(out, "[%s] %s %s @%s: %s, retrying every %lld s\n", when, item->name,
+                                   dns_type_string(item->type, type, sizeof(type)), server,
+                                   result->status == DNS_TIMEOUT ? "timed out" :
+                                   result->status == DNS_BAD_REPLY ? "bad reply" : g_strerror(result->error),
+                                   DNS_WATCH_RETRY_NS / 1000000000LL);
+        }
+    } else if (diff->first) {
+        const DnsCacheEntry *e = &w->cache->entries[item->entry];
+        g_string_append_printf(out, "[%s] %s %s @%s: %s, %d record%s, TTL %u\n", when, item->name,
+                               dns_type_string(item->type, type, sizeof(type)), server, dns_rcode_string(e->rcode),
+                               e->nlines, e->nlines == 1 ? "" : "s", e->ttl);
+        for (int i = 0; i < e->nlines; i++) {
+            g_string_append_printf(out, "    %s\n", e->lines[i]);
+        }
+    } else if (dns_cache_diff_changed(diff, result->message->rcode)) {
+        g_string_append_printf(out, "[%s] %s %s @%s changed:\n", when, item->name,
+                               dns_type_string(item->type, type, sizeof(type)), server);
+        if (diff->old_rcode != result->message->rcode) {
+            g_string_append_printf(out, "    status %s -> %s\n", dns_rcode_string(diff->old_rcode),
+                                   dns_rcode_string(result->message->rcode));
+        }
+        for (int i = 0; i < diff->nremoved; i++) {
+            g_string_append_printf(out, "  - %s\n", diff->removed[i]);
+        }
+        for (int i = 0; i < diff->nadded; i++) {
+            g_string_append_printf(out, "  + %s\n", diff->added[i]);
+        }
+    }
+    
+    if (out->len > 0) {
+        dig_watch_log(watch, out->str);
+    }
+    g_string_free(out, TRUE);
+    dig_watch_schedule(watch);
+}
+
+static gboolean dig_watch_refresh(gpointer user_data) {
+    DigWatch *watch = (DigWatch *)user_data;
+    const DnsWatch *w = &watch->watch;
+    int64_t now_ns = g_get_monotonic_time() * 1000;
+    
+    if (!watch->dirty) {
+        return G_SOURCE_CONTINUE;
+    }
+    watch->dirty = FALSE;
+    
+    GString *output = g_string_new("");
+    g_string_append_printf(output, "%-40s %-6s %-20s %-9s %7s %6s %-8s %-8s %7s %7s\n", "Name", "Type", "Server",
+                           "Status", "Records", "TTL", "Last", "Next", "Lookups", "Changes");
+    for (int i = 0; i < w->count; i++) {
+        const DnsWatchItem *item = &w->items[i];
+        const DnsCacheEntry *e = item->entry >= 0 ? &w->cache->entries[item->entry] : NULL;
+        char server[NI_MAXHOST + NI_MAXSERV];
+        char type[16];
+        char last[16] = "-";
+        char next[16] = "now";
+        
+        dig_watch_server_text(item, server, sizeof(server));
+        if (e != NULL) {
+            dig_watch_clock(e->fetched_ns, now_ns, last, sizeof(last));
+        }
+        if (item->heap_index >= 0) {
+            dig_watch_clock(item->due_ns, now_ns, next, sizeof(next));
+        }
+        g_string_append_printf(output, "%-40.40s %-6s %-20.20s %-9s ", item->name,
+                               dns_type_string(item->type, type, sizeof(type)), server,
+                               item->failures > 0 ? "FAILING" : e != NULL ? dns_rcode_string(e->rcode) : "...");
+        if (e != NULL) {
+            g_string_append_printf(output, "%7d %6u", e->nlines, e->ttl);
+        } else {
+            g_string_append_printf(output, "%7s %6s", "-", "-");
+        }
+        g_string_append_printf(output, " %-8s %-8s %7d %7d\n", last, next, item->lookups, item->changes);
+    }
+    g_string_append_printf(output, "\nEach name is looked up again once its TTL runs out (every %lld s at most, "
+                           "%lld s at least).\n",
+                           DNS_WATCH_MAX_INTERVAL_NS / 1000000000LL, DNS_WATCH_MIN_INTERVAL_NS / 1000000000LL);
+    
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(watch->table));
+    gtk_text_buffer_set_text(buffer, output->str, -1);
+    g_string_free(output, TRUE);
+    return G_SOURCE_CONTINUE;
+}
+
+// Closing the window ends the watch; the cache outlives it
+static void on_dig_watch_destroy(GtkWidget *window, gpointer user_data) {
+    DigWatch *watch = (DigWatch *)user_data;
+    
+    if (watch->timer != 0) {
+        g_source_remove(watch->timer);
+    }
+    g_source_remove(watch->refresh_timer);
+    dns_watch_free(&watch->watch);
+    watch->app->watch = NULL;
+    g_free(watch);
+}
+
+static DigWatch *dig_watch_open(AppData *data) {
+    DigWatch *watch = g_new0(DigWatch, 1);
+    watch->app = data;
+    dns_watch_init(&watch->watch, data->dns, &data->dns_cache, on_dig_watch_result, watch);
+    
+    watch->window = gtk_window_new();
+    gtk_window_set_title(GTK_WINDOW(watch->window), "DNS watch");
+    gtk_window_set_default_size(GTK_WINDOW(watch->window), 1000, 600);
+    gtk_window_set_transient_for(GTK_WINDOW(watch->window), GTK_WINDOW(data->window));
+    
+    GtkWidget *paned = gtk_paned_new(GTK_ORIENTATION_VERTICAL);
+    gtk_widget_set_margin_start(paned, 5);
+    gtk_widget_set_margin_end(paned, 5);
+    gtk_widget_set_margin_top(paned, 5);
+    gtk_widget_set_margin_bottom(paned, 5);
+    gtk_paned_set_position(GTK_PANED(paned), 300);
+    gtk_window_set_child(GTK_WINDOW(watch->window), paned);
+    
+    GtkWidget *table_scroll = gtk_scrolled_window_new();
+    watch->table = gtk_text_view_new();
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(watch->table), FALSE);
+    gtk_text_view_set_monospace(GTK_TEXT_VIEW(watch->table), TRUE);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(table_scroll), watch->table);
+    gtk_paned_set_start_child(GTK_PANED(paned), table_scroll);
+    
+    GtkWidget *log_scroll = gtk_scrolled_window_new();
+    watch->log = gtk_text_view_new();
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(watch->log), FALSE);
+    gtk_text_view_set_monospace(GTK_TEXT_VIEW(watch->log), TRUE);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(log_scroll), watch->log);
+    gtk_paned_set_end_child(GTK_PANED(paned), log_scroll);
+    
+    g_signal_connect(watch->window, "destroy", G_CALLBACK(on_dig_watch_destroy), watch);
+    watch->refresh_timer = g_timeout_add(1000, dig_watch_refresh, watch);
+    return watch;
+}
+
+// Adds one name, FALSE if the list could not grow
+static gboolean dig_watch_add_name(AppData *data, const char *name, int type) {
+    return dns_watch_add(&data->watch->watch, name, type, (struct sockaddr *)&data->dig_server,
+                         data->dig_server_len) >= 0;
+}
+
+static void dig_watch_added(AppData *data, int before) {
+    char line[128];
+    
+    snprintf(line, sizeof(line), "Watching %d new name%s (%d in all)\n", data->watch->watch.count - before,
+             data->watch->watch.count - before == 1 ? "" : "s", data->watch->watch.count);
+    dig_output_append(data, line);
+    
+    data->watch->dirty = TRUE;
+    dig_watch_schedule(data->watch);
+    dig_watch_refresh(data->watch);
+    gtk_window_present(GTK_WINDOW(data->watch->window));
+}
+
+// A names file, read on a worker: one "name [type]" per line and #
+// comments.  The names go to the server current when it was asked for.
+typedef struct {
+    AppData *app;
+    char path[1024];
+    struct sockaddr_storage server;
+    socklen_t server_len;
+    int error;                  // errno from fopen, 0 if it opened
+    GArray *types;
+    GPtrArray *names;
+    GString *bad;               // lines that did not parse, reported as they were
+} DigWatchFile;
+
+static void dig_watch_file_work(Job *job, void *user_data) {
+    DigWatchFile *file = (DigWatchFile *)user_data;
+    FILE *fp = fopen(file->path, "r");
+    char name[DNS_NAME_MAX];
+    char type_name[64];
+    char file_line[1200];
+    
+    if (fp == NULL) {
+        file->error = errno;
+        return;
+    }
+    while (fgets(file_line, sizeof(file_line), fp) != NULL && !job_cancelled(job)) {
+        char *hash = strchr(file_line, '#');
+        if (hash != NULL) {
+            *hash = '\0';
+        }
+        int fields = sscanf(file_line, "%1024s %63s", name, type_name);
+        if (fields <= 0) {
+            continue;
+        }
+        int type = fields == 2 ? dns_type_from_string(type_name) : DNS_TYPE_A;
+        if (type < 0) {
+            g_string_append_printf(file->bad, "dig: %s: cannot watch '%s'\n", file->path, file_line);
+            continue;
+        }
+        g_ptr_array_add(file->names, g_strdup(name));
+        g_array_append_val(file->types, type);
+    }
+    fclose(fp);
+}
+
+static void on_dig_watch_file_read(void *user_data, int cancelled) {
+    DigWatchFile *file = (DigWatchFile *)user_data;
+    AppData *data = file->app;
+    char line[1400];
+    
+    // Closing the watch window drops a file still being read
+    if (!cancelled && data->watch != NULL) {
+        int before = data->watch->watch.count;
+        
+        if (file->error != 0) {
+            snprintf(line, sizeof(line), "dig: %s: %s\n", file->path, g_strerror(file->error));
+            dig_output_append(data, line);
+        }
+        dig_output_append(data, file->bad->str);
+        for (guint i = 0; i < file->names->len; i++) {
+            const char *name = g_ptr_array_index(file->names, i);
+            if (dns_watch_add(&data->watch->watch, name, g_array_index(file->types, int, i),
+                              (struct sockaddr *)&file->server, file->server_len) < 0) {
+                snprintf(line, sizeof(line), "dig: %s: cannot watch '%s'\n", file->path, name);
+                dig_output_append(data, line);
+            }
+        }
+        dig_watch_added(data, before);
+    }
+    
+    g_ptr_array_free(file->names, TRUE);
+    g_array_free(file->types, TRUE);
+    g_string_free(file->bad, TRUE);
+    g_free(file);
+}
+
+static void dig_watch_add_file(AppData *data, const char *path) {
+    DigWatchFile *file = g_new0(DigWatchFile, 1);
+    char line[1400];
+    
+    file->app = data;
+    g_strlcpy(file->path, path, sizeof(file->path));
+    file->server = data->dig_server;
+    file->server_len = data->dig_server_len;
+    file->types = g_array_new(FALSE, FALSE, sizeof(int));
+    file->names = g_ptr_array_new_with_free_func(g_free);
+    file->bad = g_string_new("");
+    if (job_submit(&data->jobs, 0, dig_watch_file_work, on_dig_watch_file_read, file) == 0) {
+        snprintf(line, sizeof(line), "dig: %s: %s\n", path, g_strerror(errno));
+        dig_output_append(data, line);
+        on_dig_watch_file_read(file, TRUE);
+    }
+}
+
+// Watch mode: [@server] name [type] [name [type] ...] [@file], where the
+// file has one "name [type]" per line and # comments
+static void dig_watch_add(AppData *data, const char *text) {
+    char **args = g_strsplit_set(text, " \t", -1);
+    gboolean have_server = FALSE;
+    char line[1400];
+    int before;
+    
+    for (int i = 0; args[i] != NULL; i++) {
+        if (args[i][0] == '@' && dns_parse_server(args[i] + 1, &data->dig_server, &data->dig_server_len) == 0) {
+            have_server = TRUE;
+        }
+    }
+    if (!have_server && dns_default_server(&data->dig_server, &data->dig_server_len) < 0) {
+        dig_output_append(data, "dig: no DNS server found\n");
+        g_strfreev(args);
+        return;
+    }
+    
+    if (data->watch == NULL) {
+        data->watch = dig_watch_open(data);
+    }
+    before = data->watch->watch.count;
+    
+    for (int i = 0; args[i] != NULL; i++) {
+        const char *arg = args[i];
+        int type = DNS_TYPE_A;
+        
+        if (*arg == '\0' || (arg[0] == '@' && dns_parse_server(arg + 1, &data->dig_server,
+                                                              &data->dig_server_len) == 0)) {
+            continue;
+        }
+        if (arg[0] == '@') {
+            // Its names are added, and reported, once it has been read
+            dig_watch_add_file(data, arg + 1);
+            continue;
+        }
+        
+        // A type right after a name applies to it
+        if (args[i + 1] != NULL && dns_type_from_string(args[i + 1]) > 0) {
+            type = dns_type_from_string(args[i + 1]);
+            i++;
+        }
+        if (!dig_watch_add_name(data, arg, type)) {
+            snprintf(line, sizeof(line), "dig: cannot watch '%s'\n", arg);
+            dig_output_append(data, line);
+        }
+    }
+    g_strfreev(args);
+    dig_watch_added(data, before);
+}
+
+static void on_dig_clicked(GtkButton *button, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
+    if (button != NULL) {
+        flash_button_green(GTK_WIDGET(button));
+    }
+    
+    GtkEntryBuffer *buffer = gtk_entry_get_buffer(GTK_ENTRY(data->dig_entry));
+    const char *domain = gtk_entry_buffer_get_text(buffer);
+    
+    if (strlen(domain) == 0) {
+        dig_output_append(data, "Please enter a domain name\n");
+        return;
+    }
+    
+    // GO during a benchmark stops it and does nothing else
+    if (data->dig_bench != NULL) {
+        dig_bench_cancel(data);
+        return;
+    }
+    
+    // A new lookup replaces one still waiting for its answer
+    if (data->dns != NULL && data->dig_query != 0) {
+        dns_query_cancel(data->dns, data->dig_query);
+        dig_output_append(data, "(stopped)\n══════════════════════════════════════\n\n");
+        data->dig_query = 0;
+    }
+    
+    if (data->dns == NULL) {
+        data->dns = g_new0(DnsEngine, 1);
+        if (dns_engine_open(data->dns) < 0) {
+            char message[256];
+            snprintf(message, sizeof(message), "Cannot start the DNS client: %s\n", g_strerror(errno));
+            dig_output_append(data, message);
+            g_clear_pointer(&data->dns, g_free);
+            return;
+        }
+        g_unix_fd_add(dns_engine_fd(data->dns), G_IO_IN, on_dns_ready, data);
+    }
+    
+    // Each command's output is a run of its own, folded under its header
+    char header[600];
+    snprintf(header, sizeof(header), "=== dig %s ===\n", domain);
+    output_log_begin_run(&data->dig_output.log);
+    dig_output_append(data, header);
+    
+    // Load runs have their own thread and sockets, not the DNS engine
+    if (strstr(domain, "+bench=") != NULL) {
+        dig_bench_start(data, domain);
+        return;
+    }
+    
+    if (gtk_check_button_get_active(GTK_CHECK_BUTTON(data->dig_watch_check))) {
+        dig_watch_add(data, domain);
+        return;
+    }
+    
+    char name[DNS_NAME_MAX];
+    char error[256];
+    char line[1400];
+    char type_name[16];
+    int type;
+    DnsOptions opts;
+    if (dig_parse_args(domain, name, sizeof(name), &type, &data->dig_server, &data->dig_server_len, &opts,
+                       error, sizeof(error)) < 0) {
+        snprintf(line, sizeof(line), "dig: %s\n══════════════════════════════════════\n\n", error);
+        dig_output_append(data, line);
+        return;
+    }
+    
+    // The answer arrives through on_dig_result; the window stays live
+    data->dig_query = dns_query_start(data->dns, name, type, (struct sockaddr *)&data->dig_server,
+                                      data->dig_server_len, &opts, on_dig_result, data);
+    if (data->dig_query < 0) {
+        snprintf(line, sizeof(line), "dig: %s: %s\n══════════════════════════════════════\n\n",
+                 name, g_strerror(errno));
+        data->dig_query = 0;
+    } else {
+        snprintf(line, sizeof(line), "; <<>> network-inq <<>> %s %s\n", name,
+                 dns_type_string(type, type_name, sizeof(type_name)));
+    }
+    dig_output_append(data, line);
+}
+
+static void on_ping_activate(GtkEntry *entry, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
+    flash_button_green(data->ping_button);
+    on_ping_clicked(NULL, user_data);
+}
+
+static void ping_output_append(AppData *data, const char *text) {
+    output_pane_append(&data->ping_output, text);
+}
+
+static gboolean on_ping_ready(gint fd, GIOCondition condition, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
+    ping_engine_dispatch(data->ping);
+    return G_SOURCE_CONTINUE;
+}
+
+// Results arrive from the main loop one probe at a time
+static void on_ping_result(const PingResult *result, void *user_data) {
+    AppData *data = (AppData *)user_data;
+    char from[INET6_ADDRSTRLEN];
+    char line[512];
+    
+    ping_address_string(&result->from, from, sizeof(from));
+    
+    switch (result->status) {
+    case PING_REPLY:
+        if (result->ttl >= 0) {
+            snprintf(line, sizeof(line), "%d bytes from %s: icmp_seq=%d ttl=%d time=%.3f ms\n",
+                     result->bytes, from, result->seq, result->ttl, result->rtt_ns / 1e6);
+        } else {
+            snprintf(line, sizeof(line), "%d bytes from %s: icmp_seq=%d time=%.3f ms\n",
+                     result->bytes, from, result->seq, result->rtt_ns / 1e6);
+        }
+        break;
+    case PING_TIMEOUT:
+        snprintf(line, sizeof(line), "Request timeout for icmp_seq=%d\n", result->seq);
+        break;
+    case PING_UNREACHABLE:
+        snprintf(line, sizeof(line), "From %s icmp_seq=%d %s\n", from, result->seq, ping_error_string(result));
+        break;
+    case PING_SEND_ERROR:
+        snprintf(line, sizeof(line), "ping: sendto: %s (icmp_seq=%d)\n", g_strerror(result->error), result->seq);
+        break;
+    case PING_DONE:
+    default:
+        snprintf(line, sizeof(line), "\n--- %s ping statistics ---\n%d packets transmitted, %d received, %.0f%% packet loss\n",
+                 data->ping_host, result->sent, result->received,
+                 result->sent > 0 ? 100.0 * (result->sent - result->received) / result->sent : 0.0);
+        ping_output_append(data, line);
+        if (result->received > 0) {
+            snprintf(line, sizeof(line), "rtt min/avg/max = %.3f/%.3f/%.3f ms\n",
+                     result->min_ns / 1e6, result->sum_ns / 1e6 / result->received, result->max_ns / 1e6);
+            ping_output_append(data, line);
+        }
+        g_strlcpy(line, "══════════════════════════════════════\n\n", sizeof(line));
+        data->ping_session = 0;
+        break;
+    }
+    
+    ping_output_append(data, line);
+}
+
+static void on_ping_resolved(GObject *source, GAsyncResult *res, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
+    GError *error = NULL;
+    GList *addresses = g_resolver_lookup_by_name_finish(G_RESOLVER(source), res, &error);
+    char line[512];
+    
+    if (addresses == NULL) {
+        // Cancelled lookups belong to a ping that has been replaced
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            snprintf(line, sizeof(line), "ping: %s: %s\n══════════════════════════════════════\n\n",
+                     data->ping_host, error->message);
+            ping_output_append(data, line);
+            g_clear_object(&data->ping_lookup);
+        }
+        g_error_free(error);
+        return;
+    }
+    g_clear_object(&data->ping_lookup);
+    
+    GInetAddress *address = addresses->data;
+    GSocketAddress *socket_address = g_inet_socket_address_new(address, 0);
+    struct sockaddr_storage native;
+    gssize native_size = g_socket_address_get_native_size(socket_address);
+    char *text = g_inet_address_to_string(address);
+    
+    if (native_size > 0 && g_socket_address_to_native(socket_address, &native, sizeof(native), NULL)) {
+        data->ping_session = ping_start(data->ping, (struct sockaddr *)&native, native_size, 4,
+                                        1000000000LL, 2000000000LL, on_ping_result, data);
+    } else {
+        data->ping_session = -1;
+        errno = EAFNOSUPPORT;
+    }
+    
+    if (data->ping_session < 0) {
+        snprintf(line, sizeof(line), "ping: %s: %s\n══════════════════════════════════════\n\n",
+                 text, g_strerror(errno));
+        data->ping_session = 0;
+    } else {
+        snprintf(line, sizeof(line), "PING %s (%s): %d data bytes\n", data->ping_host, text, PING_PAYLOAD);
+    }
+    ping_output_append(data, line);
+    
+    g_free(text);
+    g_object_unref(socket_address);
+    g_resolver_free_addresses(addresses);
+}
+
+enum {
+    SWEEP_ROW_PROP_0,
+    SWEEP_ROW_PROP_ADDRESS,
+    SWEEP_ROW_PROP_STATUS,
+    SWEEP_ROW_PROP_RTT,
+    SWEEP_ROW_N_PROPS
+};
+
+static GParamSpec *sweep_row_props[SWEEP_ROW_N_PROPS];
+
+G_DEFINE_TYPE(SweepRow, sweep_row, G_TYPE_OBJECT)
+
+static void sweep_row_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+    SweepRow *row = SWEEP_ROW(object);
+    char text[INET6_ADDRSTRLEN];
+    
+    switch (prop_id) {
+    case SWEEP_ROW_PROP_ADDRESS: {
+        struct sockaddr_storage addr;
+        memset(&addr, 0, sizeof(addr));
+        memcpy(&addr, row->address, sizeof(*row->address));
+        g_value_set_string(value, ping_address_string(&addr, text, sizeof(text)));
+        break;
+    }
+    case SWEEP_ROW_PROP_STATUS:
+        if (row->state == SWEEP_UP) {
+            g_value_set_string(value, "Up");
+        } else if (row->state == SWEEP_PENDING) {
+            g_value_set_string(value, "…");
+        } else if (row->reason != NULL) {
+            g_value_take_string(value, g_strdup_printf("Down: %s", row->reason));
+        } else {
+            g_value_set_string(value, "Down");
+        }
+        break;
+    case SWEEP_ROW_PROP_RTT:
+        if (row->state == SWEEP_UP) {
+            g_value_take_string(value, g_strdup_printf("%.3f ms", row->rtt_ns / 1e6));
+        } else {
+            g_value_set_string(value, "");
+        }
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static void sweep_row_class_init(SweepRowClass *klass) {
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    
+    object_class->get_property = sweep_row_get_property;
+    sweep_row_props[SWEEP_ROW_PROP_ADDRESS] =
+        g_param_spec_string("address", NULL, NULL, NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+    sweep_row_props[SWEEP_ROW_PROP_STATUS] =
+        g_param_spec_string("status", NULL, NULL, NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+    sweep_row_props[SWEEP_ROW_PROP_RTT] =
+        g_param_spec_string("rtt", NULL, NULL, NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+    g_object_class_install_properties(object_class, SWEEP_ROW_N_PROPS, sweep_row_props);
+}
+
+static void sweep_row_init(SweepRow *row) {
+    row->state = SWEEP_PENDING;
+}
+
+static int sweep_compare_address(const SweepRow *a, const SweepRow *b) {
+    int family_a = a->address->sa.sa_family;
+    int family_b = b->address->sa.sa_family;
+    
+    if (family_a != family_b) {
+        return family_a == AF_INET ? -1 : 1;
+    }
+    if (family_a == AF_INET) {
+        uint32_t host_a = ntohl(a->address->v4.sin_addr.s_addr);
+        uint32_t host_b = ntohl(b->address->v4.sin_addr.s_addr);
+        return host_a < host_b ? -1 : host_a > host_b;
+    }
+    return memcmp(&a->address->v6.sin6_addr, &b->address->v6.sin6_addr, sizeof(struct in6_addr));
+}
+
+static int sweep_sort_address(gconstpointer a, gconstpointer b, gpointer user_data) {
+    return sweep_compare_address(a, b);
+}
+
+static int sweep_sort_status(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const SweepRow *row_a = a;
+    const SweepRow *row_b = b;
+    
+    if (row_a->state != row_b->state) {
+        return row_a->state < row_b->state ? -1 : 1;
+    }
+    return sweep_compare_address(row_a, row_b);
+}
+
+// Hosts without an RTT sort after all those with one
+static int sweep_sort_rtt(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const SweepRow *row_a = a;
+    const SweepRow *row_b = b;
+    int up_a = row_a->state == SWEEP_UP;
+    int up_b = row_b->state == SWEEP_UP;
+    
+    if (up_a != up_b) {
+        return up_a ? -1 : 1;
+    }
+    if (up_a && row_a->rtt_ns != row_b->rtt_ns) {
+        return row_a->rtt_ns < row_b->rtt_ns ? -1 : 1;
+    }
+    return sweep_compare_address(row_a, row_b);
+}
+
+static void sweep_setup_cell(GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data) {
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_list_item_set_child(item, label);
+}
+
+// user_data is the SweepRow property the column shows
+static void sweep_bind_cell(GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data) {
+    GtkWidget *label = gtk_list_item_get_child(item);
+    GObject *row = gtk_list_item_get_item(item);
+    GBinding *binding = g_object_bind_property(row, user_data, label, "label", G_BINDING_SYNC_CREATE);
+    g_object_set_data(G_OBJECT(label), "binding", binding);
+}
+
+static void sweep_unbind_cell(GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data) {
+    GtkWidget *label = gtk_list_item_get_child(item);
+    GBinding *binding = g_object_steal_data(G_OBJECT(label), "binding");
+    if (binding != NULL) {
+        g_binding_unbind(binding);
+    }
+}
+
+static void sweep_update_summary(PingSweep *sweep) {
+    int64_t end_us = sweep->finished_us ? sweep->finished_us : g_get_monotonic_time();
+    int pending = sweep->targets.count - sweep->up - sweep->down;
+    char text[256];
+    
+    snprintf(text, sizeof(text), "%s: %d targets, %d up, %d down, %d pending, %.1f s%s",
+             sweep->spec, sweep->targets.count, sweep->up, sweep->down, pending,
+             (end_us - sweep->started_us) / 1e6, sweep->finished_us ? " (done)" : "");
+    gtk_label_set_text(GTK_LABEL(sweep->summary), text);
+}
+
+// Push changed rows to the table; with thousands of replies a second the
+// cells and the sort order are only updated a few times a second
+static gboolean sweep_refresh(gpointer user_data) {
+    PingSweep *sweep = (PingSweep *)user_data;
+    
+    if (sweep->dirty->len > 0) {
+        for (guint i = 0; i < sweep->dirty->len; i++) {
+            SweepRow *row = g_ptr_array_index(sweep->dirty, i);
+            row->dirty = FALSE;
+            g_object_notify_by_pspec(G_OBJECT(row), sweep_row_props[SWEEP_ROW_PROP_STATUS]);
+            g_object_notify_by_pspec(G_OBJECT(row), sweep_row_props[SWEEP_ROW_PROP_RTT]);
+        }
+        g_ptr_array_set_size(sweep->dirty, 0);
+        gtk_sorter_changed(sweep->sorters[1], GTK_SORTER_CHANGE_DIFFERENT);
+        gtk_sorter_changed(sweep->sorters[2], GTK_SORTER_CHANGE_DIFFERENT);
+    }
+    sweep_update_summary(sweep);
+    
+    if (sweep->finished_us != 0) {
+        sweep->refresh_timer = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void sweep_set_state(PingSweep *sweep, SweepRow *row, SweepState state) {
+    if (row->state == SWEEP_UP) {
+        sweep->up--;
+    } else if (row->state == SWEEP_DOWN) {
+        sweep->down--;
+    }
+    row->state = state;
+    if (state == SWEEP_UP) {
+        sweep->up++;
+    } else if (state == SWEEP_DOWN) {
+        sweep->down++;
+    }
+    
+    if (!row->dirty) {
+        row->dirty = TRUE;
+        g_ptr_array_add(sweep->dirty, row);
+    }
+}
+
+static void on_sweep_result(const PingResult *result, void *user_data) {
+    PingSweep *sweep = (PingSweep *)user_data;
+    char line[512];
+    
+    if (result->status == PING_DONE) {
+        sweep->session = 0;
+        sweep->finished_us = g_get_monotonic_time();
+        snprintf(line, sizeof(line),
+                 "%d probes sent, %d replies: %d up, %d down in %.1f s\n"
+                 "══════════════════════════════════════\n\n",
+                 result->sent, result->received, sweep->up, sweep->down,
+                 (sweep->finished_us - sweep->started_us) / 1e6);
+        ping_output_append(sweep->app, line);
+        if (sweep->refresh_timer != 0) {
+            g_source_remove(sweep->refresh_timer);
+        }
+        sweep_refresh(sweep);
+        return;
+    }
+    
+    SweepRow *row = sweep->rows[result->target];
+    switch (result->status) {
+    case PING_REPLY:
+        // A late reply from an earlier round still counts
+        if (row->state != SWEEP_UP || result->rtt_ns < row->rtt_ns) {
+            row->rtt_ns = result->rtt_ns;
+            row->reason = NULL;
+            sweep_set_state(sweep, row, SWEEP_UP);
+        }
+        break;
+    case PING_UNREACHABLE:
+    case PING_TIMEOUT:
+    case PING_SEND_ERROR:
+        // Only the last round decides a host is down
+        if (row->state != SWEEP_UP && result->seq >= sweep->rounds) {
+            row->reason = result->status == PING_UNREACHABLE ? ping_error_string(result)
+                        : result->status == PING_SEND_ERROR ? "send failed" : NULL;
+            sweep_set_state(sweep, row, SWEEP_DOWN);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Closing the window stops the sweep
+static void on_sweep_destroy(GtkWidget *window, gpointer user_data) {
+    PingSweep *sweep = (PingSweep *)user_data;
+    AppData *data = sweep->app;
+    
+    if (sweep->session != 0) {
+        ping_cancel(data->ping, sweep->session);
+        ping_output_append(data, "(stopped)\n══════════════════════════════════════\n\n");
+    }
+    if (sweep->refresh_timer != 0) {
+        g_source_remove(sweep->refresh_timer);
+    }
+    for (int i = 0; i < 3; i++) {
+        g_object_unref(sweep->sorters[i]);
+    }
+    for (int i = 0; i < sweep->targets.count; i++) {
+        g_object_unref(sweep->rows[i]);
+    }
+    g_free(sweep->rows);
+    g_ptr_array_free(sweep->dirty, TRUE);
+    ping_targets_free(&sweep->targets);
+    if (data->sweep == sweep) {
+        data->sweep = NULL;
+    }
+    g_free(sweep);
+}
+
+static GtkWidget *sweep_build_window(PingSweep *sweep, GListStore *store) {
+    static const char *titles[3] = {"Address", "Status", "RTT"};
+    static const char *properties[3] = {"address", "status", "rtt"};
+    static const GCompareDataFunc compare[3] = {sweep_sort_address, sweep_sort_status, sweep_sort_rtt};
+    
+    GtkWidget *window = gtk_window_new();
+    char title[300];
+    snprintf(title, sizeof(title), "Ping sweep: %s", sweep->spec);
+    gtk_window_set_title(GTK_WINDOW(window), title);
+    gtk_window_set_default_size(GTK_WINDOW(window), 560, 600);
+    gtk_window_set_transient_for(GTK_WINDOW(window), GTK_WINDOW(sweep->app->window));
+    
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_widget_set_margin_start(vbox, 5);
+    gtk_widget_set_margin_end(vbox, 5);
+    gtk_widget_set_margin_top(vbox, 5);
+    gtk_widget_set_margin_bottom(vbox, 5);
+    gtk_window_set_child(GTK_WINDOW(window), vbox);
+    
+    sweep->summary = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(sweep->summary), 0.0);
+    gtk_box_append(GTK_BOX(vbox), sweep->summary);
+    
+    // Only the rows on screen have widgets, so a /16 is as cheap to show
+    // as a /24
+    GtkWidget *view = gtk_column_view_new(NULL);
+    GtkSortListModel *sorted = gtk_sort_list_model_new(G_LIST_MODEL(store),
+                                                       g_object_ref(gtk_column_view_get_sorter(GTK_COLUMN_VIEW(view))));
+    gtk_sort_list_model_set_incremental(sorted, TRUE);
+    GtkNoSelection *selection = gtk_no_selection_new(G_LIST_MODEL(sorted));
+    gtk_column_view_set_model(GTK_COLUMN_VIEW(view), GTK_SELECTION_MODEL(selection));
+    g_object_unref(selection);
+    gtk_column_view_set_show_column_separators(GTK_COLUMN_VIEW(view), TRUE);
+    
+    GtkColumnViewColumn *address_column = NULL;
+    for (int i = 0; i < 3; i++) {
+        GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+        g_signal_connect(factory, "setup", G_CALLBACK(sweep_setup_cell), NULL);
+        g_signal_connect(factory, "bind", G_CALLBACK(sweep_bind_cell), (gpointer)properties[i]);
+        g_signal_connect(factory, "unbind", G_CALLBACK(sweep_unbind_cell), NULL);
+        
+        GtkColumnViewColumn *column = gtk_column_view_column_new(titles[i], factory);
+        sweep->sorters[i] = GTK_SORTER(gtk_custom_sorter_new(compare[i], NULL, NULL));
+        gtk_column_view_column_set_sorter(column, sweep->sorters[i]);
+        gtk_column_view_column_set_expand(column, i == 1);
+        gtk_column_view_append_column(GTK_COLUMN_VIEW(view), column);
+        if (i == 0) {
+            address_column = column;
+        } else {
+            g_object_unref(column);
+        }
+    }
+    gtk_column_view_sort_by_column(GTK_COLUMN_VIEW(view), address_column, GTK_SORT_ASCENDING);
+    g_object_unref(address_column);
+    
+    GtkWidget *scroll = gtk_scrolled_window_new();
+    gtk_widget_set_vexpand(scroll, TRUE);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroll), view);
+    gtk_box_append(GTK_BOX(vbox), scroll);
+    
+    return window;
+}
+
+// The spec is expanded on a worker: an @file, or a range of a million
+// addresses, takes a while
+typedef struct {
+    PingSweep *sweep;
+    int status;
+    char error[256];
+} SweepParse;
+
+static void sweep_parse_work(Job *job, void *user_data) {
+    SweepParse *parse = (SweepParse *)user_data;
+    
+    parse->status = ping_targets_parse(&parse->sweep->targets, parse->sweep->spec, parse->error,
+                                       sizeof(parse->error));
+}
+
+static void on_sweep_parsed(void *user_data, int cancelled) {
+    SweepParse *parse = (SweepParse *)user_data;
+    PingSweep *sweep = parse->sweep;
+    AppData *data = sweep->app;
+    char line[600];
+    
+    // A newer sweep took its place
+    if (cancelled || parse->status < 0) {
+        if (!cancelled) {
+            snprintf(line, sizeof(line), "ping: %s\n══════════════════════════════════════\n\n", parse->error);
+            ping_output_append(data, line);
+        } else if (parse->status == 0) {
+            ping_targets_free(&sweep->targets);
+        }
+        g_free(sweep);
+        g_free(parse);
+        return;
+    }
+    g_free(parse);
+    
+    sweep->rounds = 2;
+    sweep->dirty = g_ptr_array_new();
+    
+    // Two rounds a second apart, the second only for hosts still silent,
+    // at up to 20000 probes per second
+    PingOptions opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.count = sweep->rounds;
+    opts.interval_ns = 1000000000LL;
+    opts.timeout_ns = 1000000000LL;
+    opts.rate = 20000;
+    opts.stop_on_reply = 1;
+    
+    sweep->session = ping_sweep_start(data->ping, sweep->targets.addrs, sweep->targets.count, &opts,
+                                      on_sweep_result, sweep);
+    if (sweep->session < 0) {
+        snprintf(line, sizeof(line), "ping: %s\n══════════════════════════════════════\n\n", g_strerror(errno));
+        ping_output_append(data, line);
+        ping_targets_free(&sweep->targets);
+        g_ptr_array_free(sweep->dirty, TRUE);
+        g_free(sweep);
+        return;
+    }
+    sweep->started_us = g_get_monotonic_time();
+    
+    // All rows go into the store in one splice
+    GListStore *store = g_list_store_new(SWEEP_TYPE_ROW);
+    sweep->rows = g_new(SweepRow *, sweep->targets.count);
+    for (int i = 0; i < sweep->targets.count; i++) {
+        sweep->rows[i] = g_object_new(SWEEP_TYPE_ROW, NULL);
+        sweep->rows[i]->address = &sweep->targets.addrs[i];
+    }
+    g_list_store_splice(store, 0, 0, (gpointer *)sweep->rows, sweep->targets.count);
+    
+    sweep->window = sweep_build_window(sweep, store);
+    g_object_unref(store);
+    g_signal_connect(sweep->window, "destroy", G_CALLBACK(on_sweep_destroy), sweep);
+    data->sweep = sweep;
+    
+    snprintf(line, sizeof(line), "Sweeping %d addresses, %d probes/s (results in the sweep window)\n",
+             sweep->targets.count, opts.rate);
+    ping_output_append(data, line);
+    
+    sweep_update_summary(sweep);
+    sweep->refresh_timer = g_timeout_add(250, sweep_refresh, sweep);
+    gtk_window_present(GTK_WINDOW(sweep->window));
+}
+
+// Probe every address the spec expands to and show the results in their
+// own window: a prefix, range, list or @file typed into the PING entry
+static void ping_sweep_open(AppData *data, const char *spec) {
+    SweepParse *parse = g_new0(SweepParse, 1);
+    char line[600];
+    
+    parse->sweep = g_new0(PingSweep, 1);
+    parse->sweep->app = data;
+    g_strlcpy(parse->sweep->spec, spec, sizeof(parse->sweep->spec));
+    if (job_submit(&data->jobs, JOB_KEY_SWEEP, sweep_parse_work, on_sweep_parsed, parse) == 0) {
+        snprintf(line, sizeof(line), "ping: %s\n══════════════════════════════════════\n\n", g_strerror(errno));
+        ping_output_append(data, line);
+        g_free(parse->sweep);
+        g_free(parse);
+    }
+}
+
+// Probes every 200 ms per monitored host, so a 1 minute window holds
+// about 300 samples
+#define MONITOR_INTERVAL_NS 200000000LL
+#define MONITOR_TIMEOUT_NS 2000000000LL
+
+static void on_monitor_result(const PingResult *result, void *user_data) {
+    MonitorTarget *target = (MonitorTarget *)user_data;
+    int64_t now_ns = g_get_monotonic_time() * 1000;
+    
+    switch (result->status) {
+    case PING_REPLY:
+        rtt_monitor_reply(&target->rtt, now_ns, result->rtt_ns);
+        break;
+    case PING_TIMEOUT:
+    case PING_UNREACHABLE:
+    case PING_SEND_ERROR:
+        rtt_monitor_loss(&target->rtt, now_ns);
+        break;
+    case PING_DONE:
+    default:
+        target->session = 0;
+        break;
+    }
+}
+
+static void monitor_remove_target(PingMonitor *monitor, MonitorTarget *target) {
+    if (target->lookup != NULL) {
+        g_cancellable_cancel(target->lookup);
+        g_clear_object(&target->lookup);
+    }
+    if (target->session != 0) {
+        ping_cancel(monitor->app->ping, target->session);
+    }
+    g_ptr_array_remove(monitor->targets, target);
+}
+
+static void on_monitor_resolved(GObject *source, GAsyncResult *res, gpointer user_data) {
+    GError *error = NULL;
+    GList *addresses = g_resolver_lookup_by_name_finish(G_RESOLVER(source), res, &error);
+    char line[512];
+    
+    // The target is gone if its lookup was cancelled
+    if (addresses == NULL && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_error_free(error);
+        return;
+    }
+    
+    MonitorTarget *target = (MonitorTarget *)user_data;
+    PingMonitor *monitor = target->monitor;
+    g_clear_object(&target->lookup);
+    
+    if (addresses == NULL) {
+        snprintf(line, sizeof(line), "monitor: %s: %s\n", target->host, error->message);
+        ping_output_append(monitor->app, line);
+        g_error_free(error);
+        monitor_remove_target(monitor, target);
+        return;
+    }
+    
+    GInetAddress *address = addresses->data;
+    GSocketAddress *socket_address = g_inet_socket_address_new(address, 0);
+    struct sockaddr_storage native;
+    gssize native_size = g_socket_address_get_native_size(socket_address);
+    char *text = g_inet_address_to_string(address);
+    g_strlcpy(target->address, text, sizeof(target->address));
+    
+    if (native_size > 0 && g_socket_address_to_native(socket_address, &native, sizeof(native), NULL)) {
+        target->session = ping_start(monitor->app->ping, (struct sockaddr *)&native, native_size, 0,
+                                     MONITOR_INTERVAL_NS, MONITOR_TIMEOUT_NS, on_monitor_result, target);
+    } else {
+        target->session = -1;
+        errno = EAFNOSUPPORT;
+    }
+    
+    if (target->session < 0) {
+        snprintf(line, sizeof(line), "monitor: %s: %s\n", text, g_strerror(errno));
+        ping_output_append(monitor->app, line);
+        target->session = 0;
+        monitor_remove_target(monitor, target);
+    }
+    
+    g_free(text);
+    g_object_unref(socket_address);
+    g_resolver_free_addresses(addresses);
+}
+
+static void monitor_format_ms(GString *out, int64_t ns, gboolean have) {
+    if (have) {
+        g_string_append_printf(out, " %8.2f", ns / 1e6);
+    } else {
+        g_string_append_printf(out, " %8s", "-");
+    }
+}
+
+static gboolean monitor_refresh(gpointer user_data) {
+    PingMonitor *monitor = (PingMonitor *)user_data;
+    static const int64_t windows_ns[] = {60000000000LL, 300000000000LL, 0};
+    guint selected = gtk_drop_down_get_selected(GTK_DROP_DOWN(monitor->window_dropdown));
+    int64_t window_ns = selected < G_N_ELEMENTS(windows_ns) ? windows_ns[selected] : 0;
+    int64_t now_ns = g_get_monotonic_time() * 1000;
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(monitor->table));
+    GString *output = g_string_new("");
+    
+    g_string_append_printf(output, "%-24s %7s %6s %8s %8s %8s %8s %8s %8s %8s\n",
+                           "Target", "Probes", "Loss%", "Min", "p50", "p90", "p99", "p99.9", "Max", "Jitter");
+    for (guint i = 0; i < monitor->targets->len; i++) {
+        MonitorTarget *target = g_ptr_array_index(monitor->targets, i);
+        RttStats stats;
+        char name[25];
+        
+        rtt_monitor_stats(&target->rtt, now_ns, window_ns, &stats);
+        g_strlcpy(name, target->address[0] ? target->address : target->host, sizeof(name));
+        g_string_append_printf(output, "%-24s %7d %6.1f", name, stats.probes, stats.loss);
+        
+        gboolean have = stats.replies > 0;
+        monitor_format_ms(output, stats.min_ns, have);
+        monitor_format_ms(output, stats.p50_ns, have);
+        monitor_format_ms(output, stats.p90_ns, have);
+        monitor_format_ms(output, stats.p99_ns, have);
+        monitor_format_ms(output, stats.p999_ns, have);
+        monitor_format_ms(output, stats.max_ns, have);
+        monitor_format_ms(output, stats.jitter_ns, stats.replies > 1);
+        g_string_append_c(output, '\n');
+    }
+    g_string_append(output, "\nTimes in ms. Percentiles within 1.6%; windows are rounded up to 10 s.\n");
+    
+    gtk_text_buffer_set_text(buffer, output->str, -1);
+    g_string_free(output, TRUE);
+    return G_SOURCE_CONTINUE;
+}
+
+static void on_monitor_window_changed(GtkDropDown *dropdown, GParamSpec *pspec, gpointer user_data) {
+    monitor_refresh(user_data);
+}
+
+// Closing the window stops every monitored ping
+static void on_monitor_destroy(GtkWidget *window, gpointer user_data) {
+    PingMonitor *monitor = (PingMonitor *)user_data;
+    
+    g_source_remove(monitor->refresh_timer);
+    while (monitor->targets->len > 0) {
+        monitor_remove_target(monitor, g_ptr_array_index(monitor->targets, monitor->targets->len - 1));
+    }
+    g_ptr_array_free(monitor->targets, TRUE);
+    monitor->app->monitor = NULL;
+    g_free(monitor);
+}
+
+static PingMonitor *ping_monitor_open(AppData *data) {
+    PingMonitor *monitor = g_new0(PingMonitor, 1);
+    monitor->app = data;
+    monitor->targets = g_ptr_array_new_with_free_func(g_free);
+    
+    monitor->window = gtk_window_new();
+    gtk_window_set_title(GTK_WINDOW(monitor->window), "Ping monitor");
+    gtk_window_set_default_size(GTK_WINDOW(monitor->window), 900, 300);
+    gtk_window_set_transient_for(GTK_WINDOW(monitor->window), GTK_WINDOW(data->window));
+    
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_widget_set_margin_start(vbox, 5);
+    gtk_widget_set_margin_end(vbox, 5);
+    gtk_widget_set_margin_top(vbox, 5);
+    gtk_widget_set_margin_bottom(vbox, 5);
+    gtk_window_set_child(GTK_WINDOW(monitor->window), vbox);
+    
+    GtkWidget *window_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_append(GTK_BOX(vbox), window_box);
+    gtk_box_append(GTK_BOX(window_box), gtk_label_new("Window:"));
+    const char *windows[] = {"1 min", "5 min", "Since start", NULL};
+    monitor->window_dropdown = gtk_drop_down_new_from_strings(windows);
+    g_signal_connect(monitor->window_dropdown, "notify::selected", G_CALLBACK(on_monitor_window_changed), monitor);
+    gtk_box_append(GTK_BOX(window_box), monitor->window_dropdown);
+    
+    GtkWidget *scroll = gtk_scrolled_window_new();
+    gtk_widget_set_vexpand(scroll, TRUE);
+    gtk_box_append(GTK_BOX(vbox), scroll);
+    
+    monitor->table = gtk_text_view_new();
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(monitor->table), FALSE);
+    gtk_text_view_set_monospace(GTK_TEXT_VIEW(monitor->table), TRUE);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroll), monitor->table);
+    
+    g_signal_connect(monitor->window, "destroy", G_CALLBACK(on_monitor_destroy), monitor);
+    monitor->refresh_timer = g_timeout_add(1000, monitor_refresh, monitor);
+    return monitor;
+}
+
+// Monitor mode: every host in the entry is pinged until the monitor
+// window is closed
+static void ping_monitor_add(AppData *data, const char *hosts) {
+    char **names = g_strsplit_set(hosts, " ,\t", -1);
+    GResolver *resolver = g_resolver_get_default();
+    char line[600];
+    
+    if (data->monitor == NULL) {
+        data->monitor = ping_monitor_open(data);
+    }
+    
+    for (char **name = names; *name != NULL; name++) {
+        if (**name == '\0') {
+            continue;
+        }
+        MonitorTarget *target = g_new0(MonitorTarget, 1);
+        target->monitor = data->monitor;
+        g_strlcpy(target->host, *name, sizeof(target->host));
+        rtt_monitor_init(&target->rtt);
+        g_ptr_array_add(data->monitor->targets, target);
+        
+        snprintf(line, sizeof(line), "Monitoring %s every %lld ms\n", *name, MONITOR_INTERVAL_NS / 1000000);
+        ping_output_append(data, line);
+        
+        target->lookup = g_cancellable_new();
+        g_resolver_lookup_by_name_async(resolver, *name, target->lookup, on_monitor_resolved, target);
+    }
+    
+    g_object_unref(resolver);
+    g_strfreev(names);
+    monitor_refresh(data->monitor);
+    gtk_window_present(GTK_WINDOW(data->monitor->window));
+}
+
+// Open the engine on first use; FALSE after printing why it cannot be
+static gboolean ping_engine_ensure(AppData *data) {
+    if (data->ping != NULL) {
+        return TRUE;
+    }
+    
+    data->ping = g_new0(PingEngine, 1);
+    if (ping_engine_open(data->ping) < 0) {
+        char message[512];
+        snprintf(message, sizeof(message),
+                 "Cannot open an ICMP socket: %s\n"
+                 "(unprivileged ping needs net.ipv4.ping_group_range to include your group)\n",
+                 g_strerror(errno));
+        ping_output_append(data, message);
+        g_clear_pointer(&data->ping, g_free);
+        return FALSE;
+    }
+    g_unix_fd_add(ping_engine_fd(data->ping), G_IO_IN, on_ping_ready, data);
+    return TRUE;
+}
+
+static void on_ping_clicked(GtkButton *button, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
+    if (button != NULL) {
+        flash_button_green(GTK_WIDGET(button));
+    }
+    
+    GtkEntryBuffer *buffer = gtk_entry_get_buffer(GTK_ENTRY(data->ping_entry));
+    const char *host = gtk_entry_buffer_get_text(buffer);
+    
+    if (strlen(host) == 0) {
+        ping_output_append(data, "Please enter a hostname or IP address\n");
+        return;
+    }
+    
+    if (!ping_engine_ensure(data)) {
+        return;
+    }
+    
+    if (gtk_check_button_get_active(GTK_CHECK_BUTTON(data->ping_monitor_check))) {
+        ping_monitor_add(data, host);
+        return;
+    }
+    
+    if (ping_targets_looks_like_sweep(host)) {
+        // One sweep at a time; its window going away cancels it
+        if (data->sweep != NULL) {
+            gtk_window_destroy(GTK_WINDOW(data->sweep->window));
+        }
+        char header[600];
+        snprintf(header, sizeof(header), "=== sweep %s ===\n", host);
+        output_log_begin_run(&data->ping_output.log);
+        ping_output_append(data, header);
+        ping_sweep_open(data, host);
+        return;
+    }
+    
+    // A new ping replaces one that is still resolving or running
+    if (data->ping_lookup != NULL) {
+        g_cancellable_cancel(data->ping_lookup);
+        g_clear_object(&data->ping_lookup);
+    }
+    if (ping_active(data->ping, data->ping_session)) {
+        ping_cancel(data->ping, data->ping_session);
+        ping_output_append(data, "(stopped)\n══════════════════════════════════════\n\n");
+    }
+    data->ping_session = 0;
+    
+    // Each command's output is a run of its own, folded under its header
+    g_strlcpy(data->ping_host, host, sizeof(data->ping_host));
+    char header[600];
+    snprintf(header, sizeof(header), "=== ping %s ===\n", host);
+    output_log_begin_run(&data->ping_output.log);
+    ping_output_append(data, header);
+    
+    // Name lookup runs in GLib's resolver thread; the probes start when it
+    // answers
+    GResolver *resolver = g_resolver_get_default();
+    data->ping_lookup = g_cancellable_new();
+    g_resolver_lookup_by_name_async(resolver, host, data->ping_lookup, on_ping_resolved, data);
+    g_object_unref(resolver);
+}
+
+// Average time a graph frame took to draw or build, once a second
+static void graph_frame_report(AppData *data) {
+    GraphCache *gc = &data->graph_cache;
+    int64_t now_us = g_get_monotonic_time();
+    char text[160];
+    
+    if (now_us - gc->report_us < G_USEC_PER_SEC || gc->frames == 0) {
+        return;
+    }
+    snprintf(text, sizeof(text), "Frame time: %.3f ms average over %d frames (%d scrolled, %d drawn in full)",
+             gc->frame_us / 1000.0 / gc->frames, gc->frames, gc->scrolled, gc->frames - gc->scrolled);
+    gtk_widget_set_tooltip_text(data->network_graph, text);
+    gc->frames = 0;
+    gc->scrolled = 0;
+    gc->frame_us = 0;
+    gc->report_us = now_us;
+}
+
+// New samples are in the stats table
+static void network_graph_updated(AppData *data) {
+    graph_frame_report(data);
+    
+    // Long windows only change once per second
+    if (data->graph_window_ns != 0) {
+        int64_t second = g_get_real_time() / G_USEC_PER_SEC;
+        if (second == data->graph_last_second) {
+            return;
+        }
+        data->graph_last_second = second;
+    }
+    gtk_widget_queue_draw(data->network_graph);
+}
+
+static void graph_sysfs_work(Job *job, void *user_data) {
+    AppData *data = (AppData *)user_data;
+    collector_sysfs_read(&data->graph_sysfs);
+}
+
+static void on_graph_sysfs_read(void *user_data, int cancelled) {
+    AppData *data = (AppData *)user_data;
+    
+    data->graph_sysfs_busy = FALSE;
+    if (!cancelled && collector_sysfs_apply(&data->collector, &data->graph_sysfs, NULL, NULL) > 0) {
+        network_graph_updated(data);
+    }
+}
+
+typedef struct {
+    AppData *app;
+    StatsRrdOpen *open;
+} HistoryOpen;
+
+static void history_open_work(Job *job, void *user_data) {
+    HistoryOpen *history = (HistoryOpen *)user_data;
+    stats_rrd_open_run(history->open);
+}
+
+// Also when cancelled: the row keeps its memory tiers if nothing was mapped
+static void on_history_opened(void *user_data, int cancelled) {
+    HistoryOpen *history = (HistoryOpen *)user_data;
+    AppData *data = history->app;
+    
+    stats_table_attach_rrd(&data->collector.stats, history->open);
+    g_free(history);
+    if (data->network_graph != NULL && data->graph_window_ns != 0) {
+        gtk_widget_queue_draw(data->network_graph);
+    }
+}
+
+// Creating and formatting a history file means some 670 KB of page
+// faults, so files are opened on a worker; the rows use memory tiers
+// until theirs is attached
+static void graph_open_history(AppData *data) {
+    StatsRrdOpen *open;
+    
+    while ((open = stats_table_take_open(&data->collector.stats)) != NULL) {
+        HistoryOpen *history = g_new0(HistoryOpen, 1);
+        history->app = data;
+        history->open = open;
+        if (job_submit(&data->jobs, 0, history_open_work, on_history_opened, history) == 0) {
+            stats_table_attach_rrd(&data->collector.stats, open);
+            g_free(history);
+        }
+    }
+}
+
+static gboolean update_network_graph(gpointer user_data) {
+    AppData *data = (AppData *)user_data;
+    
+    // Rows tracked since the last tick, including the ones from startup
+    graph_open_history(data);
+    
+    // Without the sampler thread, a dozen sysfs files per interface are
+    // read on a worker and folded in when it is done.  A pass still going
+    // is not doubled up on.
+    if (!collector_threaded(&data->collector)) {
+        if (!data->graph_sysfs_busy && collector_sysfs_prepare(&data->collector, &data->graph_sysfs) == 0 &&
+            job_submit(&data->jobs, 0, graph_sysfs_work, on_graph_sysfs_read, data) != 0) {
+            data->graph_sysfs_busy = TRUE;
+        }
+        return G_SOURCE_CONTINUE;
+    }
+    
+    // Move everything the sampler produced into the stats table
+    if (collector_poll(&data->collector, NULL, NULL) > 0) {
+        network_graph_updated(data);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// The first of 1, 1.5, 2, 3, 4, 5, 6 or 8 times a power of ten that is at
+// least value.  The scale moves in these steps rather than with every
+// new peak, so the plot can mostly be scrolled instead of redrawn.
+static double graph_nice_scale(double value) {
+    static const double steps[] = {1.0, 1.5, 2.0, 3.0, 4.0, 5.0, 6.0, 8.0, 10.0};
+    double decade = 1.0;
+    
+    while (decade * 10.0 <= value) {
+        decade *= 10.0;
+    }
+    while (decade > value && decade > 1e-9) {
+        decade /= 10.0;
+    }
+    for (guint i = 0; i < G_N_ELEMENTS(steps); i++) {
+        if (decade * steps[i] >= value) {
+            return decade * steps[i];
+        }
+    }
+    return decade * 10.0;
+}
+
+static cairo_surface_t *graph_layer_new(cairo_format_t format, int width, int height, int scale) {
+    cairo_surface_t *layer = cairo_image_surface_create(format, width * scale, height * scale);
+    cairo_surface_set_device_scale(layer, scale, scale);
+    return layer;
+}
+
+// Sizes the layers to the widget, painting the background and grid once.
+// They are image surfaces at the widget's scale: the cairo_t handed to a
+// draw function records into a node, and layers similar to that would be
+// recordings too, nested one more level on every scroll.
+static void graph_cache_resize(GraphCache *gc, int width, int height, int scale) {
+    if (gc->background != NULL && gc->width == width && gc->height == height && gc->device_scale == scale) {
+        return;
+    }
+    
+    g_clear_pointer(&gc->background, cairo_surface_destroy);
+    g_clear_pointer(&gc->plot[0], cairo_surface_destroy);
+    g_clear_pointer(&gc->plot[1], cairo_surface_destroy);
+    gc->background = graph_layer_new(CAIRO_FORMAT_RGB24, width, height, scale);
+    gc->plot[0] = graph_layer_new(CAIRO_FORMAT_ARGB32, width, height, scale);
+    gc->plot[1] = graph_layer_new(CAIRO_FORMAT_ARGB32, width, height, scale);
+    gc->width = width;
+    gc->height = height;
+    gc->device_scale = scale;
+    gc->valid = FALSE;
+    
+    cairo_t *bg = cairo_create(gc->background);
+    cairo_set_source_rgb(bg, 0.1, 0.1, 0.1);
+    cairo_paint(bg);
+    
+    // Grid lines, in one stroke
+    cairo_set_source_rgba(bg, 0.3, 0.3, 0.3, 0.5);
+    cairo_set_line_width(bg, 1.0);
+    for (int i = 0; i <= 5; i++) {
+        double y = (height / 5.0) * i;
+        cairo_move_to(bg, 0, y);
+        cairo_line_to(bg, width, y);
+    }
+    cairo_stroke(bg);
+    cairo_destroy(bg);
+}
+
+// Live mode line: 0 RX, 1 TX, 2 and 3 the overlay's RX and TX
+static double graph_line_value(const StatsTable *stats, int row, int series, int line, int i) {
+    switch (line) {
+    case 0: return stats_table_rx(stats, row, i);
+    case 1: return stats_table_tx(stats, row, i);
+    default: return stats_table_series(stats, row, series, line - 2, i);
+    }
+}
+
+// Samples from .. to of one line cut down to the lowest and the highest
+// in each pixel column, in time order, as ring indices.  from and to
+// are kept so runs still join up.  A redraw of a minute at 10 ms then
+// strokes two points a column instead of 6000.  Returns the count, at
+// most to - from + 1.
+static int graph_line_reduce(const StatsTable *stats, int row, int series, int line, int from, int to,
+                             double ns_per_px, int *out) {
+    int n = 0;
+    
+    if (to < from) {
+        return 0;
+    }
+    out[n++] = from;
+    for (int i = from + 1; i < to;) {
+        int64_t column = (int64_t)(stats_table_t(stats, row, i) / ns_per_px);
+        double lo_value = graph_line_value(stats, row, series, line, i);
+        double hi_value = lo_value;
+        int lo = i, hi = i;
+        
+        for (i++; i < to && (int64_t)(stats_table_t(stats, row, i) / ns_per_px) == column; i++) {
+            double value = graph_line_value(stats, row, series, line, i);
+            if (value < lo_value) {
+                lo_value = value;
+                lo = i;
+            }
+            if (value > hi_value) {
+                hi_value = value;
+                hi = i;
+            }
+        }
+        out[n++] = MIN(lo, hi);
+        if (hi != lo) {
+            out[n++] = MAX(lo, hi);
+        }
+    }
+    if (to > from) {
+        out[n++] = to;
+    }
+    return n;
+}
+
+// Strokes every line from sample first to the newest, every sample or,
+// with reduced, graph_line_reduce's.  A sample's x is its time in whole
+// pixels counted back from the newest, so a point keeps its place on
+// the layer as it scrolls.  The overlay's dashes carry on from where
+// the last stroke left them.
+static void graph_plot_lines(GraphCache *gc, cairo_t *cr, const StatsTable *stats, int row, int series, int first,
+                             double ns_per_px, int *reduced) {
+    static const double dashes[] = {6.0, 4.0};
+    int lines = series >= 0 ? 4 : 2;
+    
+    for (int line = 0; line < lines; line++) {
+        double scale = line < 2 ? gc->scale : gc->series_scale;
+        double px = 0.0, py = 0.0;
+        double length = 0.0;
+        
+        if (line < 2) {
+            if (line == 0) {
+                cairo_set_source_rgb(cr, 0.2, 0.8, 0.2);  // RX green
+            } else {
+                cairo_set_source_rgb(cr, 0.8, 0.2, 0.2);  // TX red
+            }
+            cairo_set_line_width(cr, 2.0);
+            cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+            cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+            cairo_set_dash(cr, NULL, 0, 0);
+        } else {
+            if (line == 2) {
+                cairo_set_source_rgb(cr, 0.3, 0.7, 1.0);  // overlay RX blue
+            } else {
+                cairo_set_source_rgb(cr, 1.0, 0.7, 0.2);  // overlay TX amber
+            }
+            cairo_set_line_width(cr, 1.5);
+            cairo_set_line_cap(cr, CAIRO_LINE_CAP_BUTT);
+            cairo_set_dash(cr, dashes, G_N_ELEMENTS(dashes), gc->dash_offset[line - 2]);
+        }
+        
+        int n = reduced != NULL ?
+            graph_line_reduce(stats, row, series, line, first, STATS_HISTORY_LEN - 1, ns_per_px, reduced) :
+            STATS_HISTORY_LEN - first;
+        cairo_new_path(cr);
+        for (int k = 0; k < n; k++) {
+            int i = reduced != NULL ? reduced[k] : first + k;
+            int64_t t = stats_table_t(stats, row, i);
+            double x = gc->width - (gc->end_px - (int64_t)(t / ns_per_px));
+            double y = gc->height - graph_line_value(stats, row, series, line, i) / scale * gc->height;
+            if (k > 0) {
+                length += hypot(x - px, y - py);
+            }
+            cairo_line_to(cr, x, y);
+            px = x;
+            py = y;
+        }
+        cairo_stroke(cr);
+        
+        if (line >= 2) {
+            gc->dash_offset[line - 2] = fmod(gc->dash_offset[line - 2] + length, dashes[0] + dashes[1]);
+        }
+    }
+}
+
+// Widens *max over samples first .. STATS_HISTORY_LEN - 1 of one history
+// ring, which in the array are two runs at most
+static void graph_ring_max(const float *ring, int head, int first, float *max) {
+    int start = (head + first) % STATS_HISTORY_LEN;
+    int n = STATS_HISTORY_LEN - first;
+    int run = MIN(n, STATS_HISTORY_LEN - start);
+    float min = 0.0f;
+    
+    decimate_minmax(ring + start, run, &min, max);
+    decimate_minmax(ring, n - run, &min, max);
+}
+
+// Live mode's oldest sample in the window (STATS_HISTORY_LEN for none),
+// and the scales for it
+static int graph_live_scan(const StatsTable *stats, int row, int series, int64_t start_ns, double *scale,
+                           double *series_scale) {
+    // The ring is in time order, unused slots (t = 0) first
+    int lo = 0;
+    int hi = STATS_HISTORY_LEN;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (stats_table_t(stats, row, mid) < start_ns) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    int first = lo;
+    
+    // Find max values for scaling
+    float max_value = 1.0f;
+    float series_max = 1.0f;
+    if (first < STATS_HISTORY_LEN) {
+        const StatsRing *ring = stats->ring[row];
+        graph_ring_max(ring->rx, ring->head, first, &max_value);
+        graph_ring_max(ring->tx, ring->head, first, &max_value);
+        for (int tx = 0; series >= 0 && tx < 2; tx++) {
+            graph_ring_max(ring->series[series][tx], ring->head, first, &series_max);
+        }
+    }
+    *scale = graph_nice_scale(max_value * 1.2);  // 20% headroom at least
+    *series_scale = series >= 0 ? graph_nice_scale(series_max * 1.2) : 0.0;
+    return first;
+}
+
+// Live mode: every sample in the history ring that falls inside the
+// window, onto plot[0].  Returns whether the layer was only scrolled.
+static gboolean draw_live_history(AppData *data, int row, int64_t window_ns, int width, int height) {
+    const StatsTable *stats = &data->collector.stats;
+    GraphCache *gc = &data->graph_cache;
+    int series = data->graph_series;
+    int64_t end_ns = stats->last_ns[row];
+    double ns_per_px = (double)window_ns / width;
+    int64_t end_px = (int64_t)(end_ns / ns_per_px);
+    double scale, series_scale;
+    int first = graph_live_scan(stats, row, series, end_ns - window_ns, &scale, &series_scale);
+    
+    // Scrolling needs the last sample drawn still in the ring, and the
+    // same picture otherwise
+    int from = -1;
+    if (gc->valid && gc->ifindex == stats->ifindex[row] && gc->series == series && gc->window_ns == window_ns &&
+        gc->scale == scale && gc->series_scale == series_scale && end_px >= gc->end_px &&
+        end_px - gc->end_px < width) {
+        for (int i = STATS_HISTORY_LEN - 1; i >= 0 && stats_table_t(stats, row, i) >= gc->last_t; i--) {
+            if (stats_table_t(stats, row, i) == gc->last_t) {
+                from = i;
+                break;
+            }
+        }
+    }
+    
+    gboolean scroll = from >= 0;
+    cairo_t *cr;
+    if (scroll) {
+        cr = cairo_create(gc->plot[1]);
+        cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+        cairo_set_source_surface(cr, gc->plot[0], -(double)(end_px - gc->end_px), 0);
+        cairo_paint(cr);
+        cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+        
+        cairo_surface_t *plot = gc->plot[0];
+        gc->plot[0] = gc->plot[1];
+        gc->plot[1] = plot;
+    } else {
+        cr = cairo_create(gc->plot[0]);
+        cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+        cairo_paint(cr);
+        cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+        
+        gc->ifindex = stats->ifindex[row];
+        gc->series = series;
+        gc->window_ns = window_ns;
+        gc->scale = scale;
+        gc->series_scale = series_scale;
+        gc->dash_offset[0] = gc->dash_offset[1] = 0.0;
+        from = first;
+    }
+    // A redraw takes the whole window at two points a column; a scroll
+    // only has the new samples to stroke
+    gc->end_px = end_px;
+    graph_plot_lines(gc, cr, stats, row, series, from, ns_per_px, scroll ? NULL : gc->reduced);
+    cairo_destroy(cr);
+    
+    gc->last_t = end_ns;
+    gc->valid = TRUE;
+    return scroll;
+}
+
+#define GRAPH_ARCHIVE_STEP_MS 4000
+#define GRAPH_ARCHIVE_BUCKETS (1 << 19)    // 24 days of 4 s buckets
+#define GRAPH_ARCHIVE_BUDGET (1 << 18)     // samples decoded per frame
+
+static void graph_archive_reset(GraphArchive *ga, const TscSeries *archive, int ifindex) {
+    decim_pyramid_free(&ga->pyramid);
+    decim_pyramid_init(&ga->pyramid, tsc_series_first(archive), GRAPH_ARCHIVE_STEP_MS, GRAPH_ARCHIVE_BUCKETS);
+    ga->ifindex = ifindex;
+    ga->prev_t = 0;
+    ga->prev[0] = ga->prev[1] = 0;
+}
+
+// Folds the archive's samples since the last call into the pyramid as
+// rates, decoding GRAPH_ARCHIVE_BUDGET of them at most.  Returns FALSE
+// while there are more to go.
+static gboolean graph_archive_update(GraphArchive *ga, const TscSeries *archive, int ifindex) {
+    int64_t first = tsc_series_first(archive);
+    int64_t t_ms;
+    uint64_t counters[2];
+    TscIter it;
+    
+    // Start over for another interface, and when the archive is not the
+    // one decoded so far: recreated, or dropping blocks faster than read
+    if (ga->ifindex != ifindex || first < ga->pyramid.t0_ms ||
+        (ga->prev_t != 0 && (first > ga->prev_t || archive->prev_t < ga->prev_t))) {
+        graph_archive_reset(ga, archive, ifindex);
+    }
+    
+    tsc_iter_init(&it, archive, ga->prev_t + 1);
+    for (int i = 0; i < GRAPH_ARCHIVE_BUDGET; i++) {
+        if (!tsc_iter_next(&it, &t_ms, counters)) {
+            return TRUE;
+        }
         
-        // Skip loopback
-        if (strcmp(ifa->ifa_name, "lo") == 0)
-            continue;
+        int64_t dt = t_ms - ga->prev_t;
+        int reset = 0;
+        uint64_t rx_delta = link_counter_delta(ga->prev[0], counters[0], 0, &reset);
+        uint64_t tx_delta = link_counter_delta(ga->prev[1], counters[1], 0, &reset);
         
-        int family = ifa->ifa_addr->sa_family;
+        // Skip the first sample and counter resets
+        if (ga->prev_t != 0 && dt > 0 && !reset) {
+            float rx = rx_delta * 1000.0 / dt / 1024.0; // KB/s
+            float tx = tx_delta * 1000.0 / dt / 1024.0;
+            if (decim_pyramid_add(&ga->pyramid, t_ms, rx, tx) < 0) {
+                // Full (or out of memory): begin again from what the
+                // archive holds by then
+                ga->ifindex = 0;
+                return FALSE;
+            }
+        }
         
-        if (family == AF_INET) {
-            // Check if already added
-            gboolean found = FALSE;
-            guint n_items = g_list_model_get_n_items(G_LIST_MODEL(string_list));
-            
-            for (guint i = 0; i < n_items; i++) {
-                const char *item = gtk_string_list_get_string(string_list, i);
-                if (strcmp(item, ifa->ifa_name) == 0) {
-                    found = TRUE;
-                    break;
-                }
+        ga->prev_t = t_ms;
+        ga->prev[0] = counters[0];
+        ga->prev[1] = counters[1];
+    }
+    return FALSE;
+}
+
+// Average as a line over a min/max band, one vertical stroke per point
+static void draw_history_points(cairo_t *cr, const RrdPoint *points, int n, int64_t start_ns, int64_t window_ns,
+                                int64_t step_ns, double max_value, int width, int height) {
+    double bucket_width = MAX(1.0, (double)step_ns / window_ns * width);
+    
+    for (int series = 0; series < 2; series++) {
+        double r = series == 0 ? 0.2 : 0.8;
+        double g = series == 0 ? 0.8 : 0.2;
+        
+        // Min/max band
+        cairo_set_source_rgba(cr, r, g, 0.2, 0.3);
+        cairo_set_line_width(cr, bucket_width);
+        cairo_new_path(cr);
+        for (int i = 0; i < n; i++) {
+            double x = (double)(points[i].t_ns - start_ns) / window_ns * width;
+            double lo = series == 0 ? points[i].rx_min : points[i].tx_min;
+            double hi = series == 0 ? points[i].rx_max : points[i].tx_max;
+            cairo_move_to(cr, x, height - lo / max_value * height);
+            cairo_line_to(cr, x, height - hi / max_value * height);
+        }
+        cairo_stroke(cr);
+        
+        // Average line, broken wherever points are missing
+        cairo_set_source_rgb(cr, r, g, 0.2);
+        cairo_set_line_width(cr, 2.0);
+        cairo_new_path(cr);
+        for (int i = 0; i < n; i++) {
+            double x = (double)(points[i].t_ns - start_ns) / window_ns * width;
+            double avg = series == 0 ? points[i].rx_avg : points[i].tx_avg;
+            double y = height - avg / max_value * height;
+            if (i > 0 && points[i].t_ns - points[i - 1].t_ns > step_ns) {
+                cairo_move_to(cr, x, y);
+            } else {
+                cairo_line_to(cr, x, y);
+            }
+        }
+        cairo_stroke(cr);
+    }
+}
+
+// History mode: windows past an hour come from the 1 s archive while it
+// reaches back far enough, so spikes keep their height instead of being
+// averaged into 10 s or 5 min buckets; otherwise from the history tiers.
+// Either way there is one point per pixel column at most.  The points go
+// to data->rrd_points; returns their count (-1 for no history at all) and
+// the scale.
+static int graph_history_query(AppData *data, int row, int width, int64_t *start, int64_t *step,
+                               double *max_value) {
+    const StatsTable *stats = &data->collector.stats;
+    const Rrd *rrd = stats->rrd[row];
+    GraphArchive *ga = &data->graph_archive;
+    int64_t window_ns = data->graph_window_ns;
+    int64_t end_ms = g_get_real_time() / 1000;
+    int64_t end_ns = end_ms * 1000000;
+    int64_t start_ns = end_ns - window_ns;
+    int64_t step_ns;
+    int columns = MIN(width, RRD_MAX_SLOTS + 1);
+    RrdPoint *points = data->rrd_points;
+    int n = -1;
+    
+    if (window_ns > 3600000000000LL) {
+        if (!graph_archive_update(ga, &stats->archive[row], stats->ifindex[row])) {
+            // Still catching up: the tiers until then, and another frame soon
+            gtk_widget_queue_draw(data->network_graph);
+        } else if (ga->pyramid.t0_ms <= start_ns / 1000000) {
+            n = decim_pyramid_query(&ga->pyramid, start_ns / 1000000, end_ms, columns, points);
+            step_ns = (window_ns / 1000000 + columns - 1) / columns * 1000000;
+        }
+    }
+    
+    if (n < 0) {
+        if (rrd == NULL) {
+            *max_value = 1.0;
+            return -1;
+        }
+        n = rrd_query(rrd, start_ns, end_ns, points, RRD_MAX_SLOTS + 1, &step_ns);
+        
+        // The 10 s tier has 8640 buckets in a day, more than the graph has
+        // pixels: stroking them all only overdraws the same columns
+        if (n > columns) {
+            n = decimate_points(points, n, start_ns, window_ns, columns, points);
+            step_ns = (window_ns + columns - 1) / columns;
+        }
+    }
+    
+    *max_value = 1.0;
+    for (int i = 0; i < n; i++) {
+        if (points[i].rx_max > *max_value) *max_value = points[i].rx_max;
+        if (points[i].tx_max > *max_value) *max_value = points[i].tx_max;
+    }
+    *max_value *= 1.2; // Add 20% headroom
+    *start = start_ns;
+    *step = step_ns;
+    return n;
+}
+
+static double draw_rrd_history(AppData *data, cairo_t *cr, int row, int width, int height) {
+    int64_t start_ns, step_ns;
+    double max_value;
+    int n = graph_history_query(data, row, width, &start_ns, &step_ns, &max_value);
+    
+    if (n > 0) {
+        draw_history_points(cr, data->rrd_points, n, start_ns, data->graph_window_ns, step_ns, max_value,
+                            width, height);
+    }
+    return max_value;
+}
+
+// Shapes legend line `line` again if its text changed; returns whether
+// it did
+static gboolean graph_legend_update(AppData *data, int line, const char *text) {
+    GraphCache *gc = &data->graph_cache;
+    
+    if (gc->legend[line] == NULL) {
+        PangoFontDescription *font = pango_font_description_from_string("monospace bold");
+        pango_font_description_set_absolute_size(font, 14 * PANGO_SCALE);
+        gc->legend[line] = gtk_widget_create_pango_layout(data->network_graph, NULL);
+        pango_layout_set_font_description(gc->legend[line], font);
+        pango_font_description_free(font);
+    }
+    if (strcmp(gc->legend_text[line], text) == 0) {
+        return FALSE;
+    }
+    g_strlcpy(gc->legend_text[line], text, sizeof(gc->legend_text[line]));
+    pango_layout_set_text(gc->legend[line], text, -1);
+    g_clear_pointer(&gc->nodes.legend[line], gsk_render_node_unref);
+    return TRUE;
+}
+
+// A legend line with its baseline at y, in white
+static void graph_legend_show(AppData *data, cairo_t *cr, int line, const char *text, double y) {
+    GraphCache *gc = &data->graph_cache;
+    
+    graph_legend_update(data, line, text);
+    cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+    cairo_move_to(cr, 10, y - (double)pango_layout_get_baseline(gc->legend[line]) / PANGO_SCALE);
+    pango_cairo_show_layout(cr, gc->legend[line]);
+}
+
+static void network_graph_frame(AppData *data, int64_t start_us, gboolean scrolled) {
+    GraphCache *gc = &data->graph_cache;
+    
+    gc->frames++;
+    gc->scrolled += scrolled;
+    gc->frame_us += g_get_monotonic_time() - start_us;
+}
+
+// The legend's lines for a frame: current values with total bytes, then
+// the overlay's and counter resets if there is anything to say.  Returns
+// how many lines there are.
+static int graph_legend_text(AppData *data, int row, int64_t window_ns, double max_value, double series_max,
+                             char legend[2][512]) {
+    const StatsTable *stats = &data->collector.stats;
+    int current_index = STATS_HISTORY_LEN - 1;
+    double total_rx_gb = stats->rx_bytes[row] / (1024.0 * 1024.0 * 1024.0);
+    double total_tx_gb = stats->tx_bytes[row] / (1024.0 * 1024.0 * 1024.0);
+    
+    char window_text[32];
+    if (window_ns >= 3600000000000LL) {
+        snprintf(window_text, sizeof(window_text), "%.0f h", window_ns / 3600e9);
+    } else if (window_ns >= 600000000000LL) {
+        snprintf(window_text, sizeof(window_text), "%.0f min", window_ns / 60e9);
+    } else {
+        snprintf(window_text, sizeof(window_text), "%.0f s", window_ns / 1e9);
+    }
+    
+    snprintf(legend[0], sizeof(legend[0]), 
+             "↓ RX: %.2f KB/s  ↑ TX: %.2f KB/s  Max: %.2f KB/s  |  Total RX: %.2f GB  Total TX: %.2f GB  |  Window: %s",
+             stats_table_rx(stats, row, current_index), stats_table_tx(stats, row, current_index), max_value,
+             total_rx_gb, total_tx_gb, window_text);
+    
+    // Second line: the overlay's rates and totals, and counter resets
+    if (data->graph_series < 0 && stats->resets[row] == 0) {
+        return 1;
+    }
+    
+    const uint64_t *counters = stats->counters[row];
+    char resets[48] = "";
+    if (stats->resets[row] > 0) {
+        snprintf(resets, sizeof(resets), "Counter resets: %u", stats->resets[row]);
+    }
+    
+    if (data->graph_series < 0) {
+        g_strlcpy(legend[1], resets, sizeof(legend[1]));
+    } else {
+        static const char *const names[STATS_SERIES] = {"Packets/s", "Drops/s", "Errors/s"};
+        unsigned long long total_rx, total_tx;
+        
+        switch (data->graph_series) {
+        case STATS_SERIES_PACKETS:
+            total_rx = counters[LINK_RX_PACKETS];
+            total_tx = counters[LINK_TX_PACKETS];
+            break;
+        case STATS_SERIES_DROPS:
+            total_rx = counters[LINK_RX_DROPPED] + counters[LINK_RX_MISSED_ERRORS];
+            total_tx = counters[LINK_TX_DROPPED];
+            break;
+        default:
+            total_rx = counters[LINK_RX_ERRORS];
+            total_tx = counters[LINK_TX_ERRORS];
+            break;
+        }
+        
+        // The history tiers only keep throughput
+        if (data->graph_window_ns != 0) {
+            snprintf(legend[1], sizeof(legend[1]), "%s: Live window only  |  Total RX: %llu  Total TX: %llu%s%s",
+                     names[data->graph_series], total_rx, total_tx, resets[0] ? "  |  " : "", resets);
+        } else {
+            snprintf(legend[1], sizeof(legend[1]), "- - %s  ↓ RX: %.0f  ↑ TX: %.0f  Max: %.0f  |  Total RX: %llu  Total TX: %llu%s%s",
+                     names[data->graph_series],
+                     stats_table_series(stats, row, data->graph_series, 0, current_index),
+                     stats_table_series(stats, row, data->graph_series, 1, current_index),
+                     series_max, total_rx, total_tx, resets[0] ? "  |  " : "", resets);
+        }
+    }
+    
+    return 2;
+}
+
+// Paints a frame with Cairo, for the Cairo renderer
+static void network_graph_draw(AppData *data, cairo_t *cr, int width, int height, int scale) {
+    const StatsTable *stats = &data->collector.stats;
+    GraphCache *gc = &data->graph_cache;
+    int row = stats_table_lookup(stats, data->selected_ifindex);
+    int64_t start_us = g_get_monotonic_time();
+    gboolean scrolled = FALSE;
+    
+    graph_cache_resize(gc, width, height, scale);
+    cairo_set_source_surface(cr, gc->background, 0, 0);
+    cairo_paint(cr);
+    
+    if (row < 0 || stats->last_ns[row] == 0) {
+        gc->valid = FALSE;
+        network_graph_frame(data, start_us, FALSE);
+        return;
+    }
+    
+    double max_value;
+    double series_max = 0.0;
+    int64_t window_ns;
+    
+    if (data->graph_window_ns != 0) {
+        // Redrawn once a second at most, and never scrolled
+        window_ns = data->graph_window_ns;
+        max_value = draw_rrd_history(data, cr, row, width, height);
+        gc->valid = FALSE;
+    } else {
+        // The x axis is real time: 60 s, or whatever the history ring holds
+        // at the current sampling rate
+        window_ns = MIN(60000000000LL, STATS_HISTORY_LEN * data->collector.interval_ns);
+        scrolled = draw_live_history(data, row, window_ns, width, height);
+        max_value = gc->scale;
+        series_max = gc->series_scale;
+        cairo_set_source_surface(cr, gc->plot[0], 0, 0);
+        cairo_paint(cr);
+    }
+    
+    char legend[2][512];
+    int lines = graph_legend_text(data, row, window_ns, max_value, series_max, legend);
+    for (int line = 0; line < lines; line++) {
+        graph_legend_show(data, cr, line, legend[line], 20 + 20 * line);
+    }
+    network_graph_frame(data, start_us, scrolled);
+}
+
+#if GTK_CHECK_VERSION(4, 14, 0)
+// Past this many pixels from origin_px the chunks are stroked afresh, so
+// their float coordinates stay exact
+#define GRAPH_NODES_REBASE_PX (1 << 20)
+
+static GskRenderNode *graph_nodes_background(int width, int height) {
+    GtkSnapshot *snapshot = gtk_snapshot_new();
+    const GdkRGBA background = {0.1, 0.1, 0.1, 1.0};
+    const GdkRGBA grid = {0.3, 0.3, 0.3, 0.5};
+    
+    gtk_snapshot_append_color(snapshot, &background, &GRAPHENE_RECT_INIT(0, 0, width, height));
+    for (int i = 0; i <= 5; i++) {
+        float y = (height / 5.0) * i;
+        gtk_snapshot_append_color(snapshot, &grid, &GRAPHENE_RECT_INIT(0, y - 0.5f, width, 1));
+    }
+    return gtk_snapshot_free_to_node(snapshot);
+}
+
+static void graph_nodes_clear(GraphNodes *gn) {
+    for (int i = 0; i < gn->chunk_count; i++) {
+        gsk_render_node_unref(gn->chunks[i].node);
+    }
+    gn->chunk_count = 0;
+    gn->valid = FALSE;
+}
+
+// graph_plot_lines as paths: samples from .. to, or graph_line_reduce's
+// with reduced, with x in whole pixels from origin_px.  dash_offset
+// carries the overlay's dashes on.
+static void graph_nodes_stroke(GtkSnapshot *snapshot, const GraphNodes *gn, const StatsTable *stats, int row,
+                               int from, int to, double ns_per_px, double dash_offset[2], int *reduced) {
+    static const float dashes[] = {6.0f, 4.0f};
+    static const GdkRGBA colors[] = {
+        {0.2, 0.8, 0.2, 1.0},   // RX green
+        {0.8, 0.2, 0.2, 1.0},   // TX red
+        {0.3, 0.7, 1.0, 1.0},   // overlay RX blue
+        {1.0, 0.7, 0.2, 1.0}    // overlay TX amber
+    };
+    int lines = gn->series >= 0 ? 4 : 2;
+    
+    for (int line = 0; line < lines; line++) {
+        double scale = line < 2 ? gn->scale : gn->series_scale;
+        GskPathBuilder *builder = gsk_path_builder_new();
+        float px = 0.0f, py = 0.0f;
+        double length = 0.0;
+        
+        int n = reduced != NULL ?
+            graph_line_reduce(stats, row, gn->series, line, from, to, ns_per_px, reduced) : to - from + 1;
+        for (int k = 0; k < n; k++) {
+            int i = reduced != NULL ? reduced[k] : from + k;
+            int64_t t = stats_table_t(stats, row, i);
+            float x = (int64_t)(t / ns_per_px) - gn->origin_px;
+            float y = gn->height - graph_line_value(stats, row, gn->series, line, i) / scale * gn->height;
+            if (k == 0) {
+                gsk_path_builder_move_to(builder, x, y);
+            } else {
+                gsk_path_builder_line_to(builder, x, y);
+                length += hypot(x - px, y - py);
+            }
+            px = x;
+            py = y;
+        }
+        GskPath *path = gsk_path_builder_free_to_path(builder);
+        
+        GskStroke *stroke = gsk_stroke_new(line < 2 ? 2.0f : 1.5f);
+        gsk_stroke_set_line_join(stroke, GSK_LINE_JOIN_ROUND);
+        if (line < 2) {
+            gsk_stroke_set_line_cap(stroke, GSK_LINE_CAP_ROUND);
+        } else {
+            gsk_stroke_set_dash(stroke, dashes, G_N_ELEMENTS(dashes));
+            gsk_stroke_set_dash_offset(stroke, dash_offset[line - 2]);
+            dash_offset[line - 2] = fmod(dash_offset[line - 2] + length, dashes[0] + dashes[1]);
+        }
+        gtk_snapshot_append_stroke(snapshot, path, stroke, &colors[line]);
+        gsk_stroke_free(stroke);
+        gsk_path_unref(path);
+    }
+}
+
+// Live mode: finished chunks as they are, new ones for every
+// GRAPH_CHUNK_SAMPLES samples since, and the samples after those stroked
+// for this frame only.  Returns whether the chunks were kept.
+static gboolean snapshot_live_history(AppData *data, GtkSnapshot *snapshot, int row, int64_t window_ns,
+                                      int width) {
+    const StatsTable *stats = &data->collector.stats;
+    GraphNodes *gn = &data->graph_cache.nodes;
+    int series = data->graph_series;
+    int64_t end_ns = stats->last_ns[row];
+    double ns_per_px = (double)window_ns / width;
+    int64_t end_px = (int64_t)(end_ns / ns_per_px);
+    double scale, series_scale;
+    int first = graph_live_scan(stats, row, series, end_ns - window_ns, &scale, &series_scale);
+    
+    // The chunks can stay while the last sample in them is still in the
+    // ring and the picture is otherwise the same
+    int from = -1;
+    if (gn->valid && gn->ifindex == stats->ifindex[row] && gn->series == series && gn->window_ns == window_ns &&
+        gn->scale == scale && gn->series_scale == series_scale && end_px >= gn->origin_px &&
+        end_px - gn->origin_px < GRAPH_NODES_REBASE_PX) {
+        for (int i = STATS_HISTORY_LEN - 1; i >= 0 && stats_table_t(stats, row, i) >= gn->last_t; i--) {
+            if (stats_table_t(stats, row, i) == gn->last_t) {
+                from = i;
+                break;
+            }
+        }
+    }
+    
+    gboolean kept = from >= 0;
+    if (!kept) {
+        graph_nodes_clear(gn);
+        gn->ifindex = stats->ifindex[row];
+        gn->series = series;
+        gn->window_ns = window_ns;
+        gn->scale = scale;
+        gn->series_scale = series_scale;
+        if (first >= STATS_HISTORY_LEN) {
+            return FALSE;
+        }
+        gn->valid = TRUE;
+        gn->origin_px = end_px;
+        gn->last_t = stats_table_t(stats, row, first);
+        gn->dash_offset[0] = gn->dash_offset[1] = 0.0;
+        from = first;
+    }
+    
+    // Chunks that have scrolled out of sight
+    int gone = 0;
+    while (gone < gn->chunk_count && (int64_t)(gn->chunks[gone].last_t / ns_per_px) < end_px - width) {
+        gsk_render_node_unref(gn->chunks[gone].node);
+        gone++;
+    }
+    gn->chunk_count -= gone;
+    memmove(gn->chunks, gn->chunks + gone, gn->chunk_count * sizeof(GraphChunk));
+    
+    // Each chunk ends on the sample the next one starts from, so the
+    // lines run on without a gap.  Rebuilt chunks cover the whole window
+    // and take two points a column; new ones on a kept frame are only
+    // the samples since.
+    int *reduced = kept ? NULL : data->graph_cache.reduced;
+    while (STATS_HISTORY_LEN - 1 - from >= GRAPH_CHUNK_SAMPLES && gn->chunk_count < GRAPH_MAX_CHUNKS) {
+        int to = from + GRAPH_CHUNK_SAMPLES;
+        GtkSnapshot *chunk = gtk_snapshot_new();
+        
+        graph_nodes_stroke(chunk, gn, stats, row, from, to, ns_per_px, gn->dash_offset, reduced);
+        gn->chunks[gn->chunk_count].node = gtk_snapshot_free_to_node(chunk);
+        gn->chunks[gn->chunk_count].last_t = stats_table_t(stats, row, to);
+        if (gn->chunks[gn->chunk_count].node != NULL) {
+            gn->chunk_count++;
+        }
+        gn->last_t = stats_table_t(stats, row, to);
+        from = to;
+    }
+    
+    gtk_snapshot_save(snapshot);
+    gtk_snapshot_translate(snapshot, &GRAPHENE_POINT_INIT(width - (end_px - gn->origin_px), 0));
+    for (int i = 0; i < gn->chunk_count; i++) {
+        gtk_snapshot_append_node(snapshot, gn->chunks[i].node);
+    }
+    if (from < STATS_HISTORY_LEN - 1) {
+        double dash_offset[2] = {gn->dash_offset[0], gn->dash_offset[1]};
+        graph_nodes_stroke(snapshot, gn, stats, row, from, STATS_HISTORY_LEN - 1, ns_per_px, dash_offset, NULL);
+    }
+    gtk_snapshot_restore(snapshot);
+    return kept;
+}
+
+// draw_rrd_history as paths
+static double snapshot_rrd_history(AppData *data, GtkSnapshot *snapshot, int row, int width, int height) {
+    const RrdPoint *points = data->rrd_points;
+    int64_t window_ns = data->graph_window_ns;
+    int64_t start_ns, step_ns;
+    double max_value;
+    int n = graph_history_query(data, row, width, &start_ns, &step_ns, &max_value);
+    
+    if (n <= 0) {
+        return max_value;
+    }
+    float bucket_width = MAX(1.0, (double)step_ns / window_ns * width);
+    
+    for (int series = 0; series < 2; series++) {
+        float r = series == 0 ? 0.2f : 0.8f;
+        float g = series == 0 ? 0.8f : 0.2f;
+        GskPathBuilder *builder;
+        GskPath *path;
+        GskStroke *stroke;
+        
+        // Min/max band
+        builder = gsk_path_builder_new();
+        for (int i = 0; i < n; i++) {
+            float x = (double)(points[i].t_ns - start_ns) / window_ns * width;
+            double lo = series == 0 ? points[i].rx_min : points[i].tx_min;
+            double hi = series == 0 ? points[i].rx_max : points[i].tx_max;
+            gsk_path_builder_move_to(builder, x, height - lo / max_value * height);
+            gsk_path_builder_line_to(builder, x, height - hi / max_value * height);
+        }
+        path = gsk_path_builder_free_to_path(builder);
+        stroke = gsk_stroke_new(bucket_width);
+        gtk_snapshot_append_stroke(snapshot, path, stroke, &(GdkRGBA){r, g, 0.2f, 0.3f});
+        gsk_stroke_free(stroke);
+        gsk_path_unref(path);
+        
+        // Average line, broken wherever points are missing
+        builder = gsk_path_builder_new();
+        for (int i = 0; i < n; i++) {
+            float x = (double)(points[i].t_ns - start_ns) / window_ns * width;
+            double avg = series == 0 ? points[i].rx_avg : points[i].tx_avg;
+            float y = height - avg / max_value * height;
+            if (i == 0 || points[i].t_ns - points[i - 1].t_ns > step_ns) {
+                gsk_path_builder_move_to(builder, x, y);
+            } else {
+                gsk_path_builder_line_to(builder, x, y);
             }
-            
-            if (!found) {
-                gtk_string_list_append(string_list, ifa->ifa_name);
+        }
+        path = gsk_path_builder_free_to_path(builder);
+        stroke = gsk_stroke_new(2.0f);
+        gtk_snapshot_append_stroke(snapshot, path, stroke, &(GdkRGBA){r, g, 0.2f, 1.0f});
+        gsk_stroke_free(stroke);
+        gsk_path_unref(path);
+    }
+    return max_value;
+}
+
+// graph_legend_show as a text node, kept until the text changes
+static void snapshot_legend(AppData *data, GtkSnapshot *snapshot, int line, const char *text, float y) {
+    GraphCache *gc = &data->graph_cache;
+    GskRenderNode **node = &gc->nodes.legend[line];
+    
+    graph_legend_update(data, line, text);
+    if (*node == NULL) {
+        GtkSnapshot *legend = gtk_snapshot_new();
+        const GdkRGBA white = {1.0, 1.0, 1.0, 1.0};
+        
+        gtk_snapshot_translate(legend, &GRAPHENE_POINT_INIT(10, y - (float)pango_layout_get_baseline(gc->legend[line]) / PANGO_SCALE));
+        gtk_snapshot_append_layout(legend, gc->legend[line], &white);
+        *node = gtk_snapshot_free_to_node(legend);
+    }
+    if (*node != NULL) {
+        gtk_snapshot_append_node(snapshot, *node);
+    }
+}
+
+// Builds a frame as render nodes, for the GPU renderers
+static void network_graph_snapshot(AppData *data, GtkSnapshot *snapshot, int width, int height) {
+    const StatsTable *stats = &data->collector.stats;
+    GraphNodes *gn = &data->graph_cache.nodes;
+    int row = stats_table_lookup(stats, data->selected_ifindex);
+    int64_t start_us = g_get_monotonic_time();
+    gboolean kept = FALSE;
+    
+    if (gn->background == NULL || gn->width != width || gn->height != height) {
+        g_clear_pointer(&gn->background, gsk_render_node_unref);
+        graph_nodes_clear(gn);
+        gn->background = graph_nodes_background(width, height);
+        gn->width = width;
+        gn->height = height;
+    }
+    
+    gtk_snapshot_push_clip(snapshot, &GRAPHENE_RECT_INIT(0, 0, width, height));
+    gtk_snapshot_append_node(snapshot, gn->background);
+    
+    if (row < 0 || stats->last_ns[row] == 0) {
+        graph_nodes_clear(gn);
+        gtk_snapshot_pop(snapshot);
+        network_graph_frame(data, start_us, FALSE);
+        return;
+    }
+    
+    double max_value;
+    double series_max = 0.0;
+    int64_t window_ns;
+    
+    if (data->graph_window_ns != 0) {
+        window_ns = data->graph_window_ns;
+        max_value = snapshot_rrd_history(data, snapshot, row, width, height);
+        graph_nodes_clear(gn);
+    } else {
+        window_ns = MIN(60000000000LL, STATS_HISTORY_LEN * data->collector.interval_ns);
+        kept = snapshot_live_history(data, snapshot, row, window_ns, width);
+        max_value = gn->scale;
+        series_max = gn->series_scale;
+    }
+    
+    char legend[2][512];
+    int lines = graph_legend_text(data, row, window_ns, max_value, series_max, legend);
+    for (int line = 0; line < lines; line++) {
+        snapshot_legend(data, snapshot, line, legend[line], 20 + 20 * line);
+    }
+    gtk_snapshot_pop(snapshot);
+    network_graph_frame(data, start_us, kept);
+}
+#endif
+
+G_DEFINE_TYPE(GraphView, graph_view, GTK_TYPE_WIDGET)
+
+static void graph_view_snapshot(GtkWidget *widget, GtkSnapshot *snapshot) {
+    GraphView *view = GRAPH_VIEW(widget);
+    int width = gtk_widget_get_width(widget);
+    int height = gtk_widget_get_height(widget);
+    
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    
+#if GTK_CHECK_VERSION(4, 14, 0)
+    GskRenderer *renderer = gtk_native_get_renderer(gtk_widget_get_native(widget));
+    if (renderer != NULL && !GSK_IS_CAIRO_RENDERER(renderer)) {
+        network_graph_snapshot(view->app, snapshot, width, height);
+        return;
+    }
+#endif
+    
+    cairo_t *cr = gtk_snapshot_append_cairo(snapshot, &GRAPHENE_RECT_INIT(0, 0, width, height));
+    network_graph_draw(view->app, cr, width, height, gtk_widget_get_scale_factor(widget));
+    cairo_destroy(cr);
+}
+
+static void graph_view_class_init(GraphViewClass *klass) {
+    GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
+    
+    widget_class->snapshot = graph_view_snapshot;
+}
+
+static void graph_view_init(GraphView *view) {
+}
+
+static GtkWidget *graph_view_new(AppData *data) {
+    GraphView *view = g_object_new(GRAPH_TYPE_VIEW, NULL);
+    view->app = data;
+    return GTK_WIDGET(view);
+}
+
+// The interrupts followed are the graph's interface's; not while a read
+// is using the names, which then picks it up when done
+static void softnet_view_follow(SoftnetView *view) {
+    char name[IF_NAMESIZE];
+    
+    if (view->job != 0) {
+        view->follow = TRUE;
+        return;
+    }
+    if (if_indextoname(view->app->selected_ifindex, name) == NULL) {
+        name[0] = '\0';
+    }
+    softnet_set_interface(&view->softnet, name);
+}
+
+static void softnet_view_free(SoftnetView *view) {
+    softnet_close(&view->softnet);
+    cairo_surface_destroy(view->image);
+    g_free(view);
+}
+
+static void softnet_view_work(Job *job, void *user_data) {
+    SoftnetView *view = (SoftnetView *)user_data;
+    softnet_read(&view->softnet);
+}
+
+static void on_softnet_read(void *user_data, int cancelled) {
+    SoftnetView *view = (SoftnetView *)user_data;
+    
+    view->job = 0;
+    if (view->closed) {
+        softnet_view_free(view);
+        return;
+    }
+    softnet_commit(&view->softnet);
+    gtk_widget_queue_draw(view->area);
+    if (view->follow) {
+        view->follow = FALSE;
+        softnet_view_follow(view);
+    }
+}
+
+// Both files are read on a worker; a tick that finds the last read still
+// going skips rather than queueing another
+static gboolean softnet_view_tick(gpointer user_data) {
+    SoftnetView *view = (SoftnetView *)user_data;
+    
+    if (view->job == 0) {
+        view->job = job_submit(&view->app->jobs, 0, softnet_view_work, on_softnet_read, view);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// Black through red and yellow to white as value goes from 0 to 1
+static guint32 softnet_heat(double value) {
+    double r = CLAMP(value * 3.0, 0.0, 1.0);
+    double g = CLAMP(value * 3.0 - 1.0, 0.0, 1.0);
+    double b = CLAMP(value * 3.0 - 2.0, 0.0, 1.0);
+    
+    return ((guint32)(r * 255) << 16) | ((guint32)(g * 255) << 8) | (guint32)(b * 255);
+}
+
+static void softnet_view_draw(GtkDrawingArea *area, cairo_t *cr, int width, int height, gpointer user_data) {
+    SoftnetView *view = (SoftnetView *)user_data;
+    const Softnet *sn = &view->softnet;
+    static const char *const names[SOFTNET_METRICS] = {"Processed/s", "Dropped/s", "Squeezed/s", "NIC IRQs/s"};
+    int metric = (int)gtk_drop_down_get_selected(GTK_DROP_DOWN(view->metric_dropdown));
+    const double left = 60.0, top = 30.0;
+    
+    cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
+    cairo_rectangle(cr, 0, 0, width, height);
+    cairo_fill(cr);
+    
+    if (metric < 0 || metric >= SOFTNET_METRICS || width <= left || height <= top) {
+        return;
+    }
+    
+    // Scale to the busiest CPU in the window, and note which it is
+    double max_value = 0.0;
+    int max_cpu = 0;
+    for (int i = 0; i < SOFTNET_HISTORY; i++) {
+        if (softnet_t(sn, i) == 0) continue;
+        for (int cpu = 0; cpu < sn->ncpus; cpu++) {
+            if (softnet_rate(sn, metric, cpu, i) > max_value) {
+                max_value = softnet_rate(sn, metric, cpu, i);
+                max_cpu = cpu;
             }
         }
     }
     
-    freeifaddrs(ifaddr);
+    // One pixel per cell, stretched over the area without smoothing
+    unsigned char *pixels = cairo_image_surface_get_data(view->image);
+    int stride = cairo_image_surface_get_stride(view->image);
+    cairo_surface_flush(view->image);
+    for (int cpu = 0; cpu < sn->ncpus; cpu++) {
+        guint32 *row = (guint32 *)(pixels + (size_t)cpu * stride);
+        for (int i = 0; i < SOFTNET_HISTORY; i++) {
+            double value = max_value > 0.0 ? softnet_rate(sn, metric, cpu, i) / max_value : 0.0;
+            row[i] = softnet_t(sn, i) != 0 ? softnet_heat(value) : 0x1a1a1a;
+        }
+    }
+    cairo_surface_mark_dirty(view->image);
+    
+    cairo_save(cr);
+    cairo_translate(cr, left, top);
+    cairo_scale(cr, (width - left) / SOFTNET_HISTORY, (height - top) / sn->ncpus);
+    cairo_set_source_surface(cr, view->image, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+    cairo_paint(cr);
+    cairo_restore(cr);
+    
+    // CPU labels, as many as fit
+    cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 11);
+    cairo_set_source_rgb(cr, 0.8, 0.8, 0.8);
+    double row_height = (height - top) / sn->ncpus;
+    int step = 1;
+    while (step * row_height < 14.0) {
+        step++;
+    }
+    for (int cpu = 0; cpu < sn->ncpus; cpu += step) {
+        char label[16];
+        snprintf(label, sizeof(label), "CPU%d", cpu);
+        cairo_move_to(cr, 5, top + (cpu + 0.5) * row_height + 4);
+        cairo_show_text(cr, label);
+    }
+    
+    char legend[256];
+    if (metric == SOFTNET_IRQS && sn->irq_lines == 0) {
+        snprintf(legend, sizeof(legend), "%s: no interrupt lines for %s%s%s", names[metric],
+                 sn->ifname[0] ? sn->ifname : "this interface", sn->device[0] ? " or " : "", sn->device);
+    } else {
+        snprintf(legend, sizeof(legend), "%s  Max: %.0f (CPU%d)  |  Window: %d s", names[metric], max_value,
+                 max_cpu, SOFTNET_HISTORY / 10);
+        if (metric == SOFTNET_IRQS) {
+            g_strlcat(legend, "  |  ", sizeof(legend));
+            char lines[64];
+            snprintf(lines, sizeof(lines), "%d interrupt line%s", sn->irq_lines, sn->irq_lines == 1 ? "" : "s");
+            g_strlcat(legend, lines, sizeof(legend));
+        }
+    }
+    cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+    cairo_set_font_size(cr, 14);
+    cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+    cairo_move_to(cr, 10, 20);
+    cairo_show_text(cr, legend);
+}
+
+static void on_softnet_metric_changed(GtkDropDown *dropdown, GParamSpec *pspec, gpointer user_data) {
+    SoftnetView *view = (SoftnetView *)user_data;
+    gtk_widget_queue_draw(view->area);
+}
+
+static void on_softnet_destroy(GtkWidget *window, gpointer user_data) {
+    SoftnetView *view = (SoftnetView *)user_data;
+    
+    g_source_remove(view->timer);
+    view->app->softnet = NULL;
+    if (view->job != 0) {
+        view->closed = TRUE;
+        job_cancel(&view->app->jobs, view->job);
+    } else {
+        softnet_view_free(view);
+    }
+}
+
+static SoftnetView *softnet_view_open(AppData *data) {
+    SoftnetView *view = g_new0(SoftnetView, 1);
+    view->app = data;
+    
+    if (softnet_open(&view->softnet) < 0) {
+        g_warning("cannot read /proc/net/softnet_stat: %s", g_strerror(errno));
+        g_free(view);
+        return NULL;
+    }
+    view->image = cairo_image_surface_create(CAIRO_FORMAT_RGB24, SOFTNET_HISTORY, view->softnet.ncpus);
+    softnet_view_follow(view);
+    
+    view->window = gtk_window_new();
+    gtk_window_set_title(GTK_WINDOW(view->window), "Softnet and interrupts per CPU");
+    gtk_window_set_default_size(GTK_WINDOW(view->window), 900, 500);
+    gtk_window_set_transient_for(GTK_WINDOW(view->window), GTK_WINDOW(data->window));
+    
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_widget_set_margin_start(vbox, 5);
+    gtk_widget_set_margin_end(vbox, 5);
+    gtk_widget_set_margin_top(vbox, 5);
+    gtk_widget_set_margin_bottom(vbox, 5);
+    gtk_window_set_child(GTK_WINDOW(view->window), vbox);
+    
+    GtkWidget *metric_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_append(GTK_BOX(vbox), metric_box);
+    gtk_box_append(GTK_BOX(metric_box), gtk_label_new("Show:"));
+    const char *metrics[] = {"Processed/s", "Dropped/s", "Squeezed/s", "NIC IRQs/s", NULL};
+    view->metric_dropdown = gtk_drop_down_new_from_strings(metrics);
+    g_signal_connect(view->metric_dropdown, "notify::selected", G_CALLBACK(on_softnet_metric_changed), view);
+    gtk_box_append(GTK_BOX(metric_box), view->metric_dropdown);
+    
+    view->area = gtk_drawing_area_new();
+    gtk_widget_set_vexpand(view->area, TRUE);
+    gtk_drawing_area_set_draw_func(GTK_DRAWING_AREA(view->area), softnet_view_draw, view, NULL);
+    gtk_box_append(GTK_BOX(vbox), view->area);
+    
+    g_signal_connect(view->window, "destroy", G_CALLBACK(on_softnet_destroy), view);
+    softnet_view_tick(view);
+    view->timer = g_timeout_add(100, softnet_view_tick, view);
+    return view;
+}
+
+static void on_softnet_clicked(GtkButton *button, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
     
-    // Select first interface by default
+    if (data->softnet == NULL) {
+        data->softnet = softnet_view_open(data);
+    }
+    if (data->softnet != NULL) {
+        gtk_window_present(GTK_WINDOW(data->softnet->window));
+    }
+}
+
+// First position in iface_order at or after ifindex
+static guint interface_list_search(AppData *data, int ifindex) {
+    const int *order = (const int *)data->iface_order->data;
+    guint lo = 0;
+    guint hi = data->iface_order->len;
+    
+    while (lo < hi) {
+        guint mid = (lo + hi) / 2;
+        if (order[mid] < ifindex) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Adds, renames or (name NULL) removes one dropdown entry.  Entries are in
+// ifindex order, so a binary search finds the place and new veths, which
+// get the highest ifindex yet, go on the end.
+static void interface_list_update(AppData *data, int ifindex, const char *name) {
+    GtkDropDown *dropdown = GTK_DROP_DOWN(data->interface_dropdown);
+    GtkStringList *string_list = GTK_STRING_LIST(gtk_drop_down_get_model(dropdown));
+    guint position = interface_list_search(data, ifindex);
+    gboolean present = position < data->iface_order->len &&
+                       g_array_index(data->iface_order, int, position) == ifindex;
+    const char *names[] = {name, NULL};
+    
+    if (name == NULL) {
+        if (present) {
+            g_array_remove_index(data->iface_order, position);
+            gtk_string_list_remove(string_list, position);
+        }
+    } else if (!present) {
+        g_array_insert_val(data->iface_order, position, ifindex);
+        gtk_string_list_splice(string_list, position, 0, names);
+    } else if (strcmp(gtk_string_list_get_string(string_list, position), name) != 0) {
+        // A renamed entry is a new item; keep it selected if it was
+        gboolean selected = gtk_drop_down_get_selected(dropdown) == position;
+        gtk_string_list_splice(string_list, position, 1, names);
+        if (selected) {
+            gtk_drop_down_set_selected(dropdown, position);
+        }
+    }
+}
+
+// The list follows link events (on_addr_link_change); this only fills it
+// when netlink is unavailable, and picks the first interface
+static void populate_interface_dropdown(AppData *data) {
+    if (data->addrs == NULL) {
+        struct if_nameindex *names = if_nameindex();
+        if (names != NULL) {
+            for (struct if_nameindex *n = names; n->if_index != 0; n++) {
+                if (strcmp(n->if_name, "lo") != 0) {
+                    interface_list_update(data, n->if_index, n->if_name);
+                }
+            }
+            if_freenameindex(names);
+        }
+    }
     gtk_drop_down_set_selected(GTK_DROP_DOWN(data->interface_dropdown), 0);
 }
 
 static void on_interface_changed(GtkDropDown *dropdown, GParamSpec *pspec, gpointer user_data) {
     AppData *data = (AppData *)user_data;
     guint selected = gtk_drop_down_get_selected(dropdown);
-    GtkStringList *string_list = GTK_STRING_LIST(gtk_drop_down_get_model(dropdown));
     
-    if (selected != GTK_INVALID_LIST_POSITION) {
-        const char *interface = gtk_string_list_get_string(string_list, selected);
-        
-        if (interface != NULL) {
-            strncpy(data->selected_interface, interface, sizeof(data->selected_interface) - 1);
-            data->selected_interface[sizeof(data->selected_interface) - 1] = '\0';
-            
-            // Reset graph data
-            for (int i = 0; i < 60; i++) {
-                data->rx_data[i] = 0.0;
-                data->tx_data[i] = 0.0;
-            }
-            data->graph_position = 0;
-            data->prev_rx_bytes = 0;
-            data->prev_tx_bytes = 0;
+    if (selected < data->iface_order->len) {
+        // History is kept per interface, so switching only changes the view;
+        // a virtual one starts its long-term history once looked at
+        data->selected_ifindex = g_array_index(data->iface_order, int, selected);
+        collector_track_interface(&data->collector, data->selected_ifindex);
+        graph_open_history(data);
+        if (data->network_graph != NULL) {
+            gtk_widget_queue_draw(data->network_graph);
         }
+        if (data->softnet != NULL) {
+            softnet_view_follow(data->softnet);
+        }
+    }
+}
+
+static void on_rate_changed(GtkDropDown *dropdown, GParamSpec *pspec, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
+    static const int64_t intervals_ns[] = {1000000000LL, 100000000LL, 50000000LL, 20000000LL, 10000000LL};
+    guint selected = gtk_drop_down_get_selected(dropdown);
+    
+    if (selected >= G_N_ELEMENTS(intervals_ns)) {
+        return;
+    }
+    
+    collector_set_interval(&data->collector, intervals_ns[selected]);
+    gtk_widget_queue_draw(data->network_graph);
+}
+
+static void on_window_changed(GtkDropDown *dropdown, GParamSpec *pspec, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
+    static const int64_t windows_ns[] = {
+        0, 600000000000LL, 3600000000000LL, 21600000000000LL,
+        86400000000000LL, 604800000000000LL, 2592000000000000LL
+    };
+    guint selected = gtk_drop_down_get_selected(dropdown);
+    
+    if (selected >= G_N_ELEMENTS(windows_ns)) {
+        return;
+    }
+    
+    data->graph_window_ns = windows_ns[selected];
+    gtk_widget_queue_draw(data->network_graph);
+}
+
+static void on_series_changed(GtkDropDown *dropdown, GParamSpec *pspec, gpointer user_data) {
+    AppData *data = (AppData *)user_data;
+    guint selected = gtk_drop_down_get_selected(dropdown);
+    
+    if (selected > STATS_SERIES) {
+        return;
     }
+    
+    // Entry 0 is throughput alone, the rest follow STATS_SERIES
+    data->graph_series = (int)selected - 1;
+    gtk_widget_queue_draw(data->network_graph);
 }
 
 static void flash_button_green(GtkWidget *button) {
@@ -0,0 +1,12 @@
+/*
+ * Dave's Network Inquisition - headless collector without GTK
+ * Website: https://prowse.tech
+ *
+ * Same as "network-inq --headless", for servers that have no GTK installed.
+ */
+
+#include "headless.h"
+
+int main(int argc, char **argv) {
+    return headless_main(argc, argv);
+}
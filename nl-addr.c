@@ -0,0 +1,682 @@
+/*
+ * Dave's Network Inquisition - netlink address table
+ * Website: https://prowse.tech
+ *
+ * A copy of the kernel's interface addresses, and of the link details
+ * shown next to them, kept in step with notifications (see nl-addr.h).
+ */
+
+#include "nl-addr.h"
+#include "nl-common.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/if.h>
+#include <linux/if_addr.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+// Dump replies come in batches of up to 32 KB
+#define NL_ADDR_BUF_SIZE 65536
+// Room for a burst of notifications (a node starting a thousand pods)
+#define NL_ADDR_RCVBUF (4 * 1024 * 1024)
+
+static int nl_addr_key_equal(const AddrEntry *a, const AddrEntry *b) {
+    int len = a->family == AF_INET ? 4 : 16;
+    return a->family == b->family && a->ifindex == b->ifindex && a->prefixlen == b->prefixlen &&
+           memcmp(a->address, b->address, len) == 0;
+}
+
+// FNV-1a over the key fields
+static unsigned int nl_addr_hash(const AddrEntry *a) {
+    unsigned int h = NL_FNV_BASIS;
+
+    h = nl_fnv(h, a->family);
+    h = nl_fnv(h, a->prefixlen);
+    h = nl_fnv(h, (unsigned int)a->ifindex);
+    return nl_fnv_bytes(h, a->address, a->family == AF_INET ? 4 : 16);
+}
+
+static unsigned int nl_addr_row_hash(const void *rows, int row) {
+    return nl_addr_hash(&((const AddrEntry *)rows)[row]);
+}
+
+static int nl_addr_row_equal(const void *rows, int row, const void *key) {
+    return nl_addr_key_equal(&((const AddrEntry *)rows)[row], key);
+}
+
+// Hash slot holding an address with a's key, or the empty slot where it
+// would go
+static unsigned int nl_addr_slot(const NlAddr *nl, const AddrEntry *a) {
+    return nl_hash_find(nl->hash, nl->hash_size, nl_addr_hash(a), nl_addr_row_equal, nl->addrs, a);
+}
+
+static int nl_addr_grow(NlAddr *nl) {
+    int capacity = nl->capacity ? nl->capacity * 2 : 64;
+    AddrEntry *addrs = realloc(nl->addrs, capacity * sizeof(AddrEntry));
+    if (addrs == NULL) {
+        return -1;
+    }
+    nl->addrs = addrs;
+    int *free_rows = realloc(nl->free_rows, capacity * sizeof(int));
+    if (free_rows == NULL) {
+        return -1;
+    }
+    nl->free_rows = free_rows;
+    int *dead_rows = realloc(nl->dead_rows, capacity * sizeof(int));
+    if (dead_rows == NULL) {
+        return -1;
+    }
+    nl->dead_rows = dead_rows;
+
+    // Keep the hash at most half full
+    int *hash = calloc(capacity * 2, sizeof(int));
+    if (hash == NULL) {
+        return -1;
+    }
+    free(nl->hash);
+    nl->hash = hash;
+    nl->hash_size = capacity * 2;
+    nl->capacity = capacity;
+
+    for (int i = 0; i < nl->size; i++) {
+        if (nl_addr_live(nl, i)) {
+            nl_hash_place(nl->hash, nl->hash_size, nl_addr_hash(&nl->addrs[i]), i);
+        }
+    }
+    return 0;
+}
+
+// Returns the address's row with *changed set when the table changed, -1
+// when out of memory
+static int nl_addr_upsert(NlAddr *nl, const AddrEntry *a, int *changed) {
+    *changed = 0;
+    if (nl->size == nl->capacity && nl->nfree == 0 && nl_addr_grow(nl) < 0) {
+        return -1;
+    }
+
+    unsigned int slot = nl_addr_slot(nl, a);
+    int row = nl->hash[slot] - 1;
+    if (row >= 0) {
+        if (memcmp(&nl->addrs[row], a, sizeof(*a)) == 0) {
+            return row;
+        }
+    } else {
+        row = nl->nfree > 0 ? nl->free_rows[--nl->nfree] : nl->size++;
+        nl->hash[slot] = row + 1;
+        nl->count++;
+    }
+    nl->addrs[row] = *a;
+    nl->generation++;
+    *changed = 1;
+    if (nl->func != NULL) {
+        nl->func(nl, row, 1, nl->user_data);
+    }
+    return row;
+}
+
+// The row keeps its contents until nl_addr_reap()
+static void nl_addr_remove_row(NlAddr *nl, int row) {
+    nl_hash_delete(nl->hash, nl->hash_size, nl_addr_slot(nl, &nl->addrs[row]), nl_addr_row_hash, nl->addrs);
+    nl->addrs[row].dead = 1;
+    nl->dead_rows[nl->ndead++] = row;
+    nl->count--;
+    nl->generation++;
+    if (nl->func != NULL) {
+        nl->func(nl, row, 0, nl->user_data);
+    }
+}
+
+static int nl_addr_remove(NlAddr *nl, const AddrEntry *a) {
+    if (nl->hash_size == 0) {
+        return 0;
+    }
+    int row = nl->hash[nl_addr_slot(nl, a)] - 1;
+    if (row < 0) {
+        return 0;
+    }
+    nl_addr_remove_row(nl, row);
+    return 1;
+}
+
+// Deleted rows become free for reuse
+static void nl_addr_reap(NlAddr *nl) {
+    for (int i = 0; i < nl->ndead; i++) {
+        nl->addrs[nl->dead_rows[i]].family = 0;
+        nl->addrs[nl->dead_rows[i]].dead = 0;
+        nl->free_rows[nl->nfree++] = nl->dead_rows[i];
+    }
+    nl->ndead = 0;
+}
+
+// Link rows are hashed on ifindex alone (Fibonacci hashing)
+static unsigned int nl_addr_link_hash(int ifindex) {
+    return (unsigned int)ifindex * 2654435761u;
+}
+
+static unsigned int nl_addr_link_row_hash(const void *links, int row) {
+    return nl_addr_link_hash(((const AddrLink *)links)[row].ifindex);
+}
+
+static int nl_addr_link_row_equal(const void *links, int row, const void *ifindex) {
+    return ((const AddrLink *)links)[row].ifindex == *(const int *)ifindex;
+}
+
+static unsigned int nl_addr_link_slot(const NlAddr *nl, int ifindex) {
+    return nl_hash_find(nl->link_hash, nl->link_hash_size, nl_addr_link_hash(ifindex), nl_addr_link_row_equal,
+                        nl->links, &ifindex);
+}
+
+static int nl_addr_link_grow(NlAddr *nl) {
+    int capacity = nl->links_capacity ? nl->links_capacity * 2 : 64;
+    AddrLink *links = realloc(nl->links, capacity * sizeof(AddrLink));
+    if (links == NULL) {
+        return -1;
+    }
+    nl->links = links;
+    int *free_links = realloc(nl->free_links, capacity * sizeof(int));
+    if (free_links == NULL) {
+        return -1;
+    }
+    nl->free_links = free_links;
+    int *hash = calloc(capacity * 2, sizeof(int));
+    if (hash == NULL) {
+        return -1;
+    }
+    free(nl->link_hash);
+    nl->link_hash = hash;
+    nl->link_hash_size = capacity * 2;
+    nl->links_capacity = capacity;
+
+    for (int i = 0; i < nl->links_size; i++) {
+        if (nl->links[i].ifindex != 0) {
+            nl_hash_place(nl->link_hash, nl->link_hash_size, nl_addr_link_hash(nl->links[i].ifindex), i);
+        }
+    }
+    return 0;
+}
+
+const AddrLink *nl_addr_link(const NlAddr *nl, int ifindex) {
+    if (nl->link_hash_size == 0 || ifindex == 0) {
+        return NULL;
+    }
+    int row = nl->link_hash[nl_addr_link_slot(nl, ifindex)] - 1;
+    return row >= 0 ? &nl->links[row] : NULL;
+}
+
+// Returns the link's row with *changed set when it is new or differs, -1
+// when out of memory
+static int nl_addr_link_upsert(NlAddr *nl, const AddrLink *link, int *changed) {
+    *changed = 0;
+    if (nl->links_size == nl->links_capacity && nl->nfree_links == 0 && nl_addr_link_grow(nl) < 0) {
+        return -1;
+    }
+
+    unsigned int slot = nl_addr_link_slot(nl, link->ifindex);
+    int row = nl->link_hash[slot] - 1;
+    if (row >= 0) {
+        if (memcmp(&nl->links[row], link, sizeof(*link)) == 0) {
+            return row;
+        }
+    } else {
+        row = nl->nfree_links > 0 ? nl->free_links[--nl->nfree_links] : nl->links_size++;
+        nl->link_hash[slot] = row + 1;
+        nl->links_count++;
+    }
+    nl->links[row] = *link;
+    nl->generation++;
+    *changed = 1;
+    if (nl->link_func != NULL) {
+        nl->link_func(nl, link->ifindex, nl->user_data);
+    }
+    return row;
+}
+
+static void nl_addr_link_remove_row(NlAddr *nl, int row) {
+    int ifindex = nl->links[row].ifindex;
+
+    nl_hash_delete(nl->link_hash, nl->link_hash_size, nl_addr_link_slot(nl, ifindex), nl_addr_link_row_hash,
+                   nl->links);
+    nl->links[row].ifindex = 0;
+    nl->free_links[nl->nfree_links++] = row;
+    nl->links_count--;
+    nl->generation++;
+    if (nl->link_func != NULL) {
+        nl->link_func(nl, ifindex, nl->user_data);
+    }
+}
+
+// Fills a from an RTM_NEWADDR/RTM_DELADDR; -1 for other families
+static int nl_addr_parse(struct nlmsghdr *nh, AddrEntry *a) {
+    struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+    int len = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifa));
+    int has_local = 0;
+
+    if (len < 0 || (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6)) {
+        return -1;
+    }
+
+    memset(a, 0, sizeof(*a));
+    a->family = ifa->ifa_family;
+    a->prefixlen = ifa->ifa_prefixlen;
+    a->scope = ifa->ifa_scope;
+    a->flags = ifa->ifa_flags;
+    a->ifindex = ifa->ifa_index;
+
+    size_t alen = a->family == AF_INET ? 4 : 16;
+    for (struct rtattr *rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        size_t payload = RTA_PAYLOAD(rta);
+
+        switch (rta->rta_type) {
+        case IFA_LOCAL:
+            if (payload >= alen) {
+                memcpy(a->address, RTA_DATA(rta), alen);
+                has_local = 1;
+            }
+            break;
+        case IFA_ADDRESS:
+            // The peer on point-to-point links, the address itself otherwise
+            if (payload >= alen) {
+                memcpy(a->peer, RTA_DATA(rta), alen);
+                a->has_peer = 1;
+            }
+            break;
+        case IFA_BROADCAST:
+            if (payload >= 4 && a->family == AF_INET) {
+                memcpy(a->broadcast, RTA_DATA(rta), 4);
+                a->has_broadcast = 1;
+            }
+            break;
+        case IFA_LABEL:
+            if (payload > 0) {
+                size_t n = payload < sizeof(a->label) ? payload : sizeof(a->label) - 1;
+                memcpy(a->label, RTA_DATA(rta), n);
+                a->label[n] = '\0';
+            }
+            break;
+        case IFA_FLAGS:
+            // The full set; ifa_flags only has room for the first 8
+            if (payload >= sizeof(uint32_t)) {
+                memcpy(&a->flags, RTA_DATA(rta), sizeof(uint32_t));
+            }
+            break;
+        }
+    }
+
+    if (!has_local) {
+        memcpy(a->address, a->peer, alen);
+        a->has_peer = 0;
+    } else if (a->has_peer && memcmp(a->address, a->peer, alen) == 0) {
+        a->has_peer = 0;
+    }
+    if (!a->has_peer) {
+        memset(a->peer, 0, sizeof(a->peer));
+    }
+    return 0;
+}
+
+// Fills link from an RTM_NEWLINK/RTM_DELLINK
+static int nl_addr_parse_link(struct nlmsghdr *nh, AddrLink *link) {
+    struct ifinfomsg *ifi = NLMSG_DATA(nh);
+    int len = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+
+    if (len < 0 || ifi->ifi_index == 0) {
+        return -1;
+    }
+
+    memset(link, 0, sizeof(*link));
+    link->ifindex = ifi->ifi_index;
+    link->flags = ifi->ifi_flags;
+    for (struct rtattr *rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        size_t payload = RTA_PAYLOAD(rta);
+
+        switch (rta->rta_type) {
+        case IFLA_IFNAME:
+            if (payload > 0) {
+                size_t n = payload < sizeof(link->name) ? payload : sizeof(link->name) - 1;
+                memcpy(link->name, RTA_DATA(rta), n);
+                link->name[n] = '\0';
+            }
+            break;
+        case IFLA_MTU:
+            if (payload >= sizeof(uint32_t)) {
+                memcpy(&link->mtu, RTA_DATA(rta), sizeof(uint32_t));
+            }
+            break;
+        case IFLA_OPERSTATE:
+            if (payload >= 1) {
+                link->operstate = *(unsigned char *)RTA_DATA(rta);
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
+// Returns 1 when a table changed, 0 when not, -1 when out of memory.  row
+// gets the address or link row for a dump's mark-and-sweep.
+static int nl_addr_apply(NlAddr *nl, struct nlmsghdr *nh, int *row) {
+    int changed;
+
+    *row = -1;
+    if (nh->nlmsg_type == RTM_NEWADDR || nh->nlmsg_type == RTM_DELADDR) {
+        AddrEntry a;
+        if (nl_addr_parse(nh, &a) < 0) {
+            return 0;
+        }
+        if (nh->nlmsg_type == RTM_DELADDR) {
+            return nl_addr_remove(nl, &a);
+        }
+        *row = nl_addr_upsert(nl, &a, &changed);
+        return *row < 0 ? -1 : changed;
+    }
+    if (nh->nlmsg_type == RTM_NEWLINK || nh->nlmsg_type == RTM_DELLINK) {
+        AddrLink link;
+        if (nl_addr_parse_link(nh, &link) < 0) {
+            return 0;
+        }
+        if (nh->nlmsg_type == RTM_DELLINK) {
+            if (nl->link_hash_size == 0) {
+                return 0;
+            }
+            int r = nl->link_hash[nl_addr_link_slot(nl, link.ifindex)] - 1;
+            if (r < 0) {
+                return 0;
+            }
+            nl_addr_link_remove_row(nl, r);
+            return 1;
+        }
+        *row = nl_addr_link_upsert(nl, &link, &changed);
+        return *row < 0 ? -1 : changed;
+    }
+    return 0;
+}
+
+// Notifications as they come; one that cannot be applied is skipped
+static int nl_addr_on_message(struct nlmsghdr *nh, void *user_data) {
+    int row;
+
+    return nl_addr_apply(user_data, nh, &row);
+}
+
+typedef struct {
+    NlAddr *nl;
+    unsigned char *seen;
+    int seen_size;
+} NlAddrDump;
+
+// A restarted dump reports every row again, and marking is idempotent
+static int nl_addr_on_dump(struct nlmsghdr *nh, void *user_data) {
+    NlAddrDump *dump = user_data;
+    int row;
+
+    if (nh == NULL) {
+        return 0;
+    }
+    int result = nl_addr_apply(dump->nl, nh, &row);
+    if (result < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (dump->seen != NULL && row >= 0 && row < dump->seen_size) {
+        dump->seen[row] = 1;
+    }
+    return result;
+}
+
+// One dump request on fd, applied as it arrives.  seen (may be NULL) marks
+// the rows below seen_size the dump reported.
+static int nl_addr_dump_one(NlAddr *nl, int fd, int type, unsigned char *seen, int seen_size) {
+    struct {
+        struct nlmsghdr nh;
+        union {
+            struct ifinfomsg ifi;
+            struct ifaddrmsg ifa;
+        } msg;
+    } req;
+    NlAddrDump dump = { nl, seen, seen_size };
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(type == RTM_GETLINK ? sizeof(req.msg.ifi) : sizeof(req.msg.ifa));
+    req.nh.nlmsg_type = type;
+    return nl_dump(fd, &req.nh, &nl->seq, &nl->buf, &nl->buf_size, nl_addr_on_dump, &dump);
+}
+
+// Links then addresses, on a socket of their own so notifications queued
+// on nl->fd stay in order.  Whatever the dumps no longer have is removed.
+static int nl_addr_dump(NlAddr *nl) {
+    int old_links = nl->links_size;
+    int old_size = nl->size;
+    unsigned char *seen_links = old_links > 0 ? calloc(old_links, 1) : NULL;
+    unsigned char *seen = old_size > 0 ? calloc(old_size, 1) : NULL;
+    int changes = -1;
+    int fd = -1;
+
+    if ((old_links > 0 && seen_links == NULL) || (old_size > 0 && seen == NULL)) {
+        errno = ENOMEM;
+        goto out;
+    }
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        goto out;
+    }
+
+    int links = nl_addr_dump_one(nl, fd, RTM_GETLINK, seen_links, old_links);
+    if (links < 0) {
+        goto out;
+    }
+    int addrs = nl_addr_dump_one(nl, fd, RTM_GETADDR, seen, old_size);
+    if (addrs < 0) {
+        goto out;
+    }
+    changes = links + addrs;
+
+    for (int row = 0; row < old_size; row++) {
+        if (!seen[row] && nl_addr_live(nl, row)) {
+            nl_addr_remove_row(nl, row);
+            changes++;
+        }
+    }
+    for (int row = 0; row < old_links; row++) {
+        if (!seen_links[row] && nl->links[row].ifindex != 0) {
+            nl_addr_link_remove_row(nl, row);
+            changes++;
+        }
+    }
+
+out:
+    if (fd >= 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+    }
+    free(seen_links);
+    free(seen);
+    return changes;
+}
+
+static int nl_addr_resync(void *user_data) {
+    NlAddr *nl = user_data;
+
+    nl->resyncs++;
+    return nl_addr_dump(nl);
+}
+
+int nl_addr_open(NlAddr *nl, AddrChangeFunc func, AddrLinkFunc link_func, void *user_data) {
+    memset(nl, 0, sizeof(*nl));
+    nl->func = func;
+    nl->link_func = link_func;
+    nl->user_data = user_data;
+
+    nl->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+    if (nl->fd < 0) {
+        return -1;
+    }
+
+    // Forced size needs CAP_NET_ADMIN; otherwise take what rmem_max allows
+    int rcvbuf = NL_ADDR_RCVBUF;
+    if (setsockopt(nl->fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        setsockopt(nl->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+
+    // Subscribe before dumping so no change falls between the two
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    nl->buf_size = NL_ADDR_BUF_SIZE;
+    nl->buf = malloc(nl->buf_size);
+    if (nl->buf == NULL) {
+        errno = ENOMEM;
+    }
+    if (nl->buf == NULL || bind(nl->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || nl_addr_dump(nl) < 0) {
+        int err = errno;
+        nl_addr_close(nl);
+        errno = err;
+        return -1;
+    }
+    nl_addr_reap(nl);
+    return 0;
+}
+
+void nl_addr_close(NlAddr *nl) {
+    if (nl->fd >= 0) {
+        close(nl->fd);
+    }
+    free(nl->buf);
+    free(nl->addrs);
+    free(nl->hash);
+    free(nl->free_rows);
+    free(nl->dead_rows);
+    free(nl->links);
+    free(nl->link_hash);
+    free(nl->free_links);
+    memset(nl, 0, sizeof(*nl));
+    nl->fd = -1;
+}
+
+int nl_addr_fd(const NlAddr *nl) {
+    return nl->fd;
+}
+
+int nl_addr_dispatch(NlAddr *nl) {
+    int changes = nl_dispatch(nl->fd, &nl->buf, &nl->buf_size, nl_addr_on_message, nl_addr_resync, nl);
+
+    int err = errno;
+    nl_addr_reap(nl);
+    errno = err;
+    return changes;
+}
+
+int nl_addr_compare(const AddrEntry *a, const AddrEntry *b) {
+    if (a->ifindex != b->ifindex) {
+        return a->ifindex < b->ifindex ? -1 : 1;
+    }
+    if (a->family != b->family) {
+        // AF_INET < AF_INET6: inet before inet6, as ip lists them
+        return a->family < b->family ? -1 : 1;
+    }
+    int c = memcmp(a->address, b->address, a->family == AF_INET ? 4 : 16);
+    if (c != 0) {
+        return c;
+    }
+    return a->prefixlen < b->prefixlen ? -1 : a->prefixlen > b->prefixlen;
+}
+
+static const char *nl_addr_operstate(int operstate) {
+    switch (operstate) {
+    case IF_OPER_NOTPRESENT: return "NOTPRESENT";
+    case IF_OPER_DOWN: return "DOWN";
+    case IF_OPER_LOWERLAYERDOWN: return "LOWERLAYERDOWN";
+    case IF_OPER_TESTING: return "TESTING";
+    case IF_OPER_DORMANT: return "DORMANT";
+    case IF_OPER_UP: return "UP";
+    }
+    return "UNKNOWN";
+}
+
+const char *nl_addr_format(const NlAddr *nl, const AddrEntry *a, char *buf, size_t size) {
+    static const struct {
+        unsigned int flag;
+        const char *name;
+    } link_flags[] = {
+        { IFF_LOOPBACK, "LOOPBACK" }, { IFF_BROADCAST, "BROADCAST" }, { IFF_POINTOPOINT, "POINTOPOINT" },
+        { IFF_MULTICAST, "MULTICAST" }, { IFF_NOARP, "NOARP" }, { IFF_PROMISC, "PROMISC" },
+        { IFF_UP, "UP" }, { IFF_LOWER_UP, "LOWER_UP" }
+    };
+    static const struct {
+        uint32_t flag;
+        const char *name;
+    } addr_flags[] = {
+        { IFA_F_TENTATIVE, "tentative" }, { IFA_F_DEPRECATED, "deprecated" }, { IFA_F_DADFAILED, "dadfailed" },
+        { IFA_F_NODAD, "nodad" }, { IFA_F_OPTIMISTIC, "optimistic" }, { IFA_F_HOMEADDRESS, "home" },
+        { IFA_F_MANAGETEMPADDR, "mngtmpaddr" }, { IFA_F_NOPREFIXROUTE, "noprefixroute" },
+        { IFA_F_MCAUTOJOIN, "autojoin" }, { IFA_F_STABLE_PRIVACY, "stable-privacy" }
+    };
+    const AddrLink *link = nl_addr_link(nl, a->ifindex);
+    char address[INET6_ADDRSTRLEN];
+    size_t o = 0;
+
+#define APPEND(...) do { \
+        if (o < size) o += snprintf(buf + o, size - o, __VA_ARGS__); \
+    } while (0)
+
+    buf[0] = '\0';
+    if (link != NULL) {
+        APPEND("%s %s <", link->name, nl_addr_operstate(link->operstate));
+        const char *sep = "";
+        for (size_t i = 0; i < sizeof(link_flags) / sizeof(link_flags[0]); i++) {
+            if (link->flags & link_flags[i].flag) {
+                APPEND("%s%s", sep, link_flags[i].name);
+                sep = ",";
+            }
+        }
+        APPEND("> mtu %u ", link->mtu);
+    } else {
+        APPEND("if%d ", a->ifindex);
+    }
+
+    inet_ntop(a->family, a->address, address, sizeof(address));
+    APPEND("%s %s", a->family == AF_INET ? "inet" : "inet6", address);
+    if (a->has_peer) {
+        inet_ntop(a->family, a->peer, address, sizeof(address));
+        APPEND(" peer %s", address);
+    }
+    APPEND("/%d", a->prefixlen);
+    if (a->has_broadcast) {
+        inet_ntop(AF_INET, a->broadcast, address, sizeof(address));
+        APPEND(" brd %s", address);
+    }
+    switch (a->scope) {
+    case RT_SCOPE_UNIVERSE: APPEND(" scope global"); break;
+    case RT_SCOPE_SITE: APPEND(" scope site"); break;
+    case RT_SCOPE_LINK: APPEND(" scope link"); break;
+    case RT_SCOPE_HOST: APPEND(" scope host"); break;
+    default: APPEND(" scope %d", a->scope); break;
+    }
+    // The same bit means a secondary IPv4 address and an IPv6 privacy one
+    if (a->flags & IFA_F_SECONDARY) {
+        APPEND(a->family == AF_INET ? " secondary" : " temporary");
+    }
+    // Addresses that expire
+    if (!(a->flags & IFA_F_PERMANENT)) {
+        APPEND(" dynamic");
+    }
+    for (size_t i = 0; i < sizeof(addr_flags) / sizeof(addr_flags[0]); i++) {
+        if (a->flags & addr_flags[i].flag) {
+            APPEND(" %s", addr_flags[i].name);
+        }
+    }
+    if (a->label[0] != '\0' && (link == NULL || strcmp(a->label, link->name) != 0)) {
+        APPEND(" %s", a->label);
+    }
+
+#undef APPEND
+    return buf;
+}
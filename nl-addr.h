@@ -0,0 +1,109 @@
+/*
+ * Dave's Network Inquisition - netlink address table
+ * Website: https://prowse.tech
+ */
+
+#ifndef NL_ADDR_H
+#define NL_ADDR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <net/if.h>
+
+// One address as reported by RTM_NEWADDR.  Addresses are in network byte
+// order, only the first 4 bytes used for IPv4.
+typedef struct {
+    unsigned char address[16];  // IFA_LOCAL, or IFA_ADDRESS when there is none
+    unsigned char peer[16];     // the other end of a point-to-point link
+    unsigned char broadcast[4];
+    int ifindex;
+    uint32_t flags;             // IFA_F_*
+    unsigned char family;       // AF_INET or AF_INET6; 0 = free row
+    unsigned char prefixlen;
+    unsigned char scope;        // RT_SCOPE_*
+    unsigned char has_peer;
+    unsigned char has_broadcast;
+    unsigned char dead;         // deleted, row not yet reusable
+    char label[IF_NAMESIZE];    // IPv4 alias ("eth0:1"), empty when none
+} AddrEntry;
+
+// What an address row shows about its interface, from RTM_NEWLINK
+typedef struct {
+    int ifindex;                // 0 = free row
+    unsigned int flags;         // IFF_*
+    unsigned int mtu;
+    unsigned char operstate;    // IF_OPER_*
+    char name[IF_NAMESIZE];
+} AddrLink;
+
+struct NlAddr;
+
+// added: 1 for a new or changed address, 0 for one that went away.  A
+// deleted address keeps its row and contents until the dispatch (or open)
+// that removed it returns, so views can still find it by key.
+typedef void (*AddrChangeFunc)(const struct NlAddr *nl, int row, int added, void *user_data);
+// The interface's name, flags, MTU or state changed, or it went away
+typedef void (*AddrLinkFunc)(const struct NlAddr *nl, int ifindex, void *user_data);
+
+// Every address on the host, kept current: RTM_GETLINK and RTM_GETADDR
+// dumps when opened, then RTNLGRP_LINK and RTNLGRP_IPV4_IFADDR/IPV6_IFADDR
+// notifications applied as they come, so nothing is polled.  Addresses are
+// found through a hash on the kernel's key (family, ifindex, address,
+// prefix length) and links through one on ifindex.  Notifications that
+// change nothing (a link's statistics, say) are not reported.
+typedef struct NlAddr {
+    int fd;                     // notifications; poll it and call dispatch
+    unsigned int seq;
+    char *buf;
+    size_t buf_size;
+
+    AddrEntry *addrs;
+    int size;                   // rows in use or free; iterate up to here
+    int count;                  // live addresses
+    int capacity;
+    int *hash;                  // open-addressed, row + 1 (0 = empty)
+    int hash_size;
+    int *free_rows;
+    int nfree;
+    int *dead_rows;             // deleted during the current dispatch
+    int ndead;
+
+    AddrLink *links;
+    int links_size;
+    int links_count;
+    int links_capacity;
+    int *link_hash;             // by ifindex, row + 1
+    int link_hash_size;
+    int *free_links;
+    int nfree_links;
+
+    uint64_t generation;        // bumped on every change
+    int resyncs;                // full dumps after notifications were lost
+
+    AddrChangeFunc func;
+    AddrLinkFunc link_func;
+    void *user_data;
+} NlAddr;
+
+// func and link_func may be NULL; func sees the initial dump too
+int nl_addr_open(NlAddr *nl, AddrChangeFunc func, AddrLinkFunc link_func, void *user_data);
+void nl_addr_close(NlAddr *nl);
+int nl_addr_fd(const NlAddr *nl);
+// Applies every pending notification without blocking.  Returns the
+// number of changes, or -1 with errno set.
+int nl_addr_dispatch(NlAddr *nl);
+
+// NULL when the kernel has not reported the interface (or it went away)
+const AddrLink *nl_addr_link(const NlAddr *nl, int ifindex);
+
+static inline int nl_addr_live(const NlAddr *nl, int row) {
+    return nl->addrs[row].family != 0 && !nl->addrs[row].dead;
+}
+
+// Sort order of "ip address": interface, then family, address and prefix
+int nl_addr_compare(const AddrEntry *a, const AddrEntry *b);
+
+// "eth0 UP mtu 1500 inet 192.0.2.10/24 brd 192.0.2.255 scope global dynamic"
+const char *nl_addr_format(const NlAddr *nl, const AddrEntry *a, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * Dave's Network Inquisition - netlink socket and table helpers
+ * Website: https://prowse.tech
+ *
+ * The dump and notification loops shared by the link, route and address
+ * engines (see nl-common.h).
+ */
+
+#include "nl-common.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+// Attempts at a dump whose replies outgrow the buffer each time
+#define NL_DUMP_TRIES 3
+
+ssize_t nl_recv(int fd, char **buf, size_t *size, int flags) {
+    for (;;) {
+        // With MSG_TRUNC the length is the datagram's, not what was copied
+        ssize_t n = recv(fd, *buf, *size, flags | MSG_TRUNC);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if ((size_t)n <= *size) {
+            return n;
+        }
+
+        size_t grown = *size * 2 > (size_t)n ? *size * 2 : (size_t)n;
+        char *p = realloc(*buf, grown);
+        if (p != NULL) {
+            *buf = p;
+            *size = grown;
+        }
+        errno = EMSGSIZE;
+        return -1;
+    }
+}
+
+int nl_dump(int fd, struct nlmsghdr *req, unsigned int *seq, char **buf, size_t *size, NlMessageFunc func,
+            void *user_data) {
+    for (int tries = 1;; tries++) {
+        int changes = 0;
+        int truncated = 0;
+
+        req->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        req->nlmsg_seq = ++*seq;
+        if (send(fd, req, req->nlmsg_len, 0) < 0) {
+            return -1;
+        }
+
+        for (;;) {
+            // The kernel queues the next batch before recv() returns, so
+            // once one was cut short an empty socket means NLMSG_DONE went
+            // with it
+            ssize_t n = nl_recv(fd, buf, size, truncated ? MSG_DONTWAIT : 0);
+            if (n < 0) {
+                if (errno == EMSGSIZE) {
+                    truncated = 1;
+                    continue;
+                }
+                if (truncated && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    break;
+                }
+                return -1;
+            }
+
+            int done = 0;
+            for (struct nlmsghdr *nh = (struct nlmsghdr *)*buf; NLMSG_OK(nh, n); nh = NLMSG_NEXT(nh, n)) {
+                // Skip leftovers from an earlier, interrupted dump
+                if (nh->nlmsg_seq != *seq) {
+                    continue;
+                }
+                if (nh->nlmsg_type == NLMSG_DONE) {
+                    done = 1;
+                    break;
+                }
+                if (nh->nlmsg_type == NLMSG_ERROR) {
+                    struct nlmsgerr *err = NLMSG_DATA(nh);
+                    errno = err->error ? -err->error : EIO;
+                    return -1;
+                }
+                int result = func(nh, user_data);
+                if (result < 0) {
+                    return -1;
+                }
+                changes += result;
+            }
+            if (done) {
+                break;
+            }
+        }
+
+        if (!truncated) {
+            return changes;
+        }
+        if (tries == NL_DUMP_TRIES) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        // Again with the grown buffer
+        func(NULL, user_data);
+    }
+}
+
+int nl_dispatch(int fd, char **buf, size_t *size, NlMessageFunc func, NlResyncFunc resync, void *user_data) {
+    int changes = 0;
+
+    for (;;) {
+        ssize_t n = nl_recv(fd, buf, size, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return changes;
+            }
+            if (errno != ENOBUFS && errno != EMSGSIZE) {
+                return -1;
+            }
+            // Notifications were lost: start over from a dump
+            if (resync == NULL) {
+                errno = ENOBUFS;
+                return -1;
+            }
+            int result = resync(user_data);
+            if (result < 0) {
+                return -1;
+            }
+            changes += result;
+            continue;
+        }
+
+        for (struct nlmsghdr *nh = (struct nlmsghdr *)*buf; NLMSG_OK(nh, n); nh = NLMSG_NEXT(nh, n)) {
+            int result = func(nh, user_data);
+            if (result > 0) {
+                changes += result;
+            }
+        }
+    }
+}
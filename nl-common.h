@@ -0,0 +1,105 @@
+/*
+ * Dave's Network Inquisition - netlink socket and table helpers
+ * Website: https://prowse.tech
+ */
+
+#ifndef NL_COMMON_H
+#define NL_COMMON_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <linux/netlink.h>
+
+// FNV-1a, a value or a run of bytes at a time
+#define NL_FNV_BASIS 2166136261u
+
+static inline unsigned int nl_fnv(unsigned int h, unsigned int value) {
+    return (h ^ value) * 16777619u;
+}
+
+static inline unsigned int nl_fnv_bytes(unsigned int h, const void *data, size_t len) {
+    const unsigned char *p = data;
+
+    for (size_t i = 0; i < len; i++) {
+        h = nl_fnv(h, p[i]);
+    }
+    return h;
+}
+
+// Open-addressed index over a table's rows: hash[] holds row + 1 (0 =
+// empty) and size is a power of two, kept at least twice the rows so
+// probes stay short.  Callers pass their own hash and key test, which
+// inline here.
+typedef unsigned int (*NlRowHashFunc)(const void *rows, int row);
+typedef int (*NlRowEqualFunc)(const void *rows, int row, const void *key);
+
+// Slot holding the row equal to key, or the empty slot where it would go
+static inline unsigned int nl_hash_find(const int *hash, int size, unsigned int h, NlRowEqualFunc equal,
+                                        const void *rows, const void *key) {
+    unsigned int mask = size - 1;
+    unsigned int slot = h & mask;
+
+    while (hash[slot] != 0 && !equal(rows, hash[slot] - 1, key)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Adds row, known not to be there yet (rebuilding after a grow)
+static inline void nl_hash_place(int *hash, int size, unsigned int h, int row) {
+    unsigned int mask = size - 1;
+    unsigned int slot = h & mask;
+
+    while (hash[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    hash[slot] = row + 1;
+}
+
+// Linear probing: deleting shifts later members of the cluster back so no
+// tombstones are needed
+static inline void nl_hash_delete(int *hash, int size, unsigned int slot, NlRowHashFunc row_hash,
+                                  const void *rows) {
+    unsigned int mask = size - 1;
+    unsigned int next = (slot + 1) & mask;
+
+    hash[slot] = 0;
+    while (hash[next] != 0) {
+        unsigned int home = row_hash(rows, hash[next] - 1) & mask;
+        // Move it back if its home is not in (slot, next]
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            hash[slot] = hash[next];
+            hash[next] = 0;
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+// Called per message; returns how many changes it made, or -1 with errno
+// set.  A dump stops at -1; notifications go on past one they could not
+// apply.  A dump calls it with NULL when it starts over.
+typedef int (*NlMessageFunc)(struct nlmsghdr *nh, void *user_data);
+// Dumps the whole state again after notifications were lost; returns the
+// changes, or -1 with errno set
+typedef int (*NlResyncFunc)(void *user_data);
+
+// One datagram into *buf.  One larger than the buffer has lost its tail
+// by the time recv() returns: then the buffer is grown to fit the next
+// such one, and -1 returned with errno EMSGSIZE.
+ssize_t nl_recv(int fd, char **buf, size_t *size, int flags);
+
+// Sends req as a dump with the next sequence number and feeds the replies
+// to func until NLMSG_DONE.  A reply that did not fit starts the dump over
+// with the grown buffer, a few times at most.  Returns the changes, or -1
+// with errno set.
+int nl_dump(int fd, struct nlmsghdr *req, unsigned int *seq, char **buf, size_t *size, NlMessageFunc func,
+            void *user_data);
+
+// Feeds every queued notification on a non-blocking fd to func.  When
+// some were lost (ENOBUFS, or one too big for the buffer) resync is called
+// and draining goes on; without one, -1 is returned with errno ENOBUFS.
+// Returns the changes, or -1 with errno set.
+int nl_dispatch(int fd, char **buf, size_t *size, NlMessageFunc func, NlResyncFunc resync, void *user_data);
+
+#endif
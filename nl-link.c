@@ -0,0 +1,287 @@
+/*
+ * Dave's Network Inquisition - netlink link statistics
+ * Website: https://prowse.tech
+ */
+
+#include "nl-link.h"
+#include "nl-common.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#define NL_LINK_BUF_SIZE 32768
+
+const char *const link_counter_names[LINK_COUNTERS] = {
+    [LINK_RX_PACKETS] = "rx_packets",
+    [LINK_TX_PACKETS] = "tx_packets",
+    [LINK_RX_ERRORS] = "rx_errors",
+    [LINK_TX_ERRORS] = "tx_errors",
+    [LINK_RX_DROPPED] = "rx_dropped",
+    [LINK_TX_DROPPED] = "tx_dropped",
+    [LINK_RX_FIFO_ERRORS] = "rx_fifo_errors",
+    [LINK_TX_FIFO_ERRORS] = "tx_fifo_errors",
+    [LINK_RX_MISSED_ERRORS] = "rx_missed_errors",
+    [LINK_MULTICAST] = "multicast",
+};
+
+void nl_link_counters(const struct rtnl_link_stats64 *stats, uint64_t counters[LINK_COUNTERS]) {
+    counters[LINK_RX_PACKETS] = stats->rx_packets;
+    counters[LINK_TX_PACKETS] = stats->tx_packets;
+    counters[LINK_RX_ERRORS] = stats->rx_errors;
+    counters[LINK_TX_ERRORS] = stats->tx_errors;
+    counters[LINK_RX_DROPPED] = stats->rx_dropped;
+    counters[LINK_TX_DROPPED] = stats->tx_dropped;
+    counters[LINK_RX_FIFO_ERRORS] = stats->rx_fifo_errors;
+    counters[LINK_TX_FIFO_ERRORS] = stats->tx_fifo_errors;
+    counters[LINK_RX_MISSED_ERRORS] = stats->rx_missed_errors;
+    counters[LINK_MULTICAST] = stats->multicast;
+}
+
+int nl_link_open(NlLink *nl) {
+    memset(nl, 0, sizeof(*nl));
+    nl->events_fd = -1;
+
+    nl->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (nl->fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(nl->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int err = errno;
+        close(nl->fd);
+        nl->fd = -1;
+        errno = err;
+        return -1;
+    }
+
+    nl->buf_size = NL_LINK_BUF_SIZE;
+    nl->buf = malloc(nl->buf_size);
+    if (nl->buf == NULL) {
+        close(nl->fd);
+        nl->fd = -1;
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+void nl_link_close(NlLink *nl) {
+    if (nl->fd >= 0) {
+        close(nl->fd);
+    }
+    if (nl->events_fd >= 0) {
+        close(nl->events_fd);
+    }
+    free(nl->buf);
+    free(nl->entries);
+    memset(nl, 0, sizeof(*nl));
+    nl->fd = -1;
+    nl->events_fd = -1;
+}
+
+static LinkEntry *nl_link_next_entry(NlLink *nl) {
+    if (nl->count == nl->capacity) {
+        int capacity = nl->capacity ? nl->capacity * 2 : 16;
+        LinkEntry *entries = realloc(nl->entries, capacity * sizeof(LinkEntry));
+        if (entries == NULL) {
+            return NULL;
+        }
+        nl->entries = entries;
+        nl->capacity = capacity;
+    }
+    return &nl->entries[nl->count++];
+}
+
+// Fills entry from an RTM_NEWLINK/RTM_DELLINK
+static int nl_link_parse(struct nlmsghdr *nh, LinkEntry *entry) {
+    struct ifinfomsg *ifi = NLMSG_DATA(nh);
+    int len = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+
+    if (len < 0) {
+        return -1;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    entry->ifindex = ifi->ifi_index;
+    entry->flags = ifi->ifi_flags;
+
+    int have_stats64 = 0;
+    struct rtnl_link_stats *stats32 = NULL;
+
+    for (struct rtattr *rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        size_t payload = RTA_PAYLOAD(rta);
+
+        switch (rta->rta_type) {
+        case IFLA_IFNAME:
+            strncpy(entry->name, RTA_DATA(rta), sizeof(entry->name) - 1);
+            break;
+        case IFLA_MTU:
+            if (payload >= sizeof(unsigned int)) {
+                memcpy(&entry->mtu, RTA_DATA(rta), sizeof(unsigned int));
+            }
+            break;
+        case IFLA_STATS64:
+            // Older kernels send a shorter struct; copy what is there
+            memcpy(&entry->stats, RTA_DATA(rta),
+                   payload < sizeof(entry->stats) ? payload : sizeof(entry->stats));
+            have_stats64 = 1;
+            break;
+        case IFLA_STATS:
+            if (payload >= sizeof(*stats32)) {
+                stats32 = RTA_DATA(rta);
+            }
+            break;
+        }
+    }
+
+    // 32-bit counters only when the kernel did not give us IFLA_STATS64
+    if (!have_stats64 && stats32 != NULL) {
+        entry->stats32 = 1;
+        entry->stats.rx_packets = stats32->rx_packets;
+        entry->stats.tx_packets = stats32->tx_packets;
+        entry->stats.rx_bytes = stats32->rx_bytes;
+        entry->stats.tx_bytes = stats32->tx_bytes;
+        entry->stats.rx_errors = stats32->rx_errors;
+        entry->stats.tx_errors = stats32->tx_errors;
+        entry->stats.rx_dropped = stats32->rx_dropped;
+        entry->stats.tx_dropped = stats32->tx_dropped;
+        entry->stats.rx_fifo_errors = stats32->rx_fifo_errors;
+        entry->stats.tx_fifo_errors = stats32->tx_fifo_errors;
+        entry->stats.rx_missed_errors = stats32->rx_missed_errors;
+        entry->stats.multicast = stats32->multicast;
+    }
+    return 0;
+}
+
+// Fills entry from an RTM_NEWSTATS: ifindex and counters only
+static int nl_link_parse_stats(struct nlmsghdr *nh, LinkEntry *entry) {
+    struct if_stats_msg *ifsm = NLMSG_DATA(nh);
+    int len = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifsm));
+
+    if (len < 0) {
+        return -1;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    entry->ifindex = ifsm->ifindex;
+    struct rtattr *rta = (struct rtattr *)((char *)ifsm + NLMSG_ALIGN(sizeof(*ifsm)));
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type == IFLA_STATS_LINK_64) {
+            size_t payload = RTA_PAYLOAD(rta);
+            memcpy(&entry->stats, RTA_DATA(rta),
+                   payload < sizeof(entry->stats) ? payload : sizeof(entry->stats));
+        }
+    }
+    return 0;
+}
+
+// Collects the replies into entries; a restarted dump begins again
+static int nl_link_on_dump(struct nlmsghdr *nh, void *user_data) {
+    NlLink *nl = user_data;
+
+    if (nh == NULL) {
+        nl->count = 0;
+        return 0;
+    }
+    if (nh->nlmsg_type == RTM_NEWLINK || nh->nlmsg_type == RTM_NEWSTATS) {
+        LinkEntry *entry = nl_link_next_entry(nl);
+        if (entry == NULL) {
+            return 0;
+        }
+        int ok = nh->nlmsg_type == RTM_NEWLINK ? nl_link_parse(nh, entry) : nl_link_parse_stats(nh, entry);
+        if (ok < 0) {
+            nl->count--;
+        }
+    }
+    return 0;
+}
+
+// Sends a dump request and collects the replies into entries
+static int nl_link_dump(NlLink *nl, struct nlmsghdr *req) {
+    if (nl->fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    nl->count = 0;
+    return nl_dump(nl->fd, req, &nl->seq, &nl->buf, &nl->buf_size, nl_link_on_dump, nl) < 0 ? -1 : 0;
+}
+
+int nl_link_refresh(NlLink *nl) {
+    struct {
+        struct nlmsghdr nh;
+        struct ifinfomsg ifi;
+    } req;
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifi));
+    req.nh.nlmsg_type = RTM_GETLINK;
+    req.ifi.ifi_family = AF_UNSPEC;
+    return nl_link_dump(nl, &req.nh);
+}
+
+int nl_link_refresh_stats(NlLink *nl) {
+    struct {
+        struct nlmsghdr nh;
+        struct if_stats_msg ifsm;
+    } req;
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifsm));
+    req.nh.nlmsg_type = RTM_GETSTATS;
+    req.ifsm.family = AF_UNSPEC;
+    req.ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+    return nl_link_dump(nl, &req.nh);
+}
+
+int nl_link_watch(NlLink *nl) {
+    struct sockaddr_nl addr;
+
+    nl->events_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+    if (nl->events_fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK;
+    if (bind(nl->events_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int err = errno;
+        close(nl->events_fd);
+        nl->events_fd = -1;
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    LinkEventFunc func;
+    void *user_data;
+} NlLinkEvents;
+
+static int nl_link_on_event(struct nlmsghdr *nh, void *user_data) {
+    NlLinkEvents *events = user_data;
+    LinkEntry link;
+
+    if ((nh->nlmsg_type != RTM_NEWLINK && nh->nlmsg_type != RTM_DELLINK) || nl_link_parse(nh, &link) < 0) {
+        return 0;
+    }
+    events->func(&link, nh->nlmsg_type == RTM_DELLINK, events->user_data);
+    return 1;
+}
+
+int nl_link_read_events(NlLink *nl, LinkEventFunc func, void *user_data) {
+    NlLinkEvents events = { func, user_data };
+
+    // No resync here: the caller dumps again on ENOBUFS
+    return nl_dispatch(nl->events_fd, &nl->buf, &nl->buf_size, nl_link_on_event, NULL, &events);
+}
@@ -0,0 +1,98 @@
+/*
+ * Dave's Network Inquisition - netlink link statistics
+ * Website: https://prowse.tech
+ */
+
+#ifndef NL_LINK_H
+#define NL_LINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <net/if.h>
+#include <linux/if_link.h>
+
+// One interface as reported by RTM_NEWLINK
+typedef struct {
+    int ifindex;
+    unsigned int flags;
+    unsigned int mtu;
+    char name[IF_NAMESIZE];
+    int stats32;                // stats came from IFLA_STATS: 32 bits wide
+    struct rtnl_link_stats64 stats;
+} LinkEntry;
+
+// The rtnl_link_stats64 counters a sample carries besides rx/tx bytes.
+// link_counter_names are also the files under
+// /sys/class/net/<name>/statistics/.
+enum {
+    LINK_RX_PACKETS,
+    LINK_TX_PACKETS,
+    LINK_RX_ERRORS,
+    LINK_TX_ERRORS,
+    LINK_RX_DROPPED,
+    LINK_TX_DROPPED,
+    LINK_RX_FIFO_ERRORS,
+    LINK_TX_FIFO_ERRORS,
+    LINK_RX_MISSED_ERRORS,
+    LINK_MULTICAST,
+    LINK_COUNTERS
+};
+
+extern const char *const link_counter_names[LINK_COUNTERS];
+
+void nl_link_counters(const struct rtnl_link_stats64 *stats, uint64_t counters[LINK_COUNTERS]);
+
+// How far a counter moved between two readings.  One that went backwards
+// wrapped if its source is known to be 32 bits wide (bits32: IFLA_STATS,
+// the kernel's per-CPU softnet counts) and is counted through the wrap.
+// A 64-bit counter never wraps in practice, so there it was reset (driver
+// reload, device reset), however small it was before: then there is no
+// delta and *reset is set.
+static inline uint64_t link_counter_delta(uint64_t prev, uint64_t now, int bits32, int *reset) {
+    if (now >= prev) {
+        return now - prev;
+    }
+    if (bits32 && prev <= UINT32_MAX) {
+        // Only a wrap if less than half the 32-bit range went by
+        uint64_t wrapped = now + (UINT64_C(1) << 32) - prev;
+        if (wrapped < (UINT64_C(1) << 31)) {
+            return wrapped;
+        }
+    }
+    *reset = 1;
+    return 0;
+}
+
+// Counter engine: a NETLINK_ROUTE socket plus the last RTM_GETLINK dump.
+// The receive buffer and entry array are reused between refreshes, so once
+// the array has grown to the number of links no further allocation happens.
+typedef struct {
+    int fd;
+    int events_fd;              // link notifications, -1 until nl_link_watch
+    unsigned int seq;
+    char *buf;
+    size_t buf_size;
+    LinkEntry *entries;
+    int count;
+    int capacity;
+} NlLink;
+
+int nl_link_open(NlLink *nl);
+void nl_link_close(NlLink *nl);
+int nl_link_refresh(NlLink *nl);
+// Counters only, from RTM_GETSTATS: a fraction of the bytes of the full
+// RTM_GETLINK dump, which adds up with thousands of interfaces.  Entries
+// get ifindex and stats, nothing else.  Kernels before 4.7 fail it with
+// EOPNOTSUPP or EINVAL.
+int nl_link_refresh_stats(NlLink *nl);
+
+// removed: RTM_DELLINK.  Only the link's own attributes are filled in, the
+// counters of an event are not meaningful.
+typedef void (*LinkEventFunc)(const LinkEntry *link, int removed, void *user_data);
+// Subscribes a second socket to RTNLGRP_LINK
+int nl_link_watch(NlLink *nl);
+// Handles every pending event without blocking.  Returns the number of
+// events, or -1 with errno set (ENOBUFS: some were lost, dump again).
+int nl_link_read_events(NlLink *nl, LinkEventFunc func, void *user_data);
+
+#endif
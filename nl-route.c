@@ -0,0 +1,626 @@
+/*
+ * Dave's Network Inquisition - netlink route table
+ * Website: https://prowse.tech
+ *
+ * A copy of the kernel's routing tables kept in step with route
+ * notifications (see nl-route.h).
+ */
+
+#include "nl-route.h"
+#include "nl-common.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+// Dump replies come in batches of up to 32 KB
+#define NL_ROUTE_BUF_SIZE 65536
+// Room for a burst of notifications (a BGP session flapping)
+#define NL_ROUTE_RCVBUF (16 * 1024 * 1024)
+
+static int nl_route_key_equal(const RouteEntry *a, const RouteEntry *b) {
+    int len = a->family == AF_INET ? 4 : 16;
+    return a->family == b->family && a->table == b->table && a->dst_len == b->dst_len && a->tos == b->tos &&
+           a->priority == b->priority && memcmp(a->dst, b->dst, len) == 0;
+}
+
+// FNV-1a over the key fields
+static unsigned int nl_route_hash(const RouteEntry *r) {
+    unsigned int h = NL_FNV_BASIS;
+
+    h = nl_fnv(h, r->family);
+    h = nl_fnv(h, r->dst_len);
+    h = nl_fnv(h, r->tos);
+    h = nl_fnv(h, r->table);
+    h = nl_fnv(h, r->priority);
+    return nl_fnv_bytes(h, r->dst, r->family == AF_INET ? 4 : 16);
+}
+
+static unsigned int nl_route_row_hash(const void *rows, int row) {
+    return nl_route_hash(&((const RouteEntry *)rows)[row]);
+}
+
+static int nl_route_row_equal(const void *rows, int row, const void *key) {
+    return nl_route_key_equal(&((const RouteEntry *)rows)[row], key);
+}
+
+// Hash slot holding a route with r's key, or the empty slot where it would go
+static unsigned int nl_route_slot(const NlRoute *nl, const RouteEntry *r) {
+    return nl_hash_find(nl->hash, nl->hash_size, nl_route_hash(r), nl_route_row_equal, nl->routes, r);
+}
+
+static int nl_route_grow(NlRoute *nl) {
+    int capacity = nl->capacity ? nl->capacity * 2 : 256;
+    RouteEntry *routes = realloc(nl->routes, capacity * sizeof(RouteEntry));
+    if (routes == NULL) {
+        return -1;
+    }
+    nl->routes = routes;
+    int *free_rows = realloc(nl->free_rows, capacity * sizeof(int));
+    if (free_rows == NULL) {
+        return -1;
+    }
+    nl->free_rows = free_rows;
+    int *dead_rows = realloc(nl->dead_rows, capacity * sizeof(int));
+    if (dead_rows == NULL) {
+        return -1;
+    }
+    nl->dead_rows = dead_rows;
+
+    // Keep the hash at most half full
+    int *hash = calloc(capacity * 2, sizeof(int));
+    if (hash == NULL) {
+        return -1;
+    }
+    free(nl->hash);
+    nl->hash = hash;
+    nl->hash_size = capacity * 2;
+    nl->capacity = capacity;
+
+    for (int i = 0; i < nl->size; i++) {
+        if (nl_route_live(nl, i)) {
+            nl_hash_place(nl->hash, nl->hash_size, nl_route_hash(&nl->routes[i]), i);
+        }
+    }
+    return 0;
+}
+
+// FNV-1a over the whole hop; callers zero it first so padding compares equal
+static unsigned int nl_route_hop_hash(const RouteHop *hop) {
+    return nl_fnv_bytes(NL_FNV_BASIS, hop, sizeof(*hop));
+}
+
+static int nl_route_hop_equal(const void *hops, int i, const void *hop) {
+    return memcmp(&((const RouteHop *)hops)[i], hop, sizeof(RouteHop)) == 0;
+}
+
+// Index of hop in the pool, adding it when new; -1 when out of memory
+static int nl_route_hop_intern(NlRoute *nl, const RouteHop *hop) {
+    if (nl->nhops == nl->hops_capacity) {
+        int capacity = nl->hops_capacity ? nl->hops_capacity * 2 : 64;
+        RouteHop *hops = realloc(nl->hops, capacity * sizeof(RouteHop));
+        if (hops == NULL) {
+            return -1;
+        }
+        nl->hops = hops;
+        int *hash = calloc(capacity * 2, sizeof(int));
+        if (hash == NULL) {
+            return -1;
+        }
+        free(nl->hop_hash);
+        nl->hop_hash = hash;
+        nl->hop_hash_size = capacity * 2;
+        nl->hops_capacity = capacity;
+        for (int i = 0; i < nl->nhops; i++) {
+            nl_hash_place(nl->hop_hash, nl->hop_hash_size, nl_route_hop_hash(&nl->hops[i]), i);
+        }
+    }
+
+    unsigned int slot = nl_hash_find(nl->hop_hash, nl->hop_hash_size, nl_route_hop_hash(hop), nl_route_hop_equal,
+                                     nl->hops, hop);
+    if (nl->hop_hash[slot] != 0) {
+        return nl->hop_hash[slot] - 1;
+    }
+    nl->hops[nl->nhops] = *hop;
+    nl->hop_hash[slot] = nl->nhops + 1;
+    return nl->nhops++;
+}
+
+// Returns the route's row with *changed set when the table changed (0 when
+// the route was already there as is), -1 when out of memory
+static int nl_route_upsert(NlRoute *nl, const RouteEntry *r, int *changed) {
+    *changed = 0;
+    if (nl->size == nl->capacity && nl->nfree == 0 && nl_route_grow(nl) < 0) {
+        return -1;
+    }
+
+    unsigned int slot = nl_route_slot(nl, r);
+    int row = nl->hash[slot] - 1;
+    if (row >= 0) {
+        if (memcmp(&nl->routes[row], r, sizeof(*r)) == 0) {
+            return row;
+        }
+    } else {
+        row = nl->nfree > 0 ? nl->free_rows[--nl->nfree] : nl->size++;
+        nl->hash[slot] = row + 1;
+        nl->count++;
+    }
+    nl->routes[row] = *r;
+    nl->generation++;
+    *changed = 1;
+    if (nl->func != NULL) {
+        nl->func(nl, row, 1, nl->user_data);
+    }
+    return row;
+}
+
+// The row keeps its contents until nl_route_reap(), so the callback (and
+// anything it defers to the end of the batch) can still read the route
+static void nl_route_remove_row(NlRoute *nl, int row) {
+    nl_hash_delete(nl->hash, nl->hash_size, nl_route_slot(nl, &nl->routes[row]), nl_route_row_hash, nl->routes);
+    nl->routes[row].dead = 1;
+    nl->dead_rows[nl->ndead++] = row;
+    nl->count--;
+    nl->generation++;
+    if (nl->func != NULL) {
+        nl->func(nl, row, 0, nl->user_data);
+    }
+}
+
+static int nl_route_remove(NlRoute *nl, const RouteEntry *r) {
+    if (nl->hash_size == 0) {
+        return 0;
+    }
+    int row = nl->hash[nl_route_slot(nl, r)] - 1;
+    if (row < 0) {
+        return 0;
+    }
+    nl_route_remove_row(nl, row);
+    return 1;
+}
+
+// Deleted rows become free for reuse
+static void nl_route_reap(NlRoute *nl) {
+    for (int i = 0; i < nl->ndead; i++) {
+        nl->routes[nl->dead_rows[i]].family = 0;
+        nl->routes[nl->dead_rows[i]].dead = 0;
+        nl->free_rows[nl->nfree++] = nl->dead_rows[i];
+    }
+    nl->ndead = 0;
+}
+
+// Fills r and its next hop from an RTM_NEWROUTE/RTM_DELROUTE; 0 for routes
+// that are kept, -1 for ones that are not (cache clones, other families)
+static int nl_route_parse(struct nlmsghdr *nh, RouteEntry *r, RouteHop *hop) {
+    struct rtmsg *rtm = NLMSG_DATA(nh);
+    int len = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
+
+    if (len < 0 || (rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6) ||
+        (rtm->rtm_flags & RTM_F_CLONED)) {
+        return -1;
+    }
+
+    memset(r, 0, sizeof(*r));
+    memset(hop, 0, sizeof(*hop));
+    hop->family = rtm->rtm_family;
+    r->family = rtm->rtm_family;
+    r->dst_len = rtm->rtm_dst_len;
+    r->tos = rtm->rtm_tos;
+    r->protocol = rtm->rtm_protocol;
+    r->scope = rtm->rtm_scope;
+    r->type = rtm->rtm_type;
+    r->table = rtm->rtm_table;
+    r->nexthops = 1;
+
+    size_t alen = r->family == AF_INET ? 4 : 16;
+    for (struct rtattr *rta = RTM_RTA(rtm); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        size_t payload = RTA_PAYLOAD(rta);
+
+        switch (rta->rta_type) {
+        case RTA_DST:
+            if (payload >= alen) {
+                memcpy(r->dst, RTA_DATA(rta), alen);
+            }
+            break;
+        case RTA_GATEWAY:
+            if (payload >= alen) {
+                memcpy(hop->gateway, RTA_DATA(rta), alen);
+                hop->has_gateway = 1;
+            }
+            break;
+        case RTA_PREFSRC:
+            if (payload >= alen) {
+                memcpy(hop->prefsrc, RTA_DATA(rta), alen);
+                hop->has_prefsrc = 1;
+            }
+            break;
+        case RTA_OIF:
+            if (payload >= sizeof(int)) {
+                memcpy(&hop->oif, RTA_DATA(rta), sizeof(int));
+            }
+            break;
+        case RTA_PRIORITY:
+            if (payload >= sizeof(uint32_t)) {
+                memcpy(&r->priority, RTA_DATA(rta), sizeof(uint32_t));
+            }
+            break;
+        case RTA_TABLE:
+            if (payload >= sizeof(uint32_t)) {
+                memcpy(&r->table, RTA_DATA(rta), sizeof(uint32_t));
+            }
+            break;
+        case RTA_MULTIPATH: {
+            // Count the next hops, keep the first one's device and gateway
+            struct rtnexthop *nh = RTA_DATA(rta);
+            int left = payload;
+            r->nexthops = 0;
+            while (left >= (int)sizeof(*nh) && nh->rtnh_len >= sizeof(*nh) && nh->rtnh_len <= left) {
+                if (r->nexthops++ == 0) {
+                    int nlen = nh->rtnh_len - sizeof(*nh);
+                    hop->oif = nh->rtnh_ifindex;
+                    for (struct rtattr *a = RTNH_DATA(nh); RTA_OK(a, nlen); a = RTA_NEXT(a, nlen)) {
+                        if (a->rta_type == RTA_GATEWAY && RTA_PAYLOAD(a) >= alen) {
+                            memcpy(hop->gateway, RTA_DATA(a), alen);
+                            hop->has_gateway = 1;
+                        }
+                    }
+                }
+                left -= RTNH_ALIGN(nh->rtnh_len);
+                nh = RTNH_NEXT(nh);
+            }
+            break;
+        }
+        }
+    }
+    return 0;
+}
+
+// Returns 1 when the table changed, 0 when not, -1 when out of memory
+static int nl_route_apply(NlRoute *nl, struct nlmsghdr *nh) {
+    RouteEntry r;
+    RouteHop hop;
+    int changed;
+
+    if ((nh->nlmsg_type != RTM_NEWROUTE && nh->nlmsg_type != RTM_DELROUTE) || nl_route_parse(nh, &r, &hop) < 0) {
+        return 0;
+    }
+    if (nh->nlmsg_type == RTM_DELROUTE) {
+        return nl_route_remove(nl, &r);
+    }
+    int index = nl_route_hop_intern(nl, &hop);
+    r.hop = index;
+    if (index < 0 || nl_route_upsert(nl, &r, &changed) < 0) {
+        return -1;
+    }
+    return changed;
+}
+
+// Notifications as they come; one that cannot be applied is skipped
+static int nl_route_on_message(struct nlmsghdr *nh, void *user_data) {
+    return nl_route_apply(user_data, nh);
+}
+
+typedef struct {
+    NlRoute *nl;
+    unsigned char *seen;
+    int old_size;
+} NlRouteDump;
+
+static int nl_route_on_dump(struct nlmsghdr *nh, void *user_data) {
+    NlRouteDump *dump = user_data;
+    NlRoute *nl = dump->nl;
+    RouteEntry r;
+    RouteHop hop;
+    int changed;
+
+    // A restarted dump reports every route again, and marking is idempotent
+    if (nh == NULL || nh->nlmsg_type != RTM_NEWROUTE || nl_route_parse(nh, &r, &hop) < 0) {
+        return 0;
+    }
+    int index = nl_route_hop_intern(nl, &hop);
+    r.hop = index;
+    int row = index < 0 ? -1 : nl_route_upsert(nl, &r, &changed);
+    if (row < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    // Rows reused from the free list count as seen too
+    if (row < dump->old_size) {
+        dump->seen[row] = 1;
+    }
+    return changed;
+}
+
+// Full RTM_GETROUTE dump on a socket of its own, so notifications queued on
+// nl->fd stay in order.  Routes the dump no longer has are removed.
+static int nl_route_dump(NlRoute *nl) {
+    struct {
+        struct nlmsghdr nh;
+        struct rtmsg rtm;
+    } req;
+    NlRouteDump dump = { nl, NULL, nl->size };
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (nl->size > 0) {
+        dump.seen = calloc(nl->size, 1);
+        if (dump.seen == NULL) {
+            close(fd);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.rtm));
+    req.nh.nlmsg_type = RTM_GETROUTE;
+    req.rtm.rtm_family = AF_UNSPEC;
+
+    int changes = nl_dump(fd, &req.nh, &nl->seq, &nl->buf, &nl->buf_size, nl_route_on_dump, &dump);
+    if (changes >= 0) {
+        for (int row = 0; row < dump.old_size; row++) {
+            if (!dump.seen[row] && nl_route_live(nl, row)) {
+                nl_route_remove_row(nl, row);
+                changes++;
+            }
+        }
+    }
+    int err = errno;
+    free(dump.seen);
+    close(fd);
+    errno = err;
+    return changes;
+}
+
+static int nl_route_resync(void *user_data) {
+    NlRoute *nl = user_data;
+
+    nl->resyncs++;
+    return nl_route_dump(nl);
+}
+
+int nl_route_open(NlRoute *nl, RouteChangeFunc func, void *user_data) {
+    memset(nl, 0, sizeof(*nl));
+    nl->func = func;
+    nl->user_data = user_data;
+
+    nl->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+    if (nl->fd < 0) {
+        return -1;
+    }
+
+    // Forced size needs CAP_NET_ADMIN; otherwise take what rmem_max allows
+    int rcvbuf = NL_ROUTE_RCVBUF;
+    if (setsockopt(nl->fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        setsockopt(nl->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+
+    // Subscribe before dumping so no change falls between the two
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+    nl->buf_size = NL_ROUTE_BUF_SIZE;
+    nl->buf = malloc(nl->buf_size);
+    if (nl->buf == NULL) {
+        errno = ENOMEM;
+    }
+    if (nl->buf == NULL || bind(nl->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || nl_route_dump(nl) < 0) {
+        int err = errno;
+        nl_route_close(nl);
+        errno = err;
+        return -1;
+    }
+    nl_route_reap(nl);
+    return 0;
+}
+
+void nl_route_close(NlRoute *nl) {
+    if (nl->fd >= 0) {
+        close(nl->fd);
+    }
+    free(nl->buf);
+    free(nl->routes);
+    free(nl->hash);
+    free(nl->free_rows);
+    free(nl->dead_rows);
+    free(nl->hops);
+    free(nl->hop_hash);
+    memset(nl, 0, sizeof(*nl));
+    nl->fd = -1;
+}
+
+int nl_route_fd(const NlRoute *nl) {
+    return nl->fd;
+}
+
+int nl_route_dispatch(NlRoute *nl) {
+    int changes = nl_dispatch(nl->fd, &nl->buf, &nl->buf_size, nl_route_on_message, nl_route_resync, nl);
+
+    int err = errno;
+    nl_route_reap(nl);
+    errno = err;
+    return changes;
+}
+
+int nl_route_query(int family, const unsigned char *addr, RouteEntry *r, RouteHop *hop) {
+    struct {
+        struct nlmsghdr nh;
+        struct rtmsg rtm;
+        char attrs[64];
+    } req;
+    int alen = family == AF_INET ? 4 : 16;
+    int status = -1;
+    size_t buf_size = NL_ROUTE_BUF_SIZE;
+    char *buf = malloc(buf_size);
+    int fd;
+
+    if (buf == NULL) {
+        return -1;
+    }
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        free(buf);
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.rtm));
+    req.nh.nlmsg_type = RTM_GETROUTE;
+    req.nh.nlmsg_flags = NLM_F_REQUEST;
+    req.nh.nlmsg_seq = 1;       // the socket is this request's alone
+    req.rtm.rtm_family = family;
+    req.rtm.rtm_dst_len = alen * 8;
+    // The table entry that matched, not the route cache entry made from it
+    req.rtm.rtm_flags = RTM_F_FIB_MATCH;
+    struct rtattr *rta = (struct rtattr *)((char *)&req + NLMSG_ALIGN(req.nh.nlmsg_len));
+    rta->rta_type = RTA_DST;
+    rta->rta_len = RTA_LENGTH(alen);
+    memcpy(RTA_DATA(rta), addr, alen);
+    req.nh.nlmsg_len = NLMSG_ALIGN(req.nh.nlmsg_len) + RTA_ALIGN(rta->rta_len);
+
+    if (send(fd, &req, req.nh.nlmsg_len, 0) < 0) {
+        goto out;
+    }
+    for (;;) {
+        ssize_t n = nl_recv(fd, &buf, &buf_size, 0);
+        if (n < 0) {
+            goto out;
+        }
+        for (struct nlmsghdr *nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, n); nh = NLMSG_NEXT(nh, n)) {
+            if (nh->nlmsg_seq != req.nh.nlmsg_seq) {
+                continue;
+            }
+            if (nh->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr *err = NLMSG_DATA(nh);
+                errno = err->error ? -err->error : EIO;
+                goto out;
+            }
+            if (nh->nlmsg_type == RTM_NEWROUTE) {
+                // Older kernels mark the answer as a cache entry, which
+                // the table itself leaves out
+                ((struct rtmsg *)NLMSG_DATA(nh))->rtm_flags &= ~RTM_F_CLONED;
+                if (nl_route_parse(nh, r, hop) < 0) {
+                    errno = EPROTO;
+                    goto out;
+                }
+                status = 0;
+                goto out;
+            }
+        }
+    }
+
+out:
+    close(fd);
+    free(buf);
+    return status;
+}
+
+int nl_route_intern(NlRoute *nl, RouteEntry *r, const RouteHop *hop) {
+    int index = nl_route_hop_intern(nl, hop);
+
+    if (index < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    r->hop = index;
+    return 0;
+}
+
+static const char *nl_route_protocol(int protocol, char *buf, size_t size) {
+    switch (protocol) {
+    case RTPROT_REDIRECT: return "redirect";
+    case RTPROT_KERNEL: return "kernel";
+    case RTPROT_BOOT: return "boot";
+    case RTPROT_STATIC: return "static";
+    case RTPROT_RA: return "ra";
+    case RTPROT_DHCP: return "dhcp";
+    case RTPROT_ZEBRA: return "zebra";
+    case RTPROT_BIRD: return "bird";
+    case RTPROT_BGP: return "bgp";
+    case RTPROT_ISIS: return "isis";
+    case RTPROT_OSPF: return "ospf";
+    case RTPROT_RIP: return "rip";
+    }
+    snprintf(buf, size, "%d", protocol);
+    return buf;
+}
+
+const char *nl_route_format(const NlRoute *nl, const RouteEntry *r, const char *ifname, char *buf, size_t size) {
+    static const char *types[] = {
+        [RTN_LOCAL] = "local", [RTN_BROADCAST] = "broadcast", [RTN_ANYCAST] = "anycast",
+        [RTN_MULTICAST] = "multicast", [RTN_BLACKHOLE] = "blackhole", [RTN_UNREACHABLE] = "unreachable",
+        [RTN_PROHIBIT] = "prohibit", [RTN_THROW] = "throw", [RTN_NAT] = "nat"
+    };
+    const RouteHop *hop = nl_route_hop(nl, r);
+    char address[INET6_ADDRSTRLEN];
+    char number[16];
+    size_t o = 0;
+
+#define APPEND(...) do { \
+        if (o < size) o += snprintf(buf + o, size - o, __VA_ARGS__); \
+    } while (0)
+
+    buf[0] = '\0';
+    if (r->type < sizeof(types) / sizeof(types[0]) && types[r->type] != NULL) {
+        APPEND("%s ", types[r->type]);
+    }
+    if (r->dst_len == 0) {
+        APPEND("default");
+    } else {
+        inet_ntop(r->family, r->dst, address, sizeof(address));
+        // Host routes without the /32 or /128, as ip does
+        if (r->dst_len == (r->family == AF_INET ? 32 : 128)) {
+            APPEND("%s", address);
+        } else {
+            APPEND("%s/%d", address, r->dst_len);
+        }
+    }
+    if (hop->has_gateway) {
+        inet_ntop(r->family, hop->gateway, address, sizeof(address));
+        APPEND(" via %s", address);
+    }
+    if (hop->oif != 0) {
+        if (ifname != NULL) {
+            APPEND(" dev %s", ifname);
+        } else {
+            APPEND(" dev if%d", hop->oif);
+        }
+    }
+    if (r->table == RT_TABLE_LOCAL) {
+        APPEND(" table local");
+    } else if (r->table != RT_TABLE_MAIN) {
+        APPEND(" table %u", r->table);
+    }
+    if (r->protocol != RTPROT_BOOT) {
+        APPEND(" proto %s", nl_route_protocol(r->protocol, number, sizeof(number)));
+    }
+    if (r->scope == RT_SCOPE_LINK) {
+        APPEND(" scope link");
+    } else if (r->scope == RT_SCOPE_HOST) {
+        APPEND(" scope host");
+    } else if (r->scope == RT_SCOPE_SITE) {
+        APPEND(" scope site");
+    }
+    if (hop->has_prefsrc) {
+        inet_ntop(r->family, hop->prefsrc, address, sizeof(address));
+        APPEND(" src %s", address);
+    }
+    if (r->priority != 0) {
+        APPEND(" metric %u", r->priority);
+    }
+    if (r->nexthops > 1) {
+        APPEND(" (%d next hops)", r->nexthops);
+    }
+
+#undef APPEND
+    return buf;
+}
@@ -0,0 +1,117 @@
+/*
+ * Dave's Network Inquisition - netlink route table
+ * Website: https://prowse.tech
+ */
+
+#ifndef NL_ROUTE_H
+#define NL_ROUTE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Where a route sends its traffic.  A full Internet table has a million
+// routes but only a handful of distinct next hops, so routes share these
+// through a pool instead of carrying 36 bytes each.
+typedef struct {
+    unsigned char family;
+    unsigned char has_gateway;
+    unsigned char has_prefsrc;
+    int oif;
+    unsigned char gateway[16];
+    unsigned char prefsrc[16];
+} RouteHop;
+
+// One route as reported by RTM_NEWROUTE, 36 bytes.  Addresses are in
+// network byte order, only the first 4 bytes used for IPv4.  Multipath
+// routes keep their first next hop and how many there are.
+typedef struct {
+    unsigned char dst[16];
+    uint32_t table;
+    uint32_t priority;          // metric
+    uint32_t hop;               // index into the next-hop pool
+    unsigned char family;       // AF_INET or AF_INET6; 0 = free row
+    unsigned char dst_len;
+    unsigned char tos;
+    unsigned char protocol;     // RTPROT_*
+    unsigned char scope;        // RT_SCOPE_*
+    unsigned char type;         // RTN_*
+    unsigned char dead;         // deleted, row not yet reusable
+    unsigned char nexthops;
+} RouteEntry;
+
+struct NlRoute;
+
+// added: 1 for a new or replaced route, 0 for one that went away.  A
+// deleted route keeps its row and contents until the dispatch (or open)
+// that removed it returns, so views can still find it by key.
+typedef void (*RouteChangeFunc)(const struct NlRoute *nl, int row, int added, void *user_data);
+
+// The kernel's routing tables, kept current: one RTM_GETROUTE dump when
+// opened, then RTNLGRP_IPV4_ROUTE/RTNLGRP_IPV6_ROUTE notifications applied
+// as they come.  Routes are found through a hash on the kernel's own key
+// (family, table, dst/len, tos, metric).  A route keeps its row for life,
+// so a view can hold row numbers; freed rows are reused.
+typedef struct NlRoute {
+    int fd;                     // notifications; poll it and call dispatch
+    unsigned int seq;
+    char *buf;
+    size_t buf_size;
+
+    RouteEntry *routes;
+    int size;                   // rows in use or free; iterate up to here
+    int count;                  // live routes
+    int capacity;
+    int *hash;                  // open-addressed, row + 1 (0 = empty)
+    int hash_size;
+    int *free_rows;
+    int nfree;
+    int *dead_rows;             // deleted during the current dispatch
+    int ndead;
+
+    RouteHop *hops;             // never shrinks
+    int nhops;
+    int hops_capacity;
+    int *hop_hash;
+    int hop_hash_size;
+
+    uint64_t generation;        // bumped on every change
+    int resyncs;                // full dumps after notifications were lost
+
+    RouteChangeFunc func;
+    void *user_data;
+} NlRoute;
+
+// func may be NULL; it sees the initial dump too
+int nl_route_open(NlRoute *nl, RouteChangeFunc func, void *user_data);
+void nl_route_close(NlRoute *nl);
+int nl_route_fd(const NlRoute *nl);
+// Applies every pending notification without blocking.  Returns the
+// number of changes, or -1 with errno set.
+int nl_route_dispatch(NlRoute *nl);
+
+// Asks the kernel which table entry it would use for addr, as "ip route
+// get fibmatch" does.  The type says what the destination is (multicast
+// through a unicast default route, say), the rest is the route's own,
+// except that IPv4 reports local routes as main while no policy rules have
+// been added (the kernel merges the two tables).  -1 with errno set when
+// it has none: ENETUNREACH, or EINVAL, EHOSTUNREACH and EACCES for
+// blackhole, unreachable and prohibit routes.  No NlRoute is touched, so
+// it can run on a worker while the tables are in use: the answer comes
+// over a socket of its own, with its next hop in hop and r->hop unset.
+int nl_route_query(int family, const unsigned char *addr, RouteEntry *r, RouteHop *hop);
+// Makes a route from nl_route_query one of nl's for nl_route_hop and
+// nl_route_format, on the thread that owns nl.  -1 with ENOMEM.
+int nl_route_intern(NlRoute *nl, RouteEntry *r, const RouteHop *hop);
+
+static inline int nl_route_live(const NlRoute *nl, int row) {
+    return nl->routes[row].family != 0 && !nl->routes[row].dead;
+}
+
+static inline const RouteHop *nl_route_hop(const NlRoute *nl, const RouteEntry *r) {
+    return &nl->hops[r->hop];
+}
+
+// "ip route" style: "10.0.0.0/8 via 192.0.2.1 dev eth0 proto static metric 100"
+const char *nl_route_format(const NlRoute *nl, const RouteEntry *r, const char *ifname, char *buf, size_t size);
+
+#endif
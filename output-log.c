@@ -0,0 +1,411 @@
+/*
+ * Dave's Network Inquisition - bounded output log
+ * Website: https://prowse.tech
+ */
+
+#define _GNU_SOURCE     // memmem
+#include "output-log.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static OutputLine *log_line(const OutputLog *log, uint64_t n) {
+    return &log->lines[n % log->max_lines];
+}
+
+// i counts from the oldest run kept
+static OutputRun *log_run(const OutputLog *log, uint64_t i) {
+    return &log->runs[(log->first_run + i) % (log->max_lines + 1)];
+}
+
+static uint64_t log_run_end(const OutputLog *log, uint64_t i) {
+    return i + 1 < log->run_count ? log_run(log, i + 1)->first : log->first + log->count;
+}
+
+// First line of run i still kept
+static uint64_t log_run_start(const OutputLog *log, uint64_t i) {
+    uint64_t first = log_run(log, i)->first;
+    return first > log->first ? first : log->first;
+}
+
+// Rows of run i counting lines already dropped, which is how run->row
+// advances from one run to the next
+static uint64_t log_run_rows(const OutputLog *log, uint64_t i) {
+    const OutputRun *run = log_run(log, i);
+    uint64_t lines = log_run_end(log, i) - run->first;
+    return lines == 0 ? 0 : run->collapsed ? 1 : lines;
+}
+
+// Row counter of what is shown first, and one past what is shown last
+static uint64_t log_base_row(const OutputLog *log) {
+    const OutputRun *run = log_run(log, 0);
+    return run->collapsed ? run->row : run->row + (log->first - run->first);
+}
+
+static uint64_t log_end_row(const OutputLog *log) {
+    return log_run(log, log->run_count - 1)->row + log_run_rows(log, log->run_count - 1);
+}
+
+static uint64_t log_line_run(const OutputLog *log, uint64_t n) {
+    return (uint32_t)(log_line(log, n)->run - (uint32_t)log->first_run);
+}
+
+static void log_changed(OutputLog *log, uint64_t position, uint64_t removed, uint64_t added) {
+    if (log->changed != NULL && (removed > 0 || added > 0)) {
+        log->changed((int)position, (int)removed, (int)added, log->user_data);
+    }
+}
+
+// Run and line shown at a row
+static void log_locate(const OutputLog *log, int row, uint64_t *run, uint64_t *line) {
+    uint64_t at = log_base_row(log) + row;
+    uint64_t lo = 0;
+    uint64_t hi = log->run_count;
+
+    // Last run starting at or before the row; empty runs never do
+    while (hi - lo > 1) {
+        uint64_t mid = (lo + hi) / 2;
+        if (log_run(log, mid)->row <= at) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    const OutputRun *r = log_run(log, lo);
+    *run = lo;
+    *line = r->collapsed ? log_run_start(log, lo) : r->first + (at - r->row);
+}
+
+static void log_drop_first(OutputLog *log) {
+    OutputRun *run = log_run(log, 0);
+
+    log->first++;
+    log->count--;
+    if (log->count == 0) {
+        log->open = 0;
+    }
+    if (log->run_count > 1 && log_run(log, 1)->first <= log->first) {
+        log->first_run++;
+        log->run_count--;
+    } else if (log->run_count == 1 && log->count == 0) {
+        // The only run is empty again: it starts where the next line goes
+        run->row = run->row + (run->collapsed ? 1 : log->first - run->first);
+        run->first = log->first;
+    }
+}
+
+// Where len bytes can go from `at` on without wrapping, once the lines
+// they would overwrite are dropped; a new line also needs a free slot
+static uint64_t log_make_room(OutputLog *log, uint64_t at, uint64_t len, int new_line) {
+    uint64_t base = log_base_row(log);
+    uint64_t first = log->first;
+
+    if (at % log->text_size + len > log->text_size) {
+        at += log->text_size - at % log->text_size;
+    }
+    while (log->count > 0 && (log_line(log, log->first)->offset + log->text_size < at + len ||
+                              (new_line && log->count >= log->max_lines))) {
+        log_drop_first(log);
+    }
+
+    log_changed(log, 0, log_base_row(log) - base, 0);
+    // A run that lost its first lines shows its header on the oldest one
+    // kept, or a smaller count if collapsed
+    if (log->first != first && log->count > 0 && log->first > log_run(log, 0)->first) {
+        log_changed(log, 0, 1, 1);
+    }
+    return at;
+}
+
+// Longest prefix of at most max bytes that does not split a character
+static size_t log_cut(const char *s, size_t len, size_t max) {
+    if (len <= max) {
+        return len;
+    }
+    len = max;
+    while (len > 0 && ((unsigned char)s[len] & 0xC0) == 0x80) {
+        len--;
+    }
+    return len;
+}
+
+static void log_push(OutputLog *log, const char *s, size_t len) {
+    len = log_cut(s, len, OUTPUT_LOG_LINE_MAX);
+    uint64_t at = log_make_room(log, log->text_end, len, 1);
+    uint64_t rows = log_end_row(log) - log_base_row(log);
+
+    OutputLine *line = log_line(log, log->first + log->count);
+    memcpy(log->text + at % log->text_size, s, len);
+    line->offset = at;
+    line->len = len;
+    line->run = (uint32_t)(log->first_run + log->run_count - 1);
+    log->count++;
+    log->text_end = at + len;
+
+    uint64_t now = log_end_row(log) - log_base_row(log);
+    if (now > rows) {
+        log_changed(log, rows, 0, now - rows);
+    } else if (now > 0) {
+        log_changed(log, now - 1, 1, 1);    // a collapsed run's count
+    }
+}
+
+// More text for the last line, in place or moved to the start of the ring
+static void log_continue(OutputLog *log, const char *s, size_t len) {
+    uint64_t n = log->first + log->count - 1;
+    OutputLine *line = log_line(log, n);
+
+    len = log_cut(s, len, OUTPUT_LOG_LINE_MAX - line->len);
+    if (len == 0) {
+        return;
+    }
+
+    uint64_t at = log_make_room(log, line->offset, line->len + len, 0);
+    if (at != line->offset) {
+        memmove(log->text + at % log->text_size, log->text + line->offset % log->text_size, line->len);
+        line->offset = at;
+    }
+    memcpy(log->text + (line->offset + line->len) % log->text_size, s, len);
+    line->len += len;
+    log->text_end = line->offset + line->len;
+
+    uint64_t i = log_line_run(log, n);
+    const OutputRun *run = log_run(log, i);
+    if (!run->collapsed || n == log_run_start(log, i)) {
+        log_changed(log, log_end_row(log) - log_base_row(log) - 1, 1, 1);
+    }
+}
+
+int output_log_init(OutputLog *log, uint64_t max_lines, OutputLogChangedFunc changed, void *user_data) {
+    memset(log, 0, sizeof(*log));
+    if (max_lines == 0) {
+        max_lines = 1;
+    }
+    log->changed = changed;
+    log->user_data = user_data;
+    log->max_lines = max_lines;
+    log->text_size = max_lines * OUTPUT_LOG_LINE_BYTES;
+    if (log->text_size < 4 * OUTPUT_LOG_LINE_MAX) {
+        log->text_size = 4 * OUTPUT_LOG_LINE_MAX;
+    }
+
+    log->text = malloc(log->text_size);
+    log->lines = malloc(max_lines * sizeof(OutputLine));
+    log->runs = calloc(max_lines + 1, sizeof(OutputRun));
+    if (log->text == NULL || log->lines == NULL || log->runs == NULL) {
+        output_log_free(log);
+        errno = ENOMEM;
+        return -1;
+    }
+    log->run_count = 1;
+    return 0;
+}
+
+void output_log_free(OutputLog *log) {
+    free(log->text);
+    free(log->lines);
+    free(log->runs);
+    log->text = NULL;
+    log->lines = NULL;
+    log->runs = NULL;
+    log->count = 0;
+}
+
+int output_log_set_limit(OutputLog *log, uint64_t max_lines) {
+    OutputLog next;
+    int rows = output_log_rows(log);
+    uint64_t end = log->first + log->count;
+    uint64_t from = log->count > max_lines ? end - max_lines : log->first;
+    uint64_t run = 0;
+
+    if (output_log_init(&next, max_lines, NULL, NULL) < 0) {
+        return -1;
+    }
+    for (uint64_t n = from; n < end; n++) {
+        const OutputLine *line = log_line(log, n);
+        uint64_t i = log_line_run(log, n);
+        if (n == from || i != run) {
+            if (n != from) {
+                output_log_begin_run(&next);
+            }
+            log_run(&next, next.run_count - 1)->collapsed = log_run(log, i)->collapsed;
+            run = i;
+        }
+        log_push(&next, log->text + line->offset % log->text_size, line->len);
+    }
+    if (log->count > 0 && log_run_end(log, log->run_count - 1) == log_run(log, log->run_count - 1)->first) {
+        output_log_begin_run(&next);
+    }
+    next.open = log->open && next.count > 0;
+
+    next.changed = log->changed;
+    next.user_data = log->user_data;
+    output_log_free(log);
+    *log = next;
+    log_changed(log, 0, rows, output_log_rows(log));
+    return 0;
+}
+
+void output_log_append(OutputLog *log, const char *text) {
+    while (*text != '\0') {
+        const char *newline = strchr(text, '\n');
+        size_t len = newline != NULL ? (size_t)(newline - text) : strlen(text);
+
+        if (log->open) {
+            log_continue(log, text, len);
+        } else {
+            log_push(log, text, len);
+        }
+        log->open = newline == NULL;
+        if (newline == NULL) {
+            break;
+        }
+        text = newline + 1;
+    }
+}
+
+void output_log_begin_run(OutputLog *log) {
+    OutputRun *last = log_run(log, log->run_count - 1);
+
+    log->open = 0;
+    if (log_run_end(log, log->run_count - 1) == last->first) {
+        last->collapsed = 0;    // nothing in it yet: it becomes the new one
+        return;
+    }
+
+    OutputRun *run = log_run(log, log->run_count);
+    run->first = log->first + log->count;
+    run->row = log_end_row(log);
+    run->collapsed = 0;
+    log->run_count++;
+}
+
+int output_log_rows(const OutputLog *log) {
+    return log->count > 0 ? (int)(log_end_row(log) - log_base_row(log)) : 0;
+}
+
+const char *output_log_format(const OutputLog *log, int row, char *buf, size_t size) {
+    uint64_t i, n;
+
+    if (row < 0 || row >= output_log_rows(log)) {
+        buf[0] = '\0';
+        return buf;
+    }
+    log_locate(log, row, &i, &n);
+
+    const OutputLine *line = log_line(log, n);
+    const char *text = log->text + line->offset % log->text_size;
+    if (n != log_run_start(log, i)) {
+        snprintf(buf, size, "  %.*s", (int)line->len, text);
+    } else if (log_run(log, i)->collapsed) {
+        unsigned long long lines = log_run_end(log, i) - n;
+        snprintf(buf, size, "▸ %.*s  (%llu line%s)", (int)line->len, text, lines, lines == 1 ? "" : "s");
+    } else {
+        snprintf(buf, size, "▾ %.*s", (int)line->len, text);
+    }
+    return buf;
+}
+
+int output_log_toggle(OutputLog *log, int row) {
+    uint64_t i, n;
+
+    if (row < 0 || row >= output_log_rows(log)) {
+        return 0;
+    }
+    log_locate(log, row, &i, &n);
+    if (n != log_run_start(log, i)) {
+        return 0;
+    }
+
+    OutputRun *run = log_run(log, i);
+    uint64_t lines = log_run_end(log, i) - n;
+    uint64_t before = log_run_rows(log, i);
+    run->collapsed = !run->collapsed;
+    uint64_t delta = log_run_rows(log, i) - before;     // modulo 2^64
+    for (uint64_t j = i + 1; j < log->run_count; j++) {
+        log_run(log, j)->row += delta;
+    }
+
+    if (run->collapsed) {
+        log_changed(log, row, lines, 1);
+    } else {
+        log_changed(log, row, 1, lines);
+    }
+    return 1;
+}
+
+// First line of n .. end - 1 whose text starts past `at`
+static uint64_t log_line_after(const OutputLog *log, uint64_t n, uint64_t end, uint64_t at) {
+    while (n < end) {
+        uint64_t mid = n + (end - n) / 2;
+        if (log_line(log, mid)->offset <= at) {
+            n = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return n;
+}
+
+int64_t output_log_find(const OutputLog *log, const char *needle, uint64_t from, int backward) {
+    size_t len = strlen(needle);
+    uint64_t end = log->first + log->count;
+
+    if (len == 0 || log->count == 0) {
+        return -1;
+    }
+
+    if (backward) {
+        if (from < log->first) {
+            return -1;
+        }
+        for (uint64_t n = from < end ? from + 1 : end; n-- > log->first;) {
+            const OutputLine *line = log_line(log, n);
+            if (memmem(log->text + line->offset % log->text_size, line->len, needle, len) != NULL) {
+                return n;
+            }
+        }
+        return -1;
+    }
+
+    // Lines in one lap of the ring are one run of text: search all of it
+    // at once and only then work out which line a hit is in
+    uint64_t n = from > log->first ? from : log->first;
+    while (n < end) {
+        const OutputLine *line = log_line(log, n);
+        uint64_t lap = line->offset / log->text_size;
+        uint64_t m = log_line_after(log, n, end, (lap + 1) * log->text_size - 1);
+        const OutputLine *last = log_line(log, m - 1);
+        const char *text = log->text + line->offset % log->text_size;
+        const char *stop = text + (last->offset + last->len - line->offset);
+        const char *p = text;
+        const char *hit;
+
+        while (stop - p >= (ptrdiff_t)len && (hit = memmem(p, stop - p, needle, len)) != NULL) {
+            uint64_t at = line->offset + (hit - text);
+            uint64_t k = log_line_after(log, n, m, at) - 1;
+            const OutputLine *found = log_line(log, k);
+            if (at + len <= found->offset + found->len) {
+                return k;
+            }
+            p = hit + 1;    // across two lines
+        }
+        n = m;
+    }
+    return -1;
+}
+
+int output_log_reveal(OutputLog *log, uint64_t line) {
+    if (line < log->first || line >= log->first + log->count) {
+        return -1;
+    }
+
+    uint64_t i = log_line_run(log, line);
+    const OutputRun *run = log_run(log, i);
+    if (run->collapsed) {
+        output_log_toggle(log, (int)(run->row - log_base_row(log)));
+    }
+    return (int)(run->row + (line - run->first) - log_base_row(log));
+}
@@ -0,0 +1,92 @@
+/*
+ * Dave's Network Inquisition - bounded output log
+ * Website: https://prowse.tech
+ */
+
+#ifndef OUTPUT_LOG_H
+#define OUTPUT_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Longer lines are cut here
+#define OUTPUT_LOG_LINE_MAX 1024
+// Text kept per line of retention: lines are mostly shorter, and a log
+// of long ones keeps fewer
+#define OUTPUT_LOG_LINE_BYTES 96
+
+typedef struct {
+    uint64_t offset;            // of its text, counted over the ring's whole life
+    uint32_t len;
+    uint32_t run;               // low bits of its run's number
+} OutputLine;
+
+// A run: one command's output, from its header line on
+typedef struct {
+    uint64_t first;             // number of its first line
+    uint64_t row;               // its first row, counted like offsets
+    int collapsed;
+} OutputRun;
+
+// Rows [position, position + removed) were replaced by `added` new ones
+typedef void (*OutputLogChangedFunc)(int position, int removed, int added, void *user_data);
+
+// A panel's output as a ring of lines with a fixed budget of lines and
+// text: appending past either drops the oldest lines, so a log that runs
+// for days costs what it did after the first hour.  Lines are numbered
+// from the first ever appended and grouped into runs, which can be
+// collapsed to their first line.  What a list widget shows are rows,
+// reported through changed as they come and go.
+typedef struct {
+    OutputLogChangedFunc changed;
+    void *user_data;
+
+    // Line text back to back, with no terminator; a line that would wrap
+    // starts over at the beginning instead, so each one is contiguous
+    char *text;
+    uint64_t text_size;
+    uint64_t text_end;
+
+    // Lines first .. first + count - 1 are kept, ring of max_lines
+    OutputLine *lines;
+    uint64_t max_lines;
+    uint64_t first;
+    uint64_t count;
+    int open;                   // the last line has had no newline yet
+
+    // Runs first_run .. first_run + run_count - 1, ring of max_lines + 1:
+    // all but the newest have a line
+    OutputRun *runs;
+    uint64_t first_run;
+    uint64_t run_count;
+} OutputLog;
+
+int output_log_init(OutputLog *log, uint64_t max_lines, OutputLogChangedFunc changed, void *user_data);
+void output_log_free(OutputLog *log);
+// Keeps the newest lines that fit the new budget; the rows are reported
+// as replaced.  Line numbers start over.
+int output_log_set_limit(OutputLog *log, uint64_t max_lines);
+
+// Text is split at newlines; a piece without one is continued by the
+// next append
+void output_log_append(OutputLog *log, const char *text);
+// Everything appended from now on is a new run
+void output_log_begin_run(OutputLog *log);
+
+int output_log_rows(const OutputLog *log);
+// The row as shown: a run's first line has a fold marker, and a collapsed
+// run its line count
+const char *output_log_format(const OutputLog *log, int row, char *buf, size_t size);
+// Collapses or expands the run whose first line is at row; returns 0 if
+// the row is not one
+int output_log_toggle(OutputLog *log, int row);
+
+// Number of the first line from `from` on (backward: from `from` back)
+// that contains needle, or -1.  A forward search runs memmem over the
+// text in as few pieces as the ring allows.
+int64_t output_log_find(const OutputLog *log, const char *needle, uint64_t from, int backward);
+// Expands the run of a line if it is collapsed and returns the line's row,
+// or -1 for a line no longer kept
+int output_log_reveal(OutputLog *log, uint64_t line);
+
+#endif
@@ -0,0 +1,306 @@
+/*
+ * Dave's Network Inquisition - ping sweep target lists
+ * Website: https://prowse.tech
+ *
+ * Expands the PING entry's sweep syntax (see ping-targets.h) into the
+ * address array a sweep session probes.
+ */
+
+#include "ping-targets.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PING_TARGETS_ITEM_MAX 128
+
+static int ping_targets_fail(PingTargets *t, char *error, size_t error_size, const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(error, error_size, fmt, ap);
+    va_end(ap);
+    ping_targets_free(t);
+    return -1;
+}
+
+// Room for n more addresses, within PING_TARGETS_MAX
+static int ping_targets_reserve(PingTargets *t, uint64_t n) {
+    if (n > (uint64_t)(PING_TARGETS_MAX - t->count)) {
+        errno = E2BIG;
+        return -1;
+    }
+    if (t->count + (int)n <= t->capacity) {
+        return 0;
+    }
+
+    int capacity = t->capacity ? t->capacity : 256;
+    while (capacity < t->count + (int)n) {
+        capacity *= 2;
+    }
+    PingAddress *addrs = realloc(t->addrs, capacity * sizeof(PingAddress));
+    if (addrs == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    t->addrs = addrs;
+    t->capacity = capacity;
+    return 0;
+}
+
+static void ping_targets_add_v4(PingTargets *t, uint32_t host) {
+    PingAddress *a = &t->addrs[t->count++];
+
+    memset(a, 0, sizeof(*a));
+    a->v4.sin_family = AF_INET;
+    a->v4.sin_addr.s_addr = htonl(host);
+}
+
+static void ping_targets_add_v6(PingTargets *t, const struct in6_addr *host) {
+    PingAddress *a = &t->addrs[t->count++];
+
+    memset(a, 0, sizeof(*a));
+    a->v6.sin6_family = AF_INET6;
+    a->v6.sin6_addr = *host;
+}
+
+static int ping_targets_prefix(const char *s, int max) {
+    char *end;
+    long prefix = strtol(s, &end, 10);
+
+    if (*s == '\0' || *end != '\0' || prefix < 0 || prefix > max) {
+        return -1;
+    }
+    return prefix;
+}
+
+// Expand one item; errno E2BIG means the list grew too long, anything
+// else that the item is malformed
+static int ping_targets_item(PingTargets *t, char *item) {
+    struct in_addr v4, v4_last;
+    struct in6_addr v6;
+    char *slash = strchr(item, '/');
+    char *dash = strchr(item, '-');
+
+    errno = EINVAL;
+    if (slash != NULL) {
+        *slash = '\0';
+        if (inet_pton(AF_INET, item, &v4) == 1) {
+            int prefix = ping_targets_prefix(slash + 1, 32);
+            if (prefix < 0) {
+                return -1;
+            }
+            uint32_t mask = prefix == 0 ? 0 : 0xffffffffU << (32 - prefix);
+            uint32_t first = ntohl(v4.s_addr) & mask;
+            uint64_t n = 1ULL << (32 - prefix);
+
+            // Leave out the network and broadcast addresses where a
+            // subnet has them
+            if (prefix <= 30) {
+                first++;
+                n -= 2;
+            }
+            if (ping_targets_reserve(t, n) < 0) {
+                return -1;
+            }
+            for (uint64_t i = 0; i < n; i++) {
+                ping_targets_add_v4(t, first + (uint32_t)i);
+            }
+            return 0;
+        }
+        if (inet_pton(AF_INET6, item, &v6) == 1) {
+            // At most 65536 addresses; anything wider is not sweepable
+            int prefix = ping_targets_prefix(slash + 1, 128);
+            if (prefix < 112) {
+                return -1;
+            }
+            int bits = 128 - prefix;
+            uint32_t n = 1U << bits;
+            uint16_t base = (v6.s6_addr[14] << 8 | v6.s6_addr[15]) & ~(n - 1);
+
+            if (ping_targets_reserve(t, n) < 0) {
+                return -1;
+            }
+            for (uint32_t i = 0; i < n; i++) {
+                uint16_t low = base + i;
+                v6.s6_addr[14] = low >> 8;
+                v6.s6_addr[15] = low & 0xff;
+                ping_targets_add_v6(t, &v6);
+            }
+            return 0;
+        }
+        return -1;
+    }
+
+    if (dash != NULL) {
+        *dash = '\0';
+        if (inet_pton(AF_INET, item, &v4) != 1) {
+            return -1;
+        }
+        if (strchr(dash + 1, '.') != NULL) {
+            if (inet_pton(AF_INET, dash + 1, &v4_last) != 1) {
+                return -1;
+            }
+        } else {
+            // Short form: only the last octet
+            int octet = ping_targets_prefix(dash + 1, 255);
+            if (octet < 0) {
+                return -1;
+            }
+            v4_last.s_addr = htonl((ntohl(v4.s_addr) & 0xffffff00U) | octet);
+        }
+
+        uint32_t first = ntohl(v4.s_addr);
+        uint32_t last = ntohl(v4_last.s_addr);
+        if (last < first) {
+            return -1;
+        }
+        if (ping_targets_reserve(t, (uint64_t)last - first + 1) < 0) {
+            return -1;
+        }
+        for (uint64_t host = first; host <= last; host++) {
+            ping_targets_add_v4(t, (uint32_t)host);
+        }
+        return 0;
+    }
+
+    if (inet_pton(AF_INET, item, &v4) == 1) {
+        if (ping_targets_reserve(t, 1) < 0) {
+            return -1;
+        }
+        ping_targets_add_v4(t, ntohl(v4.s_addr));
+        return 0;
+    }
+    if (inet_pton(AF_INET6, item, &v6) == 1) {
+        if (ping_targets_reserve(t, 1) < 0) {
+            return -1;
+        }
+        ping_targets_add_v6(t, &v6);
+        return 0;
+    }
+    return -1;
+}
+
+static int ping_targets_separator(int ch) {
+    return ch == ',' || isspace(ch);
+}
+
+// Items in one line of text; in_file refuses nested @file items
+static int ping_targets_text(PingTargets *t, const char *text, int in_file, char *error, size_t error_size) {
+    const char *p = text;
+
+    for (;;) {
+        while (ping_targets_separator((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '\0' || (in_file && *p == '#')) {
+            return 0;
+        }
+
+        size_t len = 0;
+        while (p[len] != '\0' && !ping_targets_separator((unsigned char)p[len]) && !(in_file && p[len] == '#')) {
+            len++;
+        }
+
+        char item[PING_TARGETS_ITEM_MAX];
+        if (len >= sizeof(item)) {
+            return ping_targets_fail(t, error, error_size, "Target too long: %.32s...", p);
+        }
+        memcpy(item, p, len);
+        item[len] = '\0';
+        p += len;
+
+        if (item[0] == '@') {
+            if (in_file) {
+                return ping_targets_fail(t, error, error_size, "Target files cannot include others: %s", item);
+            }
+            FILE *fp = fopen(item + 1, "r");
+            if (fp == NULL) {
+                return ping_targets_fail(t, error, error_size, "%s: %s", item + 1, strerror(errno));
+            }
+            char line[1024];
+            int status = 0;
+            while (status == 0 && fgets(line, sizeof(line), fp) != NULL) {
+                status = ping_targets_text(t, line, 1, error, error_size);
+            }
+            fclose(fp);
+            if (status < 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        char copy[PING_TARGETS_ITEM_MAX];
+        memcpy(copy, item, len + 1);
+        if (ping_targets_item(t, item) < 0) {
+            if (errno == E2BIG) {
+                return ping_targets_fail(t, error, error_size, "Too many targets (limit %d) at %s", PING_TARGETS_MAX,
+                                         copy);
+            }
+            if (errno == ENOMEM) {
+                return ping_targets_fail(t, error, error_size, "%s", strerror(errno));
+            }
+            return ping_targets_fail(t, error, error_size, "Not an address, prefix or range: %s", copy);
+        }
+    }
+}
+
+int ping_targets_parse(PingTargets *t, const char *spec, char *error, size_t error_size) {
+    memset(t, 0, sizeof(*t));
+    if (ping_targets_text(t, spec, 0, error, error_size) < 0) {
+        return -1;
+    }
+    if (t->count == 0) {
+        return ping_targets_fail(t, error, error_size, "No targets");
+    }
+    return 0;
+}
+
+void ping_targets_free(PingTargets *t) {
+    free(t->addrs);
+    memset(t, 0, sizeof(*t));
+}
+
+int ping_targets_looks_like_sweep(const char *spec) {
+    const char *p = spec;
+    char first[PING_TARGETS_ITEM_MAX];
+    struct in_addr v4;
+    size_t len;
+
+    while (ping_targets_separator((unsigned char)*p)) {
+        p++;
+    }
+    if (*p == '@') {
+        return 1;
+    }
+
+    len = 0;
+    while (p[len] != '\0' && !ping_targets_separator((unsigned char)p[len])) {
+        len++;
+    }
+    // A second item makes it a list
+    for (size_t i = len; p[i] != '\0'; i++) {
+        if (!ping_targets_separator((unsigned char)p[i])) {
+            return 1;
+        }
+    }
+    if (len == 0 || len >= sizeof(first)) {
+        return 0;
+    }
+    memcpy(first, p, len);
+    first[len] = '\0';
+
+    if (strchr(first, '/') != NULL) {
+        return 1;
+    }
+    // Host names have dashes too; a range starts with an IPv4 address
+    char *dash = strchr(first, '-');
+    if (dash != NULL) {
+        *dash = '\0';
+        return inet_pton(AF_INET, first, &v4) == 1;
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * Dave's Network Inquisition - ping sweep target lists
+ * Website: https://prowse.tech
+ */
+
+#ifndef PING_TARGETS_H
+#define PING_TARGETS_H
+
+#include <stddef.h>
+
+#include "ping.h"
+
+// Largest list a spec may expand to
+#define PING_TARGETS_MAX (1 << 18)
+
+typedef struct {
+    PingAddress *addrs;
+    int count;
+    int capacity;
+} PingTargets;
+
+// A spec is one or more items separated by spaces or commas:
+//   192.0.2.7, 2001:db8::1      single addresses
+//   192.0.2.0/24                IPv4 prefix; /30 and shorter skip the
+//                               network and broadcast addresses
+//   2001:db8::/120              IPv6 prefix, /112 or longer
+//   192.0.2.10-192.0.2.40       inclusive IPv4 range
+//   192.0.2.10-40               same, last octet only
+//   @/path/to/file              one item per line, # starts a comment
+// Literal addresses only; nothing is resolved.  On failure error holds
+// a message naming the item at fault and t is left empty.
+int ping_targets_parse(PingTargets *t, const char *spec, char *error, size_t error_size);
+void ping_targets_free(PingTargets *t);
+
+// More than a plain host name or address: a prefix, range, list or file
+int ping_targets_looks_like_sweep(const char *spec);
+
+#endif
@@ -0,0 +1,922 @@
+/*
+ * Dave's Network Inquisition - ICMP echo engine
+ * Website: https://prowse.tech
+ *
+ * Unprivileged ping sockets (SOCK_DGRAM, IPPROTO_ICMP) where the system
+ * allows them (net.ipv4.ping_group_range), raw sockets otherwise.  Round
+ * trip times come from the kernel's software timestamps: the send time
+ * from the socket error queue, the receive time from the reply itself.
+ */
+
+#include "ping.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/errqueue.h>
+#include <linux/icmp.h>
+#include <linux/net_tstamp.h>
+#include <netinet/icmp6.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#define PING_TIMER_KEY 2
+#define PING_PACKET_MAX 1500
+
+static int64_t ping_clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint16_t ping_checksum(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint32_t sum = 0;
+
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        sum += (p[i] << 8) | p[i + 1];
+    }
+    if (len & 1) {
+        sum += p[len - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons(~sum & 0xffff);
+}
+
+static int ping_socket_open(PingSocket *s, int family, int epoll_fd, int key) {
+    int proto = family == AF_INET ? IPPROTO_ICMP : IPPROTO_ICMPV6;
+    int on = 1;
+
+    memset(s, 0, sizeof(*s));
+    s->fd = socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, proto);
+    if (s->fd < 0) {
+        s->fd = socket(family, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, proto);
+        s->raw = 1;
+    }
+    if (s->fd < 0) {
+        return -1;
+    }
+
+    // Without timestamping the engine falls back to clock_gettime
+    int stamping = SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE |
+                   SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    setsockopt(s->fd, SOL_SOCKET, SO_TIMESTAMPING, &stamping, sizeof(stamping));
+
+    if (family == AF_INET) {
+        setsockopt(s->fd, IPPROTO_IP, IP_RECVTTL, &on, sizeof(on));
+        if (s->raw) {
+            // A raw socket sees every ICMP packet: keep replies and errors
+            struct icmp_filter filter;
+            filter.data = ~((1U << ICMP_ECHOREPLY) | (1U << ICMP_DEST_UNREACH) | (1U << ICMP_TIME_EXCEEDED));
+            setsockopt(s->fd, SOL_RAW, ICMP_FILTER, &filter, sizeof(filter));
+        } else {
+            // Ping sockets report ICMP errors through the error queue
+            setsockopt(s->fd, IPPROTO_IP, IP_RECVERR, &on, sizeof(on));
+        }
+    } else {
+        setsockopt(s->fd, IPPROTO_IPV6, IPV6_RECVHOPLIMIT, &on, sizeof(on));
+        if (s->raw) {
+            struct icmp6_filter filter;
+            ICMP6_FILTER_SETBLOCKALL(&filter);
+            ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filter);
+            ICMP6_FILTER_SETPASS(ICMP6_DST_UNREACH, &filter);
+            ICMP6_FILTER_SETPASS(ICMP6_TIME_EXCEEDED, &filter);
+            ICMP6_FILTER_SETPASS(ICMP6_PACKET_TOO_BIG, &filter);
+            setsockopt(s->fd, IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(filter));
+        } else {
+            setsockopt(s->fd, IPPROTO_IPV6, IPV6_RECVERR, &on, sizeof(on));
+        }
+    }
+
+    // Sweeps keep thousands of probes and replies queued at once
+    int rcvbuf = 4 << 20;
+    int sndbuf = 1 << 20;
+    setsockopt(s->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    setsockopt(s->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    // Without the map send timestamps are simply not matched
+    s->tx_seq = calloc(PING_INFLIGHT, sizeof(uint16_t));
+
+    s->ident = s->raw ? (uint16_t)(getpid() ^ ping_clock_ns(CLOCK_MONOTONIC)) : 0;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = key;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s->fd, &ev) < 0) {
+        close(s->fd);
+        free(s->tx_seq);
+        s->tx_seq = NULL;
+        s->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int ping_engine_open(PingEngine *e) {
+    memset(e, 0, sizeof(*e));
+    e->sockets[0].fd = -1;
+    e->sockets[1].fd = -1;
+    e->timer_fd = -1;
+    e->next_id = 1;
+    e->wheel_tick = ping_clock_ns(CLOCK_MONOTONIC) / PING_WHEEL_TICK_NS;
+    for (int i = 0; i < PING_WHEEL_SLOTS; i++) {
+        e->wheel[i] = -1;
+    }
+
+    e->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (e->epoll_fd < 0) {
+        return -1;
+    }
+
+    e->probes = calloc(PING_INFLIGHT, sizeof(PingProbe));
+    e->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (e->probes == NULL || e->timer_fd < 0) {
+        int err = e->probes == NULL ? ENOMEM : errno;
+        ping_engine_close(e);
+        errno = err;
+        return -1;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = PING_TIMER_KEY;
+    if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, e->timer_fd, &ev) < 0) {
+        ping_engine_close(e);
+        return -1;
+    }
+
+    // Either family is enough; report the IPv4 error if both fail
+    int v4 = ping_socket_open(&e->sockets[0], AF_INET, e->epoll_fd, 0);
+    int err = errno;
+    int v6 = ping_socket_open(&e->sockets[1], AF_INET6, e->epoll_fd, 1);
+    if (v4 < 0 && v6 < 0) {
+        ping_engine_close(e);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static void ping_session_free(PingSession *s) {
+    free(s->targets);
+    free(s->answered);
+    memset(s, 0, sizeof(*s));
+}
+
+void ping_engine_close(PingEngine *e) {
+    for (int i = 0; i < 2; i++) {
+        if (e->sockets[i].fd >= 0) {
+            close(e->sockets[i].fd);
+        }
+        free(e->sockets[i].tx_seq);
+    }
+    if (e->timer_fd >= 0) {
+        close(e->timer_fd);
+    }
+    if (e->epoll_fd >= 0) {
+        close(e->epoll_fd);
+    }
+    for (int i = 0; i < e->capacity; i++) {
+        ping_session_free(&e->sessions[i]);
+    }
+    free(e->sessions);
+    free(e->probes);
+    memset(e, 0, sizeof(*e));
+    e->epoll_fd = -1;
+    e->timer_fd = -1;
+    e->sockets[0].fd = -1;
+    e->sockets[1].fd = -1;
+}
+
+int ping_engine_fd(const PingEngine *e) {
+    return e->epoll_fd;
+}
+
+static socklen_t ping_address_len(const PingAddress *addr) {
+    return addr->sa.sa_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+static void ping_target_storage(const PingSession *s, int target, struct sockaddr_storage *out) {
+    memset(out, 0, sizeof(*out));
+    memcpy(out, &s->targets[target], ping_address_len(&s->targets[target]));
+}
+
+// Timing wheel: probe lists per 10 ms bucket, unlinked in O(1) when the
+// reply comes in.  Deadlines past the horizon wait in the farthest bucket
+// and are looked at again on every turn.
+static void ping_wheel_insert(PingEngine *e, int index) {
+    PingProbe *p = &e->probes[index];
+    int64_t tick = (p->deadline_ns + PING_WHEEL_TICK_NS - 1) / PING_WHEEL_TICK_NS;
+
+    if (tick <= e->wheel_tick) {
+        tick = e->wheel_tick + 1;
+    } else if (tick - e->wheel_tick >= PING_WHEEL_SLOTS) {
+        tick = e->wheel_tick + PING_WHEEL_SLOTS - 1;
+    }
+
+    int bucket = tick % PING_WHEEL_SLOTS;
+    p->wheel_slot = bucket;
+    p->wheel_prev = -1;
+    p->wheel_next = e->wheel[bucket];
+    if (p->wheel_next >= 0) {
+        e->probes[p->wheel_next].wheel_prev = index;
+    }
+    e->wheel[bucket] = index;
+}
+
+static void ping_wheel_remove(PingEngine *e, int index) {
+    PingProbe *p = &e->probes[index];
+
+    if (p->wheel_prev >= 0) {
+        e->probes[p->wheel_prev].wheel_next = p->wheel_next;
+    } else {
+        e->wheel[p->wheel_slot] = p->wheel_next;
+    }
+    if (p->wheel_next >= 0) {
+        e->probes[p->wheel_next].wheel_prev = p->wheel_prev;
+    }
+    p->wheel_next = -1;
+    p->wheel_prev = -1;
+}
+
+static void ping_probe_release(PingEngine *e, int index) {
+    ping_wheel_remove(e, index);
+    e->probes[index].session = 0;
+    e->inflight--;
+}
+
+static PingSession *ping_session_find(PingEngine *e, int id) {
+    for (int i = 0; i < e->capacity; i++) {
+        if (e->sessions[i].id == id) {
+            return &e->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+int ping_active(const PingEngine *e, int session) {
+    return session != 0 && ping_session_find((PingEngine *)e, session) != NULL;
+}
+
+void ping_cancel(PingEngine *e, int session) {
+    PingSession *s = ping_session_find(e, session);
+
+    if (s == NULL) {
+        return;
+    }
+    for (int i = 0; i < PING_INFLIGHT && s->outstanding > 0; i++) {
+        if (e->probes[i].session == session) {
+            ping_probe_release(e, i);
+            s->outstanding--;
+        }
+    }
+    ping_session_free(s);
+}
+
+// Rounds left, and with stop_on_reply someone left to ask
+static int ping_session_sending(const PingSession *s) {
+    return s->id != 0 && (s->opts.count == 0 || s->round < s->opts.count) &&
+           (s->answered == NULL || s->unanswered > 0);
+}
+
+// Arm the timer for the earliest send or timeout still ahead
+static void ping_arm_timer(PingEngine *e) {
+    int64_t next = INT64_MAX;
+    struct itimerspec its;
+
+    for (int i = 0; i < e->capacity; i++) {
+        const PingSession *s = &e->sessions[i];
+        if (ping_session_sending(s) && s->next_send_ns < next) {
+            next = s->next_send_ns;
+        }
+    }
+    for (int64_t tick = e->wheel_tick + 1; tick < e->wheel_tick + PING_WHEEL_SLOTS; tick++) {
+        if (e->wheel[tick % PING_WHEEL_SLOTS] >= 0) {
+            if (tick * PING_WHEEL_TICK_NS < next) {
+                next = tick * PING_WHEEL_TICK_NS;
+            }
+            break;
+        }
+    }
+
+    memset(&its, 0, sizeof(its));
+    if (next != INT64_MAX) {
+        // A zero value would disarm the timer
+        if (next <= 0) {
+            next = 1;
+        }
+        its.it_value.tv_sec = next / 1000000000LL;
+        its.it_value.tv_nsec = next % 1000000000LL;
+    }
+    timerfd_settime(e->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+int ping_sweep_start(PingEngine *e, const PingAddress *targets, int ntargets, const PingOptions *opts,
+                     PingResultFunc func, void *user_data) {
+    int slot = -1;
+
+    if (ntargets <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (int i = 0; i < ntargets; i++) {
+        int family = targets[i].sa.sa_family;
+        if ((family != AF_INET && family != AF_INET6) || e->sockets[family == AF_INET6].fd < 0) {
+            errno = EAFNOSUPPORT;
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < e->capacity; i++) {
+        if (e->sessions[i].id == 0) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        int capacity = e->capacity ? e->capacity * 2 : 8;
+        PingSession *sessions = realloc(e->sessions, capacity * sizeof(PingSession));
+        if (sessions == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        memset(&sessions[e->capacity], 0, (capacity - e->capacity) * sizeof(PingSession));
+        slot = e->capacity;
+        e->sessions = sessions;
+        e->capacity = capacity;
+    }
+
+    PingSession *s = &e->sessions[slot];
+    memset(s, 0, sizeof(*s));
+    s->targets = malloc(ntargets * sizeof(PingAddress));
+    s->answered = opts->stop_on_reply ? calloc(ntargets, 1) : NULL;
+    if (s->targets == NULL || (opts->stop_on_reply && s->answered == NULL)) {
+        ping_session_free(s);
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(s->targets, targets, ntargets * sizeof(PingAddress));
+    s->ntargets = ntargets;
+    s->unanswered = ntargets;
+    s->opts = *opts;
+    s->func = func;
+    s->user_data = user_data;
+
+    s->id = e->next_id++;
+    if (e->next_id <= 0) {
+        e->next_id = 1;
+    }
+
+    // The first probe goes out from the next dispatch, never from here,
+    // so no callback runs before the caller has the session id
+    s->round_start_ns = ping_clock_ns(CLOCK_MONOTONIC);
+    s->next_send_ns = s->round_start_ns;
+    s->tokens_ns = s->round_start_ns;
+    s->tokens = 1.0;
+    ping_arm_timer(e);
+    return s->id;
+}
+
+int ping_start(PingEngine *e, const struct sockaddr *addr, socklen_t addrlen, int count,
+               int64_t interval_ns, int64_t timeout_ns, PingResultFunc func, void *user_data) {
+    PingAddress target;
+    PingOptions opts;
+
+    if (addrlen > sizeof(target)) {
+        errno = EAFNOSUPPORT;
+        return -1;
+    }
+    memset(&target, 0, sizeof(target));
+    memcpy(&target, addr, addrlen);
+
+    memset(&opts, 0, sizeof(opts));
+    opts.count = count;
+    opts.interval_ns = interval_ns;
+    opts.timeout_ns = timeout_ns;
+    return ping_sweep_start(e, &target, 1, &opts, func, user_data);
+}
+
+// Summarize and free a session that has nothing left to send or wait for
+static void ping_finish(PingEngine *e, int slot, int id) {
+    PingSession *s;
+    PingResult r;
+
+    if (slot >= e->capacity) {
+        return;
+    }
+    s = &e->sessions[slot];
+    if (s->id != id || ping_session_sending(s) || s->outstanding > 0) {
+        return;
+    }
+
+    memset(&r, 0, sizeof(r));
+    r.session = id;
+    r.status = PING_DONE;
+    r.target = -1;
+    r.ttl = -1;
+    if (s->ntargets == 1) {
+        ping_target_storage(s, 0, &r.from);
+    }
+    r.sent = s->sent;
+    r.received = s->received;
+    r.min_ns = s->min_ns;
+    r.max_ns = s->max_ns;
+    r.sum_ns = s->sum_ns;
+
+    PingResultFunc func = s->func;
+    void *user_data = s->user_data;
+    ping_session_free(s);
+    func(&r, user_data);
+}
+
+// Hand a probe's outcome to its session.  The probe is freed and the
+// session updated first, because the callback may start or cancel
+// sessions.
+static void ping_complete(PingEngine *e, PingProbe *p, PingResult *r) {
+    int index = p - e->probes;
+    int slot = p->slot;
+    int id = p->session;
+    PingSession *s = &e->sessions[slot];
+
+    r->target = p->target;
+    r->seq = p->seq;
+    ping_probe_release(e, index);
+    if (s->id != id) {
+        return;
+    }
+
+    s->outstanding--;
+    if (r->status == PING_REPLY) {
+        s->received++;
+        s->sum_ns += r->rtt_ns;
+        if (s->received == 1 || r->rtt_ns < s->min_ns) s->min_ns = r->rtt_ns;
+        if (r->rtt_ns > s->max_ns) s->max_ns = r->rtt_ns;
+        if (s->answered != NULL && !s->answered[r->target]) {
+            s->answered[r->target] = 1;
+            s->unanswered--;
+        }
+    }
+
+    r->session = id;
+    s->func(r, s->user_data);
+    ping_finish(e, slot, id);
+}
+
+static PingProbe *ping_probe_for(PingEngine *e, int family, uint16_t seq) {
+    PingProbe *p = &e->probes[seq];
+    return p->session != 0 && p->family == family ? p : NULL;
+}
+
+// Returns -1 with errno set if sendto failed; no probe is left behind
+static int ping_send(PingEngine *e, int slot, int target) {
+    PingSession *s = &e->sessions[slot];
+    const PingAddress *addr = &s->targets[target];
+    int family = addr->sa.sa_family;
+    PingSocket *sock = &e->sockets[family == AF_INET6];
+    unsigned char packet[8 + PING_PAYLOAD];
+    uint16_t seq;
+
+    // Next free sequence number; the caller made sure there is one
+    do {
+        seq = e->next_seq++;
+    } while (e->probes[seq].session != 0);
+
+    int64_t sent_ns = ping_clock_ns(CLOCK_REALTIME);
+
+    memset(packet, 0, sizeof(packet));
+    packet[0] = family == AF_INET6 ? ICMP6_ECHO_REQUEST : ICMP_ECHO;
+    packet[4] = sock->ident >> 8;
+    packet[5] = sock->ident & 0xff;
+    packet[6] = seq >> 8;
+    packet[7] = seq & 0xff;
+    memcpy(packet + 8, &sent_ns, sizeof(sent_ns));
+    for (int i = 8 + sizeof(sent_ns); i < (int)sizeof(packet); i++) {
+        packet[i] = i;
+    }
+    // Ping sockets and ICMPv6 get their checksum from the kernel
+    if (sock->raw && family == AF_INET) {
+        uint16_t sum = ping_checksum(packet, sizeof(packet));
+        memcpy(packet + 2, &sum, sizeof(sum));
+    }
+
+    if (sendto(sock->fd, packet, sizeof(packet), 0, &addr->sa, ping_address_len(addr)) < 0) {
+        return -1;
+    }
+
+    if (sock->tx_seq != NULL) {
+        sock->tx_seq[sock->tx_key % PING_INFLIGHT] = seq;
+    }
+    sock->tx_key++;
+
+    PingProbe *p = &e->probes[seq];
+    p->session = s->id;
+    p->slot = slot;
+    p->target = target;
+    p->seq = s->round + 1;
+    p->family = family;
+    p->sent_ns = sent_ns;
+    p->deadline_ns = ping_clock_ns(CLOCK_MONOTONIC) + s->opts.timeout_ns;
+    p->tx_stamped = 0;
+    ping_wheel_insert(e, seq);
+    e->inflight++;
+    s->outstanding++;
+    s->sent++;
+    return 0;
+}
+
+static void ping_send_failed(PingEngine *e, int slot, int target, int error) {
+    PingSession *s = &e->sessions[slot];
+    int id = s->id;
+    PingResult r;
+
+    memset(&r, 0, sizeof(r));
+    r.session = id;
+    r.status = PING_SEND_ERROR;
+    r.target = target;
+    r.seq = s->round + 1;
+    r.error = error;
+    r.ttl = -1;
+    ping_target_storage(s, target, &r.from);
+    s->sent++;
+
+    s->func(&r, s->user_data);
+}
+
+// Send whatever the session's schedule and rate allow at this point
+static void ping_session_run(PingEngine *e, int slot, int64_t now) {
+    int id = e->sessions[slot].id;
+
+    for (;;) {
+        // Callbacks may have cancelled the session or moved the array
+        PingSession *s = &e->sessions[slot];
+        if (s->id != id) {
+            return;
+        }
+        if (!ping_session_sending(s)) {
+            ping_finish(e, slot, id);
+            return;
+        }
+
+        if (s->cursor >= s->ntargets) {
+            // The next round starts interval_ns after this one did
+            s->round++;
+            s->cursor = 0;
+            s->round_start_ns += s->opts.interval_ns;
+            if (s->round_start_ns < now) {
+                s->round_start_ns = now;
+            }
+            s->next_send_ns = s->round_start_ns;
+            continue;
+        }
+
+        if (s->next_send_ns > now) {
+            return;
+        }
+        if (s->answered != NULL && s->answered[s->cursor]) {
+            s->cursor++;
+            continue;
+        }
+
+        if (s->opts.rate > 0) {
+            // Token bucket, bursts of up to 10 ms worth of probes
+            double burst = s->opts.rate / 100.0 > 1.0 ? s->opts.rate / 100.0 : 1.0;
+            s->tokens += (now - s->tokens_ns) * (double)s->opts.rate / 1e9;
+            s->tokens_ns = now;
+            if (s->tokens > burst) {
+                s->tokens = burst;
+            }
+            if (s->tokens < 1.0) {
+                s->next_send_ns = now + (int64_t)((1.0 - s->tokens) * 1e9 / s->opts.rate) + 1;
+                return;
+            }
+        }
+
+        if (e->inflight >= PING_INFLIGHT) {
+            s->next_send_ns = now + PING_WHEEL_TICK_NS;
+            return;
+        }
+
+        int target = s->cursor;
+        if (ping_send(e, slot, target) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Socket buffer full: try again shortly
+                s->next_send_ns = now + PING_WHEEL_TICK_NS;
+                return;
+            }
+            s->cursor++;
+            if (s->opts.rate > 0) {
+                s->tokens -= 1.0;
+            }
+            ping_send_failed(e, slot, target, errno);
+            continue;
+        }
+        s->cursor++;
+        if (s->opts.rate > 0) {
+            s->tokens -= 1.0;
+        }
+    }
+}
+
+static void ping_expire(PingEngine *e, int64_t now) {
+    int64_t now_tick = now / PING_WHEEL_TICK_NS;
+    int64_t steps = now_tick - e->wheel_tick;
+
+    if (steps > PING_WHEEL_SLOTS) {
+        steps = PING_WHEEL_SLOTS;
+    }
+
+    for (int64_t step = 1; step <= steps; step++) {
+        int bucket = (e->wheel_tick + step) % PING_WHEEL_SLOTS;
+
+        // Restart from the head after every callback, which may have
+        // changed the list
+        for (;;) {
+            int index = e->wheel[bucket];
+            while (index >= 0 && e->probes[index].deadline_ns > now) {
+                index = e->probes[index].wheel_next;
+            }
+            if (index < 0) {
+                break;
+            }
+
+            PingProbe *p = &e->probes[index];
+            PingResult r;
+            memset(&r, 0, sizeof(r));
+            r.status = PING_TIMEOUT;
+            r.ttl = -1;
+            ping_target_storage(&e->sessions[p->slot], p->target, &r.from);
+            ping_complete(e, p, &r);
+        }
+    }
+    e->wheel_tick = now_tick;
+}
+
+static void ping_timers(PingEngine *e) {
+    int64_t now = ping_clock_ns(CLOCK_MONOTONIC);
+
+    ping_expire(e, now);
+    // Sessions may be added or cancelled from callbacks; capacity is
+    // read again on every pass
+    for (int i = 0; i < e->capacity; i++) {
+        if (e->sessions[i].id != 0) {
+            ping_session_run(e, i, now);
+        }
+    }
+}
+
+static int ping_same_host(const struct sockaddr_storage *a, const PingAddress *b) {
+    if (a->ss_family != b->sa.sa_family) {
+        return 0;
+    }
+    if (a->ss_family == AF_INET) {
+        return ((const struct sockaddr_in *)a)->sin_addr.s_addr == b->v4.sin_addr.s_addr;
+    }
+    return memcmp(&((const struct sockaddr_in6 *)a)->sin6_addr, &b->v6.sin6_addr, sizeof(struct in6_addr)) == 0;
+}
+
+// Echo header of one of our requests quoted inside an ICMP error
+static int ping_quoted_seq(const PingSocket *sock, int family, const unsigned char *inner, ssize_t len, uint16_t *seq) {
+    int header = family == AF_INET ? (inner[0] & 0x0f) * 4 : 40;
+
+    if (len < header + 8) {
+        return 0;
+    }
+    inner += header;
+    if (inner[0] != (family == AF_INET ? ICMP_ECHO : ICMP6_ECHO_REQUEST)) {
+        return 0;
+    }
+    if (sock->raw && ((inner[4] << 8) | inner[5]) != sock->ident) {
+        return 0;
+    }
+    *seq = (inner[6] << 8) | inner[7];
+    return 1;
+}
+
+static void ping_read(PingEngine *e, int index) {
+    PingSocket *sock = &e->sockets[index];
+    int family = index == 0 ? AF_INET : AF_INET6;
+    unsigned char buf[PING_PACKET_MAX];
+    char control[512];
+
+    for (;;) {
+        struct sockaddr_storage from;
+        struct iovec iov = {buf, sizeof(buf)};
+        struct msghdr msg;
+        int64_t rx_ns = 0;
+        int ttl = -1;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t len = recvmsg(sock->fd, &msg, 0);
+        if (len < 0) {
+            return;
+        }
+
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING) {
+                struct scm_timestamping ts;
+                memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                rx_ns = (int64_t)ts.ts[0].tv_sec * 1000000000LL + ts.ts[0].tv_nsec;
+            } else if ((c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_TTL) ||
+                       (c->cmsg_level == IPPROTO_IPV6 && c->cmsg_type == IPV6_HOPLIMIT)) {
+                memcpy(&ttl, CMSG_DATA(c), sizeof(ttl));
+            }
+        }
+        if (rx_ns == 0) {
+            rx_ns = ping_clock_ns(CLOCK_REALTIME);
+        }
+
+        const unsigned char *icmp = buf;
+        if (sock->raw && family == AF_INET) {
+            // Raw IPv4 sockets see the IP header too
+            int header = (buf[0] & 0x0f) * 4;
+            if (len < header + 8) {
+                continue;
+            }
+            if (ttl < 0) {
+                ttl = buf[8];
+            }
+            icmp += header;
+            len -= header;
+        }
+        if (len < 8) {
+            continue;
+        }
+
+        int type = icmp[0];
+        int reply = family == AF_INET ? ICMP_ECHOREPLY : ICMP6_ECHO_REPLY;
+        PingResult r;
+        PingProbe *p;
+        uint16_t seq;
+
+        memset(&r, 0, sizeof(r));
+        r.from = from;
+        r.ttl = ttl;
+        r.bytes = len;
+
+        if (type == reply) {
+            if (sock->raw && ((icmp[4] << 8) | icmp[5]) != sock->ident) {
+                continue;
+            }
+            seq = (icmp[6] << 8) | icmp[7];
+            p = ping_probe_for(e, family, seq);
+            if (p == NULL || !ping_same_host(&from, &e->sessions[p->slot].targets[p->target])) {
+                continue;
+            }
+            r.status = PING_REPLY;
+            r.rtt_ns = rx_ns > p->sent_ns ? rx_ns - p->sent_ns : 0;
+            r.kernel_timestamps = p->tx_stamped;
+            ping_complete(e, p, &r);
+        } else if (sock->raw && ping_quoted_seq(sock, family, icmp + 8, len - 8, &seq)) {
+            p = ping_probe_for(e, family, seq);
+            if (p == NULL) {
+                continue;
+            }
+            r.status = PING_UNREACHABLE;
+            r.type = type;
+            r.code = icmp[1];
+            ping_complete(e, p, &r);
+        }
+    }
+}
+
+// Send timestamps and, on ping sockets, ICMP errors
+static void ping_read_errors(PingEngine *e, int index) {
+    PingSocket *sock = &e->sockets[index];
+    int family = index == 0 ? AF_INET : AF_INET6;
+    unsigned char buf[PING_PACKET_MAX];
+    char control[512];
+
+    for (;;) {
+        struct iovec iov = {buf, sizeof(buf)};
+        struct msghdr msg;
+        struct sock_extended_err *ee = NULL;
+        int64_t ts_ns = 0;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t len = recvmsg(sock->fd, &msg, MSG_ERRQUEUE);
+        if (len < 0) {
+            return;
+        }
+
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING) {
+                struct scm_timestamping ts;
+                memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                ts_ns = (int64_t)ts.ts[0].tv_sec * 1000000000LL + ts.ts[0].tv_nsec;
+            } else if ((c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_RECVERR) ||
+                       (c->cmsg_level == IPPROTO_IPV6 && c->cmsg_type == IPV6_RECVERR)) {
+                ee = (struct sock_extended_err *)CMSG_DATA(c);
+            }
+        }
+        if (ee == NULL) {
+            continue;
+        }
+
+        if (ee->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && sock->tx_seq != NULL) {
+            uint16_t seq = sock->tx_seq[ee->ee_data % PING_INFLIGHT];
+            PingProbe *p = ping_probe_for(e, family, seq);
+            if (p != NULL && ts_ns != 0) {
+                p->sent_ns = ts_ns;
+                p->tx_stamped = 1;
+            }
+        } else if ((ee->ee_origin == SO_EE_ORIGIN_ICMP || ee->ee_origin == SO_EE_ORIGIN_ICMP6) && len >= 8) {
+            // The payload is the request the error is about
+            uint16_t seq = (buf[6] << 8) | buf[7];
+            PingProbe *p = ping_probe_for(e, family, seq);
+            PingResult r;
+
+            if (p == NULL) {
+                continue;
+            }
+            memset(&r, 0, sizeof(r));
+            r.status = PING_UNREACHABLE;
+            r.type = ee->ee_type;
+            r.code = ee->ee_code;
+            r.ttl = -1;
+            r.error = ee->ee_errno;
+            struct sockaddr *offender = SO_EE_OFFENDER(ee);
+            if (offender->sa_family == AF_INET) {
+                memcpy(&r.from, offender, sizeof(struct sockaddr_in));
+            } else if (offender->sa_family == AF_INET6) {
+                memcpy(&r.from, offender, sizeof(struct sockaddr_in6));
+            } else {
+                ping_target_storage(&e->sessions[p->slot], p->target, &r.from);
+            }
+            ping_complete(e, p, &r);
+        }
+    }
+}
+
+int ping_engine_dispatch(PingEngine *e) {
+    struct epoll_event events[4];
+    int n = epoll_wait(e->epoll_fd, events, 4, 0);
+
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.u32 == PING_TIMER_KEY) {
+            uint64_t expirations;
+            if (read(e->timer_fd, &expirations, sizeof(expirations)) < 0) {
+                // Already drained
+            }
+            continue;
+        }
+        // Send timestamps first, so replies find them in place
+        ping_read_errors(e, events[i].data.u32);
+        ping_read(e, events[i].data.u32);
+    }
+
+    ping_timers(e);
+    ping_arm_timer(e);
+    return n;
+}
+
+const char *ping_address_string(const struct sockaddr_storage *addr, char *buf, size_t size) {
+    const void *src = addr->ss_family == AF_INET6 ? (const void *)&((const struct sockaddr_in6 *)addr)->sin6_addr
+                                                  : (const void *)&((const struct sockaddr_in *)addr)->sin_addr;
+    if (inet_ntop(addr->ss_family, src, buf, size) == NULL) {
+        snprintf(buf, size, "?");
+    }
+    return buf;
+}
+
+const char *ping_error_string(const PingResult *result) {
+    if (result->from.ss_family == AF_INET6) {
+        switch (result->type) {
+        case ICMP6_DST_UNREACH: return "Destination unreachable";
+        case ICMP6_PACKET_TOO_BIG: return "Packet too big";
+        case ICMP6_TIME_EXCEEDED: return "Time exceeded";
+        default: return "ICMPv6 error";
+        }
+    }
+    switch (result->type) {
+    case ICMP_DEST_UNREACH:
+        switch (result->code) {
+        case ICMP_NET_UNREACH: return "Destination Net Unreachable";
+        case ICMP_HOST_UNREACH: return "Destination Host Unreachable";
+        case ICMP_PROT_UNREACH: return "Destination Protocol Unreachable";
+        case ICMP_PORT_UNREACH: return "Destination Port Unreachable";
+        case ICMP_FRAG_NEEDED: return "Frag needed";
+        default: return "Destination Unreachable";
+        }
+    case ICMP_TIME_EXCEEDED: return "Time to live exceeded";
+    default: return "ICMP error";
+    }
+}
@@ -0,0 +1,155 @@
+/*
+ * Dave's Network Inquisition - ICMP echo engine
+ * Website: https://prowse.tech
+ */
+
+#ifndef PING_H
+#define PING_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Echo requests in flight across all sessions.  This is the whole 16-bit
+// sequence space: the sequence number of a reply is its probe's index.
+#define PING_INFLIGHT 65536
+#define PING_PAYLOAD 56
+
+// Timeouts sit on a timing wheel of 10 ms ticks (about 10 s around)
+#define PING_WHEEL_SLOTS 1024
+#define PING_WHEEL_TICK_NS 10000000LL
+
+typedef union {
+    struct sockaddr sa;
+    struct sockaddr_in v4;
+    struct sockaddr_in6 v6;
+} PingAddress;
+
+typedef enum {
+    PING_REPLY,         // echo reply, rtt_ns valid
+    PING_TIMEOUT,       // no reply within the session timeout
+    PING_UNREACHABLE,   // ICMP error about the probe (type/code set)
+    PING_SEND_ERROR,    // sendto failed (error set)
+    PING_DONE           // session finished, summary fields set
+} PingStatus;
+
+typedef struct {
+    int session;
+    PingStatus status;
+    int target;             // index into the session's targets
+    int seq;                // round, 1-based
+    int64_t rtt_ns;
+    int ttl;                // -1 if unknown
+    int bytes;
+    int kernel_timestamps;  // rtt taken from SO_TIMESTAMPING on both ends
+    int type;
+    int code;
+    int error;
+    struct sockaddr_storage from;
+
+    // PING_DONE
+    int sent;
+    int received;
+    int64_t min_ns;
+    int64_t max_ns;
+    int64_t sum_ns;
+} PingResult;
+
+typedef void (*PingResultFunc)(const PingResult *result, void *user_data);
+
+// A session probes its targets in rounds: every target once per round,
+// rounds at least interval_ns apart, never faster than rate probes per
+// second.  One target and a handful of rounds is an ordinary ping; many
+// targets and a retry round is a sweep.
+typedef struct {
+    int count;              // rounds, 0 = until cancelled
+    int64_t interval_ns;
+    int64_t timeout_ns;
+    int rate;               // probes per second, 0 = no limit
+    int stop_on_reply;      // later rounds skip targets that have answered
+} PingOptions;
+
+typedef struct {
+    int fd;
+    int raw;
+    uint16_t ident;         // raw sockets only; ping sockets get one from the kernel
+    uint32_t tx_key;        // SOF_TIMESTAMPING_OPT_ID counter
+    uint16_t *tx_seq;       // tx_key -> sequence number
+} PingSocket;
+
+typedef struct {
+    int id;
+    PingAddress *targets;
+    int ntargets;
+    unsigned char *answered;    // stop_on_reply only
+    int unanswered;
+    PingOptions opts;
+    PingResultFunc func;
+    void *user_data;
+
+    // Schedule
+    int round;
+    int cursor;
+    int64_t round_start_ns;
+    int64_t next_send_ns;
+    double tokens;
+    int64_t tokens_ns;
+
+    int sent;
+    int received;
+    int outstanding;
+    int64_t min_ns;
+    int64_t max_ns;
+    int64_t sum_ns;
+} PingSession;
+
+typedef struct {
+    int session;            // session id, 0 = free
+    int slot;               // index into sessions
+    int target;
+    int seq;
+    int family;
+    int tx_stamped;
+    int64_t sent_ns;        // CLOCK_REALTIME, like the kernel timestamps
+    int64_t deadline_ns;    // CLOCK_MONOTONIC
+
+    // Timing wheel bucket list
+    int wheel_slot;
+    int wheel_next;
+    int wheel_prev;
+} PingProbe;
+
+// Everything runs on the caller's thread: watch ping_engine_fd() for
+// input in any main loop and call ping_engine_dispatch() when it fires.
+// Sockets and timers sit behind one epoll descriptor.
+typedef struct {
+    int epoll_fd;
+    int timer_fd;
+    PingSocket sockets[2];      // IPv4, IPv6; fd -1 if unavailable
+    PingProbe *probes;
+    int inflight;
+    uint16_t next_seq;
+    int wheel[PING_WHEEL_SLOTS];
+    int64_t wheel_tick;
+    PingSession *sessions;      // id 0 = free; a session keeps its index
+    int capacity;
+    int next_id;
+} PingEngine;
+
+int ping_engine_open(PingEngine *e);
+void ping_engine_close(PingEngine *e);
+int ping_engine_fd(const PingEngine *e);
+int ping_engine_dispatch(PingEngine *e);
+
+int ping_start(PingEngine *e, const struct sockaddr *addr, socklen_t addrlen, int count,
+               int64_t interval_ns, int64_t timeout_ns, PingResultFunc func, void *user_data);
+int ping_sweep_start(PingEngine *e, const PingAddress *targets, int ntargets, const PingOptions *opts,
+                     PingResultFunc func, void *user_data);
+void ping_cancel(PingEngine *e, int session);
+int ping_active(const PingEngine *e, int session);
+
+const char *ping_address_string(const struct sockaddr_storage *addr, char *buf, size_t size);
+const char *ping_error_string(const PingResult *result);
+
+#endif
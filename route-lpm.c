@@ -0,0 +1,526 @@
+/*
+ * Dave's Network Inquisition - longest-prefix-match route lookups
+ * Website: https://prowse.tech
+ *
+ * Compressed multibit tries over the local, main and default routing
+ * tables, rebuilt piecewise as routes change (see route-lpm.h).
+ */
+
+#include "route-lpm.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <linux/rtnetlink.h>
+
+#define LPM_TOP_SIZE (1 << LPM_TOP_BITS)
+
+static const uint32_t lpm_tables[LPM_TABLES] = { RT_TABLE_LOCAL, RT_TABLE_MAIN, RT_TABLE_DEFAULT };
+
+static int lpm_trie_init(LpmTrie *t, int family) {
+    memset(t, 0, sizeof(*t));
+    t->family = family;
+    t->bits = family == AF_INET ? 32 : 128;
+    t->source_free = -1;
+    t->top = calloc(LPM_TOP_SIZE, sizeof(uint32_t));
+    t->fallback = calloc(LPM_TOP_SIZE, sizeof(uint32_t));
+    t->dirty = calloc(LPM_TOP_SIZE, 1);
+    t->dirty_list = malloc(LPM_TOP_SIZE * sizeof(int));
+    t->source = malloc(64 * sizeof(LpmSourceNode));
+    if (t->top == NULL || t->fallback == NULL || t->dirty == NULL || t->dirty_list == NULL || t->source == NULL) {
+        return -1;
+    }
+    // The root, depth 0, always exists
+    t->source_capacity = 64;
+    t->nsource = 1;
+    t->source[0].child[0] = t->source[0].child[1] = -1;
+    t->source[0].routes = -1;
+    t->source[0].leaf = 0;
+    return 0;
+}
+
+static void lpm_trie_free(LpmTrie *t) {
+    free(t->source);
+    free(t->top);
+    free(t->fallback);
+    free(t->nodes);
+    free(t->leaves);
+    free(t->dirty);
+    free(t->dirty_list);
+    memset(t, 0, sizeof(*t));
+}
+
+static int lpm_source_alloc(LpmTrie *t) {
+    int n = t->source_free;
+
+    if (n >= 0) {
+        t->source_free = t->source[n].child[0];
+    } else {
+        if (t->nsource == t->source_capacity) {
+            int capacity = t->source_capacity * 2;
+            LpmSourceNode *source = realloc(t->source, capacity * sizeof(LpmSourceNode));
+            if (source == NULL) {
+                return -1;
+            }
+            t->source = source;
+            t->source_capacity = capacity;
+        }
+        n = t->nsource++;
+    }
+    t->source[n].child[0] = t->source[n].child[1] = -1;
+    t->source[n].routes = -1;
+    t->source[n].leaf = 0;
+    return n;
+}
+
+static int lpm_bit(const unsigned char *addr, int i) {
+    return (addr[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+static uint32_t lpm_leaf(const LpmSourceNode *n, uint32_t inherited) {
+    return n->leaf != 0 ? n->leaf : inherited;
+}
+
+// Sets the fallback of the top entries from first on under source node n,
+// at depth d, to the longest prefix shorter than LPM_TOP_BITS there; leaf
+// is the one in force above n
+static void lpm_fill_fallback(LpmTrie *t, int n, int d, int first, uint32_t leaf) {
+    int half = 1 << (LPM_TOP_BITS - d - 1);
+
+    leaf = lpm_leaf(&t->source[n], leaf);
+    for (int b = 0; b < 2; b++) {
+        int child = t->source[n].child[b];
+        int start = first + b * half;
+        if (child >= 0 && d + 1 < LPM_TOP_BITS) {
+            lpm_fill_fallback(t, child, d + 1, start, leaf);
+            continue;
+        }
+        for (int c = start; c < start + half; c++) {
+            t->fallback[c] = leaf;
+        }
+    }
+}
+
+// A prefix from LPM_TOP_BITS on is under one top entry, marked to be
+// rebuilt on commit.  A shorter one covers a run of top entries, up to all
+// of them for a default route; only their fallbacks are rewritten, from
+// the deepest source node still on its path, and the compiled nodes stay.
+static void lpm_mark_dirty(LpmTrie *t, const unsigned char *dst, int len) {
+    int c = (dst[0] << 8) | dst[1];
+
+    if (len >= LPM_TOP_BITS) {
+        if (!t->dirty[c]) {
+            t->dirty[c] = 1;
+            t->dirty_list[t->ndirty++] = c;
+        }
+        return;
+    }
+
+    int n = 0;
+    int d = 0;
+    uint32_t leaf = 0;
+    while (d < len && t->source[n].child[lpm_bit(dst, d)] >= 0) {
+        leaf = lpm_leaf(&t->source[n], leaf);
+        n = t->source[n].child[lpm_bit(dst, d)];
+        d++;
+    }
+    int span = 1 << (LPM_TOP_BITS - d);
+    lpm_fill_fallback(t, n, d, c & ~(span - 1), leaf);
+}
+
+// Lowest metric among the routes with this prefix
+static void lpm_source_best(RouteLpm *l, LpmSourceNode *n) {
+    int best = -1;
+
+    for (int row = n->routes; row >= 0; row = l->next[row]) {
+        if (best < 0 || l->nl->routes[row].priority < l->nl->routes[best].priority) {
+            best = row;
+        }
+    }
+    n->leaf = 0;
+    if (best >= 0) {
+        n->leaf = (best + 1) | (l->nl->routes[best].type == RTN_THROW ? LPM_THROW : 0);
+    }
+}
+
+static LpmTrie *lpm_trie_for(RouteLpm *l, const RouteEntry *r) {
+    if (r->tos != 0) {
+        return NULL;
+    }
+    for (int i = 0; i < LPM_TABLES; i++) {
+        if (r->table == lpm_tables[i]) {
+            return &l->tries[r->family == AF_INET ? 0 : 1][i];
+        }
+    }
+    return NULL;
+}
+
+static int lpm_insert(RouteLpm *l, LpmTrie *t, int row) {
+    const RouteEntry *r = &l->nl->routes[row];
+    int n = 0;
+
+    for (int d = 0; d < r->dst_len; d++) {
+        int b = lpm_bit(r->dst, d);
+        if (t->source[n].child[b] < 0) {
+            int child = lpm_source_alloc(t);
+            if (child < 0) {
+                return -1;
+            }
+            t->source[n].child[b] = child;
+        }
+        n = t->source[n].child[b];
+    }
+    l->next[row] = t->source[n].routes;
+    t->source[n].routes = row;
+    lpm_source_best(l, &t->source[n]);
+    l->member[row] = 1;
+    lpm_mark_dirty(t, r->dst, r->dst_len);
+    return 0;
+}
+
+static void lpm_remove(RouteLpm *l, LpmTrie *t, int row) {
+    const RouteEntry *r = &l->nl->routes[row];
+    int path[129];
+    int n = 0;
+
+    path[0] = 0;
+    for (int d = 0; d < r->dst_len; d++) {
+        n = t->source[n].child[lpm_bit(r->dst, d)];
+        if (n < 0) {
+            return;
+        }
+        path[d + 1] = n;
+    }
+
+    for (int *p = &t->source[n].routes; *p >= 0; p = &l->next[*p]) {
+        if (*p == row) {
+            *p = l->next[row];
+            break;
+        }
+    }
+    lpm_source_best(l, &t->source[n]);
+    l->member[row] = 0;
+
+    // Prune the prefixes nothing needs any more
+    for (int d = r->dst_len; d > 0; d--) {
+        LpmSourceNode *node = &t->source[path[d]];
+        if (node->routes >= 0 || node->child[0] >= 0 || node->child[1] >= 0) {
+            break;
+        }
+        t->source[path[d - 1]].child[lpm_bit(r->dst, d - 1)] = -1;
+        node->child[0] = t->source_free;
+        t->source_free = path[d];
+    }
+    lpm_mark_dirty(t, r->dst, r->dst_len);
+}
+
+static uint32_t lpm_alloc_nodes(LpmTrie *t, uint32_t n) {
+    if (t->nnodes + n > t->nodes_capacity) {
+        uint32_t capacity = t->nodes_capacity ? t->nodes_capacity : 1024;
+        while (capacity < t->nnodes + n) {
+            capacity *= 2;
+        }
+        LpmNode *nodes = realloc(t->nodes, capacity * sizeof(LpmNode));
+        if (nodes == NULL) {
+            return UINT32_MAX;
+        }
+        t->nodes = nodes;
+        t->nodes_capacity = capacity;
+    }
+    t->nnodes += n;
+    return t->nnodes - n;
+}
+
+static uint32_t lpm_alloc_leaves(LpmTrie *t, uint32_t n) {
+    if (t->nleaves + n > t->leaves_capacity) {
+        uint32_t capacity = t->leaves_capacity ? t->leaves_capacity : 1024;
+        while (capacity < t->nleaves + n) {
+            capacity *= 2;
+        }
+        uint32_t *leaves = realloc(t->leaves, capacity * sizeof(uint32_t));
+        if (leaves == NULL) {
+            return UINT32_MAX;
+        }
+        t->leaves = leaves;
+        t->leaves_capacity = capacity;
+    }
+    t->nleaves += n;
+    return t->nleaves - n;
+}
+
+static int lpm_has_children(const LpmSourceNode *n) {
+    return n->child[0] >= 0 || n->child[1] >= 0;
+}
+
+// Expands the next LPM_STRIDE levels below source node s into 64 slots:
+// the source node reached (or -1) and the route in force there
+static void lpm_expand(const LpmTrie *t, int s, int level, int index, uint32_t leaf, int *slot_source,
+                       uint32_t *slot_leaf) {
+    if (level == LPM_STRIDE) {
+        slot_source[index] = s;
+        slot_leaf[index] = leaf;
+        return;
+    }
+    for (int b = 0; b < 2; b++) {
+        int child = t->source[s].child[b];
+        int next = index * 2 + b;
+        if (child >= 0) {
+            lpm_expand(t, child, level + 1, next, lpm_leaf(&t->source[child], leaf), slot_source, slot_leaf);
+            continue;
+        }
+        int span = 1 << (LPM_STRIDE - level - 1);
+        for (int k = next * span; k < (next + 1) * span; k++) {
+            slot_source[k] = -1;
+            slot_leaf[k] = leaf;
+        }
+    }
+}
+
+// Fills node slot from source node s, whose route (or the one inherited
+// from above it) is leaf
+static int lpm_build(LpmTrie *t, uint32_t slot, int s, uint32_t leaf) {
+    int slot_source[64];
+    uint32_t slot_leaf[64];
+    uint64_t vector = 0;
+    uint64_t leafvec = 0;
+    uint32_t nchildren = 0;
+    uint32_t nleaves = 0;
+
+    lpm_expand(t, s, 0, 0, leaf, slot_source, slot_leaf);
+    for (int j = 0; j < 64; j++) {
+        if (slot_source[j] >= 0 && lpm_has_children(&t->source[slot_source[j]])) {
+            vector |= 1ULL << j;
+            nchildren++;
+        } else if (nleaves == 0 || slot_leaf[j] != leaf) {
+            leafvec |= 1ULL << j;
+            nleaves++;
+            leaf = slot_leaf[j];
+        }
+    }
+
+    uint32_t base1 = lpm_alloc_nodes(t, nchildren);
+    uint32_t base0 = lpm_alloc_leaves(t, nleaves);
+    if (base1 == UINT32_MAX || base0 == UINT32_MAX) {
+        return -1;
+    }
+    for (int j = 0, k = 0; j < 64; j++) {
+        if (leafvec & (1ULL << j)) {
+            t->leaves[base0 + k++] = slot_leaf[j];
+        }
+    }
+    t->nodes[slot].vector = vector;
+    t->nodes[slot].leafvec = leafvec;
+    t->nodes[slot].base0 = base0;
+    t->nodes[slot].base1 = base1;
+
+    // nodes may move while the children are built: indices only
+    for (int j = 0, k = 0; j < 64; j++) {
+        if ((vector & (1ULL << j)) && lpm_build(t, base1 + k++, slot_source[j], slot_leaf[j]) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static uint32_t lpm_count(const LpmTrie *t, uint32_t v) {
+    if (!(v & LPM_NODE)) {
+        return 0;
+    }
+    const LpmNode *n = &t->nodes[v & ~LPM_NODE];
+    uint32_t total = 1 + __builtin_popcountll(n->leafvec);
+    for (int i = 0; i < __builtin_popcountll(n->vector); i++) {
+        total += lpm_count(t, LPM_NODE | (n->base1 + i));
+    }
+    return total;
+}
+
+// Prefixes shorter than LPM_TOP_BITS are left to the fallback, so only
+// the /16 at c and what is below it count
+static int lpm_build_top(LpmTrie *t, int c) {
+    int n = 0;
+
+    for (int d = 0; d < LPM_TOP_BITS; d++) {
+        n = t->source[n].child[(c >> (LPM_TOP_BITS - 1 - d)) & 1];
+        if (n < 0) {
+            t->top[c] = 0;
+            return 0;
+        }
+    }
+    uint32_t leaf = lpm_leaf(&t->source[n], 0);
+    if (!lpm_has_children(&t->source[n])) {
+        t->top[c] = leaf;
+        return 0;
+    }
+
+    uint32_t slot = lpm_alloc_nodes(t, 1);
+    if (slot == UINT32_MAX || lpm_build(t, slot, n, leaf) < 0) {
+        t->top[c] = 0;
+        return -1;
+    }
+    t->top[c] = LPM_NODE | slot;
+    return 0;
+}
+
+static int lpm_trie_commit(LpmTrie *t, uint64_t *builds) {
+    int status = 0;
+
+    for (int i = 0; i < t->ndirty; i++) {
+        int c = t->dirty_list[i];
+        t->garbage += lpm_count(t, t->top[c]);
+        t->dirty[c] = 0;
+        if (lpm_build_top(t, c) < 0) {
+            status = -1;
+        }
+        (*builds)++;
+    }
+    t->ndirty = 0;
+
+    // Rebuild everything into fresh space once most of it is garbage
+    if (t->garbage > LPM_TOP_SIZE && t->garbage > t->nnodes + t->nleaves - t->garbage) {
+        t->nnodes = 0;
+        t->nleaves = 0;
+        t->garbage = 0;
+        for (int c = 0; c < LPM_TOP_SIZE; c++) {
+            if (lpm_build_top(t, c) < 0) {
+                status = -1;
+            }
+        }
+        *builds += LPM_TOP_SIZE;
+    }
+    return status;
+}
+
+static uint32_t lpm_trie_lookup(const LpmTrie *t, const unsigned char *addr) {
+    unsigned char a[24];
+    int depth = LPM_TOP_BITS;
+
+    // Zero padding past the address for the last stride
+    memset(a, 0, sizeof(a));
+    memcpy(a, addr, t->bits / 8);
+
+    int c = (a[0] << 8) | a[1];
+    uint32_t v = t->top[c];
+    while (v & LPM_NODE) {
+        const LpmNode *n = &t->nodes[v & ~LPM_NODE];
+        unsigned int window = (a[depth >> 3] << 8) | a[(depth >> 3) + 1];
+        int j = (window >> (16 - (depth & 7) - LPM_STRIDE)) & 63;
+        uint64_t bit = 1ULL << j;
+        uint64_t below = bit | (bit - 1);
+
+        if (!(n->vector & bit)) {
+            v = t->leaves[n->base0 + __builtin_popcountll(n->leafvec & below) - 1];
+            break;
+        }
+        v = LPM_NODE | (n->base1 + __builtin_popcountll(n->vector & below) - 1);
+        depth += LPM_STRIDE;
+    }
+    // Any prefix of LPM_TOP_BITS or more is longer than the fallback's
+    return v != 0 ? v : t->fallback[c];
+}
+
+static int lpm_reserve_rows(RouteLpm *l) {
+    if (l->rows_capacity >= l->nl->size) {
+        return 0;
+    }
+    int capacity = l->nl->capacity > l->nl->size ? l->nl->capacity : l->nl->size;
+    int *next = realloc(l->next, capacity * sizeof(int));
+    if (next == NULL) {
+        return -1;
+    }
+    l->next = next;
+    unsigned char *member = realloc(l->member, capacity);
+    if (member == NULL) {
+        return -1;
+    }
+    memset(member + l->rows_capacity, 0, capacity - l->rows_capacity);
+    l->member = member;
+    l->rows_capacity = capacity;
+    return 0;
+}
+
+int route_lpm_init(RouteLpm *l, const NlRoute *nl) {
+    memset(l, 0, sizeof(*l));
+    l->nl = nl;
+
+    for (int i = 0; i < LPM_TABLES; i++) {
+        if (lpm_trie_init(&l->tries[0][i], AF_INET) < 0 || lpm_trie_init(&l->tries[1][i], AF_INET6) < 0) {
+            route_lpm_free(l);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    if (lpm_reserve_rows(l) < 0) {
+        route_lpm_free(l);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (int row = 0; row < nl->size; row++) {
+        LpmTrie *t = nl_route_live(nl, row) ? lpm_trie_for(l, &nl->routes[row]) : NULL;
+        if (t != NULL && lpm_insert(l, t, row) < 0) {
+            route_lpm_free(l);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    if (route_lpm_commit(l) < 0) {
+        route_lpm_free(l);
+        return -1;
+    }
+    return 0;
+}
+
+void route_lpm_free(RouteLpm *l) {
+    for (int i = 0; i < LPM_TABLES; i++) {
+        lpm_trie_free(&l->tries[0][i]);
+        lpm_trie_free(&l->tries[1][i]);
+    }
+    free(l->next);
+    free(l->member);
+    memset(l, 0, sizeof(*l));
+}
+
+void route_lpm_change(RouteLpm *l, int row, int added) {
+    if (lpm_reserve_rows(l) < 0) {
+        return;
+    }
+    LpmTrie *t = lpm_trie_for(l, &l->nl->routes[row]);
+    if (t == NULL) {
+        return;
+    }
+    // A replaced route keeps its key and row, but may have become a throw
+    // route or stopped being one
+    if (l->member[row]) {
+        lpm_remove(l, t, row);
+    }
+    if (added) {
+        lpm_insert(l, t, row);
+    }
+}
+
+int route_lpm_commit(RouteLpm *l) {
+    int status = 0;
+
+    for (int i = 0; i < LPM_TABLES; i++) {
+        if (lpm_trie_commit(&l->tries[0][i], &l->chunk_builds) < 0 ||
+            lpm_trie_commit(&l->tries[1][i], &l->chunk_builds) < 0) {
+            status = -1;
+        }
+    }
+    if (status < 0) {
+        errno = ENOMEM;
+    }
+    return status;
+}
+
+int route_lpm_lookup(const RouteLpm *l, int family, const unsigned char *addr) {
+    const LpmTrie *tries = l->tries[family == AF_INET ? 0 : 1];
+
+    for (int i = 0; i < LPM_TABLES; i++) {
+        uint32_t v = lpm_trie_lookup(&tries[i], addr);
+        if (v != 0 && !(v & LPM_THROW)) {
+            return v - 1;
+        }
+    }
+    return -1;
+}
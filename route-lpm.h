@@ -0,0 +1,104 @@
+/*
+ * Dave's Network Inquisition - longest-prefix-match route lookups
+ * Website: https://prowse.tech
+ */
+
+#ifndef ROUTE_LPM_H
+#define ROUTE_LPM_H
+
+#include <stdint.h>
+
+#include "nl-route.h"
+
+// The first 16 bits index an array, then each level takes 6
+#define LPM_TOP_BITS 16
+#define LPM_STRIDE 6
+
+// Compiled trie node: 64 slots, each a child node or a route.  Children
+// are contiguous from base1 and found by counting the vector bits below
+// the slot; routes are stored once per run of equal slots from base0,
+// leafvec marking where a run starts (poptrie, Asai and Ohara 2015).
+typedef struct {
+    uint64_t vector;
+    uint64_t leafvec;
+    uint32_t base0;             // leaves
+    uint32_t base1;             // nodes
+} LpmNode;
+
+// Binary trie of the prefixes a table holds: what the compiled form is
+// built from, and what changes are applied to
+typedef struct {
+    int child[2];               // -1 = none; child[0] doubles as the free list link
+    int routes;                 // NlRoute rows with this prefix, via RouteLpm.next
+    uint32_t leaf;              // the one lookups get, as stored in leaves
+} LpmSourceNode;
+
+// One routing table of one family.  top[] and leaves[] hold a route (row
+// + 1, 0 = no route, with LPM_THROW set for a throw route so lookups need
+// not read the row); top[] can also hold LPM_NODE | node index.  Only
+// prefixes of LPM_TOP_BITS or more are compiled in, so a change to one
+// marks the single top entry it is under; those are rebuilt on commit,
+// and their old nodes and leaves left as garbage until it outweighs the
+// live part.  Shorter prefixes would cover up to every top entry: they
+// go in fallback[], the route of an address nothing longer matches,
+// which a change rewrites in place.
+typedef struct {
+    int family;
+    int bits;                   // 32 or 128
+
+    LpmSourceNode *source;
+    int nsource;
+    int source_capacity;
+    int source_free;
+
+    uint32_t *top;
+    uint32_t *fallback;         // per top entry, longest prefix shorter than LPM_TOP_BITS
+    LpmNode *nodes;
+    uint32_t nnodes;
+    uint32_t nodes_capacity;
+    uint32_t *leaves;
+    uint32_t nleaves;
+    uint32_t leaves_capacity;
+    uint32_t garbage;           // nodes plus leaves no longer reachable
+
+    unsigned char *dirty;       // per top entry
+    int *dirty_list;
+    int ndirty;
+} LpmTrie;
+
+#define LPM_NODE 0x80000000u
+#define LPM_THROW 0x40000000u
+
+// Tables searched, in the order of the kernel's default rules
+#define LPM_TABLES 3
+
+// IPv4 and IPv6 copies of the local, main and default tables kept in step
+// with an NlRoute, answering which route an address would take.  As with
+// the kernel, a table's longest matching prefix wins, the lowest metric
+// among equal prefixes, and a "throw" route moves on to the next table.
+// Routes with a TOS only apply to traffic marked with it and are left out.
+typedef struct {
+    const NlRoute *nl;          // not owned
+    LpmTrie tries[2][LPM_TABLES];
+
+    int *next;                  // per row: next route with the same prefix
+    unsigned char *member;      // per row: in a trie
+    int rows_capacity;
+
+    uint64_t chunk_builds;      // top entries rebuilt since init
+} RouteLpm;
+
+int route_lpm_init(RouteLpm *l, const NlRoute *nl);
+void route_lpm_free(RouteLpm *l);
+
+// Feed every NlRoute change through here, then commit once the dispatch
+// has returned.  Lookups between a change and its commit are not allowed.
+void route_lpm_change(RouteLpm *l, int row, int added);
+int route_lpm_commit(RouteLpm *l);
+
+// Row of the route taken to addr (network byte order, 4 or 16 bytes), -1
+// when there is none.  The route may be a blackhole, unreachable or
+// prohibit route, which the kernel reports as an error.
+int route_lpm_lookup(const RouteLpm *l, int family, const unsigned char *addr);
+
+#endif
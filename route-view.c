@@ -0,0 +1,481 @@
+/*
+ * Dave's Network Inquisition - sorted, filtered route list
+ * Website: https://prowse.tech
+ *
+ * Keeps the main routing table sorted and filtered for display, updated
+ * route by route (see route-view.h).
+ */
+
+#include "route-view.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <linux/rtnetlink.h>
+
+// flags bits
+#define ROUTE_VIEW_TOUCHED 1    // changed in the current batch, past the eager limit
+#define ROUTE_VIEW_NEXT 2       // in next or extra
+#define ROUTE_VIEW_SEEN 4       // changed during the scan; extra decides
+
+static int64_t route_view_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void route_filter_parse(RouteFilter *f, const char *text) {
+    memset(f, 0, sizeof(*f));
+    snprintf(f->text, sizeof(f->text), "%s", text);
+    for (int i = 0; f->text[i] != '\0'; i++) {
+        f->words[i] = tolower((unsigned char)f->text[i]);
+    }
+
+    char *save = NULL;
+    for (char *word = strtok_r(f->words, " \t", &save); word != NULL && f->ntokens < ROUTE_VIEW_MAX_TOKENS;
+         word = strtok_r(NULL, " \t", &save)) {
+        f->tokens[f->ntokens++] = word - f->words;
+    }
+}
+
+// True when whatever b matches, a matches too: each of a's words is part
+// of one of b's
+static int route_filter_covers(const RouteFilter *a, const RouteFilter *b) {
+    for (int i = 0; i < a->ntokens; i++) {
+        int found = 0;
+        for (int j = 0; j < b->ntokens && !found; j++) {
+            found = strstr(b->words + b->tokens[j], a->words + a->tokens[i]) != NULL;
+        }
+        if (!found) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static const char *route_view_line(const RouteView *v, int row, char *buf, size_t size) {
+    const RouteEntry *r = &v->nl->routes[row];
+    const RouteHop *hop = nl_route_hop(v->nl, r);
+    const char *name = NULL;
+
+    if (hop->oif != 0 && v->ifname != NULL) {
+        name = v->ifname(hop->oif, v->user_data);
+    }
+    return nl_route_format(v->nl, r, name, buf, size);
+}
+
+static int route_view_matches(const RouteView *v, const RouteFilter *f, int row) {
+    char line[512];
+
+    if (f->ntokens == 0) {
+        return 1;
+    }
+    route_view_line(v, row, line, sizeof(line));
+    for (char *p = line; *p != '\0'; p++) {
+        *p = tolower((unsigned char)*p);
+    }
+    for (int i = 0; i < f->ntokens; i++) {
+        if (strstr(line, f->words + f->tokens[i]) == NULL) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int route_view_listed(const RouteView *v, int row) {
+    return nl_route_live(v->nl, row) && v->nl->routes[row].table == RT_TABLE_MAIN;
+}
+
+// Family, then destination, then prefix length, tos and metric: the key
+// within one table, so no two routes compare equal
+static int route_view_compare_rows(const NlRoute *nl, int a, int b) {
+    const RouteEntry *x = &nl->routes[a];
+    const RouteEntry *y = &nl->routes[b];
+
+    if (x->family != y->family) {
+        return x->family - y->family;
+    }
+    int cmp = memcmp(x->dst, y->dst, sizeof(x->dst));
+    if (cmp != 0) {
+        return cmp;
+    }
+    if (x->dst_len != y->dst_len) {
+        return x->dst_len - y->dst_len;
+    }
+    if (x->tos != y->tos) {
+        return x->tos - y->tos;
+    }
+    return x->priority < y->priority ? -1 : x->priority > y->priority;
+}
+
+// qsort() has no context argument; the view sorting is always the one
+// being worked on, on the main thread
+static const NlRoute *route_view_sorting;
+
+static int route_view_compare(const void *a, const void *b) {
+    return route_view_compare_rows(route_view_sorting, *(const int *)a, *(const int *)b);
+}
+
+static void route_view_sort(const RouteView *v, int *rows, int n) {
+    route_view_sorting = v->nl;
+    qsort(rows, n, sizeof(int), route_view_compare);
+}
+
+static int route_list_reserve(RouteList *l, int n) {
+    if (n <= l->capacity) {
+        return 0;
+    }
+    int capacity = l->capacity ? l->capacity : 256;
+    while (capacity < n) {
+        capacity *= 2;
+    }
+    int *rows = realloc(l->rows, capacity * sizeof(int));
+    if (rows == NULL) {
+        return -1;
+    }
+    l->rows = rows;
+    l->capacity = capacity;
+    return 0;
+}
+
+static void route_list_free(RouteList *l) {
+    free(l->rows);
+    memset(l, 0, sizeof(*l));
+}
+
+// Position of row (by its key) in l; *found says whether it is there
+static int route_list_find(const RouteView *v, const RouteList *l, int row, int *found) {
+    int lo = 0;
+    int hi = l->len;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = route_view_compare_rows(v->nl, l->rows[mid], row);
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *found = lo < l->len && l->rows[lo] == row;
+    return lo;
+}
+
+// Puts row in or takes it out of l.  Returns the position, with *removed
+// and *added saying what happened there.
+static int route_list_update(const RouteView *v, RouteList *l, int row, int belongs, int *removed, int *added) {
+    int found;
+    int pos = route_list_find(v, l, row, &found);
+
+    *removed = found;
+    *added = 0;
+    if (found && !belongs) {
+        memmove(&l->rows[pos], &l->rows[pos + 1], (l->len - pos - 1) * sizeof(int));
+        l->len--;
+    } else if (!found && belongs && route_list_reserve(l, l->len + 1) == 0) {
+        memmove(&l->rows[pos + 1], &l->rows[pos], (l->len - pos) * sizeof(int));
+        l->rows[pos] = row;
+        l->len++;
+        *added = 1;
+    } else if (found) {
+        // Still there, contents changed
+        *added = 1;
+    }
+    return pos;
+}
+
+// Drops the rows flagged with bit, then merges in the sorted rows of add
+static int route_list_merge(const RouteView *v, RouteList *l, int bit, const int *add, int nadd) {
+    int len = 0;
+
+    for (int i = 0; i < l->len; i++) {
+        if (!(v->flags[l->rows[i]] & bit)) {
+            l->rows[len++] = l->rows[i];
+        }
+    }
+    l->len = len;
+    if (nadd == 0) {
+        return 0;
+    }
+    if (route_list_reserve(l, l->len + nadd) < 0) {
+        return -1;
+    }
+
+    // From the back, so the merge can happen in place
+    int i = l->len - 1;
+    int j = nadd - 1;
+    for (int k = l->len + nadd - 1; j >= 0; k--) {
+        if (i >= 0 && route_view_compare_rows(v->nl, l->rows[i], add[j]) > 0) {
+            l->rows[k] = l->rows[i--];
+        } else {
+            l->rows[k] = add[j--];
+        }
+    }
+    l->len += nadd;
+    return 0;
+}
+
+static int route_view_reserve_flags(RouteView *v) {
+    if (v->flags_size >= v->nl->size) {
+        return 0;
+    }
+    int size = v->nl->capacity > v->nl->size ? v->nl->capacity : v->nl->size;
+    unsigned char *flags = realloc(v->flags, size);
+    if (flags == NULL) {
+        return -1;
+    }
+    memset(flags + v->flags_size, 0, size - v->flags_size);
+    v->flags = flags;
+    v->flags_size = size;
+    return 0;
+}
+
+int route_view_init(RouteView *v, const NlRoute *nl, RouteViewIfnameFunc ifname, RouteViewChangedFunc changed,
+                    void *user_data) {
+    memset(v, 0, sizeof(*v));
+    v->nl = nl;
+    v->ifname = ifname;
+    v->changed = changed;
+    v->user_data = user_data;
+
+    if (route_view_reserve_flags(v) < 0 || route_list_reserve(&v->all, nl->count) < 0) {
+        route_view_free(v);
+        return -1;
+    }
+    for (int row = 0; row < nl->size; row++) {
+        if (route_view_listed(v, row)) {
+            v->all.rows[v->all.len++] = row;
+        }
+    }
+    route_view_sort(v, v->all.rows, v->all.len);
+
+    // No filter yet: everything is shown
+    if (route_list_reserve(&v->shown, v->all.len) < 0) {
+        route_view_free(v);
+        return -1;
+    }
+    memcpy(v->shown.rows, v->all.rows, v->all.len * sizeof(int));
+    v->shown.len = v->all.len;
+    return 0;
+}
+
+void route_view_free(RouteView *v) {
+    route_list_free(&v->all);
+    route_list_free(&v->shown);
+    route_list_free(&v->next);
+    route_list_free(&v->extra);
+    free(v->flags);
+    free(v->touched);
+    free(v->source);
+    memset(v, 0, sizeof(*v));
+}
+
+static void route_view_stop_scan(RouteView *v) {
+    if (!v->scanning) {
+        return;
+    }
+    for (int i = 0; i < v->flags_size; i++) {
+        v->flags[i] &= ~(ROUTE_VIEW_NEXT | ROUTE_VIEW_SEEN);
+    }
+    free(v->source);
+    v->source = NULL;
+    v->source_len = 0;
+    v->scan_pos = 0;
+    v->next.len = 0;
+    v->extra.len = 0;
+    v->scanning = 0;
+}
+
+void route_view_set_filter(RouteView *v, const char *text) {
+    RouteFilter f;
+
+    route_filter_parse(&f, text);
+    if (v->scanning && route_filter_covers(&v->target, &f) && route_filter_covers(&f, &v->target)) {
+        return;
+    }
+    route_view_stop_scan(v);
+    // Back to what is shown, say after a typo was undone
+    if (route_filter_covers(&v->filter, &f) && route_filter_covers(&f, &v->filter)) {
+        v->filter = f;
+        return;
+    }
+
+    // A narrower filter only needs to look at what is shown now
+    const RouteList *from = route_filter_covers(&v->filter, &f) ? &v->shown : &v->all;
+    v->source = malloc((from->len + 1) * sizeof(int));
+    if (v->source == NULL) {
+        return;
+    }
+    memcpy(v->source, from->rows, from->len * sizeof(int));
+    v->source_len = from->len;
+    v->target = f;
+    v->scanning = 1;
+}
+
+// The scan is done: next holds the matches in sorted order except for rows
+// changed meanwhile, which extra has instead
+static void route_view_finish_scan(RouteView *v) {
+    int removed = v->shown.len;
+    int len = 0;
+
+    for (int i = 0; i < v->next.len; i++) {
+        int row = v->next.rows[i];
+        if ((v->flags[row] & (ROUTE_VIEW_NEXT | ROUTE_VIEW_SEEN)) == ROUTE_VIEW_NEXT) {
+            v->next.rows[len++] = row;
+        }
+    }
+    v->next.len = len;
+
+    len = 0;
+    for (int i = 0; i < v->extra.len; i++) {
+        int row = v->extra.rows[i];
+        // Once each, and only if it still matched at its last change
+        if ((v->flags[row] & (ROUTE_VIEW_NEXT | ROUTE_VIEW_SEEN)) == (ROUTE_VIEW_NEXT | ROUTE_VIEW_SEEN)) {
+            v->flags[row] &= ~ROUTE_VIEW_NEXT;
+            v->extra.rows[len++] = row;
+        }
+    }
+    v->extra.len = len;
+    route_view_sort(v, v->extra.rows, v->extra.len);
+
+    RouteList shown = v->shown;
+    v->shown = v->next;
+    v->next = shown;
+    v->next.len = 0;
+    route_list_merge(v, &v->shown, 0, v->extra.rows, v->extra.len);
+    v->filter = v->target;
+    route_view_stop_scan(v);
+
+    if (v->changed != NULL) {
+        v->changed(0, removed, v->shown.len, v->user_data);
+    }
+}
+
+int route_view_step(RouteView *v, int64_t budget_ns) {
+    if (!v->scanning) {
+        return 0;
+    }
+    if (route_list_reserve(&v->next, v->source_len) < 0) {
+        return 1;
+    }
+
+    int64_t deadline = route_view_clock_ns() + budget_ns;
+    while (v->scan_pos < v->source_len) {
+        int row = v->source[v->scan_pos++];
+        if (!(v->flags[row] & (ROUTE_VIEW_NEXT | ROUTE_VIEW_SEEN)) && route_view_listed(v, row) &&
+            route_view_matches(v, &v->target, row)) {
+            v->flags[row] |= ROUTE_VIEW_NEXT;
+            v->next.rows[v->next.len++] = row;
+        }
+        // Formatting is about a microsecond a route: look at the clock now
+        // and then, not every time
+        if ((v->scan_pos & 255) == 0 && route_view_clock_ns() >= deadline) {
+            return 1;
+        }
+    }
+    route_view_finish_scan(v);
+    return 0;
+}
+
+// Keeps a scan in progress right about a row that changed under it
+static void route_view_scan_change(RouteView *v, int row) {
+    v->flags[row] |= ROUTE_VIEW_SEEN;
+    if (route_view_listed(v, row) && route_view_matches(v, &v->target, row)) {
+        if (!(v->flags[row] & ROUTE_VIEW_NEXT) && route_list_reserve(&v->extra, v->extra.len + 1) == 0) {
+            v->flags[row] |= ROUTE_VIEW_NEXT;
+            v->extra.rows[v->extra.len++] = row;
+        }
+    } else {
+        v->flags[row] &= ~ROUTE_VIEW_NEXT;
+    }
+}
+
+void route_view_change(RouteView *v, int row, int added) {
+    (void)added;
+
+    if (route_view_reserve_flags(v) < 0) {
+        return;
+    }
+    if (v->scanning) {
+        route_view_scan_change(v, row);
+    }
+
+    if (v->batch && v->batch_changes >= ROUTE_VIEW_EAGER_LIMIT) {
+        if (!(v->flags[row] & ROUTE_VIEW_TOUCHED)) {
+            if (v->ntouched == v->touched_capacity) {
+                int capacity = v->touched_capacity ? v->touched_capacity * 2 : 1024;
+                int *touched = realloc(v->touched, capacity * sizeof(int));
+                if (touched == NULL) {
+                    return;
+                }
+                v->touched = touched;
+                v->touched_capacity = capacity;
+            }
+            v->flags[row] |= ROUTE_VIEW_TOUCHED;
+            v->touched[v->ntouched++] = row;
+        }
+        return;
+    }
+    v->batch_changes++;
+
+    // A route's row holds its key until it is freed, so a deleted route is
+    // found the same way as a live one
+    int listed = route_view_listed(v, row);
+    int removed;
+    int inserted;
+    route_list_update(v, &v->all, row, listed, &removed, &inserted);
+    int pos = route_list_update(v, &v->shown, row, listed && route_view_matches(v, &v->filter, row), &removed,
+                                &inserted);
+    if ((removed || inserted) && v->changed != NULL) {
+        v->changed(pos, removed, inserted, v->user_data);
+    }
+}
+
+void route_view_begin_batch(RouteView *v) {
+    v->batch = 1;
+    v->batch_changes = 0;
+}
+
+void route_view_end_batch(RouteView *v) {
+    v->batch = 0;
+    if (v->ntouched == 0) {
+        return;
+    }
+
+    // Rows freed during the batch are no longer listed, whatever they held
+    int *add = malloc(v->ntouched * sizeof(int));
+    int nadd = 0;
+    int removed = v->shown.len;
+    if (add != NULL) {
+        for (int i = 0; i < v->ntouched; i++) {
+            if (route_view_listed(v, v->touched[i])) {
+                add[nadd++] = v->touched[i];
+            }
+        }
+        route_view_sort(v, add, nadd);
+        route_list_merge(v, &v->all, ROUTE_VIEW_TOUCHED, add, nadd);
+
+        int n = 0;
+        for (int i = 0; i < nadd; i++) {
+            if (route_view_matches(v, &v->filter, add[i])) {
+                add[n++] = add[i];
+            }
+        }
+        route_list_merge(v, &v->shown, ROUTE_VIEW_TOUCHED, add, n);
+        free(add);
+    }
+    for (int i = 0; i < v->ntouched; i++) {
+        v->flags[v->touched[i]] &= ~ROUTE_VIEW_TOUCHED;
+    }
+    v->ntouched = 0;
+
+    if (v->changed != NULL) {
+        v->changed(0, removed, v->shown.len, v->user_data);
+    }
+}
+
+const char *route_view_format(const RouteView *v, int position, char *buf, size_t size) {
+    return route_view_line(v, v->shown.rows[position], buf, size);
+}
@@ -0,0 +1,111 @@
+/*
+ * Dave's Network Inquisition - sorted, filtered route list
+ * Website: https://prowse.tech
+ */
+
+#ifndef ROUTE_VIEW_H
+#define ROUTE_VIEW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nl-route.h"
+
+#define ROUTE_VIEW_FILTER_MAX 256
+#define ROUTE_VIEW_MAX_TOKENS 16
+// Changes in one batch applied one at a time; past this the rest of the
+// batch is merged in at its end and the list reported as replaced
+#define ROUTE_VIEW_EAGER_LIMIT 64
+
+// Space-separated words, lower-cased; a line matches when it contains
+// every one of them.  Words are kept as offsets so a filter can be copied.
+typedef struct {
+    char text[ROUTE_VIEW_FILTER_MAX];
+    char words[ROUTE_VIEW_FILTER_MAX];
+    int tokens[ROUTE_VIEW_MAX_TOKENS];
+    int ntokens;
+} RouteFilter;
+
+// Rows of an NlRoute, sorted by key
+typedef struct {
+    int *rows;
+    int len;
+    int capacity;
+} RouteList;
+
+// Rows [position, position + removed) were replaced by `added` new ones
+typedef void (*RouteViewChangedFunc)(int position, int removed, int added, void *user_data);
+// Interface name for an ifindex, NULL when unknown
+typedef const char *(*RouteViewIfnameFunc)(int ifindex, void *user_data);
+
+// The main table as "ip route" lists it, narrowed by a filter, for a list
+// widget that only asks for the rows on screen.  Every route change moves
+// at most a few entries of two sorted row arrays (all routes, and the ones
+// the filter lets through) instead of rebuilding them.  A new filter is
+// applied by a scan done in slices (route_view_step) so typing stays
+// responsive at a million routes; a filter that narrows the current one
+// only rescans what is shown.  Until the scan ends the list keeps showing
+// the old filter's routes, still kept current.
+typedef struct {
+    const NlRoute *nl;          // not owned
+    RouteViewIfnameFunc ifname;
+    RouteViewChangedFunc changed;
+    void *user_data;
+
+    RouteList all;
+    RouteList shown;            // what the widget lists
+    RouteFilter filter;         // what shown was filtered with
+
+    // Per NlRoute row, ROUTE_VIEW_* bits
+    unsigned char *flags;
+    int flags_size;
+
+    // Batch: changed rows merged in at the end once past the eager limit
+    int batch;
+    int batch_changes;
+    int *touched;
+    int ntouched;
+    int touched_capacity;
+
+    // Filter scan in progress
+    int scanning;
+    RouteFilter target;
+    int *source;                // sorted rows to test
+    int source_len;
+    int scan_pos;
+    RouteList next;             // matches so far, in source order
+    RouteList extra;            // rows that changed during the scan
+} RouteView;
+
+int route_view_init(RouteView *v, const NlRoute *nl, RouteViewIfnameFunc ifname, RouteViewChangedFunc changed,
+                    void *user_data);
+void route_view_free(RouteView *v);
+
+// Starts a scan unless text filters the same as the current filter
+void route_view_set_filter(RouteView *v, const char *text);
+// Scans for about budget_ns.  Returns 1 while there is more to do.
+int route_view_step(RouteView *v, int64_t budget_ns);
+
+// Feed every NlRoute change through here, bracketing each dispatch with
+// begin/end so bursts become one update
+void route_view_change(RouteView *v, int row, int added);
+void route_view_begin_batch(RouteView *v);
+void route_view_end_batch(RouteView *v);
+
+static inline int route_view_len(const RouteView *v) {
+    return v->shown.len;
+}
+
+// Total routes in the main table
+static inline int route_view_total(const RouteView *v) {
+    return v->all.len;
+}
+
+// Scan progress in percent
+static inline int route_view_progress(const RouteView *v) {
+    return v->source_len > 0 ? (int)((int64_t)v->scan_pos * 100 / v->source_len) : 100;
+}
+
+const char *route_view_format(const RouteView *v, int position, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * Dave's Network Inquisition - memory-mapped history files
+ * Website: https://prowse.tech
+ */
+
+#include "rrd-file.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static int rrd_file_mkdirs(char *path) {
+    for (char *p = path + 1; *p != '\0'; p++) {
+        if (*p != '/') {
+            continue;
+        }
+        *p = '\0';
+        int rc = mkdir(path, 0700);
+        *p = '/';
+        if (rc < 0 && errno != EEXIST) {
+            return -1;
+        }
+    }
+    if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
+
+// $XDG_DATA_HOME/network-inquisition/history, created if missing
+int rrd_file_default_dir(char *buf, size_t size) {
+    const char *data_home = getenv("XDG_DATA_HOME");
+    const char *home = getenv("HOME");
+    int n;
+
+    if (data_home != NULL && data_home[0] == '/') {
+        n = snprintf(buf, size, "%s/network-inquisition/history", data_home);
+    } else if (home != NULL && home[0] == '/') {
+        n = snprintf(buf, size, "%s/.local/share/network-inquisition/history", home);
+    } else {
+        errno = ENOENT;
+        return -1;
+    }
+
+    if (n < 0 || (size_t)n >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return rrd_file_mkdirs(buf);
+}
+
+Rrd *rrd_file_open(const char *dir, const char *name) {
+    char path[4096];
+    size_t size = rrd_block_size();
+    int read_only = 0;
+
+    if (snprintf(path, sizeof(path), "%s/%s.rrd", dir, name) >= (int)sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+        if (errno != EWOULDBLOCK) {
+            close(fd);
+            return NULL;
+        }
+        read_only = 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    int fresh = 0;
+    if ((size_t)st.st_size != size) {
+        if (read_only) {
+            close(fd);
+            errno = EINVAL;
+            return NULL;
+        }
+        // New file, or one from another layout: start over.  The file
+        // stays sparse until tiers are actually written.
+        if (ftruncate(fd, 0) < 0 || ftruncate(fd, size) < 0) {
+            close(fd);
+            return NULL;
+        }
+        fresh = 1;
+    }
+
+    void *block = mmap(NULL, size, read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (block == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    Rrd *rrd = calloc(1, sizeof(Rrd));
+    if (rrd == NULL) {
+        munmap(block, size);
+        close(fd);
+        return NULL;
+    }
+    rrd->fd = fd;
+    rrd->read_only = read_only;
+
+    if (fresh) {
+        rrd_format(block);
+    }
+
+    if (rrd_attach(rrd, block, size) < 0) {
+        if (read_only) {
+            rrd_free(rrd);
+            errno = EINVAL;
+            return NULL;
+        }
+        // Same size but a different version: reformat in place
+        memset(block, 0, size);
+        rrd_format(block);
+        rrd_attach(rrd, block, size);
+    }
+
+    if (!read_only) {
+        rrd_recover(rrd);
+    }
+
+    return rrd;
+}
+
+int rrd_file_remove(const char *dir, const char *name) {
+    char path[4096];
+
+    if (snprintf(path, sizeof(path), "%s/%s.rrd", dir, name) >= (int)sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return unlink(path);
+}
+
+typedef struct {
+    time_t mtime;
+    char name[256];
+} RrdFileEntry;
+
+static int rrd_file_entry_compare(const void *a, const void *b) {
+    const RrdFileEntry *x = a;
+    const RrdFileEntry *y = b;
+
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+int rrd_file_prune(const char *dir, int max_files) {
+    RrdFileEntry *entries = NULL;
+    int count = 0;
+    int capacity = 0;
+    int removed = 0;
+    struct dirent *de;
+
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        return -1;
+    }
+
+    while ((de = readdir(d)) != NULL) {
+        size_t len = strlen(de->d_name);
+        struct stat st;
+
+        if (len <= 4 || strcmp(de->d_name + len - 4, ".rrd") != 0 || len >= sizeof(entries->name)) {
+            continue;
+        }
+        if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (count == capacity) {
+            int grown = capacity ? capacity * 2 : 64;
+            RrdFileEntry *p = realloc(entries, grown * sizeof(RrdFileEntry));
+            if (p == NULL) {
+                break;
+            }
+            entries = p;
+            capacity = grown;
+        }
+        entries[count].mtime = st.st_mtime;
+        memcpy(entries[count].name, de->d_name, len + 1);
+        count++;
+    }
+
+    if (count > max_files) {
+        qsort(entries, count, sizeof(RrdFileEntry), rrd_file_entry_compare);
+    }
+    for (int i = 0; i < count && count - removed > max_files; i++) {
+        // A file some process has mapped holds its lock: leave it
+        int fd = openat(dirfd(d), entries[i].name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd < 0) {
+            continue;
+        }
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0 && unlinkat(dirfd(d), entries[i].name, 0) == 0) {
+            removed++;
+        }
+        close(fd);
+    }
+
+    free(entries);
+    closedir(d);
+    return removed;
+}
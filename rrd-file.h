@@ -0,0 +1,29 @@
+/*
+ * Dave's Network Inquisition - memory-mapped history files
+ * Website: https://prowse.tech
+ */
+
+#ifndef RRD_FILE_H
+#define RRD_FILE_H
+
+#include <stddef.h>
+
+#include "rrd.h"
+
+// File format (version RRD_VERSION): the RrdHeader from rrd.h followed by
+// the tier arrays at the offsets it lists, in host byte order.  Nothing is
+// ever parsed or copied; the file is mapped and used as the Rrd block.
+//
+// The first process to open a file holds an exclusive flock() and writes
+// through the mapping.  Any other process gets a read-only mapping and
+// reads it under the header sequence number.
+
+int rrd_file_default_dir(char *buf, size_t size);
+Rrd *rrd_file_open(const char *dir, const char *name);
+// Deletes <dir>/<name>.rrd, for a caller holding it open for writing
+int rrd_file_remove(const char *dir, const char *name);
+// Deletes the least recently written files in dir that no process has
+// open until at most max_files remain.  Returns how many went, or -1.
+int rrd_file_prune(const char *dir, int max_files);
+
+#endif
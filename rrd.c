@@ -0,0 +1,304 @@
+/*
+ * Dave's Network Inquisition - round-robin history tiers
+ * Website: https://prowse.tech
+ */
+
+#include "rrd.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static const struct {
+    int64_t step_ns;
+    int slots;
+} rrd_specs[RRD_TIER_COUNT] = {
+    {1000000000LL, 3600},        // 1 s for 1 hour
+    {10000000000LL, 8640},       // 10 s for 24 hours
+    {300000000000LL, 8640},      // 5 min for 30 days
+};
+
+static size_t rrd_tier_size(int slots) {
+    // Timestamps lead so every tier stays 8-byte aligned
+    return slots * (sizeof(int64_t) + 6 * sizeof(float));
+}
+
+size_t rrd_block_size(void) {
+    size_t size = sizeof(RrdHeader);
+
+    for (int i = 0; i < RRD_TIER_COUNT; i++) {
+        size += rrd_tier_size(rrd_specs[i].slots);
+    }
+    return size;
+}
+
+// Write an empty header into a zeroed block
+void rrd_format(void *block) {
+    RrdHeader *header = block;
+    uint64_t offset = sizeof(RrdHeader);
+
+    memcpy(header->magic, RRD_MAGIC, sizeof(header->magic));
+    header->version = RRD_VERSION;
+    header->tier_count = RRD_TIER_COUNT;
+    header->seq = 0;
+
+    for (int i = 0; i < RRD_TIER_COUNT; i++) {
+        header->pending[i] = -1;
+        header->tiers[i].step_ns = rrd_specs[i].step_ns;
+        header->tiers[i].slots = rrd_specs[i].slots;
+        header->tiers[i].offset = offset;
+        offset += rrd_tier_size(rrd_specs[i].slots);
+    }
+}
+
+// Point the tier views into a formatted block; fails if the block was
+// written with a different version or tier layout
+int rrd_attach(Rrd *rrd, void *block, size_t size) {
+    RrdHeader *header = block;
+
+    if (size != rrd_block_size() ||
+        memcmp(header->magic, RRD_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != RRD_VERSION ||
+        header->tier_count != RRD_TIER_COUNT) {
+        return -1;
+    }
+
+    for (int i = 0; i < RRD_TIER_COUNT; i++) {
+        const RrdTierDesc *desc = &header->tiers[i];
+
+        if (desc->step_ns != rrd_specs[i].step_ns || desc->slots != (uint32_t)rrd_specs[i].slots ||
+            desc->offset + rrd_tier_size(desc->slots) > size) {
+            return -1;
+        }
+    }
+
+    rrd->header = header;
+    rrd->block = block;
+    rrd->size = size;
+
+    for (int i = 0; i < RRD_TIER_COUNT; i++) {
+        RrdTier *tier = &rrd->tiers[i];
+        int slots = header->tiers[i].slots;
+        unsigned char *p = (unsigned char *)block + header->tiers[i].offset;
+
+        tier->step_ns = header->tiers[i].step_ns;
+        tier->slots = slots;
+        tier->t = (int64_t *)p;
+        tier->rx_min = (float *)(p + slots * sizeof(int64_t));
+        tier->rx_max = tier->rx_min + slots;
+        tier->rx_avg = tier->rx_max + slots;
+        tier->tx_min = tier->rx_avg + slots;
+        tier->tx_max = tier->tx_min + slots;
+        tier->tx_avg = tier->tx_max + slots;
+        tier->open = &header->open[i];
+    }
+
+    return 0;
+}
+
+// An odd sequence number means the last update never finished: drop the
+// slots it may have torn and the partial buckets, then mark it consistent
+void rrd_recover(Rrd *rrd) {
+    RrdHeader *header = rrd->header;
+
+    if ((header->seq & 1) == 0) {
+        return;
+    }
+
+    for (int i = 0; i < RRD_TIER_COUNT; i++) {
+        if (header->pending[i] >= 0 && header->pending[i] < rrd->tiers[i].slots) {
+            rrd->tiers[i].t[header->pending[i]] = 0;
+        }
+        header->pending[i] = -1;
+        memset(&header->open[i], 0, sizeof(RrdOpen));
+    }
+
+    atomic_thread_fence(memory_order_release);
+    header->seq++;
+}
+
+Rrd *rrd_new(void) {
+    Rrd *rrd = calloc(1, sizeof(Rrd));
+    if (rrd == NULL) {
+        return NULL;
+    }
+
+    size_t size = rrd_block_size();
+    void *block = calloc(1, size);
+    if (block == NULL) {
+        free(rrd);
+        return NULL;
+    }
+
+    rrd_format(block);
+    rrd_attach(rrd, block, size);
+    rrd->fd = -1;
+    return rrd;
+}
+
+void rrd_free(Rrd *rrd) {
+    if (rrd == NULL) {
+        return;
+    }
+    if (rrd->fd >= 0) {
+        // Mapped history file (rrd-file.c); closing drops its lock
+        munmap(rrd->block, rrd->size);
+        close(rrd->fd);
+    } else {
+        free(rrd->block);
+    }
+    free(rrd);
+}
+
+static void rrd_accum_add(RrdAccum *acc, float min, float max, double sum, uint32_t count) {
+    if (acc->count == 0) {
+        acc->min = min;
+        acc->max = max;
+    } else {
+        if (min < acc->min) acc->min = min;
+        if (max > acc->max) acc->max = max;
+    }
+    acc->sum += sum;
+    acc->count += count;
+}
+
+// Fold a bucket (a raw sample, or a bucket closed one tier up) into tier
+// `level`, closing and cascading the open bucket when time moves past it
+static void rrd_tier_add(Rrd *rrd, int level, int64_t t_ns,
+                         const RrdAccum *rx, const RrdAccum *tx) {
+    RrdTier *tier = &rrd->tiers[level];
+    RrdOpen *open = tier->open;
+    int64_t start = t_ns - t_ns % tier->step_ns;
+
+    if (open->start != start) {
+        if (open->start != 0 && open->rx.count > 0) {
+            int slot = (open->start / tier->step_ns) % tier->slots;
+
+            // Publish the slot before touching it (see rrd_recover)
+            rrd->header->pending[level] = slot;
+            atomic_signal_fence(memory_order_seq_cst);
+            tier->t[slot] = open->start;
+            tier->rx_min[slot] = open->rx.min;
+            tier->rx_max[slot] = open->rx.max;
+            tier->rx_avg[slot] = open->rx.sum / open->rx.count;
+            tier->tx_min[slot] = open->tx.min;
+            tier->tx_max[slot] = open->tx.max;
+            tier->tx_avg[slot] = open->tx.sum / open->tx.count;
+
+            if (level + 1 < RRD_TIER_COUNT) {
+                rrd_tier_add(rrd, level + 1, open->start, &open->rx, &open->tx);
+            }
+        }
+
+        memset(open, 0, sizeof(*open));
+        open->start = start;
+    }
+
+    rrd_accum_add(&open->rx, rx->min, rx->max, rx->sum, rx->count);
+    rrd_accum_add(&open->tx, tx->min, tx->max, tx->sum, tx->count);
+}
+
+void rrd_update(Rrd *rrd, int64_t t_ns, float rx, float tx) {
+    RrdHeader *header = rrd->header;
+    RrdAccum rx_sample = {rx, rx, rx, 1, 0};
+    RrdAccum tx_sample = {tx, tx, tx, 1, 0};
+
+    if (rrd->read_only) {
+        return;
+    }
+
+    // seq odd for the duration of the update (see rrd_recover)
+    header->seq++;
+    atomic_thread_fence(memory_order_release);
+
+    rrd_tier_add(rrd, 0, t_ns, &rx_sample, &tx_sample);
+
+    atomic_thread_fence(memory_order_release);
+    for (int i = 0; i < RRD_TIER_COUNT; i++) {
+        header->pending[i] = -1;
+    }
+    header->seq++;
+}
+
+static void rrd_open_point(const RrdOpen *open, RrdPoint *point) {
+    point->t_ns = open->start;
+    point->rx_min = open->rx.min;
+    point->rx_max = open->rx.max;
+    point->rx_avg = open->rx.sum / open->rx.count;
+    point->tx_min = open->tx.min;
+    point->tx_max = open->tx.max;
+    point->tx_avg = open->tx.sum / open->tx.count;
+}
+
+static int rrd_query_once(const Rrd *rrd, int64_t start_ns, int64_t end_ns, RrdPoint *out, int max_points, int64_t *step_ns) {
+    const RrdTier *tier = &rrd->tiers[RRD_TIER_COUNT - 1];
+    int n = 0;
+
+    // Finest tier that still reaches back to start_ns and fits in out
+    for (int i = 0; i < RRD_TIER_COUNT; i++) {
+        const RrdTier *candidate = &rrd->tiers[i];
+        int64_t span = (int64_t)candidate->slots * candidate->step_ns;
+
+        if (end_ns - start_ns <= span && (end_ns - start_ns) / candidate->step_ns < max_points) {
+            tier = candidate;
+            break;
+        }
+    }
+
+    if (step_ns != NULL) {
+        *step_ns = tier->step_ns;
+    }
+
+    for (int64_t t = start_ns - start_ns % tier->step_ns; t < end_ns && n < max_points; t += tier->step_ns) {
+        if (t == tier->open->start) {
+            // The bucket still being filled is shown as it stands
+            if (tier->open->rx.count > 0) {
+                rrd_open_point(tier->open, &out[n++]);
+            }
+            continue;
+        }
+
+        int slot = (t / tier->step_ns) % tier->slots;
+        if (tier->t[slot] != t) {
+            continue;
+        }
+
+        out[n].t_ns = t;
+        out[n].rx_min = tier->rx_min[slot];
+        out[n].rx_max = tier->rx_max[slot];
+        out[n].rx_avg = tier->rx_avg[slot];
+        out[n].tx_min = tier->tx_min[slot];
+        out[n].tx_max = tier->tx_max[slot];
+        out[n].tx_avg = tier->tx_avg[slot];
+        n++;
+    }
+
+    return n;
+}
+
+int rrd_query(const Rrd *rrd, int64_t start_ns, int64_t end_ns, RrdPoint *out, int max_points, int64_t *step_ns) {
+    const volatile uint64_t *seq = &rrd->header->seq;
+
+    if (!rrd->read_only) {
+        return rrd_query_once(rrd, start_ns, end_ns, out, max_points, step_ns);
+    }
+
+    // Another process owns the file: retry until no update overlapped the read
+    for (int attempt = 0; attempt < 100; attempt++) {
+        uint64_t before = *seq;
+        atomic_thread_fence(memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+
+        int n = rrd_query_once(rrd, start_ns, end_ns, out, max_points, step_ns);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (*seq == before) {
+            return n;
+        }
+    }
+    return 0;
+}
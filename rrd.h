@@ -0,0 +1,107 @@
+/*
+ * Dave's Network Inquisition - round-robin history tiers
+ * Website: https://prowse.tech
+ */
+
+#ifndef RRD_H
+#define RRD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RRD_TIER_COUNT 3
+#define RRD_MAX_SLOTS 8640
+
+#define RRD_MAGIC "NIQRRD\0\0"
+#define RRD_VERSION 1
+
+// Running min/max/sum of one series inside the bucket being filled
+typedef struct {
+    float min;
+    float max;
+    double sum;
+    uint32_t count;
+    uint32_t reserved;
+} RrdAccum;
+
+// Bucket of one tier that is still being filled
+typedef struct {
+    int64_t start;
+    RrdAccum rx;
+    RrdAccum tx;
+} RrdOpen;
+
+typedef struct {
+    int64_t step_ns;
+    uint32_t slots;
+    uint32_t reserved;
+    uint64_t offset;
+} RrdTierDesc;
+
+// Fixed layout at the start of the block.  The block is either plain
+// memory or a mapped history file (rrd-file.c); both look the same, so the
+// file needs no serialization.  seq is odd while an update is in flight and
+// pending[] names the slots that update may be rewriting.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t tier_count;
+    uint64_t seq;
+    int32_t pending[RRD_TIER_COUNT];
+    uint32_t reserved;
+    RrdTierDesc tiers[RRD_TIER_COUNT];
+    RrdOpen open[RRD_TIER_COUNT];
+} RrdHeader;
+
+// One resolution: a ring of consolidated buckets plus the open bucket.
+// Each slot remembers the start of its bucket, so slots left over from an
+// earlier lap (or a gap in sampling) are recognised and skipped.
+typedef struct {
+    int64_t step_ns;
+    int slots;
+    int64_t *t;
+    float *rx_min;
+    float *rx_max;
+    float *rx_avg;
+    float *tx_min;
+    float *tx_max;
+    float *tx_avg;
+    RrdOpen *open;
+} RrdTier;
+
+// 1 s for 1 h, 10 s for 24 h, 5 min for 30 days; every tier is fed from
+// the buckets the tier above it closes, so an update is O(1)
+typedef struct {
+    RrdHeader *header;
+    RrdTier tiers[RRD_TIER_COUNT];
+    void *block;
+    size_t size;
+
+    // Set by rrd-file.c for mapped blocks
+    int fd;
+    int read_only;
+} Rrd;
+
+// One consolidated point handed to the graph
+typedef struct {
+    int64_t t_ns;
+    float rx_min;
+    float rx_max;
+    float rx_avg;
+    float tx_min;
+    float tx_max;
+    float tx_avg;
+} RrdPoint;
+
+Rrd *rrd_new(void);
+void rrd_free(Rrd *rrd);
+void rrd_update(Rrd *rrd, int64_t t_ns, float rx, float tx);
+int rrd_query(const Rrd *rrd, int64_t start_ns, int64_t end_ns, RrdPoint *out, int max_points, int64_t *step_ns);
+
+// Layout helpers shared with rrd-file.c
+size_t rrd_block_size(void);
+void rrd_format(void *block);
+int rrd_attach(Rrd *rrd, void *block, size_t size);
+void rrd_recover(Rrd *rrd);
+
+#endif
@@ -0,0 +1,195 @@
+/*
+ * Dave's Network Inquisition - RTT histograms
+ * Website: https://prowse.tech
+ *
+ * Log-linear histograms and the sliding-window monitor behind the PING
+ * panel's continuous mode (see rtt-hist.h for the layout).
+ */
+
+#include "rtt-hist.h"
+
+#include <string.h>
+
+static int rtt_hist_index(int64_t ns) {
+    uint64_t us = ns > 0 ? (uint64_t)ns / 1000 : 0;
+    int shift = 0;
+
+    if (us >= (1ULL << RTT_HIST_MAX_BITS)) {
+        return RTT_HIST_COUNTS - 1;
+    }
+    // Values below 2 * RTT_HIST_SUB_HALF are exact; above that each power
+    // of two is split into RTT_HIST_SUB_HALF steps
+    if (us >= 2 * RTT_HIST_SUB_HALF) {
+        shift = 63 - __builtin_clzll(us) - RTT_HIST_SUB_BITS;
+    }
+    return shift * RTT_HIST_SUB_HALF + (int)(us >> shift);
+}
+
+// Largest value, in ns, that falls into bucket index
+static int64_t rtt_hist_bucket_top(int index) {
+    int shift = index < 2 * RTT_HIST_SUB_HALF ? 0 : index / RTT_HIST_SUB_HALF - 1;
+    uint64_t sub = index - shift * RTT_HIST_SUB_HALF;
+    return (int64_t)(((sub + 1) << shift) * 1000 - 1);
+}
+
+void rtt_hist_reset(RttHist *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void rtt_hist_record(RttHist *h, int64_t ns) {
+    if (h->total == 0 || ns < h->min_ns) {
+        h->min_ns = ns;
+    }
+    if (h->total == 0 || ns > h->max_ns) {
+        h->max_ns = ns;
+    }
+    h->counts[rtt_hist_index(ns)]++;
+    h->total++;
+}
+
+void rtt_hist_merge(RttHist *into, const RttHist *from) {
+    if (from->total == 0) {
+        return;
+    }
+    if (into->total == 0 || from->min_ns < into->min_ns) {
+        into->min_ns = from->min_ns;
+    }
+    if (into->total == 0 || from->max_ns > into->max_ns) {
+        into->max_ns = from->max_ns;
+    }
+    for (int i = 0; i < RTT_HIST_COUNTS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+}
+
+int64_t rtt_hist_quantile(const RttHist *h, double quantile) {
+    uint64_t rank;
+    uint64_t seen = 0;
+
+    if (h->total == 0) {
+        return 0;
+    }
+    rank = (uint64_t)(quantile * h->total + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank >= h->total) {
+        return h->max_ns;
+    }
+
+    for (int i = 0; i < RTT_HIST_COUNTS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            // The bucket's top, but never outside what was recorded
+            int64_t value = rtt_hist_bucket_top(i);
+            if (value > h->max_ns) value = h->max_ns;
+            if (value < h->min_ns) value = h->min_ns;
+            return value;
+        }
+    }
+    return h->max_ns;
+}
+
+uint64_t rtt_hist_count_below(const RttHist *h, int64_t ns) {
+    uint64_t count = 0;
+
+    for (int i = 0; i < RTT_HIST_COUNTS && rtt_hist_bucket_top(i) < ns; i++) {
+        count += h->counts[i];
+    }
+    return count;
+}
+
+void rtt_monitor_init(RttMonitor *m) {
+    memset(m, 0, sizeof(*m));
+    m->last_rtt_ns = -1;
+}
+
+// Slice that now_ns falls into, emptied if it still holds an old lap
+static RttSlice *rtt_monitor_slice(RttMonitor *m, int64_t now_ns) {
+    int64_t start = now_ns - now_ns % RTT_SLICE_NS;
+    RttSlice *s = &m->slices[(now_ns / RTT_SLICE_NS) % RTT_SLICES];
+
+    if (s->start_ns != start) {
+        memset(s, 0, sizeof(*s));
+        s->start_ns = start;
+    }
+    return s;
+}
+
+static void rtt_slice_reply(RttSlice *s, int64_t rtt_ns, int64_t jitter_ns) {
+    s->probes++;
+    s->replies++;
+    if (jitter_ns >= 0) {
+        s->jitter_sum_ns += jitter_ns;
+        s->jitter_count++;
+    }
+    rtt_hist_record(&s->hist, rtt_ns);
+}
+
+void rtt_monitor_reply(RttMonitor *m, int64_t now_ns, int64_t rtt_ns) {
+    int64_t jitter = -1;
+
+    if (m->last_rtt_ns >= 0) {
+        jitter = rtt_ns > m->last_rtt_ns ? rtt_ns - m->last_rtt_ns : m->last_rtt_ns - rtt_ns;
+    }
+    m->last_rtt_ns = rtt_ns;
+
+    rtt_slice_reply(rtt_monitor_slice(m, now_ns), rtt_ns, jitter);
+    rtt_slice_reply(&m->total, rtt_ns, jitter);
+}
+
+void rtt_monitor_loss(RttMonitor *m, int64_t now_ns) {
+    rtt_monitor_slice(m, now_ns)->probes++;
+    m->total.probes++;
+    m->last_rtt_ns = -1;
+}
+
+static void rtt_stats_from(const RttSlice *s, RttStats *out) {
+    const RttHist *h = &s->hist;
+
+    memset(out, 0, sizeof(*out));
+    out->probes = s->probes;
+    out->replies = s->replies;
+    if (s->probes > 0) {
+        out->loss = 100.0 * (s->probes - s->replies) / s->probes;
+    }
+    if (h->total > 0) {
+        out->min_ns = h->min_ns;
+        out->p50_ns = rtt_hist_quantile(h, 0.50);
+        out->p90_ns = rtt_hist_quantile(h, 0.90);
+        out->p99_ns = rtt_hist_quantile(h, 0.99);
+        out->p999_ns = rtt_hist_quantile(h, 0.999);
+        out->max_ns = h->max_ns;
+    }
+    if (s->jitter_count > 0) {
+        out->jitter_ns = s->jitter_sum_ns / s->jitter_count;
+    }
+}
+
+// Windows are rounded up to whole slices
+void rtt_monitor_stats(const RttMonitor *m, int64_t now_ns, int64_t window_ns, RttStats *out) {
+    RttSlice merged;
+
+    if (window_ns <= 0) {
+        rtt_stats_from(&m->total, out);
+        return;
+    }
+    if (window_ns > RTT_WINDOW_MAX_NS) {
+        window_ns = RTT_WINDOW_MAX_NS;
+    }
+
+    memset(&merged, 0, sizeof(merged));
+    for (int i = 0; i < RTT_SLICES; i++) {
+        const RttSlice *s = &m->slices[i];
+        if (s->start_ns == 0 || s->start_ns > now_ns || s->start_ns + RTT_SLICE_NS <= now_ns - window_ns) {
+            continue;
+        }
+        merged.probes += s->probes;
+        merged.replies += s->replies;
+        merged.jitter_sum_ns += s->jitter_sum_ns;
+        merged.jitter_count += s->jitter_count;
+        rtt_hist_merge(&merged.hist, &s->hist);
+    }
+    rtt_stats_from(&merged, out);
+}
@@ -0,0 +1,78 @@
+/*
+ * Dave's Network Inquisition - RTT histograms
+ * Website: https://prowse.tech
+ */
+
+#ifndef RTT_HIST_H
+#define RTT_HIST_H
+
+#include <stdint.h>
+
+// Log-linear histogram in the style of HdrHistogram: values in
+// microseconds, 64 linear sub-buckets per power of two, so any recorded
+// value is reported within 1/64 (about 1.6 %).  The range runs from 1 us
+// to 2^27 us (about 134 s); anything longer lands in the last bucket.
+#define RTT_HIST_SUB_BITS 6
+#define RTT_HIST_SUB_HALF (1 << RTT_HIST_SUB_BITS)
+#define RTT_HIST_MAX_BITS 27
+#define RTT_HIST_COUNTS ((RTT_HIST_MAX_BITS - RTT_HIST_SUB_BITS + 1) * RTT_HIST_SUB_HALF)
+
+typedef struct {
+    uint64_t total;
+    int64_t min_ns;         // exact, not bucketed
+    int64_t max_ns;
+    uint32_t counts[RTT_HIST_COUNTS];
+} RttHist;
+
+// The monitor keeps one histogram per RTT_SLICE_NS slice in a ring and
+// merges slices to answer for any window up to RTT_WINDOW_MAX_NS, plus a
+// histogram of everything since it started.  Memory is fixed, however long
+// a target is watched.
+#define RTT_SLICE_NS 10000000000LL
+#define RTT_SLICES 30
+#define RTT_WINDOW_MAX_NS (RTT_SLICE_NS * RTT_SLICES)
+
+typedef struct {
+    int64_t start_ns;       // 0 = unused
+    int probes;             // outcomes, replies and losses
+    int replies;
+    int64_t jitter_sum_ns;  // |rtt - previous rtt| over consecutive replies
+    int jitter_count;
+    RttHist hist;
+} RttSlice;
+
+typedef struct {
+    RttSlice slices[RTT_SLICES];
+    RttSlice total;
+    int64_t last_rtt_ns;    // -1 until the first reply, and after a loss
+} RttMonitor;
+
+// Summary of one window; times are 0 when there were no replies
+typedef struct {
+    int probes;
+    int replies;
+    double loss;            // percent
+    int64_t min_ns;
+    int64_t p50_ns;
+    int64_t p90_ns;
+    int64_t p99_ns;
+    int64_t p999_ns;
+    int64_t max_ns;
+    int64_t jitter_ns;      // mean delta between consecutive RTTs
+} RttStats;
+
+void rtt_hist_reset(RttHist *h);
+void rtt_hist_record(RttHist *h, int64_t ns);
+void rtt_hist_merge(RttHist *into, const RttHist *from);
+// Smallest value with at least quantile (0..1) of the samples at or below it
+int64_t rtt_hist_quantile(const RttHist *h, double quantile);
+// Samples in buckets that lie wholly below ns, for drawing distributions
+uint64_t rtt_hist_count_below(const RttHist *h, int64_t ns);
+
+void rtt_monitor_init(RttMonitor *m);
+void rtt_monitor_reply(RttMonitor *m, int64_t now_ns, int64_t rtt_ns);
+void rtt_monitor_loss(RttMonitor *m, int64_t now_ns);
+// window_ns 0: since the monitor started
+void rtt_monitor_stats(const RttMonitor *m, int64_t now_ns, int64_t window_ns, RttStats *out);
+
+#endif
@@ -0,0 +1,278 @@
+/*
+ * Dave's Network Inquisition - interface sampler thread
+ * Website: https://prowse.tech
+ */
+
+#include "sampler.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int64_t sampler_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Find (or add) the previous-counter slot for an ifindex
+static SamplerPrev *sampler_prev(Sampler *s, int ifindex) {
+    if (s->prev_count * 2 >= s->prev_size) {
+        int size = s->prev_size ? s->prev_size * 2 : 64;
+        SamplerPrev *prev = calloc(size, sizeof(SamplerPrev));
+        if (prev == NULL) {
+            return NULL;
+        }
+        for (int i = 0; i < s->prev_size; i++) {
+            if (s->prev[i].ifindex <= 0) {
+                continue;
+            }
+            unsigned int slot = ((unsigned int)s->prev[i].ifindex * 2654435769u) & (size - 1);
+            while (prev[slot].ifindex != 0) {
+                slot = (slot + 1) & (size - 1);
+            }
+            prev[slot] = s->prev[i];
+        }
+        free(s->prev);
+        s->prev = prev;
+        s->prev_size = size;
+    }
+
+    unsigned int slot = ((unsigned int)ifindex * 2654435769u) & (s->prev_size - 1);
+    while (s->prev[slot].ifindex != 0 && s->prev[slot].ifindex != ifindex) {
+        slot = (slot + 1) & (s->prev_size - 1);
+    }
+    if (s->prev[slot].ifindex == 0) {
+        s->prev[slot].ifindex = ifindex;
+        s->prev_count++;
+    }
+    return &s->prev[slot];
+}
+
+void sampler_rates(Sample *sample, uint64_t rx_bytes, uint64_t tx_bytes,
+                   const uint64_t counters[LINK_COUNTERS], double dt) {
+    int bits32 = sample->stats32;
+
+    sample->reset = 0;
+    sample->rx_rate = link_counter_delta(rx_bytes, sample->rx_bytes, bits32, &sample->reset) / dt;
+    sample->tx_rate = link_counter_delta(tx_bytes, sample->tx_bytes, bits32, &sample->reset) / dt;
+    for (int i = 0; i < LINK_COUNTERS; i++) {
+        sample->rates[i] = link_counter_delta(counters[i], sample->counters[i], bits32, &sample->reset) / dt;
+    }
+}
+
+static void sampler_on_link_event(const LinkEntry *link, int removed, void *user_data) {
+    Sampler *s = user_data;
+
+    // Deletions are left to the sweep after the next dump
+    if (!removed) {
+        SamplerPrev *prev = sampler_prev(s, link->ifindex);
+        if (prev != NULL) {
+            prev->flags = link->flags;
+        }
+    }
+}
+
+// Interfaces the last dump no longer listed are reported gone and dropped,
+// so container churn does not grow the table.  The table is rebuilt rather
+// than deleted from in place, which would move entries under the scan.
+static void sampler_sweep(Sampler *s, int64_t t_ns) {
+    int stale = 0;
+
+    for (int i = 0; i < s->prev_size; i++) {
+        SamplerPrev *prev = &s->prev[i];
+        if (prev->ifindex <= 0 || prev->tick == s->tick) {
+            continue;
+        }
+        Sample sample;
+        memset(&sample, 0, sizeof(sample));
+        sample.t_ns = t_ns;
+        sample.ifindex = prev->ifindex;
+        sample.removed = 1;
+        // With the ring full the notice is tried again next tick, or the
+        // interface's row would never be dropped
+        if (spsc_ring_push(&s->ring, &sample)) {
+            prev->ifindex = -1;
+            stale++;
+        }
+    }
+    if (stale == 0) {
+        return;
+    }
+
+    SamplerPrev *prev = calloc(s->prev_size, sizeof(SamplerPrev));
+    if (prev == NULL) {
+        // Keep the old table; its stale slots only cost probes
+        return;
+    }
+    for (int i = 0; i < s->prev_size; i++) {
+        if (s->prev[i].ifindex <= 0) {
+            continue;
+        }
+        unsigned int slot = ((unsigned int)s->prev[i].ifindex * 2654435769u) & (s->prev_size - 1);
+        while (prev[slot].ifindex != 0) {
+            slot = (slot + 1) & (s->prev_size - 1);
+        }
+        prev[slot] = s->prev[i];
+    }
+    free(s->prev);
+    s->prev = prev;
+    s->prev_count -= stale;
+}
+
+static void sampler_tick(Sampler *s) {
+    if (s->nl.events_fd >= 0 && nl_link_read_events(&s->nl, sampler_on_link_event, s) < 0 && errno == ENOBUFS) {
+        s->resync = 1;
+    }
+
+    int full = !s->stats_dump || s->resync;
+    int64_t before = sampler_now_ns();
+    if ((full ? nl_link_refresh(&s->nl) : nl_link_refresh_stats(&s->nl)) < 0) {
+        // Kernels before 4.7 have no RTM_GETSTATS
+        if (!full && (errno == EOPNOTSUPP || errno == EINVAL)) {
+            s->stats_dump = 0;
+        }
+        return;
+    }
+    s->resync = 0;
+    s->tick++;
+    // Stamp the dump at the midpoint of the request and its last reply
+    int64_t t_ns = before + (sampler_now_ns() - before) / 2;
+
+    for (int i = 0; i < s->nl.count; i++) {
+        const LinkEntry *link = &s->nl.entries[i];
+        SamplerPrev *prev = sampler_prev(s, link->ifindex);
+
+        if (prev == NULL) {
+            continue;
+        }
+        prev->tick = s->tick;
+        if (full) {
+            prev->flags = link->flags;
+        }
+
+        uint64_t counters[LINK_COUNTERS];
+        nl_link_counters(&link->stats, counters);
+
+        // First sight only primes the counters
+        if (prev->t_ns != 0 && t_ns > prev->t_ns) {
+            Sample sample;
+
+            sample.t_ns = t_ns;
+            sample.ifindex = link->ifindex;
+            sample.flags = prev->flags;
+            sample.removed = 0;
+            sample.stats32 = link->stats32;
+            sample.rx_bytes = link->stats.rx_bytes;
+            sample.tx_bytes = link->stats.tx_bytes;
+            memcpy(sample.counters, counters, sizeof(counters));
+            sampler_rates(&sample, prev->rx_bytes, prev->tx_bytes, prev->counters, (t_ns - prev->t_ns) / 1e9);
+
+            if (!spsc_ring_push(&s->ring, &sample)) {
+                atomic_fetch_add_explicit(&s->dropped, 1, memory_order_relaxed);
+            }
+        }
+
+        prev->rx_bytes = link->stats.rx_bytes;
+        prev->tx_bytes = link->stats.tx_bytes;
+        memcpy(prev->counters, counters, sizeof(counters));
+        prev->t_ns = t_ns;
+    }
+    sampler_sweep(s, t_ns);
+}
+
+static void *sampler_thread(void *arg) {
+    Sampler *s = arg;
+    struct timespec next;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!atomic_load_explicit(&s->stop, memory_order_relaxed)) {
+        sampler_tick(s);
+
+        // Absolute deadlines keep the cadence free of accumulated drift
+        int64_t interval = atomic_load_explicit(&s->interval_ns, memory_order_relaxed);
+        int64_t deadline = (int64_t)next.tv_sec * 1000000000LL + next.tv_nsec + interval;
+        int64_t now = sampler_now_ns();
+
+        // Fell behind (suspend, overload): restart the schedule from now
+        if (deadline < now) {
+            deadline = now + interval;
+        }
+        next.tv_sec = deadline / 1000000000LL;
+        next.tv_nsec = deadline % 1000000000LL;
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+        }
+    }
+
+    return NULL;
+}
+
+int sampler_start(Sampler *s, int64_t interval_ns) {
+    memset(s, 0, sizeof(*s));
+
+    if (interval_ns < SAMPLER_MIN_INTERVAL_NS) {
+        interval_ns = SAMPLER_MIN_INTERVAL_NS;
+    }
+    atomic_init(&s->stop, 0);
+    atomic_init(&s->interval_ns, interval_ns);
+    atomic_init(&s->dropped, 0);
+
+    if (nl_link_open(&s->nl) < 0) {
+        return -1;
+    }
+    // Counter-only dumps need the events for the flags; the first tick
+    // learns them from a full dump
+    s->stats_dump = nl_link_watch(&s->nl) == 0;
+    s->resync = 1;
+
+    if (spsc_ring_init(&s->ring, SAMPLER_RING_SIZE, sizeof(Sample)) < 0) {
+        nl_link_close(&s->nl);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    int err = pthread_create(&s->thread, NULL, sampler_thread, s);
+    if (err != 0) {
+        spsc_ring_free(&s->ring);
+        nl_link_close(&s->nl);
+        errno = err;
+        return -1;
+    }
+
+    s->running = 1;
+    return 0;
+}
+
+void sampler_stop(Sampler *s) {
+    if (!s->running) {
+        return;
+    }
+
+    atomic_store(&s->stop, 1);
+    pthread_join(s->thread, NULL);
+    s->running = 0;
+
+    spsc_ring_free(&s->ring);
+    nl_link_close(&s->nl);
+    free(s->prev);
+    s->prev = NULL;
+    s->prev_size = 0;
+    s->prev_count = 0;
+}
+
+void sampler_set_interval(Sampler *s, int64_t interval_ns) {
+    if (interval_ns < SAMPLER_MIN_INTERVAL_NS) {
+        interval_ns = SAMPLER_MIN_INTERVAL_NS;
+    }
+    atomic_store_explicit(&s->interval_ns, interval_ns, memory_order_relaxed);
+}
+
+size_t sampler_read(Sampler *s, Sample *out, size_t max) {
+    if (!s->running) {
+        return 0;
+    }
+    return spsc_ring_pop_batch(&s->ring, out, max);
+}
@@ -0,0 +1,80 @@
+/*
+ * Dave's Network Inquisition - interface sampler thread
+ * Website: https://prowse.tech
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "nl-link.h"
+#include "spsc-ring.h"
+
+#define SAMPLER_MIN_INTERVAL_NS 10000000LL    // 10 ms
+#define SAMPLER_RING_SIZE 65536
+
+// One interface at one instant.  Rates are computed by the sampler from
+// the real CLOCK_MONOTONIC distance to the previous sample, across the
+// wraps of 32-bit counters (link_counter_delta); a counter that was reset
+// has rate 0.
+typedef struct {
+    int64_t t_ns;
+    int ifindex;
+    unsigned int flags;
+    int removed;       // the interface is gone; no counters
+    int reset;         // some counter was reset since the previous sample
+    int stats32;       // the counters are 32 bits wide (LinkEntry.stats32)
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    double rx_rate;    // bytes per second
+    double tx_rate;
+    uint64_t counters[LINK_COUNTERS];
+    double rates[LINK_COUNTERS];    // per second
+} Sample;
+
+// Previous counters of one interface, private to the sampler thread
+typedef struct {
+    int ifindex;
+    unsigned int flags;         // IFF_*, from dumps or link events
+    uint32_t tick;              // last dump that listed it
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t counters[LINK_COUNTERS];
+    int64_t t_ns;
+} SamplerPrev;
+
+typedef struct {
+    pthread_t thread;
+    int running;
+    atomic_int stop;
+    atomic_llong interval_ns;
+    atomic_ullong dropped;
+    SpscRing ring;
+
+    // Owned by the sampler thread.  With link events to keep the flags
+    // current, a tick only dumps counters (RTM_GETSTATS); a full
+    // RTM_GETLINK dump is the fallback, and the resync when events were
+    // lost.
+    NlLink nl;
+    SamplerPrev *prev;
+    int prev_size;
+    int prev_count;
+    uint32_t tick;
+    int stats_dump;
+    int resync;
+} Sampler;
+
+int sampler_start(Sampler *s, int64_t interval_ns);
+void sampler_stop(Sampler *s);
+void sampler_set_interval(Sampler *s, int64_t interval_ns);
+size_t sampler_read(Sampler *s, Sample *out, size_t max);
+// Fills the rates and reset flag of sample from its counters (as wide as
+// its stats32 says) and the previous reading, dt seconds earlier
+void sampler_rates(Sample *sample, uint64_t rx_bytes, uint64_t tx_bytes,
+                   const uint64_t counters[LINK_COUNTERS], double dt);
+int64_t sampler_now_ns(void);
+
+#endif
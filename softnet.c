@@ -0,0 +1,450 @@
+/*
+ * Dave's Network Inquisition - per-CPU softnet and NIC interrupt rates
+ * Website: https://prowse.tech
+ */
+
+#define _GNU_SOURCE             // memrchr()
+
+#include "softnet.h"
+#include "nl-link.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SOFTNET_BUF_SIZE 65536
+
+// A CPU missing from the last reading (offline, or no /proc/interrupts
+// column); it gets no rate rather than its whole count at once
+#define SOFTNET_ABSENT UINT64_MAX
+
+int softnet_open(Softnet *sn) {
+    memset(sn, 0, sizeof(*sn));
+    sn->interrupts_fd = -1;
+
+    sn->softnet_fd = open("/proc/net/softnet_stat", O_RDONLY | O_CLOEXEC);
+    if (sn->softnet_fd < 0) {
+        return -1;
+    }
+    sn->interrupts_fd = open("/proc/interrupts", O_RDONLY | O_CLOEXEC);
+
+    long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+    sn->ncpus = ncpus > 0 ? (int)ncpus : 1;
+    size_t cells = (size_t)SOFTNET_METRICS * sn->ncpus;
+
+    sn->buf_size = SOFTNET_BUF_SIZE;
+    sn->buf = malloc(sn->buf_size);
+    sn->columns = malloc(sn->ncpus * sizeof(int));
+    sn->counters = malloc(cells * sizeof(uint64_t));
+    sn->reading = malloc(cells * sizeof(uint64_t));
+    sn->hist = calloc(SOFTNET_HISTORY * cells, sizeof(float));
+    sn->t_hist = calloc(SOFTNET_HISTORY, sizeof(int64_t));
+    if (sn->buf == NULL || sn->columns == NULL || sn->counters == NULL || sn->reading == NULL ||
+        sn->hist == NULL || sn->t_hist == NULL) {
+        softnet_close(sn);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (size_t i = 0; i < cells; i++) {
+        sn->counters[i] = SOFTNET_ABSENT;
+    }
+    return 0;
+}
+
+void softnet_close(Softnet *sn) {
+    if (sn->softnet_fd >= 0) {
+        close(sn->softnet_fd);
+    }
+    if (sn->interrupts_fd >= 0) {
+        close(sn->interrupts_fd);
+    }
+    free(sn->buf);
+    free(sn->columns);
+    free(sn->counters);
+    free(sn->reading);
+    free(sn->irq_numbers);
+    free(sn->irq_counts);
+    free(sn->read_numbers);
+    free(sn->read_counts);
+    free(sn->hist);
+    free(sn->t_hist);
+    memset(sn, 0, sizeof(*sn));
+    sn->softnet_fd = -1;
+    sn->interrupts_fd = -1;
+}
+
+void softnet_set_interface(Softnet *sn, const char *ifname) {
+    char path[PATH_MAX];
+    char target[PATH_MAX];
+
+    sn->ifname[0] = '\0';
+    sn->device[0] = '\0';
+    sn->irq_lines = 0;
+    if (ifname != NULL && ifname[0] != '\0') {
+        snprintf(sn->ifname, sizeof(sn->ifname), "%s", ifname);
+
+        // The queues of virtio and many PCI drivers are named after the
+        // device ("virtio3", "0000:03:00.0") rather than the interface
+        snprintf(path, sizeof(path), "/sys/class/net/%s/device", ifname);
+        ssize_t n = readlink(path, target, sizeof(target) - 1);
+        if (n > 0) {
+            target[n] = '\0';
+            const char *base = strrchr(target, '/');
+            base = base != NULL ? base + 1 : target;
+            if (strlen(base) < sizeof(sn->device)) {
+                strcpy(sn->device, base);
+            }
+        }
+    }
+
+    // Another interface's counts are not a continuation of these
+    for (int cpu = 0; cpu < sn->ncpus; cpu++) {
+        sn->counters[SOFTNET_IRQS * sn->ncpus + cpu] = SOFTNET_ABSENT;
+    }
+    for (int column = 0; column < SOFTNET_HISTORY; column++) {
+        memset(&sn->hist[((size_t)column * SOFTNET_METRICS + SOFTNET_IRQS) * sn->ncpus], 0,
+               sn->ncpus * sizeof(float));
+    }
+}
+
+// The whole file into buf, NUL-terminated.  procfs regenerates the text
+// on every read from offset 0, so the descriptor stays open.
+static ssize_t softnet_read_file(Softnet *sn, int fd) {
+    for (;;) {
+        size_t len = 0;
+
+        while (len < sn->buf_size - 1) {
+            ssize_t n = pread(fd, sn->buf + len, sn->buf_size - 1 - len, len);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            if (n == 0) {
+                break;
+            }
+            len += n;
+        }
+
+        if (len < sn->buf_size - 1) {
+            sn->buf[len] = '\0';
+            return len;
+        }
+
+        // Filled to the brim: the file outgrew the buffer
+        char *buf = realloc(sn->buf, sn->buf_size * 2);
+        if (buf == NULL) {
+            return -1;
+        }
+        sn->buf = buf;
+        sn->buf_size *= 2;
+    }
+}
+
+static uint64_t softnet_hex(const char **p) {
+    uint64_t value = 0;
+
+    for (;; (*p)++) {
+        char c = **p;
+        if (c >= '0' && c <= '9') {
+            value = value * 16 + (c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            value = value * 16 + (c - 'a' + 10);
+        } else {
+            return value;
+        }
+    }
+}
+
+static int softnet_is_word(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Next whole-word occurrence of name in [p, end), or NULL.  The counts
+// are digits and spaces, so keying the search on the name's first other
+// character lets memchr skip them.
+static const char *softnet_find(const char *p, const char *end, const char *name) {
+    size_t len = strlen(name);
+    size_t key = strspn(name, "0123456789");
+
+    if (len == 0) {
+        return NULL;
+    }
+    if (key == len) {
+        key = 0;
+    }
+    for (const char *q = p + key; q < end && (q = memchr(q, name[key], end - q)) != NULL; q++) {
+        const char *start = q - key;
+        if (start >= p && start + len <= end && memcmp(start, name, len) == 0 &&
+            !softnet_is_word(start[-1]) && (start + len == end || !softnet_is_word(start[len]))) {
+            return start;
+        }
+    }
+    return NULL;
+}
+
+// One line per online CPU: processed, dropped, time_squeeze, then other
+// counters, all hex.  Since Linux 5.10 the 13th field is the CPU id;
+// before that lines are in CPU order with offline CPUs left out, which is
+// the best guess there is.
+static void softnet_parse_stat(Softnet *sn, const char *p) {
+    for (int line = 0; *p != '\0'; line++) {
+        uint64_t fields[13];
+        int n = 0;
+
+        while (*p != '\0' && *p != '\n') {
+            while (*p == ' ') {
+                p++;
+            }
+            if (*p == '\n' || *p == '\0') {
+                break;
+            }
+            uint64_t value = softnet_hex(&p);
+            if (n < 13) {
+                fields[n++] = value;
+            }
+            while (*p != ' ' && *p != '\n' && *p != '\0') {
+                p++;
+            }
+        }
+        if (*p == '\n') {
+            p++;
+        }
+
+        int cpu = n >= 13 ? (int)fields[12] : line;
+        if (n < 3 || cpu < 0 || cpu >= sn->ncpus) {
+            continue;
+        }
+        sn->reading[SOFTNET_PROCESSED * sn->ncpus + cpu] = fields[0];
+        sn->reading[SOFTNET_DROPPED * sn->ncpus + cpu] = fields[1];
+        sn->reading[SOFTNET_SQUEEZED * sn->ncpus + cpu] = fields[2];
+    }
+}
+
+// Room for that many interrupt lines in both the last sample's table and
+// the pending one
+static int softnet_reserve_lines(Softnet *sn, int lines) {
+    if (lines <= sn->irq_capacity) {
+        return 0;
+    }
+
+    int capacity = sn->irq_capacity ? sn->irq_capacity * 2 : 16;
+    size_t cells = (size_t)capacity * sn->ncpus;
+    int *numbers = realloc(sn->irq_numbers, capacity * sizeof(int));
+    if (numbers == NULL) {
+        return -1;
+    }
+    sn->irq_numbers = numbers;
+    numbers = realloc(sn->read_numbers, capacity * sizeof(int));
+    if (numbers == NULL) {
+        return -1;
+    }
+    sn->read_numbers = numbers;
+    uint64_t *counts = realloc(sn->irq_counts, cells * sizeof(uint64_t));
+    if (counts == NULL) {
+        return -1;
+    }
+    sn->irq_counts = counts;
+    counts = realloc(sn->read_counts, cells * sizeof(uint64_t));
+    if (counts == NULL) {
+        return -1;
+    }
+    sn->read_counts = counts;
+    sn->irq_capacity = capacity;
+    return 0;
+}
+
+// The last sample's per-CPU counts for irq, or NULL if it was not matched
+// then.  Lines come in IRQ order, so it is nearly always at the same row.
+static const uint64_t *softnet_irq_last(const Softnet *sn, int irq, int row) {
+    if (row < sn->irq_lines && sn->irq_numbers[row] == irq) {
+        return &sn->irq_counts[(size_t)row * sn->ncpus];
+    }
+    for (int i = 0; i < sn->irq_lines; i++) {
+        if (sn->irq_numbers[i] == irq) {
+            return &sn->irq_counts[(size_t)i * sn->ncpus];
+        }
+    }
+    return NULL;
+}
+
+// A header of "CPUn" columns (online CPUs only), then "label: count per
+// column  chip  hwirq  name" per interrupt.  Lines naming the interface
+// or its device each get a delta per CPU against the last sample, and
+// those are summed; a line new since then adds nothing yet.  With
+// hundreds of CPUs the counts are nearly all of the text, so rather than
+// walking every line the names are searched for: they hold letters or
+// punctuation, which counts never do.
+static void softnet_parse_interrupts(Softnet *sn, const char *p, size_t len) {
+    uint64_t *irqs = &sn->reading[SOFTNET_IRQS * sn->ncpus];
+    const char *end = p + len;
+
+    sn->ncolumns = 0;
+    while (p < end && *p != '\n') {
+        if (p[0] == 'C' && p[1] == 'P' && p[2] == 'U') {
+            p += 3;
+            int cpu = 0;
+            while (*p >= '0' && *p <= '9') {
+                cpu = cpu * 10 + (*p++ - '0');
+            }
+            if (sn->ncolumns < sn->ncpus && cpu < sn->ncpus) {
+                sn->columns[sn->ncolumns++] = cpu;
+                irqs[cpu] = 0;
+            }
+        } else {
+            p++;
+        }
+    }
+
+    // Each name's next match, looked for again only once passed
+    const char *next[2] = {p, p};
+    const char *names[2] = {sn->ifname, sn->device};
+
+    sn->read_lines = 0;
+    while (p < end) {
+        const char *hit = NULL;
+        for (int i = 0; i < 2; i++) {
+            if (next[i] != NULL && next[i] < p + 1) {
+                next[i] = softnet_find(p, end, names[i]);
+            }
+            if (next[i] != NULL && (hit == NULL || next[i] < hit)) {
+                hit = next[i];
+            }
+        }
+        if (hit == NULL) {
+            break;
+        }
+
+        const char *line = memrchr(p, '\n', hit - p) + 1;
+        const char *eol = memchr(hit, '\n', end - hit);
+        if (eol == NULL) {
+            eol = end;
+        }
+        // Device lines are numbered; the per-architecture ones ("NMI",
+        // "LOC") never name an interface
+        const char *q = line;
+        int irq = -1;
+        while (*q == ' ') {
+            q++;
+        }
+        if (*q >= '0' && *q <= '9') {
+            irq = 0;
+            while (*q >= '0' && *q <= '9') {
+                irq = irq * 10 + (*q++ - '0');
+            }
+        }
+        if (irq >= 0 && *q == ':' && softnet_reserve_lines(sn, sn->read_lines + 1) == 0) {
+            uint64_t *counts = &sn->read_counts[(size_t)sn->read_lines * sn->ncpus];
+            const uint64_t *last = softnet_irq_last(sn, irq, sn->read_lines);
+
+            for (int cpu = 0; cpu < sn->ncpus; cpu++) {
+                counts[cpu] = SOFTNET_ABSENT;
+            }
+            q++;
+            for (int column = 0; column < sn->ncolumns; column++) {
+                uint64_t count = 0;
+                while (*q == ' ') {
+                    q++;
+                }
+                if (*q < '0' || *q > '9') {
+                    break;
+                }
+                while (*q >= '0' && *q <= '9') {
+                    count = count * 10 + (*q++ - '0');
+                }
+                int cpu = sn->columns[column];
+                counts[cpu] = count;
+                // The kernel counts each line per CPU in an unsigned int
+                if (last != NULL && last[cpu] != SOFTNET_ABSENT) {
+                    irqs[cpu] += (uint32_t)(count - last[cpu]);
+                }
+            }
+            sn->read_numbers[sn->read_lines++] = irq;
+        }
+        p = eol;
+    }
+}
+
+int softnet_read(Softnet *sn) {
+    size_t cells = (size_t)SOFTNET_METRICS * sn->ncpus;
+    struct timespec ts;
+
+    for (size_t i = 0; i < cells; i++) {
+        sn->reading[i] = SOFTNET_ABSENT;
+    }
+    sn->read_lines = 0;
+    sn->read_ok = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    sn->read_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+    if (softnet_read_file(sn, sn->softnet_fd) < 0) {
+        return -1;
+    }
+    softnet_parse_stat(sn, sn->buf);
+
+    if (sn->interrupts_fd >= 0 && (sn->ifname[0] != '\0' || sn->device[0] != '\0')) {
+        ssize_t len = softnet_read_file(sn, sn->interrupts_fd);
+        if (len >= 0) {
+            softnet_parse_interrupts(sn, sn->buf, len);
+        }
+    }
+    sn->read_ok = 1;
+    return 0;
+}
+
+void softnet_commit(Softnet *sn) {
+    size_t cells = (size_t)SOFTNET_METRICS * sn->ncpus;
+    int64_t t_ns = sn->read_ns;
+
+    if (!sn->read_ok) {
+        return;
+    }
+    sn->read_ok = 0;
+
+    if (sn->last_ns != 0 && t_ns > sn->last_ns) {
+        float *column = &sn->hist[(size_t)sn->head * cells];
+        double dt = (t_ns - sn->last_ns) / 1e9;
+
+        for (size_t i = 0; i < cells; i++) {
+            int reset = 0;
+            if (sn->counters[i] == SOFTNET_ABSENT || sn->reading[i] == SOFTNET_ABSENT) {
+                column[i] = 0.0f;
+            } else if (i / sn->ncpus == SOFTNET_IRQS) {
+                column[i] = sn->reading[i] / dt;
+            } else {
+                // The kernel keeps both as 32-bit counters, which wrap
+                column[i] = link_counter_delta(sn->counters[i], sn->reading[i], 1, &reset) / dt;
+            }
+        }
+        sn->t_hist[sn->head] = t_ns;
+        sn->head = (sn->head + 1) % SOFTNET_HISTORY;
+    }
+
+    uint64_t *counters = sn->counters;
+    sn->counters = sn->reading;
+    sn->reading = counters;
+    sn->last_ns = t_ns;
+
+    int *numbers = sn->irq_numbers;
+    sn->irq_numbers = sn->read_numbers;
+    sn->read_numbers = numbers;
+    counters = sn->irq_counts;
+    sn->irq_counts = sn->read_counts;
+    sn->read_counts = counters;
+    sn->irq_lines = sn->read_lines;
+}
+
+int softnet_sample(Softnet *sn) {
+    if (softnet_read(sn) < 0) {
+        return -1;
+    }
+    softnet_commit(sn);
+    return 0;
+}
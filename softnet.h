@@ -0,0 +1,98 @@
+/*
+ * Dave's Network Inquisition - per-CPU softnet and NIC interrupt rates
+ * Website: https://prowse.tech
+ */
+
+#ifndef SOFTNET_H
+#define SOFTNET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <net/if.h>
+
+// Columns of history per CPU (30 s at 10 Hz)
+#define SOFTNET_HISTORY 300
+
+enum {
+    SOFTNET_PROCESSED,          // packets taken off the backlog
+    SOFTNET_DROPPED,            // backlog full (netdev_max_backlog)
+    SOFTNET_SQUEEZED,           // NAPI budget or time ran out with work left
+    SOFTNET_IRQS,               // interrupts of the followed NIC's queues
+    SOFTNET_METRICS
+};
+
+// /proc/net/softnet_stat and /proc/interrupts, kept open and read again
+// with pread every sample.  Everything is sized when opened (the read
+// buffer and the interrupt line tables grow only if a file outgrows
+// them), so a sample allocates nothing:
+// 256 CPUs at 10 Hz cost two file reads and a scan each.
+//
+// A sample is a read, which only touches buf, reading and the read_
+// fields and so can run on another thread, then a commit that folds it
+// into the history.  Nothing else may be called between the two.
+typedef struct {
+    int softnet_fd;
+    int interrupts_fd;          // -1 when unreadable; no IRQ rates then
+    char *buf;
+    size_t buf_size;
+
+    int ncpus;                  // rows: CPU ids 0 .. ncpus - 1
+    int *columns;               // /proc/interrupts column -> CPU id
+    int ncolumns;
+
+    // Interrupt lines whose name mentions the interface or its device
+    // ("eth0-TxRx-3", "mlx5_comp3@pci:0000:03:00.0", "virtio0-input.0")
+    char ifname[IF_NAMESIZE];
+    char device[64];
+    int irq_lines;              // matched by the last sample
+    int read_lines;             // the same, for the pending read
+
+    // Those lines by IRQ number, with their per-CPU counts [line][ncpus]
+    // as of the last sample and the pending read.  Each line's delta is
+    // taken on its own and the deltas summed, so the set of lines
+    // changing moves nothing.
+    int *irq_numbers;
+    uint64_t *irq_counts;
+    int *read_numbers;
+    uint64_t *read_counts;
+    int irq_capacity;           // lines all four have room for
+
+    uint64_t *counters;         // [SOFTNET_METRICS][ncpus], last reading;
+                                // SOFTNET_IRQS holds interrupts since the
+                                // reading before, not a running count
+    uint64_t *reading;          // the same, being filled
+    int64_t read_ns;
+    int read_ok;
+    int64_t last_ns;
+
+    // Rates per second, [SOFTNET_HISTORY][SOFTNET_METRICS][ncpus], and
+    // CLOCK_MONOTONIC times (0 = unused column)
+    float *hist;
+    int64_t *t_hist;
+    int head;
+} Softnet;
+
+int softnet_open(Softnet *sn);
+void softnet_close(Softnet *sn);
+// Interrupts to follow; NULL or "" for none.  Resets the IRQ history.
+void softnet_set_interface(Softnet *sn, const char *ifname);
+// Reads both files.  Returns -1 with errno set if softnet_stat could not
+// be read, and the commit then does nothing.
+int softnet_read(Softnet *sn);
+// Adds a column from the last read.  The first one only primes the
+// counters.
+void softnet_commit(Softnet *sn);
+// Both at once
+int softnet_sample(Softnet *sn);
+
+// i = 0 is the oldest column, SOFTNET_HISTORY - 1 the newest
+static inline int64_t softnet_t(const Softnet *sn, int i) {
+    return sn->t_hist[(sn->head + i) % SOFTNET_HISTORY];
+}
+
+static inline float softnet_rate(const Softnet *sn, int metric, int cpu, int i) {
+    int column = (sn->head + i) % SOFTNET_HISTORY;
+    return sn->hist[((size_t)column * SOFTNET_METRICS + metric) * sn->ncpus + cpu];
+}
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * Dave's Network Inquisition - single-producer/single-consumer ring
+ * Website: https://prowse.tech
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lock-free ring of fixed-size items between exactly one producer thread
+// and one consumer thread.  head is only written by the producer and tail
+// only by the consumer; each lives on its own cache line so the two sides
+// do not false-share.
+typedef struct {
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    _Alignas(64) size_t mask;
+    size_t item_size;
+    unsigned char *items;
+} SpscRing;
+
+// capacity must be a power of two
+static inline int spsc_ring_init(SpscRing *ring, size_t capacity, size_t item_size) {
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return -1;
+    }
+    ring->items = malloc(capacity * item_size);
+    if (ring->items == NULL) {
+        return -1;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->mask = capacity - 1;
+    ring->item_size = item_size;
+    return 0;
+}
+
+static inline void spsc_ring_free(SpscRing *ring) {
+    free(ring->items);
+    ring->items = NULL;
+}
+
+// Producer side; returns 0 when the ring is full
+static inline int spsc_ring_push(SpscRing *ring, const void *item) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail > ring->mask) {
+        return 0;
+    }
+
+    memcpy(ring->items + (head & ring->mask) * ring->item_size, item, ring->item_size);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 1;
+}
+
+// Consumer side; copies out up to max items and returns how many
+static inline size_t spsc_ring_pop_batch(SpscRing *ring, void *out, size_t max) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t n = head - tail;
+
+    if (n > max) {
+        n = max;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        memcpy((unsigned char *)out + i * ring->item_size,
+               ring->items + ((tail + i) & ring->mask) * ring->item_size,
+               ring->item_size);
+    }
+
+    atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+    return n;
+}
+
+#endif
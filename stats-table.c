@@ -0,0 +1,383 @@
+/*
+ * Dave's Network Inquisition - per-interface statistics table
+ * Website: https://prowse.tech
+ */
+
+#include "stats-table.h"
+#include "rrd-file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+StatsRing stats_table_no_ring;
+
+void stats_table_init(StatsTable *t) {
+    memset(t, 0, sizeof(*t));
+}
+
+void stats_table_free(StatsTable *t) {
+    for (int row = 0; row < t->count; row++) {
+        // One still being opened is freed when it comes back
+        if (t->opening[row] != NULL) {
+            t->opening[row]->memory = NULL;
+        }
+        rrd_free(t->rrd[row]);
+        tsc_series_free(&t->archive[row]);
+        if (t->ring[row] != &stats_table_no_ring) {
+            free(t->ring[row]);
+        }
+    }
+    while (t->opens != NULL) {
+        StatsRrdOpen *open = t->opens;
+        t->opens = open->next;
+        stats_rrd_open_free(open);
+    }
+    free(t->opening);
+    free(t->rrd);
+    free(t->archive);
+    free(t->history_dir);
+    free(t->hash);
+    free(t->ifindex);
+    free(t->name);
+    free(t->rx_bytes);
+    free(t->tx_bytes);
+    free(t->counters);
+    free(t->resets);
+    free(t->last_ns);
+    free(t->device);
+    free(t->ring);
+    memset(t, 0, sizeof(*t));
+}
+
+void stats_table_set_history_dir(StatsTable *t, const char *dir) {
+    free(t->history_dir);
+    t->history_dir = dir != NULL ? strdup(dir) : NULL;
+}
+
+static int stats_table_has_device(const char *name) {
+    char path[64];
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device", name);
+    return access(path, F_OK) == 0;
+}
+
+// Untracks the row.  A virtual interface's name is reused for something
+// else (the next container's veth), so its history file is deleted.
+static void stats_table_close_rrd(StatsTable *t, int row) {
+    Rrd *rrd = t->rrd[row];
+
+    if (t->opening[row] != NULL) {
+        t->opening[row]->memory = NULL;
+        t->opening[row] = NULL;
+    }
+    if (rrd != NULL && rrd->fd >= 0 && !rrd->read_only && !t->device[row]) {
+        rrd_file_remove(t->history_dir, t->name[row]);
+    }
+    rrd_free(rrd);
+    tsc_series_free(&t->archive[row]);
+    t->rrd[row] = NULL;
+}
+
+int stats_table_track(StatsTable *t, int row) {
+    // Starts empty: an untracked row's samples were not kept
+    if (t->ring[row] == &stats_table_no_ring) {
+        StatsRing *ring = calloc(1, sizeof(StatsRing));
+        if (ring == NULL) {
+            return -1;
+        }
+        t->ring[row] = ring;
+    }
+    if (t->rrd[row] != NULL) {
+        return 0;
+    }
+    if (tsc_series_init(&t->archive[row], 2, STATS_ARCHIVE_BYTES) < 0) {
+        return -1;
+    }
+    t->rrd[row] = rrd_new();
+    if (t->rrd[row] == NULL) {
+        tsc_series_free(&t->archive[row]);
+        return -1;
+    }
+
+    if (t->history_dir != NULL && t->name[row][0] != '\0') {
+        StatsRrdOpen *open = calloc(1, sizeof(StatsRrdOpen));
+        if (open == NULL || (open->dir = strdup(t->history_dir)) == NULL) {
+            // History in memory only, then
+            free(open);
+            return 0;
+        }
+        open->ifindex = t->ifindex[row];
+        memcpy(open->name, t->name[row], IF_NAMESIZE);
+        open->device = t->device[row];
+        open->memory = t->rrd[row];
+        open->next = t->opens;
+        t->opens = open;
+        t->opening[row] = open;
+    }
+    return 0;
+}
+
+StatsRrdOpen *stats_table_take_open(StatsTable *t) {
+    while (t->opens != NULL) {
+        StatsRrdOpen *open = t->opens;
+        t->opens = open->next;
+        open->next = NULL;
+        if (open->memory != NULL) {
+            return open;
+        }
+        // Its row went before it was taken
+        stats_rrd_open_free(open);
+    }
+    return NULL;
+}
+
+void stats_rrd_open_run(StatsRrdOpen *open) {
+    open->rrd = rrd_file_open(open->dir, open->name);
+    // Ours is locked now, so it is not among those pruned
+    if (open->rrd != NULL && !open->rrd->read_only) {
+        rrd_file_prune(open->dir, STATS_HISTORY_FILES);
+    }
+}
+
+void stats_table_attach_rrd(StatsTable *t, StatsRrdOpen *open) {
+    // A stale one's table may be gone
+    int row = open->memory != NULL ? stats_table_lookup(t, open->ifindex) : -1;
+
+    if (row >= 0 && t->opening[row] == open) {
+        t->opening[row] = NULL;
+        if (open->rrd != NULL) {
+            rrd_free(t->rrd[row]);
+            t->rrd[row] = open->rrd;
+            open->rrd = NULL;
+        }
+    } else if (open->rrd != NULL && !open->rrd->read_only && !open->device) {
+        // Untracked while it was being opened
+        rrd_file_remove(open->dir, open->name);
+    }
+    stats_rrd_open_free(open);
+}
+
+void stats_rrd_open_free(StatsRrdOpen *open) {
+    rrd_free(open->rrd);
+    free(open->dir);
+    free(open);
+}
+
+static unsigned int stats_table_slot(int ifindex, int hash_size) {
+    // Fibonacci hashing spreads the small sequential ifindex values
+    return ((unsigned int)ifindex * 2654435769u) & (hash_size - 1);
+}
+
+int stats_table_lookup(const StatsTable *t, int ifindex) {
+    if (t->hash_size == 0) {
+        return -1;
+    }
+
+    for (unsigned int slot = stats_table_slot(ifindex, t->hash_size);; slot = (slot + 1) & (t->hash_size - 1)) {
+        int row = t->hash[slot] - 1;
+        if (row < 0) {
+            return -1;
+        }
+        if (t->ifindex[row] == ifindex) {
+            return row;
+        }
+    }
+}
+
+static void stats_table_rehash(StatsTable *t) {
+    memset(t->hash, 0, t->hash_size * sizeof(int));
+    for (int row = 0; row < t->count; row++) {
+        unsigned int slot = stats_table_slot(t->ifindex[row], t->hash_size);
+        while (t->hash[slot] != 0) {
+            slot = (slot + 1) & (t->hash_size - 1);
+        }
+        t->hash[slot] = row + 1;
+    }
+}
+
+// Slot holding row
+static unsigned int stats_table_find_slot(const StatsTable *t, int row) {
+    unsigned int slot = stats_table_slot(t->ifindex[row], t->hash_size);
+
+    while (t->hash[slot] != row + 1) {
+        slot = (slot + 1) & (t->hash_size - 1);
+    }
+    return slot;
+}
+
+// Linear probing: deleting shifts later members of the cluster back so no
+// tombstones are needed, and nothing outside the cluster is touched
+static void stats_table_unhash(StatsTable *t, unsigned int slot) {
+    unsigned int mask = t->hash_size - 1;
+    unsigned int next = (slot + 1) & mask;
+
+    t->hash[slot] = 0;
+    while (t->hash[next] != 0) {
+        unsigned int home = stats_table_slot(t->ifindex[t->hash[next] - 1], t->hash_size);
+        // Move it back if its home is not in (slot, next]
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            t->hash[slot] = t->hash[next];
+            t->hash[next] = 0;
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+#define GROW(field, n) do { \
+        void *p = realloc(t->field, (size_t)(n) * sizeof(*t->field)); \
+        if (p == NULL) return -1; \
+        t->field = p; \
+    } while (0)
+
+static int stats_table_grow(StatsTable *t) {
+    int capacity = t->capacity ? t->capacity * 2 : 32;
+
+    GROW(ifindex, capacity);
+    GROW(name, capacity);
+    GROW(rx_bytes, capacity);
+    GROW(tx_bytes, capacity);
+    GROW(counters, capacity);
+    GROW(resets, capacity);
+    GROW(last_ns, capacity);
+    GROW(device, capacity);
+    GROW(ring, capacity);
+    GROW(rrd, capacity);
+    GROW(opening, capacity);
+    GROW(archive, capacity);
+
+    // Keep the hash at most half full
+    int *hash = calloc(capacity * 2, sizeof(int));
+    if (hash == NULL) {
+        return -1;
+    }
+    free(t->hash);
+    t->hash = hash;
+    t->hash_size = capacity * 2;
+    t->capacity = capacity;
+    stats_table_rehash(t);
+
+    return 0;
+}
+
+#undef GROW
+
+int stats_table_insert(StatsTable *t, int ifindex, const char *name) {
+    int row = stats_table_lookup(t, ifindex);
+
+    if (row >= 0) {
+        // ifindex reused or interface renamed
+        if (strcmp(t->name[row], name) != 0) {
+            int tracked = t->rrd[row] != NULL;
+
+            stats_table_close_rrd(t, row);
+            strncpy(t->name[row], name, IF_NAMESIZE - 1);
+            t->name[row][IF_NAMESIZE - 1] = '\0';
+            t->device[row] = stats_table_has_device(t->name[row]);
+            if (tracked || t->device[row]) {
+                stats_table_track(t, row);
+            }
+        }
+        return row;
+    }
+
+    if (t->count == t->capacity && stats_table_grow(t) < 0) {
+        return -1;
+    }
+
+    row = t->count++;
+    t->ifindex[row] = ifindex;
+    strncpy(t->name[row], name, IF_NAMESIZE - 1);
+    t->name[row][IF_NAMESIZE - 1] = '\0';
+    t->rx_bytes[row] = 0;
+    t->tx_bytes[row] = 0;
+    memset(t->counters[row], 0, sizeof(t->counters[row]));
+    t->resets[row] = 0;
+    t->last_ns[row] = 0;
+    t->ring[row] = &stats_table_no_ring;
+    t->device[row] = stats_table_has_device(t->name[row]);
+    t->rrd[row] = NULL;
+    t->opening[row] = NULL;
+    memset(&t->archive[row], 0, sizeof(t->archive[row]));
+
+    unsigned int slot = stats_table_slot(ifindex, t->hash_size);
+    while (t->hash[slot] != 0) {
+        slot = (slot + 1) & (t->hash_size - 1);
+    }
+    t->hash[slot] = row + 1;
+
+    // Long-term history only for NICs until asked for
+    if (t->device[row]) {
+        stats_table_track(t, row);
+    }
+    return row;
+}
+
+void stats_table_remove(StatsTable *t, int row) {
+    int last = t->count - 1;
+
+    stats_table_close_rrd(t, row);
+    if (t->ring[row] != &stats_table_no_ring) {
+        free(t->ring[row]);
+    }
+    stats_table_unhash(t, stats_table_find_slot(t, row));
+    if (row != last) {
+        // Only the moved row's own slot changes
+        t->hash[stats_table_find_slot(t, last)] = row + 1;
+        t->ifindex[row] = t->ifindex[last];
+        memcpy(t->name[row], t->name[last], IF_NAMESIZE);
+        t->rx_bytes[row] = t->rx_bytes[last];
+        t->tx_bytes[row] = t->tx_bytes[last];
+        memcpy(t->counters[row], t->counters[last], sizeof(t->counters[row]));
+        t->resets[row] = t->resets[last];
+        t->last_ns[row] = t->last_ns[last];
+        t->device[row] = t->device[last];
+        t->ring[row] = t->ring[last];
+        t->rrd[row] = t->rrd[last];
+        t->opening[row] = t->opening[last];
+        t->archive[row] = t->archive[last];
+    }
+    t->count--;
+}
+
+void stats_table_push(StatsTable *t, int row, int64_t t_ns, uint64_t rx_bytes, uint64_t tx_bytes,
+                      double rx_rate, double tx_rate, const uint64_t counters[LINK_COUNTERS],
+                      const double rates[LINK_COUNTERS], int reset) {
+    StatsRing *ring = t->ring[row];
+    int slot = ring->head;
+
+    t->rx_bytes[row] = rx_bytes;
+    t->tx_bytes[row] = tx_bytes;
+    memcpy(t->counters[row], counters, sizeof(t->counters[row]));
+    t->resets[row] += reset != 0;
+    t->last_ns[row] = t_ns;
+
+    // Untracked rows keep only the counters
+    if (t->rrd[row] == NULL) {
+        return;
+    }
+
+    ring->series[STATS_SERIES_PACKETS][0][slot] = rates[LINK_RX_PACKETS];
+    ring->series[STATS_SERIES_PACKETS][1][slot] = rates[LINK_TX_PACKETS];
+    ring->series[STATS_SERIES_DROPS][0][slot] = rates[LINK_RX_DROPPED] + rates[LINK_RX_MISSED_ERRORS];
+    ring->series[STATS_SERIES_DROPS][1][slot] = rates[LINK_TX_DROPPED];
+    ring->series[STATS_SERIES_ERRORS][0][slot] = rates[LINK_RX_ERRORS];
+    ring->series[STATS_SERIES_ERRORS][1][slot] = rates[LINK_TX_ERRORS];
+
+    ring->t[slot] = t_ns;
+    ring->rx[slot] = rx_rate / 1024.0; // Convert to KB/s
+    ring->tx[slot] = tx_rate / 1024.0;
+    ring->head = (slot + 1) % STATS_HISTORY_LEN;
+
+    rrd_update(t->rrd[row], t_ns + t->wall_offset_ns, ring->rx[slot], ring->tx[slot]);
+
+    // First sample of every wall-clock second goes to the archive
+    TscSeries *archive = &t->archive[row];
+    int64_t wall_ms = (t_ns + t->wall_offset_ns) / 1000000;
+    if (archive->count == 0 || wall_ms / 1000 != archive->prev_t / 1000) {
+        uint64_t counters[2] = {rx_bytes, tx_bytes};
+        tsc_append(archive, wall_ms, counters);
+    }
+}
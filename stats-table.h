@@ -0,0 +1,156 @@
+/*
+ * Dave's Network Inquisition - per-interface statistics table
+ * Website: https://prowse.tech
+ */
+
+#ifndef STATS_TABLE_H
+#define STATS_TABLE_H
+
+#include <stdint.h>
+#include <net/if.h>
+
+#include "nl-link.h"
+#include "rrd.h"
+#include "tsc.h"
+
+// Samples of live history kept for every tracked interface: 60 s at the sampler's
+// fastest interval (SAMPLER_MIN_INTERVAL_NS, 10 ms), and longer at slower
+// ones, of which the live graph shows the last 60 s
+#define STATS_HISTORY_LEN 6000
+
+// Cap for each interface's compressed 1 s counter archive (days at 1 s)
+#define STATS_ARCHIVE_BYTES (1024 * 1024)
+
+// History files kept in history_dir, least recently written pruned first
+// (about 43 MB of tiers)
+#define STATS_HISTORY_FILES 64
+
+// Rate series kept next to throughput, each with an rx and a tx side
+enum {
+    STATS_SERIES_PACKETS,       // rx_packets, tx_packets
+    STATS_SERIES_DROPS,         // rx_dropped + rx_missed_errors, tx_dropped
+    STATS_SERIES_ERRORS,        // rx_errors, tx_errors
+    STATS_SERIES
+};
+
+// One row's live history, STATS_HISTORY_LEN samples per array with the
+// oldest at head: CLOCK_MONOTONIC timestamps (0 = unused slot), rates in
+// KB/s, and the STATS_SERIES rates per second, rx then tx
+typedef struct {
+    int head;
+    int64_t t[STATS_HISTORY_LEN];
+    float rx[STATS_HISTORY_LEN];
+    float tx[STATS_HISTORY_LEN];
+    float series[STATS_SERIES][2][STATS_HISTORY_LEN];
+} StatsRing;
+
+// Shared by every untracked row: never written, so it reads as empty
+extern StatsRing stats_table_no_ring;
+
+// A row's history file, opened apart from the table so the owner can do
+// it on another thread: stats_table_take_open on the owner's thread,
+// stats_rrd_open_run anywhere, then stats_table_attach_rrd back on the
+// owner's thread.  Until then the row keeps its tiers in memory.
+typedef struct StatsRrdOpen StatsRrdOpen;
+struct StatsRrdOpen {
+    int ifindex;
+    char name[IF_NAMESIZE];
+    int device;
+    char *dir;
+    Rrd *memory;                // the row's tiers meanwhile; NULL once stale
+    Rrd *rrd;                   // the mapped file, or NULL
+    StatsRrdOpen *next;
+};
+
+// Every interface gets a row, found through an ifindex hash.  The columns
+// are separate arrays (structure of arrays) so a sampling pass only touches
+// the counters, and each row's history is a block of its own.
+typedef struct {
+    int count;
+    int capacity;
+
+    // Open-addressed ifindex -> row + 1 (0 marks an empty slot)
+    int *hash;
+    int hash_size;
+
+    int *ifindex;
+    char (*name)[IF_NAMESIZE];
+    uint64_t *rx_bytes;
+    uint64_t *tx_bytes;
+    uint64_t (*counters)[LINK_COUNTERS];
+    unsigned int *resets;       // samples in which a counter was reset
+    int64_t *last_ns;
+    // Backed by a device (/sys/class/net/<name>/device), so the name comes
+    // back as the same NIC; veths, bridges and tunnels are not
+    unsigned char *device;
+
+    // Live history for the graph, some 240 KB a row, so only tracked rows
+    // (see rrd) have their own; the rest point at stats_table_no_ring
+    StatsRing **ring;
+
+    // Long-term tiers per tracked row (NULL otherwise): device rows are
+    // tracked from the start, others once stats_table_track is called for
+    // them.  They are keyed by wall-clock time: CLOCK_MONOTONIC +
+    // wall_offset_ns, which the owner keeps current.  With a history_dir
+    // they are mapped from <history_dir>/<name>.rrd and survive restarts;
+    // a virtual interface's file goes when the interface does, and the
+    // directory is pruned to STATS_HISTORY_FILES.
+    Rrd **rrd;
+    int64_t wall_offset_ns;
+    char *history_dir;
+    // Files not yet taken, and each row's open still outstanding (taken
+    // or not), if any
+    StatsRrdOpen *opens;
+    StatsRrdOpen **opening;
+
+    // Raw rx/tx byte counters at 1 s resolution, compressed (tsc.c) and
+    // keyed by wall-clock milliseconds; empty unless the row is tracked
+    TscSeries *archive;
+} StatsTable;
+
+void stats_table_init(StatsTable *t);
+void stats_table_free(StatsTable *t);
+void stats_table_set_history_dir(StatsTable *t, const char *dir);
+int stats_table_lookup(const StatsTable *t, int ifindex);
+int stats_table_insert(StatsTable *t, int ifindex, const char *name);
+// Gives a row its live ring, long-term tiers and archive if it has none
+// yet; with a history_dir that queues the row's file to be opened
+int stats_table_track(StatsTable *t, int row);
+// Next file to open, or NULL
+StatsRrdOpen *stats_table_take_open(StatsTable *t);
+// Maps the file and prunes the directory; touches nothing in the table
+void stats_rrd_open_run(StatsRrdOpen *open);
+// Swaps the file in for the memory tiers if the row still wants it, and
+// frees open.  The samples the memory tiers took meanwhile are dropped.
+void stats_table_attach_rrd(StatsTable *t, StatsRrdOpen *open);
+void stats_rrd_open_free(StatsRrdOpen *open);
+// Drops a deleted interface's row; the last row moves into its place
+void stats_table_remove(StatsTable *t, int row);
+// reset: some counter went backwards since the last push (its rate is 0)
+void stats_table_push(StatsTable *t, int row, int64_t t_ns, uint64_t rx_bytes, uint64_t tx_bytes,
+                      double rx_rate, double tx_rate, const uint64_t counters[LINK_COUNTERS],
+                      const double rates[LINK_COUNTERS], int reset);
+
+// i = 0 is the oldest sample, STATS_HISTORY_LEN - 1 the newest
+static inline int64_t stats_table_t(const StatsTable *t, int row, int i) {
+    const StatsRing *ring = t->ring[row];
+    return ring->t[(ring->head + i) % STATS_HISTORY_LEN];
+}
+
+static inline float stats_table_rx(const StatsTable *t, int row, int i) {
+    const StatsRing *ring = t->ring[row];
+    return ring->rx[(ring->head + i) % STATS_HISTORY_LEN];
+}
+
+static inline float stats_table_tx(const StatsTable *t, int row, int i) {
+    const StatsRing *ring = t->ring[row];
+    return ring->tx[(ring->head + i) % STATS_HISTORY_LEN];
+}
+
+// tx: 0 for the rx side, 1 for tx
+static inline float stats_table_series(const StatsTable *t, int row, int series, int tx, int i) {
+    const StatsRing *ring = t->ring[row];
+    return ring->series[series][tx][(ring->head + i) % STATS_HISTORY_LEN];
+}
+
+#endif
@@ -0,0 +1,244 @@
+/*
+ * Dave's Network Inquisition - compressed history benchmark
+ * Website: https://prowse.tech
+ *
+ * Feeds one day of 1 s counter samples for a mix of idle, steady and
+ * bursty interfaces through tsc.c and reports bytes per sample and
+ * decode throughput.  Build and run with "make bench".
+ *
+ * Every series is also decoded and compared sample by sample with what
+ * went in, along with counter resets, irregular and backward timestamps
+ * and a series capped small enough to recycle its blocks, and seeking
+ * into each.  "make check" runs only that part and fails on the first
+ * mismatch.
+ */
+
+#include "tsc.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SECONDS 86400
+#define BENCH_COLUMNS 2
+#define BENCH_PROFILES 5
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Byte counters for one second of a given traffic profile
+static void bench_traffic(int profile, int second, uint64_t *counters) {
+    switch (profile) {
+    case 0:     // idle: an ARP or two per minute
+        if (second % 30 == 0) {
+            counters[0] += 60;
+            counters[1] += 42;
+        }
+        break;
+    case 1:     // steady stream with a little noise
+        counters[0] += 12500000 + rand() % 4096;
+        counters[1] += 250000 + rand() % 512;
+        break;
+    case 2:     // bursty: mostly quiet, random bursts
+        if (rand() % 20 == 0) {
+            counters[0] += rand() % 100000000;
+            counters[1] += rand() % 5000000;
+        } else {
+            counters[0] += rand() % 2000;
+            counters[1] += rand() % 2000;
+        }
+        break;
+    default:    // resets: driver reloads back to 0, or counters near the top
+        counters[0] += 12500000 + rand() % 4096;
+        counters[1] += rand() % 2000;
+        if (rand() % 1000 == 0) {
+            counters[0] = rand() % 100;
+            counters[1] = 0;
+        } else if (rand() % 5000 == 0) {
+            counters[0] = UINT64_MAX - rand() % 100000000;
+            counters[1] = (uint64_t)1 << 63;
+        }
+        break;
+    }
+}
+
+// Time of one sample after prev: jitter, and for the irregular profile
+// gaps from a few ms to weeks and the odd step back of the clock
+static int64_t bench_time(int profile, int64_t prev) {
+    if (profile < 4) {
+        return prev + 1000 + rand() % 5;
+    }
+    switch (rand() % 100) {
+    case 0:
+        return prev - rand() % 60000;
+    case 1:
+        return prev + (int64_t)(rand() % 100) * 86400000;
+    case 2:
+        return prev + (int64_t)60 * 86400000;    // past the 32-bit code
+    default:
+        return prev + 1 + rand() % 5000;
+    }
+}
+
+// Decodes s from start_ms on and compares it with the last `expect`
+// samples in t and v; prints the first difference
+static int bench_verify(const char *name, const TscSeries *s, int64_t start_ms, const int64_t *t,
+                        const uint64_t (*v)[BENCH_COLUMNS], uint64_t expect) {
+    TscIter it;
+    int64_t t_ms;
+    uint64_t values[BENCH_COLUMNS];
+    uint64_t i = 0;
+
+    tsc_iter_init(&it, s, start_ms);
+    while (tsc_iter_next(&it, &t_ms, values)) {
+        if (i == expect) {
+            printf("%s: more than the %llu samples expected\n", name, (unsigned long long)expect);
+            return -1;
+        }
+        if (t_ms != t[i] || memcmp(values, v[i], sizeof(values)) != 0) {
+            printf("%s: sample %llu is %lld %llu %llu, expected %lld %llu %llu\n", name,
+                   (unsigned long long)i, (long long)t_ms, (unsigned long long)values[0],
+                   (unsigned long long)values[1], (long long)t[i], (unsigned long long)v[i][0],
+                   (unsigned long long)v[i][1]);
+            return -1;
+        }
+        i++;
+    }
+    if (i != expect) {
+        printf("%s: %llu samples decoded, expected %llu\n", name, (unsigned long long)i,
+               (unsigned long long)expect);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    static const char *names[BENCH_PROFILES] = {"idle", "steady", "bursty", "resets", "irregular"};
+    int check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+    int64_t *t = malloc(BENCH_SECONDS * sizeof(int64_t));
+    uint64_t (*v)[BENCH_COLUMNS] = malloc(BENCH_SECONDS * sizeof(*v));
+    int failed = 0;
+
+    if (t == NULL || v == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    srand(1);
+    if (!check_only) {
+        printf("%-9s %10s %10s %12s %14s %12s\n", "profile", "samples", "bytes", "bytes/sample", "decode Msmp/s",
+               "decode MB/s");
+    }
+
+    for (int profile = 0; profile < BENCH_PROFILES; profile++) {
+        TscSeries series;
+        TscSeries capped;
+        uint64_t counters[BENCH_COLUMNS] = {0, 0};
+        int64_t t_ms = 1700000000000LL;
+
+        for (int second = 0; second < BENCH_SECONDS; second++) {
+            bench_traffic(profile, second, counters);
+            t_ms = bench_time(profile, t_ms);
+            t[second] = t_ms;
+            memcpy(v[second], counters, sizeof(counters));
+        }
+
+        // Whole, and capped at a few blocks so the oldest are recycled
+        tsc_series_init(&series, BENCH_COLUMNS, 64 * 1024 * 1024);
+        tsc_series_init(&capped, BENCH_COLUMNS, 8 * sizeof(TscBlock));
+        for (int second = 0; second < BENCH_SECONDS; second++) {
+            if (tsc_append(&series, t[second], v[second]) < 0 || tsc_append(&capped, t[second], v[second]) < 0) {
+                fprintf(stderr, "%s: append failed\n", names[profile]);
+                return 1;
+            }
+        }
+
+        uint64_t samples = tsc_series_samples(&series);
+        uint64_t kept = tsc_series_samples(&capped);
+        if (samples != BENCH_SECONDS || kept == 0 || kept >= BENCH_SECONDS) {
+            printf("%s: %llu samples stored, %llu kept when capped\n", names[profile],
+                   (unsigned long long)samples, (unsigned long long)kept);
+            failed = 1;
+        } else if (bench_verify(names[profile], &series, INT64_MIN, t, v, samples) < 0 ||
+                   bench_verify(names[profile], &capped, INT64_MIN, t + BENCH_SECONDS - kept,
+                                v + BENCH_SECONDS - kept, kept) < 0) {
+            failed = 1;
+        } else if (profile < 4) {
+            // Seeking: timestamps only go forward here, so the samples from
+            // any of them on are the rest of the input
+            for (int k = 0; k < 16 && !failed; k++) {
+                int from = rand() % BENCH_SECONDS;
+                failed = bench_verify(names[profile], &series, t[from], t + from, v + from,
+                                      BENCH_SECONDS - from) < 0;
+            }
+        } else {
+            // With steps back the rest starts at the first sample, in input
+            // order, at or after the time sought; capped too, where the
+            // recycled blocks take their steps with them
+            for (int k = 0; k < 16 && !failed; k++) {
+                int64_t start_ms = t[rand() % BENCH_SECONDS];
+                int from = 0;
+                int capped_from = BENCH_SECONDS - kept;
+                while (t[from] < start_ms) {
+                    from++;
+                }
+                while (capped_from < BENCH_SECONDS && t[capped_from] < start_ms) {
+                    capped_from++;
+                }
+                failed = bench_verify(names[profile], &series, start_ms, t + from, v + from,
+                                      BENCH_SECONDS - from) < 0 ||
+                         bench_verify(names[profile], &capped, start_ms, t + capped_from, v + capped_from,
+                                      BENCH_SECONDS - capped_from) < 0;
+            }
+        }
+        tsc_series_free(&capped);
+
+        if (check_only) {
+            tsc_series_free(&series);
+            continue;
+        }
+
+        // Decode everything a few times and keep the best run
+        size_t bytes = tsc_series_bytes(&series);
+        double best = 1e9;
+        uint64_t checksum = 0;
+        for (int run = 0; run < 5; run++) {
+            TscIter it;
+            int64_t ts;
+            uint64_t values[BENCH_COLUMNS];
+            double start = now_seconds();
+
+            tsc_iter_init(&it, &series, 0);
+            while (tsc_iter_next(&it, &ts, values)) {
+                checksum += values[0] ^ values[1] ^ (uint64_t)ts;
+            }
+
+            double elapsed = now_seconds() - start;
+            if (elapsed < best) {
+                best = elapsed;
+            }
+        }
+
+        double raw_mb = samples * (sizeof(int64_t) + BENCH_COLUMNS * sizeof(uint64_t)) / 1e6;
+        printf("%-9s %10llu %10zu %12.2f %14.1f %12.1f\n", names[profile],
+               (unsigned long long)samples, bytes, (double)bytes / samples,
+               samples / best / 1e6, raw_mb / best);
+
+        if (checksum == 0) {
+            printf("unexpected checksum\n");
+        }
+        tsc_series_free(&series);
+    }
+
+    if (!check_only) {
+        printf("(decode MB/s is measured against the uncompressed 24-byte samples)\n");
+    }
+    printf(failed ? "decode check FAILED\n" : "decode check passed: every sample came back exactly\n");
+    free(t);
+    free(v);
+    return failed;
+}
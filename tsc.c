@@ -0,0 +1,296 @@
+/*
+ * Dave's Network Inquisition - compressed counter history
+ * Website: https://prowse.tech
+ */
+
+#include "tsc.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Worst case for one sample: '1111' + 32 bit timestamp, '1111' + 64 bit values
+#define TSC_MAX_SAMPLE_BITS(ncols) (36 + (ncols) * 68)
+
+static inline uint64_t tsc_zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t tsc_unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static void tsc_put(TscBlock *b, uint64_t value, int n) {
+    while (n > 0) {
+        int room = 8 - (b->nbits & 7);
+        int take = n < room ? n : room;
+        unsigned int bits = (value >> (n - take)) & ((1u << take) - 1);
+
+        b->data[b->nbits >> 3] |= bits << (room - take);
+        b->nbits += take;
+        n -= take;
+    }
+}
+
+static uint64_t tsc_get(const TscBlock *b, uint32_t *pos, int n) {
+    uint64_t value = 0;
+
+    while (n > 0) {
+        int room = 8 - (*pos & 7);
+        int take = n < room ? n : room;
+        unsigned int bits = (b->data[*pos >> 3] >> (room - take)) & ((1u << take) - 1);
+
+        value = (value << take) | bits;
+        *pos += take;
+        n -= take;
+    }
+    return value;
+}
+
+// Unary prefix: count leading 1 bits up to max
+static int tsc_get_prefix(const TscBlock *b, uint32_t *pos, int max) {
+    int n = 0;
+    while (n < max && tsc_get(b, pos, 1) == 1) {
+        n++;
+    }
+    return n;
+}
+
+// Timestamp delta-of-delta: 0 | 10+7 | 110+9 | 1110+12 | 1111+32
+static const int tsc_time_widths[] = {0, 7, 9, 12, 32};
+
+// Counter delta-of-delta: 0 | 10+8 | 110+16 | 1110+32 | 1111+64
+static const int tsc_value_widths[] = {0, 8, 16, 32, 64};
+
+static int tsc_code_class(uint64_t zz, const int *widths) {
+    for (int i = 0; i < 4; i++) {
+        if (widths[i] < 64 && zz < (1ULL << widths[i]) && (i > 0 || zz == 0)) {
+            return i;
+        }
+    }
+    return 4;
+}
+
+static void tsc_put_code(TscBlock *b, uint64_t zz, const int *widths) {
+    int cls = tsc_code_class(zz, widths);
+
+    if (cls == 0) {
+        tsc_put(b, 0, 1);
+        return;
+    }
+    // cls ones, then a terminating zero except for the last class
+    tsc_put(b, (1ULL << cls) - 1, cls);
+    if (cls < 4) {
+        tsc_put(b, 0, 1);
+    }
+    tsc_put(b, zz, widths[cls]);
+}
+
+static uint64_t tsc_get_code(const TscBlock *b, uint32_t *pos, const int *widths) {
+    int cls = tsc_get_prefix(b, pos, 4);
+    return cls == 0 ? 0 : tsc_get(b, pos, widths[cls]);
+}
+
+int tsc_series_init(TscSeries *s, int ncols, size_t max_bytes) {
+    memset(s, 0, sizeof(*s));
+
+    if (ncols < 1 || ncols > TSC_MAX_COLUMNS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    s->ncols = ncols;
+    s->max_blocks = max_bytes / sizeof(TscBlock);
+    if (s->max_blocks < 2) {
+        s->max_blocks = 2;
+    }
+
+    s->blocks = calloc(s->max_blocks, sizeof(TscBlock *));
+    return s->blocks != NULL ? 0 : -1;
+}
+
+void tsc_series_free(TscSeries *s) {
+    if (s->blocks != NULL) {
+        for (int i = 0; i < s->max_blocks; i++) {
+            free(s->blocks[i]);
+        }
+    }
+    free(s->blocks);
+    memset(s, 0, sizeof(*s));
+}
+
+static TscBlock *tsc_block_at(const TscSeries *s, int i) {
+    return s->blocks[(s->head + i) % s->max_blocks];
+}
+
+// Open a new block holding the sample in the clear.  Once the ring is full
+// the oldest block is recycled, so a series stops allocating at its cap.
+static int tsc_start_block(TscSeries *s, int64_t t_ms, const uint64_t *values) {
+    int slot;
+
+    if (s->count == s->max_blocks) {
+        slot = s->head;
+        s->head = (s->head + 1) % s->max_blocks;
+        s->count--;
+        // The new oldest block has nothing before it to step back from
+        TscBlock *oldest = s->count > 0 ? tsc_block_at(s, 0) : NULL;
+        if (oldest != NULL && oldest->stepped) {
+            oldest->stepped = 0;
+            s->stepped--;
+        }
+    } else {
+        slot = (s->head + s->count) % s->max_blocks;
+    }
+
+    if (s->blocks[slot] == NULL) {
+        s->blocks[slot] = malloc(sizeof(TscBlock));
+        if (s->blocks[slot] == NULL) {
+            return -1;
+        }
+    }
+
+    TscBlock *b = s->blocks[slot];
+    b->stepped = s->count > 0 && t_ms < s->prev_t;
+    s->stepped += b->stepped;
+    b->t_first = t_ms;
+    b->t_last = t_ms;
+    b->count = 1;
+    b->nbits = 0;
+    memset(b->first, 0, sizeof(b->first));
+    memcpy(b->first, values, s->ncols * sizeof(uint64_t));
+    memset(b->data, 0, sizeof(b->data));
+    s->count++;
+
+    s->prev_t = t_ms;
+    s->prev_dt = 0;
+    memcpy(s->prev_v, values, s->ncols * sizeof(uint64_t));
+    memset(s->prev_dv, 0, sizeof(s->prev_dv));
+    return 0;
+}
+
+int tsc_append(TscSeries *s, int64_t t_ms, const uint64_t *values) {
+    if (s->blocks == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (s->count == 0 || t_ms < s->prev_t) {
+        return tsc_start_block(s, t_ms, values);
+    }
+
+    TscBlock *b = tsc_block_at(s, s->count - 1);
+    int64_t dt = t_ms - s->prev_t;
+    uint64_t t_zz = tsc_zigzag(dt - s->prev_dt);
+
+    if (b->nbits + TSC_MAX_SAMPLE_BITS(s->ncols) > TSC_BLOCK_BYTES * 8 || t_zz >= (1ULL << 32)) {
+        return tsc_start_block(s, t_ms, values);
+    }
+
+    tsc_put_code(b, t_zz, tsc_time_widths);
+    s->prev_dt = dt;
+    s->prev_t = t_ms;
+
+    for (int c = 0; c < s->ncols; c++) {
+        // Wrapping subtraction keeps counter resets representable
+        int64_t dv = (int64_t)(values[c] - s->prev_v[c]);
+        tsc_put_code(b, tsc_zigzag(dv - s->prev_dv[c]), tsc_value_widths);
+        s->prev_dv[c] = dv;
+        s->prev_v[c] = values[c];
+    }
+
+    b->t_last = t_ms;
+    b->count++;
+    return 0;
+}
+
+size_t tsc_series_bytes(const TscSeries *s) {
+    size_t bytes = 0;
+    for (int i = 0; i < s->count; i++) {
+        // Header plus the part of the bitstream in use
+        bytes += offsetof(TscBlock, data) + (tsc_block_at(s, i)->nbits + 7) / 8;
+    }
+    return bytes;
+}
+
+uint64_t tsc_series_samples(const TscSeries *s) {
+    uint64_t n = 0;
+    for (int i = 0; i < s->count; i++) {
+        n += tsc_block_at(s, i)->count;
+    }
+    return n;
+}
+
+int64_t tsc_series_first(const TscSeries *s) {
+    return s->count > 0 ? tsc_block_at(s, 0)->t_first : INT64_MAX;
+}
+
+void tsc_iter_init(TscIter *it, const TscSeries *s, int64_t start_ms) {
+    memset(it, 0, sizeof(*it));
+    it->series = s;
+
+    // First block that reaches start_ms.  Bisecting needs the blocks in
+    // time order, which a step back of the clock breaks.
+    int lo = 0;
+    int hi = s->count;
+    if (s->stepped > 0) {
+        while (lo < hi && tsc_block_at(s, lo)->t_last < start_ms) {
+            lo++;
+        }
+        hi = lo;
+    }
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (tsc_block_at(s, mid)->t_last < start_ms) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    it->block = lo;
+
+    // Skip forward inside the block
+    int64_t t;
+    uint64_t values[TSC_MAX_COLUMNS];
+    TscIter peek;
+    for (;;) {
+        peek = *it;
+        if (!tsc_iter_next(&peek, &t, values) || t >= start_ms) {
+            break;
+        }
+        *it = peek;
+    }
+}
+
+int tsc_iter_next(TscIter *it, int64_t *t_ms, uint64_t *values) {
+    const TscSeries *s = it->series;
+
+    if (it->block >= s->count) {
+        return 0;
+    }
+
+    const TscBlock *b = tsc_block_at(s, it->block);
+
+    if (it->index == 0) {
+        it->bitpos = 0;
+        it->t = b->t_first;
+        it->dt = 0;
+        memcpy(it->v, b->first, s->ncols * sizeof(uint64_t));
+        memset(it->dv, 0, sizeof(it->dv));
+    } else {
+        it->dt += tsc_unzigzag(tsc_get_code(b, &it->bitpos, tsc_time_widths));
+        it->t += it->dt;
+        for (int c = 0; c < s->ncols; c++) {
+            it->dv[c] += tsc_unzigzag(tsc_get_code(b, &it->bitpos, tsc_value_widths));
+            it->v[c] += it->dv[c];
+        }
+    }
+
+    *t_ms = it->t;
+    memcpy(values, it->v, s->ncols * sizeof(uint64_t));
+
+    if (++it->index == b->count) {
+        it->block++;
+        it->index = 0;
+    }
+    return 1;
+}
@@ -0,0 +1,77 @@
+/*
+ * Dave's Network Inquisition - compressed counter history
+ * Website: https://prowse.tech
+ */
+
+#ifndef TSC_H
+#define TSC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TSC_MAX_COLUMNS 16
+#define TSC_BLOCK_BYTES 1024
+
+// Append-only column store for counter samples in the style of Gorilla:
+// timestamps (milliseconds) as delta-of-delta and each counter column as
+// delta-of-delta as well, both zigzagged into a short prefix code.  A
+// steady 1 s cadence costs one bit for the timestamp, an idle counter one
+// bit, so a sample is a few bytes at most.
+//
+// Samples are packed into fixed-size blocks that start with the first
+// sample in the clear, which makes every block independently decodable
+// and lets a reader seek by block.
+typedef struct {
+    int64_t t_first;
+    int64_t t_last;
+    uint32_t count;
+    uint32_t nbits;
+    uint32_t stepped;           // starts before the previous block ended
+    uint64_t first[TSC_MAX_COLUMNS];
+    unsigned char data[TSC_BLOCK_BYTES];
+} TscBlock;
+
+typedef struct {
+    int ncols;
+    int max_blocks;
+
+    // Ring of blocks, oldest at head; the newest one is being appended to
+    TscBlock **blocks;
+    int head;
+    int count;
+    // Blocks after the oldest with stepped set: while there are any, the
+    // blocks are not in time order and seeking scans instead of bisecting
+    int stepped;
+
+    // Encoder state for the newest block
+    int64_t prev_t;
+    int64_t prev_dt;
+    uint64_t prev_v[TSC_MAX_COLUMNS];
+    int64_t prev_dv[TSC_MAX_COLUMNS];
+} TscSeries;
+
+// Streaming decoder over a series, oldest sample first
+typedef struct {
+    const TscSeries *series;
+    int block;
+    uint32_t index;
+    uint32_t bitpos;
+    int64_t t;
+    int64_t dt;
+    uint64_t v[TSC_MAX_COLUMNS];
+    int64_t dv[TSC_MAX_COLUMNS];
+} TscIter;
+
+int tsc_series_init(TscSeries *s, int ncols, size_t max_bytes);
+void tsc_series_free(TscSeries *s);
+int tsc_append(TscSeries *s, int64_t t_ms, const uint64_t *values);
+size_t tsc_series_bytes(const TscSeries *s);
+uint64_t tsc_series_samples(const TscSeries *s);
+int64_t tsc_series_first(const TscSeries *s);
+
+// Starts at the first sample, in the order they were appended, at or after
+// start_ms.  After a step back of the clock later samples may be earlier.
+void tsc_iter_init(TscIter *it, const TscSeries *s, int64_t start_ms);
+int tsc_iter_next(TscIter *it, int64_t *t_ms, uint64_t *values);
+
+#endif